@@ -0,0 +1,104 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_BASIS_HH
+# define ROBOPTIM_CORE_NAG_BASIS_HH
+
+# include <string>
+# include <vector>
+
+# include <boost/cstdint.hpp>
+
+# include <roboptim/core/portability.hh>
+
+# include <nag.h>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    /// \brief Header of a basis file.
+    ///
+    /// The header is followed by the arrays:
+    ///
+    /// - double x[n], xmul[n], f[nf], fmul[nf],
+    /// - Integer xstate[n], fstate[nf].
+    ///
+    /// Values are stored in the native byte order.
+    struct BasisHeader
+    {
+      /// \brief File magic: "RONAGBAS".
+      char magic[8];
+      /// \brief Format version.
+      boost::uint32_t version;
+      /// \brief Size of this header, in bytes.
+      boost::uint32_t headerSize;
+      /// \brief Size of a NAG Integer, in bytes.
+      boost::uint32_t integerSize;
+      /// \brief Unused, keeps the following fields aligned.
+      boost::uint32_t padding;
+      /// \brief Hash of the problem signature.
+      boost::uint64_t signatureHash;
+      /// \brief Number of variables.
+      boost::uint64_t n;
+      /// \brief Number of rows of F.
+      boost::uint64_t nf;
+      /// \brief Number of superbasic variables.
+      boost::int64_t ns;
+    };
+
+    /// \brief State of a sparse solve, as needed by a warm start.
+    struct Basis
+    {
+      std::vector<double> x;
+      std::vector<double> xmul;
+      std::vector<Integer> xstate;
+      std::vector<double> f;
+      std::vector<double> fmul;
+      std::vector<Integer> fstate;
+      Integer ns;
+    };
+
+    /// \brief Load a basis file.
+    ///
+    /// A missing, truncated or mismatching file is not an error.
+    ///
+    /// \param filename basis file.
+    /// \param signature expected problem signature.
+    /// \param basis loaded basis.
+    /// \return whether the basis was loaded.
+    ROBOPTIM_DLLEXPORT bool
+    loadBasis (const std::string& filename, const std::string& signature,
+               Basis& basis);
+
+    /// \brief Save a basis file.
+    ///
+    /// The file is written next to its final location then renamed,
+    /// so that a process stopped while saving leaves the previous
+    /// basis intact.
+    ///
+    /// \param filename basis file.
+    /// \param signature problem signature.
+    /// \param basis basis to save.
+    /// \throw std::runtime_error if the file cannot be written.
+    ROBOPTIM_DLLEXPORT void
+    saveBasis (const std::string& filename, const std::string& signature,
+               const Basis& basis);
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_BASIS_HH
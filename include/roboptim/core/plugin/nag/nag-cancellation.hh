@@ -0,0 +1,77 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_CANCELLATION_HH
+# define ROBOPTIM_CORE_NAG_CANCELLATION_HH
+
+# include <boost/atomic.hpp>
+# include <boost/noncopyable.hpp>
+# include <boost/shared_ptr.hpp>
+
+# include <roboptim/core/portability.hh>
+
+namespace roboptim
+{
+  /// \addtogroup roboptim_solver
+  /// @{
+
+  /// \brief Cancellation handle of a NAG solver.
+  ///
+  /// The token can be signalled from any thread. Every NAG callback
+  /// checks it before evaluating the user functions and, once it has
+  /// been signalled, returns NAG's user-requested-stop code instead. The
+  /// running solve then exits after at most one evaluation and the
+  /// result is a SolverError.
+  ///
+  /// The token stays signalled until reset () is called, so a solve
+  /// started after cancel () stops immediately.
+  class ROBOPTIM_DLLEXPORT NagCancellationToken : private boost::noncopyable
+  {
+  public:
+    NagCancellationToken () : cancelled_ (false)
+    {
+    }
+
+    /// \brief Request the running (or next) solve to stop.
+    void cancel ()
+    {
+      cancelled_.store (true, boost::memory_order_release);
+    }
+
+    /// \brief Clear a previous cancellation request.
+    void reset ()
+    {
+      cancelled_.store (false, boost::memory_order_release);
+    }
+
+    /// \brief Whether a cancellation has been requested.
+    bool isCancelled () const
+    {
+      return cancelled_.load (boost::memory_order_acquire);
+    }
+
+  private:
+    boost::atomic<bool> cancelled_;
+  };
+
+  /// \brief Shared cancellation handle, may outlive the solver.
+  typedef boost::shared_ptr<NagCancellationToken> nagCancellationToken_t;
+
+  /// @}
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_CANCELLATION_HH
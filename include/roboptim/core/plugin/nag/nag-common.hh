@@ -19,6 +19,12 @@
 # define ROBOPTIM_CORE_NAG_COMMON_HH
 
 # include <fstream>
+# include <map>
+# include <stdexcept>
+# include <string>
+
+# include <boost/numeric/conversion/cast.hpp>
+# include <boost/scoped_ptr.hpp>
 
 # include <nag.h>
 # include <nage04.h>
@@ -30,8 +36,39 @@
 # include <roboptim/core/differentiable-function.hh>
 # include <roboptim/core/twice-differentiable-function.hh>
 
+# include "roboptim/core/plugin/nag/nag-cancellation.hh"
+# include "roboptim/core/plugin/nag/nag-log-sink.hh"
+# include "roboptim/core/plugin/nag/nag-statistics.hh"
+# include "roboptim/core/plugin/nag/nag-trace.hh"
+
 namespace roboptim
 {
+  namespace nag
+  {
+    /// \brief Convert a size or an index to a NAG Integer.
+    ///
+    /// NAG Integers are 32-bit, unless the plug-ins are built against
+    /// the ILP64 variant of NAG (NAG_ILP64 CMake option).
+    ///
+    /// \param size size or index.
+    /// \param what converted quantity, for the error message.
+    /// \throw std::overflow_error if the size does not fit.
+    template <typename T>
+    Integer toInteger (T size, const char* what)
+    {
+      try
+      {
+        return boost::numeric_cast<Integer> (size);
+      }
+      catch (const boost::numeric::bad_numeric_cast&)
+      {
+        throw std::overflow_error (
+          std::string (what) +
+          " does not fit in a NAG Integer (see the NAG_ILP64 option)");
+      }
+    }
+  } // end of namespace nag.
+
   /// \brief Error handler for NAG API.
   /// \param s error message.
   /// \param code error code.
@@ -70,25 +107,127 @@ namespace roboptim
     /// \brief Problem type.
     typedef typename solver_t::problem_t problem_t;
 
+    /// \brief Parameter value type.
+    typedef Parameter::parameterValues_t parameterValue_t;
+
     /// \brief Instantiate the solver from a problem.
     /// \param problem problem that will be solved
     explicit NagSolverCommon (const problem_t& pb);
     virtual ~NagSolverCommon ();
 
+    /// \brief Cancellation handle of this solver.
+    ///
+    /// The handle can be copied and signalled from another thread to
+    /// stop a running solve.
+    const nagCancellationToken_t& cancellationToken () const
+    {
+      return cancellationToken_;
+    }
+
+    /// \brief Statistics of the last solve.
+    const nag::Statistics& statistics () const
+    {
+      return statistics_;
+    }
+
+    /// \brief Statistics of the current solve, updated by the callbacks.
+    nag::Statistics& statistics ()
+    {
+      return statistics_;
+    }
+
+    /// \brief Trace of the current solve.
+    /// \return trace writer, or null if tracing is disabled.
+    nag::Trace* trace () const
+    {
+      return trace_.get ();
+    }
+
+    /// \brief Set a solver parameter.
+    ///
+    /// Parameters listed in the NAG option table are checked against
+    /// the type expected by NAG.
+    ///
+    /// \param key parameter name.
+    /// \param value parameter value.
+    /// \throw std::runtime_error if the value has an invalid type.
+    void setParameter (const std::string& key, const parameterValue_t& value);
+
   protected:
     /// \brief Initialize parameters.
     /// Add solver parameters. Called during construction.
     void initializeParameters ();
 
     /// \brief Read parameters and update associated options in NAG.
-    /// Called before solving problem.
-    /// \param state internal information required for NAG functions.
+    /// Called before solving problem. Only the options whose values
+    /// changed since the previous call are pushed to NAG.
     /// \param fail NAG error argument
-    void updateParameters (Nag_E04State* state, NagError* fail);
+    void updateParameters (NagError* fail);
+
+    /// \brief Check a parameter value against the NAG option table.
+    /// \throw std::runtime_error if the value has an invalid type.
+    static void checkParameter (const std::string& key,
+                                const parameterValue_t& value);
+
+    /// \brief Value of a string parameter (empty if not set).
+    std::string stringParameter (const std::string& key) const;
+
+    /// \brief Value of an integer parameter.
+    /// \param key parameter name.
+    /// \param defaultValue value returned if the parameter is not set.
+    int integerParameter (const std::string& key, int defaultValue) const;
+
+    /// \brief Value of a floating-point parameter.
+    /// \param key parameter name.
+    /// \param defaultValue value returned if the parameter is not set.
+    double doubleParameter (const std::string& key, double defaultValue) const;
+
+    /// \brief Start a new trace if nag.trace_file is set.
+    /// Called before solving problem.
+    /// \param n number of variables.
+    /// \param m number of multipliers.
+    void openTrace (std::size_t n, std::size_t m);
+
+    /// \brief Forget the options applied to NAG.
+    /// To be called whenever state_ is (re)initialized by NAG.
+    void resetAppliedParameters ();
+
+    /// \brief Configure this solver as a sub-solve of another one,
+    /// possibly running in parallel with other sub-solves.
+    ///
+    /// Parameters are copied, except those making the solver write to
+    /// files, and the cancellation handle of the parent is polled. The
+    /// statistics of the sub-solves are not appended to the benchmark
+    /// results: only the parent reports its solve.
+    ///
+    /// \param parent solver running this one.
+    void shareSettings (const NagSolverCommon& parent);
+
+    /// \brief Statistics of the last solve.
+    nag::Statistics statistics_;
+
+    /// \brief Internal NAG state, kept between solves.
+    Nag_E04State state_;
+
+    /// \brief Whether state_ has been initialized by NAG.
+    bool stateInitialized_;
+
+    /// \brief Whether solves append their statistics to the benchmark
+    /// results (see nag::appendStatistics).
+    bool reportStatistics_;
 
   private:
-    /// \brief File descriptor for logging.
-    Nag_FileID fdLog_;
+    /// \brief Options applied to state_, indexed by NAG option name.
+    std::map<std::string, parameterValue_t> appliedParameters_;
+
+    /// \brief Asynchronous log file, if any.
+    boost::scoped_ptr<NagLogSink> logSink_;
+
+    /// \brief Per-iteration trace, if any.
+    boost::scoped_ptr<nag::Trace> trace_;
+
+    /// \brief Cancellation handle polled by the NAG callbacks.
+    nagCancellationToken_t cancellationToken_;
   };
 
   /// @}
@@ -18,10 +18,15 @@
 #ifndef ROBOPTIM_CORE_NAG_COMMON_HXX
 # define ROBOPTIM_CORE_NAG_COMMON_HXX
 
+# include <cassert>
+# include <cstring>
+# include <map>
 # include <string>
 # include <stdexcept>
 
+# include <boost/foreach.hpp>
 # include <boost/variant/apply_visitor.hpp>
+# include <boost/variant/get.hpp>
 # include <boost/format.hpp>
 
 # include <nagx04.h>
@@ -36,6 +41,10 @@ namespace roboptim
 {
   inline void errorHandler (const char* s, int code, const char* name)
   {
+    // A user-requested stop is not an error: it is reported through
+    // the solver result once NAG returns.
+    if (code == NE_USER_STOP) return;
+
     std::string msg =
       (boost::format ("[%s - error %i] %s") % name % code % s).str ();
     throw std::runtime_error (msg);
@@ -43,8 +52,16 @@ namespace roboptim
 
   template <typename T>
   NagSolverCommon<T>::NagSolverCommon (const problem_t& pb)
-    : solver_t (pb), fdLog_ (-1)
+    : solver_t (pb),
+      statistics_ (),
+      stateInitialized_ (false),
+      reportStatistics_ (true),
+      appliedParameters_ (),
+      logSink_ (),
+      trace_ (),
+      cancellationToken_ (new NagCancellationToken ())
   {
+    std::memset (&state_, 0, sizeof (Nag_E04State));
   }
 
   template <typename T>
@@ -75,52 +92,167 @@ namespace roboptim
 
     // Not standard NAG parameter
     DEFINE_PARAMETER ("nag.output_file", "log filename", std::string (""));
+    DEFINE_PARAMETER ("nag.output_buffer_size",
+                      "log buffer size in bytes (output dropped when full)",
+                      1 << 20);
+    DEFINE_PARAMETER ("nag.trace_file",
+                      "binary per-iteration trace filename",
+                      std::string (""));
+    DEFINE_PARAMETER ("nag.trace_capacity",
+                      "number of records kept in the trace", 4096);
   }
 
 #undef DEFINE_PARAMETER
 
   template <typename T>
-  void NagSolverCommon<T>::updateParameters (Nag_E04State* state,
-                                             NagError* fail)
+  void NagSolverCommon<T>::checkParameter (const std::string& key,
+                                           const parameterValue_t& value)
+  {
+    const nag::OptionDescriptor* option = nag::findOption (key);
+    if (!option) return;
+
+    if (!boost::apply_visitor (nag::OptionTypeChecker (option->type), value))
+      throw std::runtime_error (
+        (boost::format ("invalid value type for NAG parameter %s") % key)
+          .str ());
+  }
+
+  template <typename T>
+  void NagSolverCommon<T>::setParameter (const std::string& key,
+                                         const parameterValue_t& value)
+  {
+    checkParameter (key, value);
+    this->parameters_[key].value = value;
+  }
+
+  template <typename T>
+  std::string NagSolverCommon<T>::stringParameter (const std::string& key) const
+  {
+    typename solver_t::parameters_t::const_iterator it =
+      this->parameters_.find (key);
+    if (it == this->parameters_.end ()) return std::string ();
+
+    if (const char* const* str = boost::get<const char*> (&it->second.value))
+      return *str;
+    return boost::get<std::string> (it->second.value);
+  }
+
+  template <typename T>
+  int NagSolverCommon<T>::integerParameter (const std::string& key,
+                                            int defaultValue) const
+  {
+    typename solver_t::parameters_t::const_iterator it =
+      this->parameters_.find (key);
+    if (it == this->parameters_.end ()) return defaultValue;
+    return boost::get<int> (it->second.value);
+  }
+
+  template <typename T>
+  double NagSolverCommon<T>::doubleParameter (const std::string& key,
+                                              double defaultValue) const
+  {
+    typename solver_t::parameters_t::const_iterator it =
+      this->parameters_.find (key);
+    if (it == this->parameters_.end ()) return defaultValue;
+    return boost::get<double> (it->second.value);
+  }
+
+  template <typename T>
+  void NagSolverCommon<T>::shareSettings (const NagSolverCommon& parent)
+  {
+    // Sub-solves do not write to the files of their parent.
+    static const char* const fileParameters[] = {
+      "nag.output_file",    "nag.trace_file",        "nag.structure_cache",
+      "nag.basis_load",     "nag.basis_save",        "nag.old_basis_file",
+      "nag.new_basis_file", "nag.backup_basis_file"};
+
+    this->parameters_ = parent.parameters_;
+    for (std::size_t i = 0;
+         i < sizeof (fileParameters) / sizeof (fileParameters[0]); ++i)
+    {
+      typename solver_t::parameters_t::iterator it =
+        this->parameters_.find (fileParameters[i]);
+      if (it != this->parameters_.end ()) it->second.value = std::string ();
+    }
+    cancellationToken_ = parent.cancellationToken_;
+    reportStatistics_ = false;
+  }
+
+  template <typename T>
+  void NagSolverCommon<T>::openTrace (std::size_t n, std::size_t m)
+  {
+    trace_.reset ();
+
+    std::string filename = stringParameter ("nag.trace_file");
+    if (filename.empty ()) return;
+
+    std::size_t capacity =
+      static_cast<std::size_t> (integerParameter ("nag.trace_capacity", 4096));
+    trace_.reset (new nag::Trace (filename, capacity, n, m));
+  }
+
+  template <typename T>
+  void NagSolverCommon<T>::resetAppliedParameters ()
   {
+    appliedParameters_.clear ();
+  }
+
+  template <typename T>
+  void NagSolverCommon<T>::updateParameters (NagError* fail)
+  {
+    assert (stateInitialized_);
+
+    // Option values that NAG should hold, indexed by NAG option name.
+    typedef std::map<std::string, parameterValue_t> options_t;
+    options_t options;
+
     const std::string prefix = "nag.";
     typedef const std::pair<const std::string, Parameter> const_iterator_t;
     BOOST_FOREACH (const_iterator_t& it, this->parameters_)
     {
-      if (it.first.substr (0, prefix.size ()) == prefix)
+      checkParameter (it.first, it.second.value);
+
+      const nag::OptionDescriptor* option = nag::findOption (it.first);
+      if (option)
       {
-        boost::apply_visitor (
-            NagParametersUpdater (it.first.substr (prefix.size ()), state,
-                                  fail),
-            it.second.value);
+        // Remap standardized and RobOptim-specific parameters.
+        if (option->nagKey) options[option->nagKey] = it.second.value;
       }
+      else if (it.first.compare (0, prefix.size (), prefix) == 0)
+        options[it.first.substr (prefix.size ())] = it.second.value;
     }
 
-    // Remap standardized parameters.
-    boost::apply_visitor (
-        NagParametersUpdater ("Major Iterations Limit", state, fail),
-        this->parameters_["max-iterations"].value);
-
     // If the user specified a log filename
-    typename solver_t::parameters_t::const_iterator it =
-        this->parameters_.find ("nag.output_file");
-    if (it != this->parameters_.end ())
+    std::string filename = stringParameter ("nag.output_file");
+    std::size_t capacity = static_cast<std::size_t> (
+      integerParameter ("nag.output_buffer_size", 1 << 20));
+
+    // Log output goes through an asynchronous sink, which is only
+    // recreated when the log settings change.
+    if (filename.empty ())
+      logSink_.reset ();
+    else if (!logSink_ || logSink_->filename () != filename ||
+             logSink_->capacity () != capacity)
     {
-      std::string filename = boost::get<std::string> (it->second.value);
-      if (!filename.empty ())
-      {
-        if (fdLog_ > 2)
-        {
-          nag_close_file (fdLog_, fail);
-          fdLog_ = -1;
-        }
+      logSink_.reset ();
+      logSink_.reset (new NagLogSink (filename, capacity));
+    }
 
-        // 1: open file for writing
-        nag_open_file (filename.c_str (), 1, &fdLog_, fail);
+    if (logSink_) options["Print File"] = int(logSink_->fileId ());
 
-        NagParametersUpdater updater ("Print file", state, fail);
-        updater (int(fdLog_));
-      }
+    // Only push the options that changed since the last solve.
+    for (typename options_t::const_iterator option = options.begin ();
+         option != options.end (); ++option)
+    {
+      typename options_t::const_iterator applied =
+        appliedParameters_.find (option->first);
+      if (applied != appliedParameters_.end () &&
+          applied->second == option->second)
+        continue;
+
+      boost::apply_visitor (
+        NagParametersUpdater (option->first, &state_, fail), option->second);
+      appliedParameters_[option->first] = option->second;
     }
   }
 } // end of namespace roboptim
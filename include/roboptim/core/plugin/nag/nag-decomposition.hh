@@ -0,0 +1,158 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_DECOMPOSITION_HH
+# define ROBOPTIM_CORE_NAG_DECOMPOSITION_HH
+
+# include <cstddef>
+# include <vector>
+
+# include <roboptim/core/differentiable-function.hh>
+
+# include <nag.h>
+
+# include "roboptim/core/plugin/nag/nag-function-hints.hh"
+
+namespace roboptim
+{
+  namespace nag
+  {
+    /// \brief Sparse matrix type of the sparse solver.
+    typedef GenericDifferentiableFunction<EigenMatrixSparse>::jacobian_t
+      sparseMatrix_t;
+
+    /// \brief Independent blocks of a sparse problem: connected
+    /// components of the graph linking each row of F to the variables
+    /// it depends on.
+    struct Decomposition
+    {
+      /// \brief Number of blocks.
+      std::size_t blocks;
+      /// \brief Block of each variable.
+      std::vector<std::size_t> variableBlock;
+      /// \brief Block of each row of F. Rows without entries belong to
+      /// the first block.
+      std::vector<std::size_t> rowBlock;
+    };
+
+    /// \brief Find the independent blocks of a sparse problem.
+    ///
+    /// Variables that only appear in the objective row of A (a linear
+    /// cost is separable) are gathered in a single block, so that
+    /// they do not give a block each.
+    ///
+    /// Blocks are numbered by their first variable.
+    ///
+    /// \param n number of variables.
+    /// \param nf number of rows of F.
+    /// \param iafun rows of the elements of A (1-based).
+    /// \param javar columns of the elements of A (1-based).
+    /// \param nea number of elements of A.
+    /// \param igfun rows of the elements of G (1-based).
+    /// \param jgvar columns of the elements of G (1-based).
+    /// \param neg number of elements of G.
+    /// \param objrow objective row (1-based), whose elements in A do
+    /// not link variables, or 0.
+    /// \param decomposition computed blocks.
+    ROBOPTIM_DLLEXPORT void
+    decompose (Integer n, Integer nf, const Integer* iafun,
+               const Integer* javar, Integer nea, const Integer* igfun,
+               const Integer* jgvar, Integer neg, Integer objrow,
+               Decomposition& decomposition);
+
+    /// \brief Rows and columns of a sparse matrix.
+    ///
+    /// \param m matrix.
+    /// \param rows selected rows.
+    /// \param columnIndex index of each column in the result, or -1 to
+    /// drop it.
+    /// \param columns number of columns of the result.
+    ROBOPTIM_DLLEXPORT sparseMatrix_t
+    subMatrix (const sparseMatrix_t& m,
+               const std::vector<Function::size_type>& rows,
+               const std::vector<Function::size_type>& columnIndex,
+               Function::size_type columns);
+
+    /// \brief Rows of a sparse function, as a function of the variables
+    /// of a block.
+    ///
+    /// The other variables keep the value they have in the point given
+    /// at construction, they do not change the selected rows if the
+    /// block is independent. Evaluations go through an internal buffer,
+    /// so an instance must not be evaluated concurrently.
+    class ROBOPTIM_DLLEXPORT BlockFunction
+      : public GenericDifferentiableFunction<EigenMatrixSparse>,
+        public FusedEvaluation<EigenMatrixSparse>
+    {
+    public:
+      typedef GenericDifferentiableFunction<EigenMatrixSparse>
+        differentiableFunction_t;
+
+      /// \brief Restrict a function to a block.
+      ///
+      /// \param f restricted function, must outlive this function.
+      /// \param rows selected rows of f.
+      /// \param columns variables of the block, in increasing order.
+      /// \param x full point, giving the values of the other variables.
+      BlockFunction (const differentiableFunction_t& f,
+                     const std::vector<size_type>& rows,
+                     const std::vector<size_type>& columns,
+                     const vector_t& x);
+
+      void valueAndJacobian (result_ref result, jacobian_ref jacobian,
+                             const_argument_ref x) const;
+
+    protected:
+      void impl_compute (result_ref result, const_argument_ref x) const;
+
+      void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                          size_type functionId) const;
+
+      void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const;
+
+    private:
+      /// \brief Copy the block variables in the full point.
+      void scatter (const_argument_ref x) const;
+
+      /// \brief Restricted function.
+      const differentiableFunction_t& function_;
+
+      /// \brief Fused evaluation of the restricted function, or null.
+      const FusedEvaluation<EigenMatrixSparse>* fused_;
+
+      /// \brief Selected rows of the restricted function.
+      std::vector<size_type> rows_;
+
+      /// \brief Variables of the block.
+      std::vector<size_type> columns_;
+
+      /// \brief Index of each variable in the block, or -1.
+      std::vector<size_type> columnIndex_;
+
+      /// \brief Full point.
+      mutable vector_t x_;
+
+      /// \brief Value of the restricted function.
+      mutable vector_t value_;
+
+      /// \brief Jacobian of the restricted function.
+      mutable jacobian_t jacobian_;
+    };
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_DECOMPOSITION_HH
@@ -23,6 +23,8 @@
 # include <roboptim/core/solver.hh>
 # include <roboptim/core/differentiable-function.hh>
 
+# include "roboptim/core/plugin/nag/nag-cancellation.hh"
+
 namespace roboptim
 {
   /// \addtogroup roboptim_solver
@@ -69,6 +71,12 @@ namespace roboptim
       return this->solverState_;
     }
 
+    /// \brief Cancellation handle of this solver.
+    const nagCancellationToken_t& cancellationToken () const
+    {
+      return cancellationToken_;
+    }
+
   private:
     /// \brief Relative accuracy.
     double e1_;
@@ -90,6 +98,9 @@ namespace roboptim
 
     /// \brief Solver state
     solverState_t solverState_;
+
+    /// \brief Cancellation handle polled by the NAG callback.
+    nagCancellationToken_t cancellationToken_;
   };
 
   /// @}
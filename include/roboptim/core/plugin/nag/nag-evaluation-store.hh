@@ -0,0 +1,155 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_EVALUATION_STORE_HH
+# define ROBOPTIM_CORE_NAG_EVALUATION_STORE_HH
+
+# include <cstddef>
+# include <string>
+# include <vector>
+
+# include <boost/cstdint.hpp>
+# include <boost/noncopyable.hpp>
+
+# include <roboptim/core/portability.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    /// \brief Header of an evaluation store file.
+    ///
+    /// The header is followed by the function signature (padded to a
+    /// multiple of 8 bytes), then by capacity records:
+    ///
+    /// - boost::uint64_t hash, stamp (last use, 0: empty), parts,
+    /// - boost::int64_t key[inputSize],
+    /// - double value[valueSize], jacobian[jacobianSize].
+    ///
+    /// Records are grouped by sets of evaluationStoreWays, a point
+    /// being stored in the set given by the hash of its key.
+    struct EvaluationStoreHeader
+    {
+      /// \brief File magic: "RONAGEVL".
+      char magic[8];
+      /// \brief Format version.
+      boost::uint32_t version;
+      /// \brief Size of this header, in bytes.
+      boost::uint32_t headerSize;
+      /// \brief Hash of the function signature.
+      boost::uint64_t signatureHash;
+      /// \brief Size of the function signature, in bytes.
+      boost::uint64_t signatureSize;
+      /// \brief Size of the points.
+      boost::uint64_t inputSize;
+      /// \brief Size of the stored values.
+      boost::uint64_t valueSize;
+      /// \brief Size of the stored Jacobians.
+      boost::uint64_t jacobianSize;
+      /// \brief Number of records.
+      boost::uint64_t capacity;
+      /// \brief Last use stamp given to a record.
+      boost::uint64_t clock;
+    };
+
+    /// \brief Number of records of a set.
+    static const std::size_t evaluationStoreWays = 8;
+
+    /// \brief Bounded on-disk store of the evaluations of a function.
+    ///
+    /// The file is mapped and shared by the processes (and solvers)
+    /// opening it, each access holding an exclusive lock on the file.
+    /// When a set is full, its least recently used record is replaced.
+    ///
+    /// Points are keyed exactly, or rounded to a multiple of a quantum,
+    /// in which case an evaluation is reused for the points rounded to
+    /// the same key.
+    class ROBOPTIM_DLLEXPORT EvaluationStore : private boost::noncopyable
+    {
+    public:
+      /// \brief Open a store, creating it if needed.
+      ///
+      /// A file with another signature or other sizes is reset. An
+      /// existing file keeps its capacity.
+      ///
+      /// \param filename store file.
+      /// \param signature function signature, identifying the function
+      /// and the layout of its Jacobian.
+      /// \param inputSize size of the points.
+      /// \param valueSize size of the values.
+      /// \param jacobianSize size of the Jacobians.
+      /// \param capacity number of records of a new file.
+      /// \param quantum step of the rounded keys, 0 for exact keys.
+      /// \throw std::runtime_error if the file cannot be opened.
+      EvaluationStore (const std::string& filename,
+                       const std::string& signature, std::size_t inputSize,
+                       std::size_t valueSize, std::size_t jacobianSize,
+                       std::size_t capacity, double quantum);
+      ~EvaluationStore ();
+
+      /// \brief Copy a stored evaluation.
+      /// \param x point.
+      /// \param value value, or null if not needed.
+      /// \param jacobian Jacobian, or null if not needed.
+      /// \return whether all the needed parts were stored (nothing is
+      /// copied otherwise).
+      bool recall (const double* x, double* value, double* jacobian);
+
+      /// \brief Store an evaluation, completing the parts already
+      /// stored for the point.
+      /// \param x point.
+      /// \param value value, or null.
+      /// \param jacobian Jacobian, or null.
+      void record (const double* x, const double* value,
+                   const double* jacobian);
+
+    private:
+      /// \brief Record of a key.
+      /// \param insert whether to make room for the key if it is not
+      /// stored.
+      /// \return record, or null if not found.
+      char* find (bool insert);
+
+      /// \brief Compute key_ and hash_ for a point.
+      void computeKey (const double* x);
+
+      int fd_;
+      char* map_;
+      std::size_t mapSize_;
+      EvaluationStoreHeader* header_;
+      char* records_;
+      std::size_t recordSize_;
+      std::size_t inputSize_;
+      std::size_t valueSize_;
+      std::size_t jacobianSize_;
+      double quantum_;
+
+      /// \brief Key of the current point.
+      std::vector<boost::int64_t> key_;
+      boost::uint64_t hash_;
+    };
+
+    /// \brief Store file of a function signature.
+    /// \param directory store directory.
+    /// \param signature function signature.
+    ROBOPTIM_DLLEXPORT std::string
+    evaluationStoreFile (const std::string& directory,
+                         const std::string& signature);
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_EVALUATION_STORE_HH
@@ -0,0 +1,165 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_FUNCTION_HINTS_HH
+# define ROBOPTIM_CORE_NAG_FUNCTION_HINTS_HH
+
+# include <string>
+
+# include <roboptim/core/differentiable-function.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    /// \brief Optional interface of sparse functions declaring the
+    /// structure of their Jacobian.
+    ///
+    /// A function inheriting from this interface (in addition to
+    /// GenericDifferentiableFunction<EigenMatrixSparse>) gives the
+    /// sparse solver its sparsity pattern, which is then used as is
+    /// instead of being discovered by evaluating the Jacobian.
+    ///
+    /// Every entry that may be nonzero at some point must be declared:
+    /// the solve is stopped if the Jacobian has an entry outside of the
+    /// declared structure. Declared entries missing from the Jacobian
+    /// are zero.
+    class ROBOPTIM_DLLEXPORT JacobianStructure
+    {
+    public:
+      typedef GenericDifferentiableFunction<EigenMatrixSparse>::jacobian_t
+        structure_t;
+
+      virtual ~JacobianStructure ()
+      {
+      }
+
+      /// \brief Structural nonzeros of the Jacobian.
+      ///
+      /// Only the stored entries matter, their values are ignored.
+      virtual structure_t jacobianStructure () const = 0;
+    };
+
+    /// \brief Optional interface of the instances of a repeated
+    /// function, e.g. the same constraint applied at each time step of
+    /// a trajectory.
+    ///
+    /// Instances with the same dynamic type and sizes must have the
+    /// same Jacobian structure up to a column shift. The sparse solver
+    /// then finds the structure of the first instance only and shifts
+    /// it by the difference of column offsets for the others.
+    class ROBOPTIM_DLLEXPORT PatternInstance
+    {
+    public:
+      virtual ~PatternInstance ()
+      {
+      }
+
+      /// \brief Column offset of this instance.
+      virtual GenericDifferentiableFunction<EigenMatrixSparse>::size_type
+      columnOffset () const = 0;
+    };
+
+    /// \brief Optional interface of functions computing their value
+    /// and their Jacobian together more cheaply than separately, e.g.
+    /// when both depend on the same forward kinematics.
+    ///
+    /// When NAG requests both at the same point, the plug-ins call
+    /// valueAndJacobian once instead of the function, then its
+    /// Jacobian. T is the matrix type of the function
+    /// (EigenMatrixDense or EigenMatrixSparse).
+    template <typename T>
+    class ROBOPTIM_DLLEXPORT FusedEvaluation
+    {
+    public:
+      typedef GenericDifferentiableFunction<T> function_t;
+
+      virtual ~FusedEvaluation ()
+      {
+      }
+
+      /// \brief Compute the value and the Jacobian at the same point.
+      ///
+      /// Both outputs are sized by the caller, as for the function and
+      /// its Jacobian.
+      ///
+      /// \param result function value.
+      /// \param jacobian function Jacobian.
+      /// \param x point.
+      virtual void
+      valueAndJacobian (typename function_t::result_ref result,
+                        typename function_t::jacobian_ref jacobian,
+                        typename function_t::const_argument_ref x) const = 0;
+    };
+
+    /// \brief Optional interface of expensive functions whose
+    /// evaluations are kept across solves, e.g. functions running a
+    /// simulation.
+    ///
+    /// When the nag.memo_directory parameter is set, the plug-ins store
+    /// the values and Jacobians of these functions in that directory,
+    /// and reuse them when a point is evaluated again, by this solve or
+    /// by another one (see nag::EvaluationStore).
+    class ROBOPTIM_DLLEXPORT MemoizedEvaluation
+    {
+    public:
+      virtual ~MemoizedEvaluation ()
+      {
+      }
+
+      /// \brief Identifier of the function, including the data its
+      /// evaluations depend on: functions with the same identifier
+      /// share their stored evaluations.
+      virtual std::string memoKey () const = 0;
+    };
+
+    /// \brief Declared Jacobian structure of a function.
+    /// \return structure interface, or null if the function has none.
+    template <typename T>
+    const JacobianStructure* jacobianStructure (const GenericFunction<T>& f)
+    {
+      return dynamic_cast<const JacobianStructure*> (&f);
+    }
+
+    /// \brief Repeated function interface of a function.
+    /// \return instance interface, or null if the function has none.
+    template <typename T>
+    const PatternInstance* patternInstance (const GenericFunction<T>& f)
+    {
+      return dynamic_cast<const PatternInstance*> (&f);
+    }
+
+    /// \brief Fused value and Jacobian evaluation of a function.
+    /// \return evaluation interface, or null if the function has none.
+    template <typename T>
+    const FusedEvaluation<T>* fusedEvaluation (const GenericFunction<T>& f)
+    {
+      return dynamic_cast<const FusedEvaluation<T>*> (&f);
+    }
+
+    /// \brief Memoization interface of a function.
+    /// \return memoization interface, or null if the function has none.
+    template <typename T>
+    const MemoizedEvaluation*
+    memoizedEvaluation (const GenericFunction<T>& f)
+    {
+      return dynamic_cast<const MemoizedEvaluation*> (&f);
+    }
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_FUNCTION_HINTS_HH
@@ -0,0 +1,133 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_LOG_SINK_HH
+# define ROBOPTIM_CORE_NAG_LOG_SINK_HH
+
+# include <string>
+# include <vector>
+
+# include <boost/noncopyable.hpp>
+# include <boost/thread/condition_variable.hpp>
+# include <boost/thread/mutex.hpp>
+# include <boost/thread/thread.hpp>
+
+# include <roboptim/core/portability.hh>
+
+# include <nag.h>
+
+namespace roboptim
+{
+  /// \brief Asynchronous log file for NAG print output.
+  ///
+  /// NAG writes its print output synchronously from inside the
+  /// optimization loop. This sink hands NAG the write end of a pipe
+  /// instead of the real file: a reader thread moves the data from the
+  /// pipe into a bounded in-memory ring buffer, and a writer thread
+  /// flushes the ring buffer to disk. A slow disk therefore never
+  /// stalls the solve: when the ring buffer is full, incoming output is
+  /// dropped and the number of dropped bytes is appended to the log
+  /// when the sink is closed.
+  ///
+  /// The NAG file identifier is owned by the sink: it is closed, and
+  /// all pending output flushed, on destruction.
+  class ROBOPTIM_DLLEXPORT NagLogSink : private boost::noncopyable
+  {
+  public:
+    /// \brief Open a log file.
+    /// \param filename destination file (truncated).
+    /// \param capacity size of the ring buffer, in bytes.
+    /// \throw std::runtime_error if the sink cannot be set up.
+    NagLogSink (const std::string& filename, std::size_t capacity);
+
+    /// \brief Flush pending output and release all descriptors.
+    ~NagLogSink ();
+
+    /// \brief NAG file identifier to use as NAG's print file.
+    Nag_FileID fileId () const
+    {
+      return fileId_;
+    }
+
+    /// \brief Destination file name.
+    const std::string& filename () const
+    {
+      return filename_;
+    }
+
+    /// \brief Ring buffer size, in bytes.
+    std::size_t capacity () const
+    {
+      return buffer_.size ();
+    }
+
+    /// \brief Number of bytes dropped so far because the buffer was full.
+    std::size_t droppedBytes () const;
+
+  private:
+    /// \brief Move data from the pipe to the ring buffer.
+    void readLoop ();
+
+    /// \brief Move data from the ring buffer to the destination file.
+    void writeLoop ();
+
+    /// \brief Write a whole chunk to the destination file.
+    void writeAll (const char* data, std::size_t size);
+
+  private:
+    /// \brief Destination file name.
+    std::string filename_;
+
+    /// \brief Read end of the pipe.
+    int pipeRead_;
+
+    /// \brief Destination file descriptor.
+    int output_;
+
+    /// \brief NAG file identifier of the pipe write end.
+    Nag_FileID fileId_;
+
+    /// \brief Ring buffer storage.
+    std::vector<char> buffer_;
+
+    /// \brief Index of the first pending byte in the ring buffer.
+    std::size_t head_;
+
+    /// \brief Number of pending bytes in the ring buffer.
+    std::size_t size_;
+
+    /// \brief Number of dropped bytes.
+    std::size_t dropped_;
+
+    /// \brief Whether the reader reached the end of the pipe.
+    bool eof_;
+
+    /// \brief Protects the ring buffer state.
+    mutable boost::mutex mutex_;
+
+    /// \brief Signals new data or end of input to the writer.
+    boost::condition_variable cond_;
+
+    /// \brief Pipe reader thread.
+    boost::thread reader_;
+
+    /// \brief File writer thread.
+    boost::thread writer_;
+  };
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_LOG_SINK_HH
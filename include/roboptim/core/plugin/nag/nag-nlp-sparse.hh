@@ -18,14 +18,22 @@
 #ifndef ROBOPTIM_CORE_PLUGIN_NAG_NAG_NLP_SPARSE_HH
 # define ROBOPTIM_CORE_PLUGIN_NAG_NAG_NLP_SPARSE_HH
 
+# include <string>
 # include <vector>
 
+# include <boost/scoped_ptr.hpp>
+# include <boost/shared_ptr.hpp>
+
 # include <roboptim/core/solver.hh>
 # include <roboptim/core/linear-function.hh>
+# include <roboptim/core/numeric-linear-function.hh>
 # include <roboptim/core/differentiable-function.hh>
 # include <roboptim/core/twice-differentiable-function.hh>
 
 # include "roboptim/core/plugin/nag/nag-common.hh"
+# include "roboptim/core/plugin/nag/nag-evaluation-store.hh"
+# include "roboptim/core/plugin/nag/nag-function-hints.hh"
+# include "roboptim/core/plugin/nag/nag-result-cache.hh"
 
 namespace roboptim
 {
@@ -62,6 +70,11 @@ namespace roboptim
     static const int linearFunctionId = 0;
     static const int nonlinearFunctionId = 1;
 
+    /// \brief Sparsity patterns found for a problem, shareable with the
+    /// solvers of other problems of the same structure.
+    struct Structure;
+    typedef boost::shared_ptr<const Structure> structurePtr_t;
+
     explicit NagSolverNlpSparse (const problem_t& pb);
     virtual ~NagSolverNlpSparse ();
 
@@ -76,23 +89,471 @@ namespace roboptim
     const callback_t& callback () const { return callback_; }
     solverState_t& solverState () { return solverState_; }
 
+    /// \brief Record an evaluation in the trace.
+    /// \param x current point.
+    /// \param f values of the nonlinear rows of F (cost first).
+    /// \param multipliers multipliers of the constraints, or null.
+    void traceEvaluation (const double* x, const double* f,
+                          const double* multipliers);
+
+    /// \brief Copy the Jacobian of a nonlinear function in G.
+    ///
+    /// Entries of the sparsity pattern missing from the Jacobian are
+    /// set to zero.
+    ///
+    /// \param functionId function index in G order (0 for the cost,
+    /// then the nonlinear constraints).
+    /// \param jac Jacobian of the function.
+    /// \param g G values, as given to usrfun.
+    /// \return false if the Jacobian has an entry outside of the
+    /// pattern.
+    bool scatterJacobian (std::size_t functionId, const jacobian_t& jac,
+                          double* g);
+
+    /// \brief Copy the stored evaluation of a memoized function (see
+    /// nag::MemoizedEvaluation).
+    ///
+    /// \param functionId function index in G order.
+    /// \param x user point.
+    /// \param f values of the function, or null if not needed.
+    /// \param g G values, or null if the Jacobian is not needed.
+    /// \return whether the needed parts were stored.
+    bool recall (std::size_t functionId, const double* x, double* f,
+                 double* g);
+
+    /// \brief Store the evaluation of a memoized function, if it is
+    /// one (see recall).
+    void record (std::size_t functionId, const double* x, const double* f,
+                 const double* g);
+
+    /// \brief Record that the Jacobian of a function does not match
+    /// its pattern, to report it once the solve has stopped.
+    void setJacobianError (const function_t& f);
+
+    /// \brief Objective evaluated by usrfun, or null if the objective
+    /// is linear (stored in A) or constant (no objective row).
+    const differentiableFunction_t* objective () const
+    {
+      return objective_;
+    }
+
+    /// \brief Fused value and Jacobian evaluation of a nonlinear
+    /// function.
+    /// \param functionId function index in G order.
+    /// \return evaluation interface, or null if the function has none.
+    const nag::FusedEvaluation<EigenMatrixSparse>*
+    fusedEvaluation (std::size_t functionId) const
+    {
+      return fused_[functionId];
+    }
+
+    /// \brief Whether a constraint is stored in A: linear constraints,
+    /// and nonlinear constraints detected as affine (see the
+    /// nag.detect_affine parameter).
+    bool linearConstraint (std::size_t constraintId) const;
+
+    /// \brief Leave constraints out of the problem given to NAG until
+    /// they are violated (lazy constraint generation).
+    ///
+    /// The problem is first solved without the lazy constraints. Those
+    /// violated at the solution are then added to the problem, which is
+    /// solved again from the previous basis, until none is violated
+    /// (see the nag.lazy_rounds and nag.lazy_tolerance parameters).
+    /// Results cover all the constraints.
+    ///
+    /// \param lazy whether each constraint of the problem is lazy
+    /// (empty: none).
+    /// \throw std::runtime_error if the size does not match the problem.
+    void setLazyConstraints (const std::vector<bool>& lazy);
+
+    /// \brief Start the next solve from a point and multipliers, e.g.
+    /// interpolated from the solution of a coarser problem (see
+    /// nag::refine).
+    ///
+    /// NAG is warm-started: variables and rows with a nonzero
+    /// multiplier start nonbasic at the matching bound, the others
+    /// basic. With presolve, the multiplier of a removed row goes to
+    /// the bound it gave. A basis loaded from nag.basis_load takes
+    /// precedence.
+    /// Decomposed problems (see nag.decompose) only use the point.
+    ///
+    /// \param x starting point.
+    /// \param xmul multipliers of the argument bounds.
+    /// \param lambda multipliers of the constraints, in the Result order.
+    /// \throw std::runtime_error if the sizes do not match the problem.
+    void setWarmStart (const vector_t& x, const vector_t& xmul,
+                       const vector_t& lambda);
+
+    /// \brief Solve many instances of the problem of this solver, in
+    /// parallel (see the nag.batch_threads parameter).
+    ///
+    /// Instances should only differ by their data (bounds, starting
+    /// point, parameters of the functions...): the sparsity patterns
+    /// are then found once, on the problem of this solver, and shared
+    /// by the instances. The state of this solver (lazy constraints,
+    /// last structure) is left as it is. Instances with other functions
+    /// are set up from scratch. Each instance is solved by its own solver, with
+    /// the parameters of this one, except those writing to files.
+    ///
+    /// The user functions must support concurrent evaluations.
+    ///
+    /// A solver created by the solver factory can be cast to
+    /// NagSolverNlpSparse to call it (link roboptim-core-nag-common).
+    ///
+    /// \param problems instances.
+    /// \param statistics statistics of each instance.
+    /// \return result of each instance.
+    std::vector<result_t>
+    solveBatch (const std::vector<const problem_t*>& problems,
+                std::vector<nag::Statistics>& statistics) const;
+
+    /// \brief Sparsity patterns found by the last solve, or null.
+    const structurePtr_t& structure () const
+    {
+      return structure_;
+    }
+
+    /// \brief Take the sparsity patterns of the next solves from
+    /// another solver instead of looking for them, if its problem has
+    /// the same functions (see structure). Functions are compared by
+    /// name and size only: should a Jacobian of this problem have a
+    /// nonzero entry outside of the shared patterns, the problem is
+    /// solved again with patterns of its own.
+    /// \param structure shared patterns (null: none).
+    void shareStructure (const structurePtr_t& structure)
+    {
+      sharedStructure_ = structure;
+    }
+
+    /// \brief Give back the stored result when the same problem is
+    /// solved again, without calling NAG.
+    ///
+    /// Problems are identified by their sizes, linear data, bounds,
+    /// starting point, warm start and parameter values, and by the
+    /// identifiers of their nonlinear functions (see
+    /// nag::MemoizedEvaluation::memoKey), used to invalidate the
+    /// results. Problems with a nonlinear function without identifier,
+    /// or reading or writing a basis file, are always solved. A result
+    /// given back comes with the multipliers of the argument bounds
+    /// (see variableMultipliers), but does not call the iteration
+    /// callback.
+    ///
+    /// \param cache result cache, may be shared by several solvers
+    /// (null: none).
+    void setResultCache (const boost::shared_ptr<nag::ResultCache>& cache);
+
+    /// \brief Multipliers of the argument bounds at the last solution.
+    const vector_t& variableMultipliers () const
+    {
+      return xmul_;
+    }
+
+    /// \brief Whether a constraint is in the problem given to NAG: all
+    /// of them, except the lazy constraints not added yet.
+    bool activeConstraint (std::size_t constraintId) const
+    {
+      return active_.empty () || active_[constraintId];
+    }
+
+    /// \brief Whether the problem given to NAG is scaled (see the
+    /// nag.auto_scaling parameter).
+    bool scaled () const
+    {
+      return scaled_;
+    }
+
+    /// \brief Whether NAG solves a presolved problem (see the
+    /// nag.presolve parameter).
+    bool presolved () const
+    {
+      return presolved_;
+    }
+
+    /// \brief Point given to the user functions, from a point given by
+    /// NAG: unscaled and with the fixed variables removed by presolve.
+    /// \return user point (valid until the next call).
+    const double* userArgument (const double* x);
+
+    /// \brief Buffer receiving the Jacobians of the nonlinear
+    /// functions, before gatherJacobian.
+    /// \param g G values given by NAG.
+    double* jacobianBuffer (double* g)
+    {
+      return presolved_ ? &fullJacobian_[0] : g;
+    }
+
+    /// \brief Copy the G values of the presolved problem from the
+    /// Jacobian buffer.
+    void gatherJacobian (double* g) const;
+
+    /// \brief Scale the nonlinear rows of F computed by usrfun.
+    void scaleValues (double* f) const;
+
+    /// \brief Scale the G values computed by usrfun.
+    void scaleJacobian (double* g) const;
+
   private:
+    /// \brief Entries of a Jacobian pattern.
+    struct PatternStructure
+    {
+      /// \brief Start of each row in columns (size: rows + 1).
+      std::vector<std::size_t> rows;
+      /// \brief Column of each entry, increasing in each row.
+      std::vector<jacobian_t::Index> columns;
+    };
+
+    /// \brief Position in G of the Jacobian of a nonlinear function.
+    struct JacobianPattern
+    {
+      /// \brief Index of the first entry of the function in G.
+      std::size_t offset;
+      /// \brief Shift added to the columns of the structure.
+      jacobian_t::Index columnShift;
+      /// \brief Entries, shared by the instances of a repeated
+      /// function (see nag::PatternInstance).
+      boost::shared_ptr<const PatternStructure> structure;
+    };
+
+    /// \brief Structural nonzeros of a Jacobian, as columns per row.
+    typedef std::vector<std::vector<jacobian_t::Index> > structure_t;
+
     void compute_nf ();
+
+    /// \brief Choose how each function is given to NAG and fill A,
+    /// then G, from the pattern cache if possible.
+    void setup_structure ();
+
+    /// \brief Fill the bounds, the names and the starting point, then
+    /// presolve and scale the problem if requested.
+    /// \param x starting point.
+    void setup_bounds (const vector_t& x);
+
+    /// \brief Open the evaluation stores of the memoized functions, if
+    /// nag.memo_directory is set.
+    void setup_memo ();
+
+    /// \brief Key of the problem in the result cache.
+    /// \param key problem key.
+    /// \param tokens identifiers of the nonlinear functions.
+    /// \return false if the result of the problem cannot be cached.
+    bool result_key (std::string& key, std::vector<std::string>& tokens) const;
+
+    /// \brief Solve the problem, without looking in the result cache.
+    /// \param start time at which the solve started.
+    void solve_problem (double start);
+
+    /// \brief Set up the problem and solve it, with its lazy constraints
+    /// or by blocks if requested.
+    /// \param start time at which the solve started.
+    /// \param success whether NAG succeeded.
+    /// \return false if the problem was solved by blocks, which report
+    /// their solve themselves.
+    bool setup_and_run (double start, bool& success);
+
+    /// \brief Solve the problem given to NAG and set the result.
+    /// \param setupStart time at which the setup of this solve started.
+    /// \param startMode NAG start, Nag_Cold unless the states of a
+    /// previous solve are kept (a saved basis may still be loaded).
+    /// \return whether NAG succeeded.
+    bool run (double setupStart, Nag_Start startMode);
+
+    /// \brief Solve with lazy constraints (see setLazyConstraints).
+    /// \param start time at which the solve started.
+    /// \return whether the final solve succeeded.
+    bool solve_lazy (double start);
+
+    /// \brief Complete a result of the active constraints with the
+    /// values of the other constraints at its point.
+    /// \param res result, in the layout of the active constraints.
+    /// \param tolerance violation tolerance on the constraint bounds.
+    /// \param violated inactive constraints violated at the point.
+    void complete_result (Result& res, double tolerance,
+                          std::vector<std::size_t>& violated) const;
+
+    /// \brief Add constraints to the problem given to NAG after a
+    /// solve, keeping the rows and the G entries of the others, their
+    /// states and multipliers, so that the next solve is warm-started.
+    ///
+    /// Requires a problem that was neither presolved, nor scaled, nor
+    /// with affine constraints (the rows of F are then the ones given
+    /// to NAG).
+    ///
+    /// \param added inactive constraints, in increasing order.
+    void add_constraints (const std::vector<std::size_t>& added);
+
+    /// \brief Fill the names of the variables and of the rows of F.
+    void fill_names ();
     void fill_xlow_xupp ();
     void fill_flow_fupp ();
     void fill_iafun_javar_lena_nea ();
+
+    /// \brief Choose how the objective is given to NAG: in G if it is
+    /// nonlinear, in the cost row of A if it is linear, not at all if
+    /// it is constant.
+    void setup_objective ();
+
+    /// \brief Find the nonlinear constraints whose Jacobian is constant
+    /// and whose values match their linearization at the sample points.
+    void detect_affine ();
+
+    /// \brief First row in F of each constraint: nonlinear constraints
+    /// first, then the constraints stored in A.
+    void constraintStarts (std::vector<Integer>& start) const;
+
+    /// \brief First row in Result::constraints of each constraint:
+    /// nonlinear constraints first, then linear ones.
+    void resultStarts (std::vector<Integer>& start) const;
+
+    /// \brief Set the point, multipliers and states of the problem
+    /// given to NAG from the warm start (see setWarmStart).
+    void apply_warm_start ();
+
+    /// \brief Scale a starting point and multipliers given in the
+    /// unscaled problem (inverse of unscale_solution).
+    void scale_start ();
+
+    /// \brief Solve the independent blocks of the problem with their
+    /// own solvers, in parallel (see the nag.decompose parameter).
+    /// \param start time at which the solve started.
+    /// \return false if the problem was not decomposed.
+    bool solve_blocks (double start);
+
+    /// \brief Add back the constant part of the affine rows of F and
+    /// move them to their place in the Result (among the nonlinear
+    /// constraints).
+    void restore_affine_rows ();
+
+    /// \brief Linear form of a constraint stored in A.
+    /// \param constraintId constraint index.
+    /// \param storage storage of a converted linear function.
+    const numericLinearFunction_t*
+    linearForm (std::size_t constraintId,
+                boost::scoped_ptr<numericLinearFunction_t>& storage) const;
     void fill_igfun_jgvar_leng_neg ();
+
+    /// \brief Find the nonlinear functions offering a fused value and
+    /// Jacobian evaluation.
+    void setup_fused ();
+
+    /// \brief Compute the patterns used by scatterJacobian from G.
+    /// \return false if G does not match the nonlinear functions.
+    bool fill_patterns ();
+
+    /// \brief Whether the G entries starting at k are exactly a
+    /// shifted structure.
+    /// \param row first row of the function in F (0-based).
+    bool match_pattern (const PatternStructure& structure,
+                        jacobian_t::Index columnShift, Integer row,
+                        std::size_t k) const;
+
+    /// \brief Cost and nonlinear constraints, in G order.
+    void nonlinearFunctions (
+      std::vector<const differentiableFunction_t*>& functions) const;
+
+    /// \brief Signature identifying the structure of the problem:
+    /// names, kinds and sizes of its functions, in order.
+    ///
+    /// Coefficients of the linear constraints are not part of the
+    /// signature: A is always filled from the problem.
+    std::string signature () const;
+
+    /// \brief Load G from the pattern cache, once A is filled.
+    /// \return whether the cache had a valid entry with the
+    /// coordinates of A.
+    bool load_structure (const std::string& filename,
+                         const std::string& signature);
+
+    /// \brief Save the coordinates of A and G to the pattern cache.
+    void save_structure (const std::string& filename,
+                         const std::string& signature) const;
+
+    /// \brief Signature of the problem given to NAG, used to match
+    /// basis files.
+    std::string basisSignature () const;
+
+    /// \brief Load the starting point, multipliers and states of a
+    /// warm start from a basis file.
+    /// \return whether the file had a basis for this problem.
+    bool load_basis (const std::string& filename);
+
+    /// \brief Save the unscaled point, multipliers and states returned
+    /// by NAG to a basis file.
+    void save_basis (const std::string& filename) const;
+
     void fill_fnames ();
+    void free_names ();
 
     function_t::vector_t lookForX ();
-    function_t::vector_t lookForX (unsigned constraintId);
+
+    /// \brief Points where Jacobians are sampled to find patterns of
+    /// functions that do not declare their structure.
+    const std::vector<vector_t>& samplePoints ();
+
+    /// \brief Sparsity pattern of the Jacobian of a nonlinear function.
+    ///
+    /// The declared structure is used if the function has one,
+    /// otherwise the union of the Jacobian patterns at the sample
+    /// points.
+    void jacobianStructure (const differentiableFunction_t& f,
+                            structure_t& structure);
+
+    /// \brief Compute row and column scale factors from the Jacobians
+    /// at the starting point, by geometric-mean equilibration.
+    void compute_scaling ();
+
+    /// \brief Scale A, G, the bounds and the starting point.
+    void apply_scaling ();
+
+    /// \brief Unscale x, F and the multipliers returned by NAG.
+    void unscale_solution ();
+
+    /// \brief Remove fixed variables, turn singleton linear rows into
+    /// bounds and drop duplicate linear rows.
+    ///
+    /// Rows whose bounds would become inconsistent are kept, so that
+    /// NAG reports the infeasibility. The trace holds the variables
+    /// and rows of the full problem (see tracePostsolved).
+    void presolve ();
+
+    /// \brief Rebuild the full-size x, F and multipliers after a
+    /// presolved solve.
+    void postsolve ();
+
+    /// \brief Record an evaluation of the presolved problem in the
+    /// trace, in terms of the full problem.
+    ///
+    /// Fixed variables are added back to x, removed rows to F and to
+    /// the violation. The multipliers of removed rows are NaN.
+    ///
+    /// \param x current point, unscaled.
+    /// \param f values of the nonlinear rows of F (cost first), as
+    /// given to NAG.
+    /// \param multipliers unscaled multipliers of the presolved
+    /// constraints, or null.
+    void tracePostsolved (const double* x, const double* f,
+                          const double* multipliers);
+
+    /// \brief Append the pattern of a nonlinear function to G.
+    /// \param row first row of the function in F (0-based).
+    /// \param columnShift shift added to the columns of the structure.
+    void appendJacobianPattern (const differentiableFunction_t& f,
+                                const structure_t& structure,
+                                function_t::size_type row,
+                                jacobian_t::Index columnShift);
 
     Integer nf_;
+    /// \brief Number of rows of F computed by usrfun (cost and
+    /// nonlinear constraints).
+    Integer nfNonlinear_;
     Integer n_;
     Integer nxname_;
     Integer nfname_;
     double objadd_;
+    /// \brief Objective row of F (1), or 0 for a feasibility problem.
     Integer objrow_;
+    /// \brief Objective evaluated by usrfun (null if it is linear or
+    /// constant).
+    const differentiableFunction_t* objective_;
     std::string prob_;
 
     std::vector<Integer> iafun_;
@@ -110,6 +571,20 @@ namespace roboptim
 
     Integer neg_;
 
+    /// \brief Patterns of the cost and nonlinear constraints, in G
+    /// order.
+    std::vector<JacobianPattern> patterns_;
+
+    /// \brief Fused evaluations of the cost and nonlinear constraints,
+    /// in G order (null for the functions without one).
+    std::vector<const nag::FusedEvaluation<EigenMatrixSparse>*> fused_;
+
+    /// \brief Jacobian sample points (lazily computed).
+    std::vector<vector_t> samplePoints_;
+
+    /// \brief Why usrfun stopped the solve, if it did.
+    std::string jacobianError_;
+
     Function::vector_t xlow_;
     Function::vector_t xupp_;
 
@@ -134,6 +609,122 @@ namespace roboptim
     callback_t callback_;
 
     solverState_t solverState_;
+
+    /// \brief Values of F used to compute the traced violation.
+    Function::vector_t traceF_;
+
+    /// \brief Point and multipliers of a warm start, in the user
+    /// layout.
+    struct WarmStart
+    {
+      vector_t x;
+      vector_t xmul;
+      vector_t lambda;
+    };
+
+    /// \brief Warm start of the next solve, if any.
+    boost::scoped_ptr<WarmStart> warmStart_;
+
+    /// \brief Solve of an instance of a batch.
+    struct BatchTask;
+
+    /// \brief Sparsity patterns found by the last solve.
+    structurePtr_t structure_;
+
+    /// \brief Sparsity patterns given by shareStructure.
+    structurePtr_t sharedStructure_;
+
+    /// \brief Evaluation store of each nonlinear function in G order,
+    /// null if the function is not memoized.
+    std::vector<boost::shared_ptr<nag::EvaluationStore> > memo_;
+
+    /// \brief Results of the solved problems (see setResultCache).
+    boost::shared_ptr<nag::ResultCache> resultCache_;
+
+    /// \brief Lazy constraints (empty: none).
+    std::vector<bool> lazy_;
+
+    /// \brief Constraints given to NAG during a lazy solve (empty: all).
+    std::vector<bool> active_;
+
+    /// \brief Linear form of the nonlinear constraints detected as
+    /// affine (null for the other constraints).
+    std::vector<boost::shared_ptr<const numericLinearFunction_t> > affine_;
+
+    /// \brief Constant part of the affine rows of F, added back to the
+    /// values computed by NAG.
+    Function::vector_t affineConstants_;
+
+    /// \brief Whether the problem given to NAG is scaled.
+    bool scaled_;
+
+    /// \brief Scale factors of the rows of F: NAG sees r_i F_i.
+    Function::vector_t rowScales_;
+
+    /// \brief Scale factors of the variables: NAG sees x_j / c_j.
+    Function::vector_t columnScales_;
+
+    /// \brief Scale factor of each G entry (r_i c_j).
+    std::vector<double> jacobianScales_;
+
+    /// \brief Unscaled point given to the user functions.
+    Function::vector_t unscaledX_;
+
+    /// \brief Unscaled point and multipliers recorded in the trace.
+    Function::vector_t traceX_;
+    Function::vector_t traceMultipliers_;
+
+    /// \brief Whether NAG solves a presolved problem.
+    bool presolved_;
+
+    /// \brief Full-size point, holding the values of fixed variables.
+    Function::vector_t fullX_;
+
+    /// \brief Original index of each presolved variable.
+    std::vector<Integer> variables_;
+
+    /// \brief Original index of each presolved row of F.
+    std::vector<Integer> rows_;
+
+    /// \brief Index in the full G of each presolved G entry.
+    std::vector<std::size_t> jacobianMap_;
+
+    /// \brief Jacobian values of the full problem.
+    std::vector<double> fullJacobian_;
+
+    /// \brief A of the full problem, used by postsolve.
+    std::vector<Integer> fullIafun_;
+    std::vector<Integer> fullJavar_;
+    std::vector<double> fullA_;
+
+    /// \brief Pattern of G of the full problem, used by postsolve.
+    std::vector<Integer> fullIgfun_;
+    std::vector<Integer> fullJgvar_;
+
+    /// \brief Bounds of the full problem, used by the trace.
+    Function::vector_t fullXlow_;
+    Function::vector_t fullXupp_;
+    Function::vector_t fullFlow_;
+    Function::vector_t fullFupp_;
+
+    /// \brief Linear row of F that gave a bound to a variable or to a
+    /// kept linear row.
+    struct BoundSource
+    {
+      /// \brief Row of F (-1 if the bound is the original one).
+      Integer row;
+      /// \brief Factor such that the row is factor times the variable
+      /// (or the kept row).
+      double factor;
+    };
+
+    /// \brief Sources of the lower and upper bounds of the variables.
+    std::vector<BoundSource> variableLowerSources_;
+    std::vector<BoundSource> variableUpperSources_;
+
+    /// \brief Sources of the lower and upper bounds of the rows of F.
+    std::vector<BoundSource> rowLowerSources_;
+    std::vector<BoundSource> rowUpperSources_;
   };
 
   /// @}
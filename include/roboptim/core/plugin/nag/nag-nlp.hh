@@ -19,12 +19,15 @@
 # define ROBOPTIM_CORE_PLUGING_NAG_NAG_NLP_HH
 # include <vector>
 
+# include <boost/shared_ptr.hpp>
+
 # include <roboptim/core/portability.hh>
 # include <roboptim/core/function.hh>
 # include <roboptim/core/differentiable-function.hh>
 # include <roboptim/core/twice-differentiable-function.hh>
 
 # include "roboptim/core/plugin/nag/nag-common.hh"
+# include "roboptim/core/plugin/nag/nag-evaluation-store.hh"
 
 namespace roboptim
 {
@@ -71,7 +74,60 @@ namespace roboptim
       return solverState_;
     }
 
+    /// \brief Store the nonlinear constraint values for the trace.
+    /// \param ccon values of the nonlinear constraints.
+    void traceConstraints (const double* ccon);
+
+    /// \brief Record an evaluation in the trace.
+    /// \param x current point.
+    /// \param objf objective value.
+    /// \param multipliers multipliers (bounds, linear and nonlinear
+    /// constraints), or null.
+    void traceEvaluation (const double* x, double objf,
+			  const double* multipliers);
+
+    /// \brief Copy the stored evaluation of a memoized function (see
+    /// nag::MemoizedEvaluation).
+    ///
+    /// \param functionId 0 for the cost, then the nonlinear
+    /// constraints.
+    /// \param x point.
+    /// \param f values of the function, or null if not needed.
+    /// \param jacobian row-major Jacobian, or null if not needed.
+    /// \return whether the needed parts were stored.
+    bool recall (std::size_t functionId, const double* x, double* f,
+		 double* jacobian);
+
+    /// \brief Store the evaluation of a memoized function, if it is
+    /// one (see recall).
+    void record (std::size_t functionId, const double* x, const double* f,
+		 const double* jacobian);
+
+    /// \brief Solve many problems of the same form, in parallel (see
+    /// the nag.batch_threads parameter).
+    ///
+    /// Each problem is solved by its own solver, with its own NAG
+    /// state and the parameters of this one, except those writing to
+    /// files. The user functions must support concurrent evaluations.
+    ///
+    /// A solver created by the solver factory can be cast to
+    /// NagSolverNlp to call it (link roboptim-core-nag-common).
+    ///
+    /// \param problems instances.
+    /// \param statistics statistics of each instance.
+    /// \return result of each instance.
+    std::vector<result_t>
+    solveBatch (const std::vector<const problem_t*>& problems,
+		std::vector<nag::Statistics>& statistics) const;
+
   private:
+    /// \brief Solve of an instance of a batch.
+    struct BatchTask;
+
+    /// \brief Open the evaluation stores of the memoized functions, if
+    /// nag.memo_directory is set.
+    void setup_memo ();
+
     Integer n_;
     Integer nclin_;
     Integer ncnln_;
@@ -80,7 +136,9 @@ namespace roboptim
     Integer tdh_;
     Function::result_t objf_;
 
-    Function::matrix_t a_;
+    /// \brief Linear constraints matrix, whose rows are contiguous as
+    /// NAG expects (tda is n).
+    Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> a_;
     Function::vector_t bl_;
     Function::vector_t bu_;
 
@@ -95,6 +153,13 @@ namespace roboptim
     callback_t callback_;
 
     solverState_t solverState_;
+
+    /// \brief Last nonlinear constraint values, used by the trace.
+    Function::vector_t traceC_;
+
+    /// \brief Evaluation store of the cost and of each nonlinear
+    /// constraint, null if the function is not memoized.
+    std::vector<boost::shared_ptr<nag::EvaluationStore> > memo_;
   };
 
   /// @}
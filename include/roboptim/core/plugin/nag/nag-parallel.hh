@@ -0,0 +1,73 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_PARALLEL_HH
+# define ROBOPTIM_CORE_NAG_PARALLEL_HH
+
+# include <algorithm>
+# include <cstddef>
+
+# include <boost/atomic.hpp>
+# include <boost/thread/thread.hpp>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace detail
+    {
+      /// \brief Run tasks, taken in order until there is none left.
+      template <typename F>
+      void runTasks (const F& f, std::size_t tasks,
+                     boost::atomic<std::size_t>& next)
+      {
+        for (std::size_t k = next++; k < tasks; k = next++) f (k);
+      }
+    } // end of namespace detail.
+
+    /// \brief Run tasks 0 to tasks - 1 on a pool of threads.
+    ///
+    /// Tasks are started in increasing order, the calling thread
+    /// running some of them too. The call returns once they are all
+    /// done.
+    ///
+    /// \param f task, called with the task index. Called concurrently,
+    /// must not throw.
+    /// \param tasks number of tasks.
+    /// \param threads number of threads (0: one per core).
+    template <typename F>
+    void parallelFor (const F& f, std::size_t tasks, int threads)
+    {
+      if (threads <= 0)
+        threads = std::max (
+          1, static_cast<int> (boost::thread::hardware_concurrency ()));
+      if (static_cast<std::size_t> (threads) > tasks)
+        threads = static_cast<int> (tasks);
+
+      boost::atomic<std::size_t> next (0);
+      boost::thread_group group;
+      for (int t = 1; t < threads; ++t)
+        group.add_thread (new boost::thread (&detail::runTasks<F>,
+                                             boost::cref (f), tasks,
+                                             boost::ref (next)));
+      detail::runTasks (f, tasks, next);
+      group.join_all ();
+    }
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_PARALLEL_HH
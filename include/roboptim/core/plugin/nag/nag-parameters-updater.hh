@@ -18,57 +18,154 @@
 #ifndef ROBOPTIM_CORE_NAG_PARAMETERS_UPDATER_HH
 # define ROBOPTIM_CORE_NAG_PARAMETERS_UPDATER_HH
 
-# include <map>
+# include <cstring>
 # include <string>
-# include <set>
-# include <algorithm>
 
 # include <boost/variant/static_visitor.hpp>
-# include <boost/static_assert.hpp>
 
 # include <nag.h>
 # include <nage04.h>
 
+# include <roboptim/core/debug.hh>
+# include <roboptim/core/function.hh>
+
 namespace roboptim
 {
+  namespace nag
+  {
+    /// \brief Type expected by NAG for an option.
+    enum OptionType
+    {
+      /// \brief Set with nag_opt_sparse_nlp_option_set_integer.
+      OPTION_INTEGER = 0,
+      /// \brief Set with nag_opt_sparse_nlp_option_set_double.
+      OPTION_DOUBLE,
+      /// \brief Set with nag_opt_sparse_nlp_option_set_string.
+      OPTION_STRING
+    };
+
+    /// \brief Entry of the option table.
+    struct OptionDescriptor
+    {
+      /// \brief RobOptim parameter name.
+      const char* roboptimKey;
+      /// \brief NAG option name (null for RobOptim-only options).
+      const char* nagKey;
+      /// \brief Expected value type.
+      OptionType type;
+    };
+
+    /// \brief Option table mapping RobOptim parameters to NAG options.
+    ///
+    /// Parameters prefixed by "nag." that do not appear in this table
+    /// are forwarded verbatim (without the prefix) to NAG. The table is
+    /// terminated by an entry with a null RobOptim key.
+    inline const OptionDescriptor* optionTable ()
+    {
+      static const OptionDescriptor table[] = {
+        {"max-iterations", "Major Iterations Limit", OPTION_INTEGER},
+        {"nag.verify-level", "Verify Level", OPTION_INTEGER},
+        {"nag.print-file", "Print File", OPTION_INTEGER},
+        {"nag.output_file", 0, OPTION_STRING},
+        {"nag.output_buffer_size", 0, OPTION_INTEGER},
+        {"nag.trace_file", 0, OPTION_STRING},
+        {"nag.trace_capacity", 0, OPTION_INTEGER},
+        {"nag.structure_samples", 0, OPTION_INTEGER},
+        {"nag.structure_cache", 0, OPTION_STRING},
+        {"nag.detect_affine", 0, OPTION_INTEGER},
+        {"nag.presolve", 0, OPTION_INTEGER},
+        {"nag.auto_scaling", 0, OPTION_INTEGER},
+        {"nag.decompose", 0, OPTION_INTEGER},
+        {"nag.decompose_threads", 0, OPTION_INTEGER},
+        {"nag.lazy_rounds", 0, OPTION_INTEGER},
+        {"nag.lazy_tolerance", 0, OPTION_DOUBLE},
+        {"nag.batch_threads", 0, OPTION_INTEGER},
+        {"nag.memo_directory", 0, OPTION_STRING},
+        {"nag.memo_capacity", 0, OPTION_INTEGER},
+        {"nag.memo_quantum", 0, OPTION_DOUBLE},
+        {"nag.basis_load", 0, OPTION_STRING},
+        {"nag.basis_save", 0, OPTION_STRING},
+        {"nag.old_basis_file", 0, OPTION_STRING},
+        {"nag.new_basis_file", 0, OPTION_STRING},
+        {"nag.backup_basis_file", 0, OPTION_STRING},
+        {"nag.save_frequency", "Save Frequency", OPTION_INTEGER},
+        {0, 0, OPTION_INTEGER}};
+      return table;
+    }
+
+    /// \brief Look for a RobOptim parameter in the option table.
+    /// \param key RobOptim parameter name.
+    /// \return table entry, or null if the parameter is not listed.
+    inline const OptionDescriptor* findOption (const std::string& key)
+    {
+      for (const OptionDescriptor* it = optionTable (); it->roboptimKey; ++it)
+        if (std::strcmp (it->roboptimKey, key.c_str ()) == 0) return it;
+      return 0;
+    }
+
+    /// \brief Check that a parameter value has the expected type.
+    struct OptionTypeChecker : public boost::static_visitor<bool>
+    {
+      explicit OptionTypeChecker (OptionType type)
+        : boost::static_visitor<bool> (), type_ (type)
+      {
+      }
+
+      bool operator() (const Function::value_type&) const
+      {
+        return type_ == OPTION_DOUBLE;
+      }
+
+      bool operator() (const int&) const
+      {
+        return type_ == OPTION_INTEGER;
+      }
+
+      bool operator() (const std::string&) const
+      {
+        return type_ == OPTION_STRING;
+      }
+
+      bool operator() (const char*) const
+      {
+        return type_ == OPTION_STRING;
+      }
+
+      template <typename T>
+      bool operator() (const T&) const
+      {
+        return false;
+      }
+
+    private:
+      OptionType type_;
+    };
+  } // end of namespace nag.
+
+  /// \brief Push a parameter value to NAG.
+  ///
+  /// The key is the NAG option name, already resolved from the
+  /// option table.
   struct NagParametersUpdater : public boost::static_visitor<>
   {
     NagParametersUpdater (const std::string& key, Nag_E04State* state,
                           NagError* fail)
-      : boost::static_visitor<> (),
-        key_ (),
-        state_ (state),
-        fail_ (fail),
-        ignored_ ()
+      : boost::static_visitor<> (), key_ (key), state_ (state), fail_ (fail)
     {
-      // Conversion map from RobOptim whitespace-free strings to
-      // NAG's strings
-      toRoboptim_["max-iterations"] = std::string ("Major Iterations Limit");
-      toRoboptim_["verify-level"] = std::string ("Verify Level");
-      toRoboptim_["print-file"] = std::string ("Print file");
-      key_ = roboptim_to_nag (key);
-
-      ignored_.insert ("output_file");
     }
 
     void operator() (const Function::value_type& val) const
     {
-      if (is_ignored (key_)) return;
-
       nag_opt_sparse_nlp_option_set_double (key_.c_str (), val, state_, fail_);
     }
 
     void operator() (const int& val) const
     {
-      if (is_ignored (key_)) return;
-
       nag_opt_sparse_nlp_option_set_integer (key_.c_str (), val, state_, fail_);
     }
 
     void operator() (const std::string& val) const
     {
-      if (is_ignored (key_)) return;
-
       std::string option = key_;
       if (!val.empty ()) option += " = " + val;
       nag_opt_sparse_nlp_option_set_string (option.c_str (), state_, fail_);
@@ -76,8 +173,6 @@ namespace roboptim
 
     void operator() (const char* val) const
     {
-      if (is_ignored (key_)) return;
-
       (*this) (std::string (val));
     }
 
@@ -87,32 +182,10 @@ namespace roboptim
       ROBOPTIM_ASSERT_MSG (false, "NOT IMPLEMENTED");
     }
 
-  private:
-    bool is_ignored (const std::string& option) const
-    {
-      return std::find (ignored_.begin (), ignored_.end (), option) !=
-             ignored_.end ();
-    }
-
-    std::string roboptim_to_nag (const std::string& option) const
-    {
-      std::map<std::string, std::string>::const_iterator it =
-          toRoboptim_.find (option);
-      if (it != toRoboptim_.end ())
-      {
-        // element found
-        return it->second;
-      }
-      else
-        return option;
-    }
-
   private:
     std::string key_;
     Nag_E04State* state_;
     NagError* fail_;
-    std::set<std::string> ignored_;
-    std::map<std::string, std::string> toRoboptim_;
   };
 } // end of namespace roboptim.
 
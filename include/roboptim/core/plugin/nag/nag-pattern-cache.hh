@@ -0,0 +1,119 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_PATTERN_CACHE_HH
+# define ROBOPTIM_CORE_NAG_PATTERN_CACHE_HH
+
+# include <string>
+# include <vector>
+
+# include <boost/cstdint.hpp>
+
+# include <roboptim/core/portability.hh>
+
+# include <nag.h>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    /// \brief Header of a pattern cache file.
+    ///
+    /// The header is followed by the problem signature (padded to a
+    /// multiple of 8 bytes), then by the arrays:
+    ///
+    /// - Integer iafun[nea], javar[nea],
+    /// - Integer igfun[neg], jgvar[neg].
+    ///
+    /// The values of A are not stored: they are data of the problem,
+    /// which the signature does not cover.
+    ///
+    /// Values are stored in the native byte order, so that the file
+    /// can be mapped and copied as is.
+    struct PatternCacheHeader
+    {
+      /// \brief File magic: "RONAGPAT".
+      char magic[8];
+      /// \brief Format version.
+      boost::uint32_t version;
+      /// \brief Size of this header, in bytes.
+      boost::uint32_t headerSize;
+      /// \brief Size of a NAG Integer, in bytes.
+      boost::uint32_t integerSize;
+      /// \brief Unused, keeps the following fields aligned.
+      boost::uint32_t padding;
+      /// \brief Hash of the problem signature.
+      boost::uint64_t signatureHash;
+      /// \brief Size of the problem signature, in bytes.
+      boost::uint64_t signatureSize;
+      /// \brief Number of elements of A.
+      boost::uint64_t nea;
+      /// \brief Number of elements of G.
+      boost::uint64_t neg;
+    };
+
+    /// \brief Assembled sparse structure of a problem: coordinates
+    /// (1-based, as expected by NAG) of A and G.
+    struct SparseStructure
+    {
+      std::vector<Integer> iafun;
+      std::vector<Integer> javar;
+      std::vector<Integer> igfun;
+      std::vector<Integer> jgvar;
+    };
+
+    /// \brief 64-bit FNV-1a hash of a problem signature.
+    boost::uint64_t hashSignature (const std::string& signature);
+
+    /// \brief Cache file of a problem signature.
+    /// \param directory cache directory.
+    /// \param signature problem signature.
+    ROBOPTIM_DLLEXPORT std::string
+    patternCacheFile (const std::string& directory,
+                      const std::string& signature);
+
+    /// \brief Load a sparse structure from a cache file.
+    ///
+    /// The file is mapped and its arrays copied. A missing, truncated
+    /// or mismatching file is a cache miss.
+    ///
+    /// \param filename cache file.
+    /// \param signature expected problem signature.
+    /// \param structure loaded structure.
+    /// \return whether the structure was loaded.
+    ROBOPTIM_DLLEXPORT bool
+    loadPatternCache (const std::string& filename,
+                      const std::string& signature,
+                      SparseStructure& structure);
+
+    /// \brief Save a sparse structure to a cache file.
+    ///
+    /// The file is written next to its final location then renamed,
+    /// so that concurrent readers never see a partial file.
+    ///
+    /// \param filename cache file.
+    /// \param signature problem signature.
+    /// \param structure structure to save.
+    /// \throw std::runtime_error if the file cannot be written.
+    ROBOPTIM_DLLEXPORT void
+    savePatternCache (const std::string& filename,
+                      const std::string& signature,
+                      const SparseStructure& structure);
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_PATTERN_CACHE_HH
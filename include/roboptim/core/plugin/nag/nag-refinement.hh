@@ -0,0 +1,106 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_REFINEMENT_HH
+# define ROBOPTIM_CORE_NAG_REFINEMENT_HH
+
+# include <cstddef>
+# include <vector>
+
+# include <boost/format.hpp>
+
+# include "roboptim/core/plugin/nag/nag-nlp-sparse.hh"
+
+namespace roboptim
+{
+  namespace nag
+  {
+    /// \brief Interpolation of a solution between consecutive levels of
+    /// a mesh refinement, e.g. from N to 2N knots of a trajectory.
+    class Interpolation
+    {
+    public:
+      typedef NagSolverNlpSparse::vector_t vector_t;
+
+      virtual ~Interpolation ()
+      {
+      }
+
+      /// \brief Variables of a finer level, from those of the previous
+      /// level. Also applied to the multipliers of the argument
+      /// bounds.
+      ///
+      /// \param level finer level (1 for the first refinement).
+      /// \param coarse variables of the previous level.
+      virtual vector_t variables (std::size_t level,
+                                  const vector_t& coarse) const = 0;
+
+      /// \brief Multipliers of the constraints of a finer level, from
+      /// those of the previous level (Result order).
+      ///
+      /// \param level finer level (1 for the first refinement).
+      /// \param coarse multipliers of the previous level.
+      virtual vector_t multipliers (std::size_t level,
+                                    const vector_t& coarse) const = 0;
+    };
+
+    /// \brief Solve problems of increasing resolution, each one
+    /// warm-started from the interpolated solution of the previous one
+    /// (see NagSolverNlpSparse::setWarmStart).
+    ///
+    /// The first level is solved from the starting point of its
+    /// problem. Solvers are configured by the caller, and should not
+    /// have solved their problem yet.
+    ///
+    /// \param solvers solvers of the levels, coarsest first.
+    /// \param interpolation interpolation between the levels.
+    /// \return result of the finest level, or the error of the first
+    /// level that failed.
+    inline NagSolverNlpSparse::result_t
+    refine (const std::vector<NagSolverNlpSparse*>& solvers,
+            const Interpolation& interpolation)
+    {
+      NagSolverNlpSparse::result_t result;
+      for (std::size_t level = 0; level < solvers.size (); ++level)
+      {
+        NagSolverNlpSparse& solver = *solvers[level];
+        if (level > 0)
+        {
+          const Result& coarse = boost::get<Result> (result);
+          solver.setWarmStart (
+            interpolation.variables (level, coarse.x),
+            interpolation.variables (
+              level, solvers[level - 1]->variableMultipliers ()),
+            interpolation.multipliers (level, coarse.lambda));
+        }
+
+        result = solver.minimum ();
+        if (result.which () == NagSolverNlpSparse::SOLVER_VALUE) continue;
+        if (result.which () != NagSolverNlpSparse::SOLVER_ERROR) return result;
+
+        const SolverError& error = boost::get<SolverError> (result);
+        SolverError levelError (
+          (boost::format ("level %1%: %2%") % level % error.what ()).str ());
+        levelError.lastState () = error.lastState ();
+        return levelError;
+      }
+      return result;
+    }
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_REFINEMENT_HH
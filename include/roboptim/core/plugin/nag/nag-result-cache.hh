@@ -0,0 +1,105 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_RESULT_CACHE_HH
+# define ROBOPTIM_CORE_NAG_RESULT_CACHE_HH
+
+# include <cstddef>
+# include <list>
+# include <map>
+# include <string>
+# include <vector>
+
+# include <boost/cstdint.hpp>
+# include <boost/noncopyable.hpp>
+# include <boost/thread/mutex.hpp>
+
+# include <roboptim/core/solver.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    /// \brief Results of solved problems, given back when the same
+    /// problem is solved again (see NagSolverNlpSparse::setResultCache).
+    ///
+    /// Problems are identified by a key holding all their data. Only
+    /// the most recently used results are kept. The cache can be shared
+    /// by solvers running in several threads.
+    class ROBOPTIM_DLLEXPORT ResultCache : private boost::noncopyable
+    {
+    public:
+      /// \brief Create an empty cache.
+      /// \param capacity maximum number of results.
+      explicit ResultCache (std::size_t capacity);
+
+      /// \brief Stored result of a problem.
+      /// \param key problem key.
+      /// \param result stored result, if any.
+      /// \param xmul stored multipliers of the argument bounds, if any.
+      /// \return whether the problem was found.
+      bool find (const std::string& key, Result& result,
+                 Function::vector_t& xmul);
+
+      /// \brief Store the result of a problem, dropping the least
+      /// recently used result if the cache is full.
+      /// \param key problem key.
+      /// \param tokens identifiers of the functions of the problem (see
+      /// invalidate).
+      /// \param result result of the problem.
+      /// \param xmul multipliers of the argument bounds at the result.
+      void insert (const std::string& key,
+                   const std::vector<std::string>& tokens,
+                   const Result& result, const Function::vector_t& xmul);
+
+      /// \brief Drop the results of the problems using a function, e.g.
+      /// after the data it depends on changed.
+      /// \param token function identifier (see
+      /// MemoizedEvaluation::memoKey).
+      void invalidate (const std::string& token);
+
+      /// \brief Drop all the results.
+      void clear ();
+
+      /// \brief Number of stored results.
+      std::size_t size () const;
+
+    private:
+      struct Entry
+      {
+        boost::uint64_t hash;
+        std::string key;
+        std::vector<std::string> tokens;
+        Result result;
+        Function::vector_t xmul;
+      };
+
+      /// \brief Entries, most recently used first.
+      typedef std::list<Entry> entries_t;
+
+      /// \brief Entries by key hash.
+      typedef std::map<boost::uint64_t, entries_t::iterator> index_t;
+
+      std::size_t capacity_;
+      entries_t entries_;
+      index_t index_;
+      mutable boost::mutex mutex_;
+    };
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_RESULT_CACHE_HH
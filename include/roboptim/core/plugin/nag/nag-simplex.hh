@@ -23,6 +23,8 @@
 # include <roboptim/core/solver.hh>
 # include <roboptim/core/differentiable-function.hh>
 
+# include "roboptim/core/plugin/nag/nag-cancellation.hh"
+
 namespace roboptim
 {
   namespace nag
@@ -86,6 +88,15 @@ namespace roboptim
         return solverState_;
       }
 
+      /// \brief Cancellation handle of this solver.
+      ///
+      /// The handle can be copied and signalled from another thread to
+      /// stop a running solve.
+      const nagCancellationToken_t& cancellationToken () const
+      {
+        return cancellationToken_;
+      }
+
     private:
       /// \brief Lower bound.
       std::vector<double> a_;
@@ -103,6 +114,9 @@ namespace roboptim
 
       /// \brief Current solver state used by callback.
       solverState_t solverState_;
+
+      /// \brief Cancellation handle polled by the NAG callback.
+      nagCancellationToken_t cancellationToken_;
     };
 
     /// @}
@@ -0,0 +1,147 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_SOLVER_POOL_HH
+# define ROBOPTIM_CORE_NAG_SOLVER_POOL_HH
+
+# include <cstddef>
+# include <map>
+# include <string>
+
+# include <boost/format.hpp>
+# include <boost/noncopyable.hpp>
+# include <boost/shared_ptr.hpp>
+# include <boost/thread/locks.hpp>
+# include <boost/thread/mutex.hpp>
+
+# include "roboptim/core/plugin/nag/nag-nlp-sparse.hh"
+
+namespace roboptim
+{
+  namespace nag
+  {
+    /// \brief Sparse solvers for a stream of problems, e.g. the
+    /// requests of a service.
+    ///
+    /// Solvers are created directly, without going through the plug-in
+    /// loader, and configured with the parameters of the pool. The
+    /// sparsity patterns found for a problem are kept, keyed by the
+    /// names and sizes of its functions, and shared with the solvers of
+    /// the next problems with the same key (see
+    /// NagSolverNlpSparse::shareStructure). A problem whose Jacobians do
+    /// not fit the shared patterns is solved again with its own.
+    ///
+    /// A solver is bound to its problem, so solvers are not reused:
+    /// each checkout still runs the solver constructor, which sets up
+    /// the parameters again before the pool ones are copied. What is
+    /// saved is the search for the sparsity patterns, which samples
+    /// the Jacobians. The pool can be used from several threads.
+    ///
+    /// Code using the pool links the roboptim-core-nag-common library
+    /// (see the pkg-config file), which defines the solvers.
+    class SolverPool : private boost::noncopyable
+    {
+    public:
+      typedef NagSolverNlpSparse solver_t;
+      typedef solver_t::problem_t problem_t;
+      typedef solver_t::parameters_t parameters_t;
+
+      /// \brief Create a pool.
+      /// \param parameters parameters of the solvers, e.g. those of a
+      /// configured solver.
+      explicit SolverPool (const parameters_t& parameters)
+        : parameters_ (parameters)
+      {
+      }
+
+      /// \brief Solver of a problem, configured and sharing the
+      /// sparsity patterns known for its structure.
+      ///
+      /// \param problem problem, must outlive the solver.
+      boost::shared_ptr<solver_t> checkout (const problem_t& problem)
+      {
+        boost::shared_ptr<solver_t> solver (new solver_t (problem));
+        solver->parameters () = parameters_;
+
+        std::string key = structureKey (problem);
+        boost::lock_guard<boost::mutex> lock (mutex_);
+        structures_t::const_iterator it = structures_.find (key);
+        if (it != structures_.end ()) solver->shareStructure (it->second);
+        return solver;
+      }
+
+      /// \brief Keep the sparsity patterns found by a solver once it
+      /// has solved its problem.
+      /// \param solver solver given by checkout.
+      void release (const solver_t& solver)
+      {
+        if (!solver.structure ()) return;
+
+        std::string key = structureKey (solver.problem ());
+        boost::lock_guard<boost::mutex> lock (mutex_);
+        structures_[key] = solver.structure ();
+      }
+
+      /// \brief Number of structures whose patterns are known.
+      std::size_t size () const
+      {
+        boost::lock_guard<boost::mutex> lock (mutex_);
+        return structures_.size ();
+      }
+
+      /// \brief Forget the known sparsity patterns.
+      void clear ()
+      {
+        boost::lock_guard<boost::mutex> lock (mutex_);
+        structures_.clear ();
+      }
+
+    private:
+      typedef std::map<std::string, solver_t::structurePtr_t> structures_t;
+
+      /// \brief Names and sizes of the functions of a problem: patterns
+      /// are only shared by problems with the same key. The sparsity of
+      /// the Jacobians is not part of it, it is checked by the solvers
+      /// as they evaluate them.
+      static std::string structureKey (const problem_t& problem)
+      {
+        std::string key =
+          (boost::format ("%1% %2% %3%\n") % problem.function ().inputSize () %
+           problem.function ().getName () % problem.function ().outputSize ())
+            .str ();
+        for (std::size_t i = 0; i < problem.constraints ().size (); ++i)
+        {
+          const problem_t::function_t& g = *problem.constraints ()[i];
+          key += (boost::format ("%1% %2%\n") % g.getName () %
+                  g.outputSize ())
+                   .str ();
+        }
+        return key;
+      }
+
+      /// \brief Parameters of the solvers.
+      const parameters_t parameters_;
+
+      /// \brief Known sparsity patterns, by structure key.
+      structures_t structures_;
+
+      mutable boost::mutex mutex_;
+    };
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_SOLVER_POOL_HH
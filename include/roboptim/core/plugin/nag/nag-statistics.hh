@@ -0,0 +1,114 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_STATISTICS_HH
+# define ROBOPTIM_CORE_NAG_STATISTICS_HH
+
+# include <string>
+
+# include <roboptim/core/portability.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    /// \brief Statistics of the last solve.
+    struct Statistics
+    {
+      Statistics ()
+      {
+        reset ();
+      }
+
+      /// \brief Reset all the counters.
+      void reset ()
+      {
+        evaluations = 0;
+        derivativeEvaluations = 0;
+        majorIterations = -1;
+        setupTime = 0.;
+        solveTime = 0.;
+        wallTime = 0.;
+        callbackTime = 0.;
+        nonZeros = 0;
+      }
+
+      /// \brief Number of callbacks requesting function values.
+      long evaluations;
+
+      /// \brief Number of callbacks requesting derivatives.
+      long derivativeEvaluations;
+
+      /// \brief Number of major iterations (-1 if not reported by NAG).
+      long majorIterations;
+
+      /// \brief Time spent preparing NAG data, in seconds.
+      double setupTime;
+
+      /// \brief Time spent in the NAG solver, in seconds.
+      double solveTime;
+
+      /// \brief Total time spent in solve (), in seconds.
+      double wallTime;
+
+      /// \brief Time spent in the NAG callbacks, in seconds.
+      double callbackTime;
+
+      /// \brief Number of structural nonzeros of the constraint
+      /// Jacobian given to NAG (cost included).
+      long nonZeros;
+    };
+
+    /// \brief Add the lifetime of this object to a time counter.
+    class ROBOPTIM_DLLEXPORT ScopedTimer
+    {
+    public:
+      explicit ScopedTimer (double& counter);
+      ~ScopedTimer ();
+
+    private:
+      double& counter_;
+      double start_;
+    };
+
+    /// \brief Monotonic clock, in seconds.
+    ROBOPTIM_DLLEXPORT double now ();
+
+    /// \brief Append statistics to the benchmark results file.
+    ///
+    /// Nothing is done unless the ROBOPTIM_NAG_STATS_FILE environment
+    /// variable is set. One CSV line is appended to that file per call:
+    /// program, solver, problem, n, nf, nonzeros, success, setup time,
+    /// solve time, wall time, callback time, evaluations, derivative
+    /// evaluations, major iterations and peak resident memory of the
+    /// process (in KiB). The program is the value of the
+    /// ROBOPTIM_NAG_STATS_PROGRAM environment variable, if any.
+    ///
+    /// \param solver solver name.
+    /// \param problem problem name.
+    /// \param n number of variables.
+    /// \param nf number of constraint rows.
+    /// \param success whether the solve succeeded.
+    /// \param stats solve statistics.
+    ROBOPTIM_DLLEXPORT void
+    appendStatistics (const std::string& solver,
+                      const std::string& problem, long n, long nf,
+                      bool success, const Statistics& stats);
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_STATISTICS_HH
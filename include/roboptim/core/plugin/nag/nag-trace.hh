@@ -0,0 +1,125 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_NAG_TRACE_HH
+# define ROBOPTIM_CORE_NAG_TRACE_HH
+
+# include <string>
+# include <vector>
+
+# include <boost/cstdint.hpp>
+# include <boost/noncopyable.hpp>
+
+# include <roboptim/core/portability.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    /// \brief Header of a trace file.
+    ///
+    /// A trace file is made of this header followed by capacity
+    /// fixed-size records used as a ring buffer. Each record is laid
+    /// out as:
+    ///
+    /// - boost::uint64_t sequence,
+    /// - boost::uint64_t iteration,
+    /// - double objective,
+    /// - double constraint violation (sum of the violations of the
+    ///   variable and constraint bounds),
+    /// - double step (Euclidean norm of x - previous x),
+    /// - double x[n],
+    /// - double multipliers[m] (NaN when not available).
+    ///
+    /// Records are published with a sequence lock: the sequence is odd
+    /// while a record is written and becomes 2 * (iteration + 1) once it
+    /// is complete. A reader copies a record and keeps it only if the
+    /// sequence was even and unchanged before and after the copy. The
+    /// count field is the number of records published so far.
+    struct TraceHeader
+    {
+      /// \brief File magic: "RONAGTRC".
+      char magic[8];
+      /// \brief Format version.
+      boost::uint32_t version;
+      /// \brief Size of this header, in bytes.
+      boost::uint32_t headerSize;
+      /// \brief Size of a record, in bytes.
+      boost::uint64_t recordSize;
+      /// \brief Number of records in the ring buffer.
+      boost::uint64_t capacity;
+      /// \brief Number of variables.
+      boost::uint64_t n;
+      /// \brief Number of multipliers.
+      boost::uint64_t m;
+      /// \brief Number of records published so far.
+      volatile boost::uint64_t count;
+    };
+
+    /// \brief Binary per-iteration trace writer.
+    ///
+    /// Records are written into a memory-mapped file so that an
+    /// external tool can follow the solve while it runs, without any
+    /// system call or lock on the solver side.
+    class ROBOPTIM_DLLEXPORT Trace : private boost::noncopyable
+    {
+    public:
+      /// \brief Create (or truncate) a trace file.
+      /// \param filename trace file.
+      /// \param capacity number of records kept in the ring buffer.
+      /// \param n number of variables.
+      /// \param m number of multipliers.
+      /// \throw std::runtime_error if the file cannot be mapped.
+      Trace (const std::string& filename, std::size_t capacity, std::size_t n,
+             std::size_t m);
+
+      ~Trace ();
+
+      /// \brief Append a record.
+      /// \param objective objective value.
+      /// \param violation constraint violation.
+      /// \param x current point (n values).
+      /// \param multipliers multipliers (m values), or null if unknown.
+      void record (double objective, double violation, const double* x,
+                   const double* multipliers);
+
+      /// \brief Trace file name.
+      const std::string& filename () const
+      {
+        return filename_;
+      }
+
+    private:
+      /// \brief Trace file name.
+      std::string filename_;
+      /// \brief File descriptor.
+      int fd_;
+      /// \brief Mapped memory.
+      char* data_;
+      /// \brief Mapped size, in bytes.
+      std::size_t size_;
+      /// \brief Mapped header.
+      TraceHeader* header_;
+      /// \brief Previous point, used to compute the step.
+      std::vector<double> previous_;
+      /// \brief Number of records written so far.
+      boost::uint64_t iteration_;
+    };
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_NAG_TRACE_HH
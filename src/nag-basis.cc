@@ -0,0 +1,139 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+#include <roboptim/core/plugin/nag/nag-basis.hh>
+#include <roboptim/core/plugin/nag/nag-pattern-cache.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace
+    {
+      static const boost::uint32_t basisVersion = 1;
+
+      void throwSystemError (const std::string& what)
+      {
+        throw std::runtime_error (
+          (boost::format ("%s: %s") % what % std::strerror (errno)).str ());
+      }
+
+      template <typename T>
+      bool read (std::FILE* file, std::vector<T>& v, std::size_t size)
+      {
+        v.resize (size);
+        return size == 0 || std::fread (&v[0], sizeof (T), size, file) == size;
+      }
+
+      template <typename T>
+      void write (std::FILE* file, const std::vector<T>& v)
+      {
+        if (!v.empty () &&
+            std::fwrite (&v[0], sizeof (T), v.size (), file) != v.size ())
+          throwSystemError ("failed to write basis");
+      }
+    } // end of anonymous namespace
+
+    bool loadBasis (const std::string& filename, const std::string& signature,
+                    Basis& basis)
+    {
+      std::FILE* file = std::fopen (filename.c_str (), "rb");
+      if (!file) return false;
+
+      BasisHeader header;
+      bool valid =
+        std::fread (&header, sizeof (header), 1, file) == 1 &&
+        std::memcmp (header.magic, "RONAGBAS", sizeof (header.magic)) == 0 &&
+        header.version == basisVersion &&
+        header.headerSize == sizeof (BasisHeader) &&
+        header.integerSize == sizeof (Integer) &&
+        header.signatureHash == hashSignature (signature);
+
+      if (valid)
+      {
+        std::size_t n = static_cast<std::size_t> (header.n);
+        std::size_t nf = static_cast<std::size_t> (header.nf);
+
+        valid = read (file, basis.x, n) && read (file, basis.xmul, n) &&
+                read (file, basis.f, nf) && read (file, basis.fmul, nf) &&
+                read (file, basis.xstate, n) && read (file, basis.fstate, nf) &&
+                std::fgetc (file) == EOF;
+        basis.ns = static_cast<Integer> (header.ns);
+      }
+
+      std::fclose (file);
+      return valid;
+    }
+
+    void saveBasis (const std::string& filename, const std::string& signature,
+                    const Basis& basis)
+    {
+      BasisHeader header;
+      std::memset (&header, 0, sizeof (BasisHeader));
+      std::memcpy (header.magic, "RONAGBAS", sizeof (header.magic));
+      header.version = basisVersion;
+      header.headerSize = sizeof (BasisHeader);
+      header.integerSize = sizeof (Integer);
+      header.signatureHash = hashSignature (signature);
+      header.n = basis.x.size ();
+      header.nf = basis.f.size ();
+      header.ns = basis.ns;
+
+      std::string temporary =
+        (boost::format ("%s.%d.tmp") % filename % ::getpid ()).str ();
+      std::FILE* file = std::fopen (temporary.c_str (), "wb");
+      if (!file) throwSystemError ("failed to open " + temporary);
+
+      try
+      {
+        if (std::fwrite (&header, sizeof (header), 1, file) != 1)
+          throwSystemError ("failed to write basis");
+        write (file, basis.x);
+        write (file, basis.xmul);
+        write (file, basis.f);
+        write (file, basis.fmul);
+        write (file, basis.xstate);
+        write (file, basis.fstate);
+
+        if (std::fclose (file) != 0)
+        {
+          file = 0;
+          throwSystemError ("failed to write basis");
+        }
+        file = 0;
+
+        if (std::rename (temporary.c_str (), filename.c_str ()) != 0)
+          throwSystemError ("failed to rename " + temporary);
+      }
+      catch (...)
+      {
+        if (file) std::fclose (file);
+        std::remove (temporary.c_str ());
+        throw;
+      }
+    }
+  } // end of namespace nag.
+} // end of namespace roboptim.
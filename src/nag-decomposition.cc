@@ -0,0 +1,236 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <roboptim/core/plugin/nag/nag-decomposition.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace
+    {
+      /// \brief Disjoint sets of variables.
+      class DisjointSets
+      {
+      public:
+        explicit DisjointSets (std::size_t size) : parent_ (size)
+        {
+          for (std::size_t i = 0; i < size; ++i) parent_[i] = i;
+        }
+
+        std::size_t find (std::size_t i)
+        {
+          while (parent_[i] != i)
+          {
+            parent_[i] = parent_[parent_[i]];
+            i = parent_[i];
+          }
+          return i;
+        }
+
+        void unite (std::size_t i, std::size_t j)
+        {
+          i = find (i);
+          j = find (j);
+          // The smallest variable is the root, so that roots are met
+          // in increasing order.
+          if (i < j)
+            parent_[j] = i;
+          else
+            parent_[i] = j;
+        }
+
+      private:
+        std::vector<std::size_t> parent_;
+      };
+
+      /// \brief Link the variables of each row of a sparse matrix.
+      void linkRows (const Integer* rows, const Integer* columns,
+                     Integer size, Integer skippedRow,
+                     std::vector<std::size_t>& first, std::vector<bool>& used,
+                     DisjointSets& sets)
+      {
+        const std::size_t none = used.size ();
+        for (Integer k = 0; k < size; ++k)
+        {
+          if (rows[k] == skippedRow) continue;
+
+          std::size_t row = static_cast<std::size_t> (rows[k] - 1);
+          std::size_t column = static_cast<std::size_t> (columns[k] - 1);
+          if (first[row] == none)
+            first[row] = column;
+          else
+            sets.unite (first[row], column);
+          used[column] = true;
+        }
+      }
+    } // end of anonymous namespace
+
+    void decompose (Integer n, Integer nf, const Integer* iafun,
+                    const Integer* javar, Integer nea, const Integer* igfun,
+                    const Integer* jgvar, Integer neg, Integer objrow,
+                    Decomposition& decomposition)
+    {
+      const std::size_t variables = static_cast<std::size_t> (n);
+      const std::size_t rows = static_cast<std::size_t> (nf);
+
+      // First variable of each row, the others are linked to it.
+      std::vector<std::size_t> first (rows, variables);
+      std::vector<bool> used (variables, false);
+      DisjointSets sets (variables);
+
+      linkRows (iafun, javar, nea, objrow > 0 ? objrow : -1, first, used,
+                sets);
+      linkRows (igfun, jgvar, neg, -1, first, used, sets);
+
+      // Variables without rows are gathered in a single block.
+      std::size_t unused = variables;
+      for (std::size_t i = 0; i < variables; ++i)
+        if (!used[i])
+        {
+          if (unused == variables)
+            unused = i;
+          else
+            sets.unite (unused, i);
+        }
+
+      decomposition.blocks = 0;
+      decomposition.variableBlock.assign (variables, 0);
+      std::vector<std::size_t> rootBlock (variables, variables);
+      for (std::size_t i = 0; i < variables; ++i)
+      {
+        std::size_t root = sets.find (i);
+        if (rootBlock[root] == variables)
+          rootBlock[root] = decomposition.blocks++;
+        decomposition.variableBlock[i] = rootBlock[root];
+      }
+
+      decomposition.rowBlock.assign (rows, 0);
+      for (std::size_t r = 0; r < rows; ++r)
+        if (first[r] != variables)
+          decomposition.rowBlock[r] = decomposition.variableBlock[first[r]];
+    }
+
+    sparseMatrix_t
+    subMatrix (const sparseMatrix_t& m,
+               const std::vector<Function::size_type>& rows,
+               const std::vector<Function::size_type>& columnIndex,
+               Function::size_type columns)
+    {
+      typedef Eigen::Triplet<double> triplet_t;
+      std::vector<triplet_t> triplets;
+
+      for (std::size_t i = 0; i < rows.size (); ++i)
+        for (sparseMatrix_t::InnerIterator it (m, rows[i]); it; ++it)
+        {
+          Function::size_type column =
+            columnIndex[static_cast<std::size_t> (it.col ())];
+          if (column >= 0)
+            triplets.push_back (triplet_t (static_cast<int> (i),
+                                           static_cast<int> (column),
+                                           it.value ()));
+        }
+
+      sparseMatrix_t res (static_cast<sparseMatrix_t::Index> (rows.size ()),
+                          columns);
+      res.setFromTriplets (triplets.begin (), triplets.end ());
+      return res;
+    }
+
+    BlockFunction::BlockFunction (const differentiableFunction_t& f,
+                                  const std::vector<size_type>& rows,
+                                  const std::vector<size_type>& columns,
+                                  const vector_t& x)
+      : differentiableFunction_t (static_cast<size_type> (columns.size ()),
+                                  static_cast<size_type> (rows.size ()),
+                                  f.getName () + " (block)"),
+        function_ (f),
+        fused_ (fusedEvaluation (f)),
+        rows_ (rows),
+        columns_ (columns),
+        columnIndex_ (static_cast<std::size_t> (f.inputSize ()), -1),
+        x_ (x),
+        value_ (f.outputSize ()),
+        jacobian_ (f.outputSize (), f.inputSize ())
+    {
+      for (std::size_t i = 0; i < columns_.size (); ++i)
+        columnIndex_[static_cast<std::size_t> (columns_[i])] =
+          static_cast<size_type> (i);
+    }
+
+    void BlockFunction::scatter (const_argument_ref x) const
+    {
+      for (std::size_t i = 0; i < columns_.size (); ++i)
+        x_[columns_[i]] = x[static_cast<size_type> (i)];
+    }
+
+    void BlockFunction::valueAndJacobian (result_ref result,
+                                          jacobian_ref jacobian,
+                                          const_argument_ref x) const
+    {
+      if (!fused_)
+      {
+        impl_compute (result, x);
+        impl_jacobian (jacobian, x);
+        return;
+      }
+
+      scatter (x);
+      fused_->valueAndJacobian (value_, jacobian_, x_);
+      for (std::size_t i = 0; i < rows_.size (); ++i)
+        result[static_cast<size_type> (i)] = value_[rows_[i]];
+      jacobian = subMatrix (jacobian_, rows_, columnIndex_, inputSize ());
+    }
+
+    void BlockFunction::impl_compute (result_ref result,
+                                      const_argument_ref x) const
+    {
+      scatter (x);
+      function_ (value_, x_);
+      for (std::size_t i = 0; i < rows_.size (); ++i)
+        result[static_cast<size_type> (i)] = value_[rows_[i]];
+    }
+
+    void BlockFunction::impl_gradient (gradient_ref gradient,
+                                       const_argument_ref x,
+                                       size_type functionId) const
+    {
+      scatter (x);
+      gradient_t g = function_.gradient (
+        x_, rows_[static_cast<std::size_t> (functionId)]);
+
+      gradient.resize (inputSize ());
+      gradient.setZero ();
+      for (gradient_t::InnerIterator it (g); it; ++it)
+      {
+        size_type column = columnIndex_[static_cast<std::size_t> (it.index ())];
+        if (column >= 0) gradient.coeffRef (column) = it.value ();
+      }
+    }
+
+    void BlockFunction::impl_jacobian (jacobian_ref jacobian,
+                                       const_argument_ref x) const
+    {
+      scatter (x);
+      function_.jacobian (jacobian_, x_);
+
+      // Entries of other variables are outside of the sparsity pattern
+      // of the problem, they are dropped.
+      jacobian = subMatrix (jacobian_, rows_, columnIndex_, inputSize ());
+    }
+  } // end of namespace nag.
+} // end of namespace roboptim.
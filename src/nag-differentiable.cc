@@ -48,6 +48,13 @@ namespace roboptim
         static_cast<NagSolverDifferentiable*> (comm->p);
       assert (!!solver);
 
+      // Request termination if the solve has been cancelled.
+      if (solver->cancellationToken ()->isCancelled ())
+      {
+        comm->flag = -1;
+        return;
+      }
+
       const Eigen::Map<const function_t::argument_t> x_ (&xc, 1);
       Eigen::Map<function_t::result_t> fc_ (
         fc, solver->problem ().function ().outputSize ());
@@ -81,7 +88,8 @@ namespace roboptim
       f_ (problem ().function ().outputSize ()),
       g_ (problem ().function ().inputSize ()),
       callback_ (),
-      solverState_ (pb)
+      solverState_ (pb),
+      cancellationToken_ (new NagCancellationToken ())
   {
     if (pb.function ().inputSize () != 1)
       throw std::runtime_error (
@@ -0,0 +1,304 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+#include <roboptim/core/plugin/nag/nag-evaluation-store.hh>
+#include <roboptim/core/plugin/nag/nag-pattern-cache.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace
+    {
+      static const boost::uint32_t evaluationStoreVersion = 1;
+
+      /// \brief Fields of a record before the key.
+      static const std::size_t recordHeader = 3;
+
+      void throwSystemError (const std::string& what)
+      {
+        throw std::runtime_error (
+          (boost::format ("%s: %s") % what % std::strerror (errno)).str ());
+      }
+
+      /// \brief Round a size up to a multiple of 8 bytes.
+      std::size_t align (std::size_t size)
+      {
+        return (size + 7) & ~static_cast<std::size_t> (7);
+      }
+
+      /// \brief Exclusive lock on a file, for the current scope.
+      class FileLock
+      {
+      public:
+        explicit FileLock (int fd) : fd_ (fd)
+        {
+          while (::flock (fd_, LOCK_EX) != 0)
+            if (errno != EINTR) throwSystemError ("failed to lock store");
+        }
+
+        ~FileLock ()
+        {
+          ::flock (fd_, LOCK_UN);
+        }
+
+      private:
+        int fd_;
+      };
+
+      boost::uint64_t* fields (char* record)
+      {
+        return reinterpret_cast<boost::uint64_t*> (record);
+      }
+
+      enum Part
+      {
+        VALUE = 1,
+        JACOBIAN = 2
+      };
+    } // end of anonymous namespace
+
+    EvaluationStore::EvaluationStore (const std::string& filename,
+                                      const std::string& signature,
+                                      std::size_t inputSize,
+                                      std::size_t valueSize,
+                                      std::size_t jacobianSize,
+                                      std::size_t capacity, double quantum)
+      : fd_ (-1),
+        map_ (0),
+        mapSize_ (0),
+        header_ (0),
+        records_ (0),
+        recordSize_ (sizeof (boost::uint64_t) *
+                     (recordHeader + inputSize + valueSize + jacobianSize)),
+        inputSize_ (inputSize),
+        valueSize_ (valueSize),
+        jacobianSize_ (jacobianSize),
+        quantum_ (quantum),
+        key_ (inputSize),
+        hash_ (0)
+    {
+      fd_ = ::open (filename.c_str (), O_RDWR | O_CREAT, 0644);
+      if (fd_ < 0) throwSystemError ("failed to open " + filename);
+
+      try
+      {
+        FileLock lock (fd_);
+        const std::size_t offset =
+          sizeof (EvaluationStoreHeader) + align (signature.size ());
+
+        EvaluationStoreHeader header;
+        std::vector<char> fileSignature (signature.size ());
+        struct stat st;
+        bool valid =
+          ::fstat (fd_, &st) == 0 &&
+          static_cast<std::size_t> (st.st_size) >= offset &&
+          ::pread (fd_, &header, sizeof (header), 0) ==
+            static_cast<ssize_t> (sizeof (header)) &&
+          std::memcmp (header.magic, "RONAGEVL", sizeof (header.magic)) == 0 &&
+          header.version == evaluationStoreVersion &&
+          header.headerSize == sizeof (EvaluationStoreHeader) &&
+          header.signatureHash == hashSignature (signature) &&
+          header.signatureSize == signature.size () &&
+          header.inputSize == inputSize &&
+          header.valueSize == valueSize &&
+          header.jacobianSize == jacobianSize &&
+          header.capacity > 0 && header.capacity % evaluationStoreWays == 0 &&
+          static_cast<std::size_t> (st.st_size) ==
+            offset + header.capacity * recordSize_ &&
+          (signature.empty () ||
+           (::pread (fd_, &fileSignature[0], signature.size (),
+                     sizeof (header)) ==
+              static_cast<ssize_t> (signature.size ()) &&
+            signature.compare (0, signature.size (), &fileSignature[0],
+                               signature.size ()) == 0));
+
+        if (!valid)
+        {
+          // New (or mismatching) file: empty records.
+          capacity = std::max (capacity, evaluationStoreWays);
+          capacity += (evaluationStoreWays - capacity % evaluationStoreWays) %
+                      evaluationStoreWays;
+
+          std::memset (&header, 0, sizeof (EvaluationStoreHeader));
+          std::memcpy (header.magic, "RONAGEVL", sizeof (header.magic));
+          header.version = evaluationStoreVersion;
+          header.headerSize = sizeof (EvaluationStoreHeader);
+          header.signatureHash = hashSignature (signature);
+          header.signatureSize = signature.size ();
+          header.inputSize = inputSize;
+          header.valueSize = valueSize;
+          header.jacobianSize = jacobianSize;
+          header.capacity = capacity;
+
+          std::vector<char> data (offset, 0);
+          std::memcpy (&data[0], &header, sizeof (header));
+          std::copy (signature.begin (), signature.end (),
+                     data.begin () + sizeof (header));
+
+          if (::ftruncate (fd_, 0) != 0 ||
+              ::ftruncate (fd_, static_cast<off_t> (
+                                  offset + capacity * recordSize_)) != 0 ||
+              ::pwrite (fd_, &data[0], offset, 0) !=
+                static_cast<ssize_t> (offset))
+            throwSystemError ("failed to write " + filename);
+        }
+        else
+          capacity = static_cast<std::size_t> (header.capacity);
+
+        mapSize_ = offset + capacity * recordSize_;
+        void* map =
+          ::mmap (0, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED) throwSystemError ("failed to map " + filename);
+
+        map_ = static_cast<char*> (map);
+        header_ = reinterpret_cast<EvaluationStoreHeader*> (map_);
+        records_ = map_ + offset;
+      }
+      catch (...)
+      {
+        ::close (fd_);
+        throw;
+      }
+    }
+
+    EvaluationStore::~EvaluationStore ()
+    {
+      ::munmap (map_, mapSize_);
+      ::close (fd_);
+    }
+
+    void EvaluationStore::computeKey (const double* x)
+    {
+      for (std::size_t i = 0; i < inputSize_; ++i)
+        if (quantum_ > 0.)
+          key_[i] =
+            static_cast<boost::int64_t> (std::floor (x[i] / quantum_ + .5));
+        else
+        {
+          // -0 and 0 are the same point.
+          double xi = x[i] == 0. ? 0. : x[i];
+          std::memcpy (&key_[i], &xi, sizeof (double));
+        }
+
+      // 64-bit FNV-1a hash of the key.
+      const unsigned char* data =
+        reinterpret_cast<const unsigned char*> (key_.empty () ? 0 : &key_[0]);
+      hash_ = 14695981039346656037ULL;
+      for (std::size_t i = 0; i < inputSize_ * sizeof (boost::int64_t); ++i)
+      {
+        hash_ ^= data[i];
+        hash_ *= 1099511628211ULL;
+      }
+    }
+
+    char* EvaluationStore::find (bool insert)
+    {
+      const std::size_t sets =
+        static_cast<std::size_t> (header_->capacity) / evaluationStoreWays;
+      char* set = records_ + static_cast<std::size_t> (hash_ % sets) *
+                               evaluationStoreWays * recordSize_;
+      const std::size_t keySize = inputSize_ * sizeof (boost::int64_t);
+
+      char* oldest = set;
+      for (std::size_t w = 0; w < evaluationStoreWays; ++w)
+      {
+        char* record = set + w * recordSize_;
+        boost::uint64_t* f = fields (record);
+        if (f[1] != 0 && f[0] == hash_ &&
+            (keySize == 0 ||
+             std::memcmp (f + recordHeader, &key_[0], keySize) == 0))
+          return record;
+        if (f[1] < fields (oldest)[1]) oldest = record;
+      }
+      if (!insert) return 0;
+
+      // Least recently used (or empty) record of the set.
+      boost::uint64_t* f = fields (oldest);
+      f[0] = hash_;
+      f[2] = 0;
+      if (keySize > 0) std::memcpy (f + recordHeader, &key_[0], keySize);
+      return oldest;
+    }
+
+    bool EvaluationStore::recall (const double* x, double* value,
+                                  double* jacobian)
+    {
+      computeKey (x);
+
+      FileLock lock (fd_);
+      char* record = find (false);
+      if (!record) return false;
+
+      boost::uint64_t* f = fields (record);
+      if ((value && !(f[2] & VALUE)) || (jacobian && !(f[2] & JACOBIAN)))
+        return false;
+
+      const double* data =
+        reinterpret_cast<const double*> (f + recordHeader + inputSize_);
+      if (value) std::copy (data, data + valueSize_, value);
+      if (jacobian)
+        std::copy (data + valueSize_, data + valueSize_ + jacobianSize_,
+                   jacobian);
+      f[1] = ++header_->clock;
+      return true;
+    }
+
+    void EvaluationStore::record (const double* x, const double* value,
+                                  const double* jacobian)
+    {
+      computeKey (x);
+
+      FileLock lock (fd_);
+      boost::uint64_t* f = fields (find (true));
+      double* data = reinterpret_cast<double*> (f + recordHeader + inputSize_);
+      if (value)
+      {
+        std::copy (value, value + valueSize_, data);
+        f[2] |= VALUE;
+      }
+      if (jacobian)
+      {
+        std::copy (jacobian, jacobian + jacobianSize_, data + valueSize_);
+        f[2] |= JACOBIAN;
+      }
+      f[1] = ++header_->clock;
+    }
+
+    std::string evaluationStoreFile (const std::string& directory,
+                                     const std::string& signature)
+    {
+      return (boost::format ("%s/%016x.evaluations") % directory %
+              hashSignature (signature))
+        .str ();
+    }
+  } // end of namespace nag.
+} // end of namespace roboptim.
@@ -0,0 +1,192 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+#include <nag.h>
+#include <nagx04.h>
+
+#include <roboptim/core/plugin/nag/nag-log-sink.hh>
+
+namespace roboptim
+{
+  namespace
+  {
+    /// \brief Size of the chunks read from the pipe.
+    static const std::size_t chunkSize = 4096;
+
+    void throwSystemError (const std::string& what)
+    {
+      throw std::runtime_error (
+        (boost::format ("%s: %s") % what % std::strerror (errno)).str ());
+    }
+  } // end of anonymous namespace
+
+  NagLogSink::NagLogSink (const std::string& filename, std::size_t capacity)
+    : filename_ (filename),
+      pipeRead_ (-1),
+      output_ (-1),
+      fileId_ (-1),
+      buffer_ (std::max (capacity, chunkSize)),
+      head_ (0),
+      size_ (0),
+      dropped_ (0),
+      eof_ (false),
+      mutex_ (),
+      cond_ (),
+      reader_ (),
+      writer_ ()
+  {
+    output_ = ::open (filename.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (output_ < 0) throwSystemError ("failed to open " + filename);
+
+    int fds[2];
+    if (::pipe (fds) != 0)
+    {
+      ::close (output_);
+      throwSystemError ("failed to create NAG log pipe");
+    }
+    pipeRead_ = fds[0];
+
+    // Let NAG open the write end as a regular file, then release our
+    // own copy: the reader sees the end of the pipe once NAG closes it.
+    NagError fail;
+    std::memset (&fail, 0, sizeof (NagError));
+    INIT_FAIL (fail);
+    std::string path = (boost::format ("/dev/fd/%d") % fds[1]).str ();
+    nag_open_file (path.c_str (), 1, &fileId_, &fail);
+    ::close (fds[1]);
+
+    if (fail.code != NE_NOERROR)
+    {
+      ::close (pipeRead_);
+      ::close (output_);
+      throw std::runtime_error (fail.message);
+    }
+
+    reader_ = boost::thread (&NagLogSink::readLoop, this);
+    writer_ = boost::thread (&NagLogSink::writeLoop, this);
+  }
+
+  NagLogSink::~NagLogSink ()
+  {
+    // Closing the NAG file flushes NAG's buffers into the pipe and
+    // terminates the reader, which in turn terminates the writer.
+    NagError fail;
+    std::memset (&fail, 0, sizeof (NagError));
+    INIT_FAIL (fail);
+    nag_close_file (fileId_, &fail);
+
+    reader_.join ();
+    writer_.join ();
+
+    if (dropped_ > 0)
+    {
+      std::string msg =
+        (boost::format ("\n[roboptim] %d bytes of NAG output dropped\n") %
+         dropped_)
+          .str ();
+      writeAll (msg.c_str (), msg.size ());
+    }
+
+    ::close (pipeRead_);
+    ::close (output_);
+  }
+
+  std::size_t NagLogSink::droppedBytes () const
+  {
+    boost::mutex::scoped_lock lock (mutex_);
+    return dropped_;
+  }
+
+  void NagLogSink::readLoop ()
+  {
+    char chunk[chunkSize];
+
+    for (;;)
+    {
+      ssize_t n = ::read (pipeRead_, chunk, chunkSize);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+
+      std::size_t count = static_cast<std::size_t> (n);
+      {
+        boost::mutex::scoped_lock lock (mutex_);
+
+        // Drop what does not fit rather than blocking NAG.
+        std::size_t accepted = std::min (count, buffer_.size () - size_);
+        for (std::size_t i = 0; i < accepted; ++i)
+          buffer_[(head_ + size_ + i) % buffer_.size ()] = chunk[i];
+        size_ += accepted;
+        dropped_ += count - accepted;
+      }
+      cond_.notify_one ();
+    }
+
+    {
+      boost::mutex::scoped_lock lock (mutex_);
+      eof_ = true;
+    }
+    cond_.notify_one ();
+  }
+
+  void NagLogSink::writeLoop ()
+  {
+    std::vector<char> chunk;
+    chunk.reserve (buffer_.size ());
+
+    for (;;)
+    {
+      {
+        boost::mutex::scoped_lock lock (mutex_);
+        while (size_ == 0 && !eof_) cond_.wait (lock);
+        if (size_ == 0 && eof_) return;
+
+        // Take the contiguous part of the pending data.
+        std::size_t count = std::min (size_, buffer_.size () - head_);
+        chunk.assign (buffer_.begin () + static_cast<std::ptrdiff_t> (head_),
+                      buffer_.begin () +
+                        static_cast<std::ptrdiff_t> (head_ + count));
+        head_ = (head_ + count) % buffer_.size ();
+        size_ -= count;
+      }
+
+      writeAll (&chunk[0], chunk.size ());
+    }
+  }
+
+  void NagLogSink::writeAll (const char* data, std::size_t size)
+  {
+    while (size > 0)
+    {
+      ssize_t n = ::write (output_, data, size);
+      if (n < 0 && errno == EINTR) continue;
+      // Nothing sensible can be done from here: give up on this chunk.
+      if (n <= 0) return;
+      data += n;
+      size -= static_cast<std::size_t> (n);
+    }
+  }
+} // end of namespace roboptim.
@@ -0,0 +1,47 @@
+// Copyright (C) 2013 by Thomas Moulard, AIST, CNRS.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <typeinfo>
+
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+extern "C" {
+typedef roboptim::NagSolverNlpSparse NagSolverNlpSparse;
+typedef roboptim::Solver< ::roboptim::EigenMatrixSparse> solver_t;
+
+ROBOPTIM_DLLEXPORT unsigned getSizeOfProblem ();
+ROBOPTIM_DLLEXPORT const char* getTypeIdOfConstraintsList ();
+ROBOPTIM_DLLEXPORT solver_t* create (const NagSolverNlpSparse::problem_t& pb);
+ROBOPTIM_DLLEXPORT void destroy (solver_t* p);
+
+ROBOPTIM_DLLEXPORT unsigned getSizeOfProblem ()
+{
+  return sizeof (NagSolverNlpSparse::problem_t);
+}
+
+ROBOPTIM_DLLEXPORT const char* getTypeIdOfConstraintsList ()
+{
+  return typeid (NagSolverNlpSparse::problem_t::constraintsList_t).name ();
+}
+
+ROBOPTIM_DLLEXPORT solver_t* create (const NagSolverNlpSparse::problem_t& pb)
+{
+  return new roboptim::NagSolverNlpSparse (pb);
+}
+
+ROBOPTIM_DLLEXPORT void destroy (solver_t* p) { delete p; }
+}
@@ -15,12 +15,22 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <cstring>
+#include <limits>
+#include <map>
 #include <stdexcept>
+#include <typeinfo>
 
+#include <boost/foreach.hpp>
 #include <boost/format.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
 #include <boost/scoped_ptr.hpp>
+#include <boost/static_assert.hpp>
 
 #include <roboptim/core/debug.hh>
 #include <roboptim/core/differentiable-function.hh>
@@ -28,8 +38,16 @@
 
 #include <nag.h>
 #include <nage04.h>
+#include <nagx04.h>
 
+#include <roboptim/core/plugin/nag/nag-basis.hh>
+#include <roboptim/core/plugin/nag/nag-decomposition.hh>
+#include <roboptim/core/plugin/nag/nag-evaluation-store.hh>
+#include <roboptim/core/plugin/nag/nag-function-hints.hh>
 #include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+#include <roboptim/core/plugin/nag/nag-parallel.hh>
+#include <roboptim/core/plugin/nag/nag-pattern-cache.hh>
+#include <roboptim/core/plugin/nag/nag-result-cache.hh>
 
 #ifdef ROBOPTIM_CORE_PLUGIN_NAG_CHECK_GRADIENT
 #include <roboptim/core/finite-difference-gradient.hh>
@@ -75,12 +93,11 @@ namespace roboptim
   namespace detail
   {
     // Constraints Callback
-    static void usrfun (::Integer* status, ::Integer n, const double x[],
+    static void usrfun (::Integer* status, ::Integer /* n */, const double x[],
                         ::Integer needf, ::Integer nf, double f[],
                         ::Integer needg, ::Integer leng, double g[],
                         Nag_Comm* comm)
     {
-      typedef NagSolverNlpSparse::function_t function_t;
       typedef NagSolverNlpSparse::differentiableFunction_t
         differentiableFunction_t;
       typedef differentiableFunction_t::jacobian_t jacobian_t;
@@ -93,7 +110,18 @@ namespace roboptim
       NagSolverNlpSparse* solver = static_cast<NagSolverNlpSparse*> (comm->p);
       assert (!!solver);
 
-      Eigen::Map<const DifferentiableFunction::argument_t> x_ (x, n);
+      nag::ScopedTimer timer (solver->statistics ().callbackTime);
+
+      // Request termination if the solve has been cancelled.
+      if (solver->cancellationToken ()->isCancelled ())
+      {
+        *status = -2;
+        return;
+      }
+
+      // User functions are evaluated at the unscaled, full-size point.
+      Eigen::Map<const DifferentiableFunction::argument_t> x_ (
+        solver->userArgument (x), solver->problem ().function ().inputSize ());
 
       // WARNING: the real f array is bigger than that but we map only
       // the part corresponding to the cost function.
@@ -102,91 +130,183 @@ namespace roboptim
       typedef NagSolverNlpSparse::problem_t::constraints_t::const_iterator
         iter_t;
 
+      // Jacobians are copied in G following the patterns computed at
+      // setup, in the same order.
+      double* jac = needg > 0 ? solver->jacobianBuffer (g) : 0;
+      jacobian_t j;
+
       // functions computation are needed
       if (needf > 0)
       {
-        // the cost function is evaluated first
-        f_.head<1> () = solver->problem ().function () (x_);
+        ++solver->statistics ().evaluations;
+
+        // When the derivatives are needed too, the functions offering
+        // a fused evaluation compute their Jacobian here.
+        std::size_t functionId = 0;
+        const nag::FusedEvaluation<EigenMatrixSparse>* fused = 0;
+
+        // the cost function is evaluated first, unless it is linear
+        // (stored in A) or constant
+        if (const differentiableFunction_t* obj = solver->objective ())
+        {
+          if (needg > 0) fused = solver->fusedEvaluation (functionId);
+
+          // Memoized evaluations are reused when they are stored.
+          if (!solver->recall (functionId, x_.data (), f, fused ? jac : 0))
+          {
+            if (fused)
+            {
+              j.resize (1, obj->inputSize ());
+              fused->valueAndJacobian (f_.head<1> (), j, x_);
+              checkJacobian (*obj, -1, x_);
+
+              if (!solver->scatterJacobian (functionId, j, jac))
+              {
+                solver->setJacobianError (*obj);
+                *status = -2;
+                return;
+              }
+            }
+            else
+              f_.head<1> () = (*obj) (x_);
+            solver->record (functionId, x_.data (), f, fused ? jac : 0);
+          }
+          ++functionId;
+        }
+        else
+          f_[0] = 0.;
 
         // then the nonlinear constraints
-        unsigned offset = 1;
-        unsigned constraintId = 0;
+        Integer offset = 1;
+        std::size_t constraintId = 0;
 
         for (iter_t it = solver->problem ().constraints ().begin ();
              it != solver->problem ().constraints ().end ();
              ++it, ++constraintId)
         {
-          function_t::result_t res;
-
-          if ((*it)->asType<NagSolverNlpSparse::linearFunction_t> ()) continue;
+          if (!solver->activeConstraint (constraintId) ||
+              solver->linearConstraint (constraintId))
+            continue;
 
-          const NagSolverNlpSparse::nonlinearFunction_t* g =
+          const NagSolverNlpSparse::nonlinearFunction_t* g_ =
             (*it)->castInto<NagSolverNlpSparse::nonlinearFunction_t> ();
-          assert (!!g);
-          f_.segment (offset, g->outputSize ()) = (*g) (x_);
-          offset += static_cast<unsigned> (g->outputSize ());
+          assert (!!g_);
+          if (needg > 0) fused = solver->fusedEvaluation (functionId);
+
+          if (!solver->recall (functionId, x_.data (), f + offset,
+                               fused ? jac : 0))
+          {
+            if (fused)
+            {
+              j.resize (g_->outputSize (), g_->inputSize ());
+              fused->valueAndJacobian (
+                f_.segment (offset, g_->outputSize ()), j, x_);
+              checkJacobian (*g_, static_cast<int> (constraintId), x_);
+
+              if (!solver->scatterJacobian (functionId, j, jac))
+              {
+                solver->setJacobianError (*g_);
+                *status = -2;
+                return;
+              }
+            }
+            else
+              f_.segment (offset, g_->outputSize ()) = (*g_) (x_);
+            solver->record (functionId, x_.data (), f + offset,
+                            fused ? jac : 0);
+          }
+          offset += static_cast<Integer> (g_->outputSize ());
+          ++functionId;
         }
 
         // the linear part is not taken into account but we will
         // have to iterate through linear constraints to fetch
         // their output size to update the offset
+        constraintId = 0;
         for (iter_t it = solver->problem ().constraints ().begin ();
              it != solver->problem ().constraints ().end ();
              ++it, ++constraintId)
         {
-          if (!(*it)->asType<NagSolverNlpSparse::linearFunction_t> ()) continue;
+          if (!solver->activeConstraint (constraintId) ||
+              !solver->linearConstraint (constraintId))
+            continue;
 
-          const NagSolverNlpSparse::linearFunction_t* g =
-            (*it)->castInto<NagSolverNlpSparse::linearFunction_t> ();
-          assert (!!g);
-          offset += static_cast<unsigned> (g->outputSize ());
+          offset += static_cast<Integer> ((*it)->outputSize ());
         }
 
-        assert (offset == nf);
+        // Presolve removes linear rows only.
+        assert (solver->presolved () || offset == nf);
+
+        if (solver->scaled ()) solver->scaleValues (f);
+
+        if (solver->trace ()) solver->traceEvaluation (x, f, 0);
       }
 
       // gradient functions computation are needed
       if (needg > 0)
       {
-        Eigen::Map<DifferentiableFunction::vector_t> g_ (g, leng);
-
-        unsigned offset = 0;
-        jacobian_t j;
-
-        // retrieve objective jacobian
-        const differentiableFunction_t* obj;
-        if (!solver->problem ().function ().asType<differentiableFunction_t> ())
-          throw std::runtime_error (
-            "objective function should be differentiable");
+        ++solver->statistics ().derivativeEvaluations;
 
-        obj =
-          solver->problem ().function ().castInto<differentiableFunction_t> ();
-        j = obj->jacobian (x_);
+        assert (leng >= 1);
 
-        checkJacobian (*obj, -1, x_);
+        // Jacobians already computed with the values are skipped.
+        std::size_t functionId = 0;
 
-        for (int k = 0; k < j.outerSize (); ++k)
-          for (function_t::matrix_t::InnerIterator it (j, k); it; ++it)
-            g_[offset++] = it.value ();
+        // objective jacobian, unless the objective is linear or constant
+        if (const differentiableFunction_t* obj = solver->objective ())
+        {
+          if ((needf <= 0 || !solver->fusedEvaluation (functionId)) &&
+              !solver->recall (functionId, x_.data (), 0, jac))
+          {
+            j = obj->jacobian (x_);
+
+            checkJacobian (*obj, -1, x_);
+
+            if (!solver->scatterJacobian (functionId, j, jac))
+            {
+              solver->setJacobianError (*obj);
+              *status = -2;
+              return;
+            }
+            solver->record (functionId, x_.data (), 0, jac);
+          }
+          ++functionId;
+        }
 
-        function_t::size_type constraintId = 0;
+        std::size_t constraintId = 0;
         for (iter_t it = solver->problem ().constraints ().begin ();
              it != solver->problem ().constraints ().end ();
              ++it, ++constraintId)
         {
-          if (!(*it)->asType<NagSolverNlpSparse::linearFunction_t> ()) continue;
-
-          const NagSolverNlpSparse::nonlinearFunction_t* g =
+          // linear constraints are stored in A.
+          if (!solver->activeConstraint (constraintId) ||
+              solver->linearConstraint (constraintId))
+            continue;
+
+          if ((needf > 0 && solver->fusedEvaluation (functionId)) ||
+              solver->recall (functionId, x_.data (), 0, jac))
+          {
+            ++functionId;
+            continue;
+          }
+
+          const NagSolverNlpSparse::nonlinearFunction_t* g_ =
             (*it)->castInto<NagSolverNlpSparse::nonlinearFunction_t> ();
-          assert (!!g);
-          j = g->jacobian (x_);
-          checkJacobian (*g, constraintId, x_);
-
-          for (int k = 0; k < j.outerSize (); ++k)
-            for (function_t::matrix_t::InnerIterator it (j, k); it; ++it)
-              g_[offset++] = it.value ();
+          assert (!!g_);
+          j = g_->jacobian (x_);
+          checkJacobian (*g_, static_cast<int> (constraintId), x_);
+
+          if (!solver->scatterJacobian (functionId, j, jac))
+          {
+            solver->setJacobianError (*g_);
+            *status = -2;
+            return;
+          }
+          solver->record (functionId++, x_.data (), 0, jac);
         }
-        assert (offset == leng);
+
+        if (solver->presolved ()) solver->gatherJacobian (g);
+        if (solver->scaled ()) solver->scaleJacobian (g);
       }
 
       if (!solver->callback ()) return;
@@ -198,6 +318,7 @@ namespace roboptim
   NagSolverNlpSparse::NagSolverNlpSparse (const problem_t& pb)
     : parent_t (pb),
       nf_ (),
+      nfNonlinear_ (),
       n_ (pb.function ().inputSize ()),
       nxname_ (),
       nfname_ (),
@@ -205,6 +326,7 @@ namespace roboptim
       objadd_ (0.),
       // object function is always the first one
       objrow_ (1),
+      objective_ (),
       prob_ (),
       iafun_ (),
       javar_ (),
@@ -215,6 +337,10 @@ namespace roboptim
       jgvar_ (),
       leng_ (),
       neg_ (),
+      patterns_ (),
+      fused_ (),
+      samplePoints_ (),
+      jacobianError_ (),
       xlow_ (),
       xupp_ (),
       xnames_ (),
@@ -230,12 +356,123 @@ namespace roboptim
       ninf_ (0.),
       sinf_ (0.),
       callback_ (),
-      solverState_ (pb)
+      solverState_ (pb),
+      traceF_ (),
+      warmStart_ (),
+      structure_ (),
+      sharedStructure_ (),
+      memo_ (),
+      resultCache_ (),
+      lazy_ (),
+      active_ (),
+      affine_ (),
+      affineConstants_ (),
+      scaled_ (false),
+      rowScales_ (),
+      columnScales_ (),
+      jacobianScales_ (),
+      unscaledX_ (),
+      traceX_ (),
+      traceMultipliers_ (),
+      presolved_ (false),
+      fullX_ (),
+      variables_ (),
+      rows_ (),
+      jacobianMap_ (),
+      fullJacobian_ (),
+      fullIafun_ (),
+      fullJavar_ (),
+      fullA_ (),
+      fullIgfun_ (),
+      fullJgvar_ (),
+      fullXlow_ (),
+      fullXupp_ (),
+      fullFlow_ (),
+      fullFupp_ (),
+      variableLowerSources_ (),
+      variableUpperSources_ (),
+      rowLowerSources_ (),
+      rowUpperSources_ ()
   {
     initializeParameters ();
+
+    // Sparse solver specific.
+    DEFINE_PARAMETER ("nag.structure_samples",
+                      "number of points where Jacobians are sampled to "
+                      "find sparsity patterns",
+                      3);
+    DEFINE_PARAMETER ("nag.structure_cache",
+                      "directory of the sparsity pattern cache",
+                      std::string (""));
+    DEFINE_PARAMETER ("nag.detect_affine",
+                      "move the nonlinear constraints found to be affine "
+                      "at the structure samples to A (0: no, 1: yes)",
+                      0);
+    DEFINE_PARAMETER ("nag.presolve",
+                      "remove fixed variables, singleton and duplicate "
+                      "linear rows (0: no, 1: yes)",
+                      0);
+    DEFINE_PARAMETER ("nag.basis_load",
+                      "basis file to warm start from, if it matches the "
+                      "problem",
+                      std::string (""));
+    DEFINE_PARAMETER ("nag.basis_save",
+                      "basis file written at the end of each solve",
+                      std::string (""));
+    DEFINE_PARAMETER ("nag.old_basis_file",
+                      "NAG basis file read by a cold start",
+                      std::string (""));
+    DEFINE_PARAMETER ("nag.new_basis_file",
+                      "NAG basis file written every nag.save_frequency "
+                      "iterations",
+                      std::string (""));
+    DEFINE_PARAMETER ("nag.backup_basis_file",
+                      "NAG backup of the new basis file", std::string (""));
+    DEFINE_PARAMETER ("nag.save_frequency",
+                      "iterations between NAG basis file saves", 100);
+    DEFINE_PARAMETER ("nag.decompose",
+                      "solve the independent blocks of the problem "
+                      "separately, in parallel; the user functions must "
+                      "support concurrent evaluations (0: no, 1: yes)",
+                      0);
+    DEFINE_PARAMETER ("nag.decompose_threads",
+                      "number of threads solving the blocks (0: one per "
+                      "core)",
+                      0);
+    DEFINE_PARAMETER ("nag.lazy_rounds",
+                      "maximum number of solves adding violated lazy "
+                      "constraints (see setLazyConstraints)",
+                      20);
+    DEFINE_PARAMETER ("nag.lazy_tolerance",
+                      "violation of the bounds above which a lazy "
+                      "constraint is added",
+                      1e-6);
+    DEFINE_PARAMETER ("nag.batch_threads",
+                      "number of threads solving the instances of a batch "
+                      "(0: one per core)",
+                      0);
+    DEFINE_PARAMETER ("nag.memo_directory",
+                      "directory of the stored evaluations of the functions "
+                      "implementing nag::MemoizedEvaluation (empty: none)",
+                      std::string (""));
+    DEFINE_PARAMETER ("nag.memo_capacity",
+                      "number of evaluations stored per function", 4096);
+    DEFINE_PARAMETER ("nag.memo_quantum",
+                      "step of the rounded points of the stored evaluations "
+                      "(0: exact points)",
+                      0.);
+    DEFINE_PARAMETER ("nag.auto_scaling",
+                      "scale rows and variables from the initial Jacobians "
+                      "(0: no, 1: yes)",
+                      0);
   }
 
   NagSolverNlpSparse::~NagSolverNlpSparse ()
+  {
+    free_names ();
+  }
+
+  void NagSolverNlpSparse::free_names ()
   {
     // functions and variables names are allocated by strdup so we
     // need to call free, unfortunately Nag API requires a C-array of
@@ -246,332 +483,1745 @@ namespace roboptim
 
     for (std::size_t i = 0; i < fnames_.size (); ++i)
       free (const_cast<char*> (fnames_[i]));
+
+    xnames_.clear ();
+    fnames_.clear ();
   }
 
-  void NagSolverNlpSparse::compute_nf ()
+  void NagSolverNlpSparse::traceEvaluation (const double* x, const double* f,
+                                            const double* multipliers)
   {
-    // Count constraints and compute their size.
-    nf_ = problem ().function ().outputSize ();
+    assert (!!trace ());
 
-    unsigned constraintId = 0;
-    typedef problem_t::constraints_t::const_iterator iter_t;
-    for (iter_t it = problem ().constraints ().begin ();
-         it != problem ().constraints ().end (); ++it, ++constraintId)
+    // F = f + A x: f comes from the user functions, the linear part
+    // is computed here since NAG does not give it back.
+    double violation = 0.;
+    if (!presolved_)
     {
-      if ((*it)->asType<NagSolverNlpSparse::linearFunction_t> ())
+      traceF_.setZero (nf_);
+      for (Integer k = 0; k < nea_; ++k)
       {
-        const linearFunction_t* g = (*it)->castInto<linearFunction_t> ();
-        assert (!!g);
-        nf_ += g->outputSize ();
+        std::size_t k_ = static_cast<std::size_t> (k);
+        traceF_[iafun_[k_] - 1] += a_[k_] * x[javar_[k_] - 1];
       }
-      else if ((*it)->asType<NagSolverNlpSparse::nonlinearFunction_t> ())
+      for (Integer i = 0; i < nfNonlinear_; ++i) traceF_[i] += f[i];
+
+      for (Function::size_type i = 1; i < nf_; ++i)
+        violation += (std::max (0., flow_[i] - traceF_[i]) +
+                      std::max (0., traceF_[i] - fupp_[i])) /
+                     (scaled_ ? rowScales_[i] : 1.);
+      for (Integer j = 0; j < n_; ++j)
+        violation += (std::max (0., xlow_[j] - x[j]) +
+                      std::max (0., x[j] - xupp_[j])) *
+                     (scaled_ ? columnScales_[j] : 1.);
+    }
+
+    // The trace holds unscaled values.
+    if (scaled_)
+    {
+      traceX_ = Eigen::Map<const vector_t> (x, n_).cwiseProduct (columnScales_);
+      x = traceX_.data ();
+
+      if (multipliers)
       {
-        const nonlinearFunction_t* g = (*it)->castInto<nonlinearFunction_t> ();
-        assert (!!g);
-        nf_ += g->outputSize ();
+        traceMultipliers_ = Eigen::Map<const vector_t> (multipliers, nf_ - 1)
+                              .cwiseProduct (rowScales_.tail (nf_ - 1));
+        multipliers = traceMultipliers_.data ();
       }
-      else
-        assert (false && "should never happen");
     }
+
+    if (presolved_)
+      tracePostsolved (x, f, multipliers);
+    else
+      trace ()->record (traceF_[0], violation, x, multipliers);
   }
 
-  void NagSolverNlpSparse::fill_xlow_xupp ()
+  void NagSolverNlpSparse::tracePostsolved (const double* x, const double* f,
+                                            const double* multipliers)
   {
-    assert (problem ().argumentBounds ().size () ==
-            static_cast<std::size_t> (n_));
+    // Point of the full problem, with its fixed variables.
+    vector_t fullX = fullX_;
+    for (std::size_t i = 0; i < variables_.size (); ++i)
+      fullX[variables_[i]] = x[i];
+
+    // Nonlinear rows keep their index, linear rows are computed from
+    // the full A.
+    const vector_t::Index nf = fullFlow_.size ();
+    traceF_.setZero (nf);
+    for (Integer i = 0; i < nfNonlinear_; ++i)
+      traceF_[i] = scaled_ ? f[i] / rowScales_[i] : f[i];
+    for (std::size_t k = 0; k < fullA_.size (); ++k)
+      traceF_[fullIafun_[k] - 1] += fullA_[k] * fullX[fullJavar_[k] - 1];
+
+    double violation = 0.;
+    for (vector_t::Index i = 1; i < nf; ++i)
+      violation += std::max (0., fullFlow_[i] - traceF_[i]) +
+                   std::max (0., traceF_[i] - fullFupp_[i]);
+    for (vector_t::Index j = 0; j < fullX.size (); ++j)
+      violation += std::max (0., fullXlow_[j] - fullX[j]) +
+                   std::max (0., fullX[j] - fullXupp_[j]);
+
+    // Multipliers of removed rows are only known once the solve is
+    // over (see postsolve): they are not available.
+    if (multipliers)
+    {
+      vector_t fullMultipliers =
+        vector_t::Constant (nf - 1, std::numeric_limits<double>::quiet_NaN ());
+      for (std::size_t k = 1; k < rows_.size (); ++k)
+        fullMultipliers[rows_[k] - 1] = multipliers[k - 1];
+      traceMultipliers_.swap (fullMultipliers);
+      multipliers = traceMultipliers_.data ();
+    }
 
-    xlow_.resize (n_);
-    xupp_.resize (n_);
+    traceX_.swap (fullX);
+    trace ()->record (traceF_[0], violation, traceX_.data (), multipliers);
+  }
+
+  const double* NagSolverNlpSparse::userArgument (const double* x)
+  {
+    if (scaled_)
+    {
+      unscaledX_ =
+        Eigen::Map<const vector_t> (x, n_).cwiseProduct (columnScales_);
+      x = unscaledX_.data ();
+    }
 
-    for (unsigned i = 0; i < n_; ++i)
+    if (presolved_)
     {
-      xlow_[i] = problem ().argumentBounds ()[i].first;
-      xupp_[i] = problem ().argumentBounds ()[i].second;
+      for (std::size_t i = 0; i < variables_.size (); ++i)
+        fullX_[variables_[i]] = x[i];
+      x = fullX_.data ();
     }
+    return x;
   }
 
-  void NagSolverNlpSparse::fill_flow_fupp ()
+  void NagSolverNlpSparse::gatherJacobian (double* g) const
   {
-    flow_.resize (nf_);
-    fupp_.resize (nf_);
-    flow_.setZero ();
-    fupp_.setZero ();
+    for (std::size_t k = 0; k < jacobianMap_.size (); ++k)
+      g[k] = fullJacobian_[jacobianMap_[k]];
+  }
 
-    // - bounds for cost function: always none.
-    flow_[0] = -function_t::infinity ();
-    fupp_[0] = function_t::infinity ();
+  void NagSolverNlpSparse::scaleValues (double* f) const
+  {
+    for (Integer i = 0; i < nfNonlinear_; ++i) f[i] *= rowScales_[i];
+  }
 
-    // - bounds for nonlinear constraints
-    int offset = 1; // start at one because of cost function.
-    for (unsigned constraintId = 0;
-         constraintId < problem ().constraints ().size (); ++constraintId)
-    {
-      const boost::shared_ptr<const function_t>& cstr =
-        problem ().constraints ()[constraintId];
+  void NagSolverNlpSparse::scaleJacobian (double* g) const
+  {
+    for (std::size_t k = 0; k < jacobianScales_.size (); ++k)
+      g[k] *= jacobianScales_[k];
+  }
 
-      if (cstr->asType<linearFunction_t> ()) continue;
+  namespace
+  {
+    /// \brief Number of equilibration passes.
+    static const int scalingPasses = 4;
 
-      const nonlinearFunction_t* g = cstr->castInto<nonlinearFunction_t> ();
-      assert (!!g);
+    /// \brief Scale factors are powers of two in [2^-20, 2^20], so that
+    /// scaling does not introduce rounding errors.
+    double roundScale (double scale)
+    {
+      int exponent = static_cast<int> (std::floor (std::log (scale) /
+                                                   std::log (2.) + .5));
+      return std::ldexp (1., std::min (20, std::max (-20, exponent)));
+    }
 
-      for (Function::size_type i = 0; i < g->outputSize (); ++i)
-      {
-        std::size_t i_ = static_cast<std::size_t> (i);
-        flow_[offset] = problem ().boundsVector ()[constraintId][i_].first;
-        fupp_[offset] = problem ().boundsVector ()[constraintId][i_].second;
-        ++offset;
-      }
+    /// \brief Whether a bound is infinite for NAG.
+    bool infiniteBound (double bound)
+    {
+      return std::abs (bound) >= 1e20;
     }
 
-    // - bounds for linear constraints
-    for (unsigned constraintId = 0;
-         constraintId < problem ().constraints ().size (); ++constraintId)
+    /// \brief Scale a bound, leaving infinite bounds unchanged.
+    double scaleBound (double bound, double scale)
     {
-      const boost::shared_ptr<const function_t>& cstr =
-        problem ().constraints ()[constraintId];
+      return infiniteBound (bound) ? bound : bound * scale;
+    }
 
-      if (!cstr->asType<linearFunction_t> ()) continue;
+    /// \brief Geometric-mean scale factor of a row or column.
+    void equilibrate (const NagSolverNlpSparse::vector_t& minimum,
+                      const NagSolverNlpSparse::vector_t& maximum,
+                      NagSolverNlpSparse::vector_t& scales,
+                      NagSolverNlpSparse::vector_t::Index first)
+    {
+      for (NagSolverNlpSparse::vector_t::Index i = first; i < scales.size ();
+           ++i)
+        if (maximum[i] > 0.)
+          scales[i] = 1. / std::sqrt (minimum[i] * maximum[i]);
+    }
+  } // end of anonymous namespace
 
-      const numericLinearFunction_t* g;
-      boost::scoped_ptr<numericLinearFunction_t> g_;
+  void NagSolverNlpSparse::compute_scaling ()
+  {
+    const std::size_t nea = static_cast<std::size_t> (nea_);
+    const std::size_t neg = static_cast<std::size_t> (neg_);
 
-      if (cstr->asType<numericLinearFunction_t> ())
-        g = cstr->castInto<numericLinearFunction_t> ();
-      else
+    // G values at the starting point.
+    std::vector<double> g (std::max<std::size_t> (1, neg), 0.);
+    std::vector<const differentiableFunction_t*> functions;
+    nonlinearFunctions (functions);
+
+    vector_t x = lookForX ();
+    for (std::size_t f = 0; f < functions.size (); ++f)
+      if (!scatterJacobian (f, functions[f]->jacobian (x),
+                            jacobianBuffer (&g[0])))
       {
-        // Create a numeric linear function from a linear function
-        g_.reset (
-          new numericLinearFunction_t (*(cstr->castInto<linearFunction_t> ())));
-        g = g_.get ();
+        setJacobianError (*functions[f]);
+        throw std::runtime_error (jacobianError_);
       }
-      assert (!!g);
-
-      for (function_t::size_type i = 0; i < g->outputSize (); ++i)
+    if (presolved_) gatherJacobian (&g[0]);
+
+    // Magnitudes of the nonzero entries of G and A.
+    std::vector<Integer> rows;
+    std::vector<Integer> columns;
+    std::vector<double> values;
+    rows.reserve (neg + nea);
+    columns.reserve (neg + nea);
+    values.reserve (neg + nea);
+    for (std::size_t k = 0; k < neg; ++k)
+      if (g[k] != 0.)
       {
-        std::size_t i_ = static_cast<std::size_t> (i);
-        // warning: we shift bounds here.
-        flow_[offset] =
-          problem ().boundsVector ()[constraintId][i_].first - g->b ()[i];
-        fupp_[offset] =
-          problem ().boundsVector ()[constraintId][i_].second - g->b ()[i];
-        ++offset;
+        rows.push_back (igfun_[k] - 1);
+        columns.push_back (jgvar_[k] - 1);
+        values.push_back (std::abs (g[k]));
+      }
+    for (std::size_t k = 0; k < nea; ++k)
+      if (a_[k] != 0.)
+      {
+        rows.push_back (iafun_[k] - 1);
+        columns.push_back (javar_[k] - 1);
+        values.push_back (std::abs (a_[k]));
       }
-    }
 
-    // Make sure we fill the vector entirely.
-    assert (offset == nf_);
+    // Alternate row and column geometric-mean scaling of R J C, where
+    // x = C x~ and F~ = R F. The cost row is not scaled.
+    rowScales_.setOnes (nf_);
+    columnScales_.setOnes (n_);
+    vector_t minimum;
+    vector_t maximum;
 
-    // Make sure the bounds are consistent.
-    for (int id = 0; id < nf_; ++id)
+    for (int pass = 0; pass < scalingPasses; ++pass)
     {
-      if (std::abs (flow_[id]) < 1e-6) flow_[id] = 0.;
-      if (std::abs (fupp_[id]) < 1e-6) fupp_[id] = 0.;
-      if (std::abs (flow_[id] - fupp_[id]) < 1e-6) flow_[id] = fupp_[id];
-      assert (flow_[id] <= fupp_[id]);
+      minimum.setConstant (nf_, function_t::infinity ());
+      maximum.setZero (nf_);
+      for (std::size_t k = 0; k < values.size (); ++k)
+      {
+        double v = values[k] * columnScales_[columns[k]];
+        minimum[rows[k]] = std::min (minimum[rows[k]], v);
+        maximum[rows[k]] = std::max (maximum[rows[k]], v);
+      }
+      equilibrate (minimum, maximum, rowScales_, 1);
+
+      minimum.setConstant (n_, function_t::infinity ());
+      maximum.setZero (n_);
+      for (std::size_t k = 0; k < values.size (); ++k)
+      {
+        double v = values[k] * rowScales_[rows[k]];
+        minimum[columns[k]] = std::min (minimum[columns[k]], v);
+        maximum[columns[k]] = std::max (maximum[columns[k]], v);
+      }
+      equilibrate (minimum, maximum, columnScales_, 0);
     }
+
+    for (Integer i = 1; i < nf_; ++i)
+      rowScales_[i] = roundScale (rowScales_[i]);
+    for (Integer j = 0; j < n_; ++j)
+      columnScales_[j] = roundScale (columnScales_[j]);
   }
 
-  NagSolverNlpSparse::function_t::vector_t NagSolverNlpSparse::lookForX ()
+  void NagSolverNlpSparse::apply_scaling ()
   {
-    function_t::vector_t x (n_);
+    // With x = C x~ and F~ = R F, NAG sees the Jacobian R J C.
+    for (Integer k = 0; k < nea_; ++k)
+    {
+      std::size_t k_ = static_cast<std::size_t> (k);
+      a_[k_] *= rowScales_[iafun_[k_] - 1] * columnScales_[javar_[k_] - 1];
+    }
 
-    if (!problem ().startingPoint ())
-      x.setZero ();
-    else
-      x = *(problem ().startingPoint ());
-    return x;
-  }
+    jacobianScales_.resize (static_cast<std::size_t> (neg_));
+    for (std::size_t k = 0; k < jacobianScales_.size (); ++k)
+      jacobianScales_[k] =
+        rowScales_[igfun_[k] - 1] * columnScales_[jgvar_[k] - 1];
 
-  NagSolverNlpSparse::function_t::vector_t NagSolverNlpSparse::lookForX (
-    unsigned constraintId)
-  {
-    function_t::vector_t x (n_);
+    for (Integer j = 0; j < n_; ++j)
+    {
+      xlow_[j] = scaleBound (xlow_[j], 1. / columnScales_[j]);
+      xupp_[j] = scaleBound (xupp_[j], 1. / columnScales_[j]);
+      x_[j] /= columnScales_[j];
+    }
 
-    // Look for a place to evaluate the jacobian of the
-    // current constraint.
-    // If we do not have an initial guess...
-    if (!problem ().startingPoint ())
-      for (unsigned i = 0; i < x.size (); ++i)
-      {
-        // if constraint is in an interval, evaluate at middle.
-        if (problem ().boundsVector ()[constraintId][i].first !=
-              function_t::infinity () &&
-            problem ().boundsVector ()[constraintId][i].second !=
-              function_t::infinity ())
-          x[i] = (problem ().boundsVector ()[constraintId][i].second -
-                  problem ().boundsVector ()[constraintId][i].first) /
-                 2.;
-        // otherwise use the non-infinite bound.
-        else if (problem ().boundsVector ()[constraintId][i].first !=
-                 function_t::infinity ())
-          x[i] = problem ().boundsVector ()[constraintId][i].first;
-        else
-          x[i] = problem ().boundsVector ()[constraintId][i].second;
-      }
-    else
-      x = *(problem ().startingPoint ());
-    return x;
+    for (Integer i = 0; i < nf_; ++i)
+    {
+      flow_[i] = scaleBound (flow_[i], rowScales_[i]);
+      fupp_[i] = scaleBound (fupp_[i], rowScales_[i]);
+    }
+
+    unscaledX_.resize (n_);
+    scaled_ = true;
   }
 
-  void NagSolverNlpSparse::fill_iafun_javar_lena_nea ()
+  void NagSolverNlpSparse::unscale_solution ()
   {
-    iafun_.clear ();
-    javar_.clear ();
-    a_.clear ();
-
-    function_t::size_type offset = 0;
+    // The Lagrangian f - l~' R F gives the multipliers l = R l~ of F,
+    // and reduced costs are derivatives with respect to x = C x~.
+    x_ = x_.cwiseProduct (columnScales_);
+    xmul_ = xmul_.cwiseQuotient (columnScales_);
+    f_ = f_.cwiseQuotient (rowScales_);
+    fmul_ = fmul_.cwiseProduct (rowScales_);
+  }
 
-    // compute the initial offset
-    offset += problem ().function ().outputSize ();
-    for (unsigned constraintId = 0;
-         constraintId < problem ().constraints ().size (); ++constraintId)
-    {
-      const boost::shared_ptr<const function_t>& cstr =
-        problem ().constraints ()[constraintId];
+  bool NagSolverNlpSparse::scatterJacobian (std::size_t functionId,
+                                            const jacobian_t& jac, double* g)
+  {
+    BOOST_STATIC_ASSERT (jacobian_t::IsRowMajor);
 
-      // if linear, pass.
-      if (cstr->asType<linearFunction_t> ()) continue;
+    assert (functionId < patterns_.size ());
+    const JacobianPattern& pattern = patterns_[functionId];
+    const PatternStructure& structure = *pattern.structure;
+    const jacobian_t::Index shift = pattern.columnShift;
 
-      const nonlinearFunction_t* g = cstr->castInto<nonlinearFunction_t> ();
-      assert (!!g);
-      offset += static_cast<unsigned> (g->outputSize ());
-    }
+    if (static_cast<std::size_t> (jac.outerSize ()) + 1 !=
+        structure.rows.size ())
+      return false;
 
-    nea_ = 0;
+    double* values = g + pattern.offset;
+    std::fill (values, values + structure.columns.size (), 0.);
 
-    for (unsigned constraintId = 0;
-         constraintId < problem ().constraints ().size (); ++constraintId)
+    // Both the pattern and the Jacobian rows are sorted by column:
+    // walk them together.
+    for (jacobian_t::Index r = 0; r < jac.outerSize (); ++r)
     {
-      const boost::shared_ptr<const function_t>& cstr =
-        problem ().constraints ()[constraintId];
-
-      // if nonlinear, pass.
-      if (!cstr->asType<linearFunction_t> ()) continue;
+      std::size_t k = structure.rows[static_cast<std::size_t> (r)];
+      const std::size_t end = structure.rows[static_cast<std::size_t> (r) + 1];
 
-      const numericLinearFunction_t* g;
-      boost::scoped_ptr<numericLinearFunction_t> g_;
-
-      if (cstr->asType<numericLinearFunction_t> ())
-        g = cstr->castInto<numericLinearFunction_t> ();
-      else
+      for (jacobian_t::InnerIterator it (jac, r); it; ++it)
       {
-        // Create a numeric linear function from a linear function
-        g_.reset (
-          new numericLinearFunction_t (*(cstr->castInto<linearFunction_t> ())));
-        g = g_.get ();
-      }
+        while (k < end && structure.columns[k] + shift < it.col ()) ++k;
 
-      // copy the non-null elements of the jacobian
-      for (int k = 0; k < g->A ().outerSize (); ++k)
-        for (function_t::matrix_t::InnerIterator it (g->A (), k); it; ++it)
+        if (k == end || structure.columns[k] + shift != it.col ())
         {
-          iafun_.push_back (offset + it.row () + 1);
-          javar_.push_back (it.col () + 1);
-          a_.push_back (it.value ());
+          // Explicit zeros outside of the pattern are harmless.
+          if (it.value () == 0.) continue;
+          return false;
         }
-      offset += static_cast<int> (g->A ().rows ());
+        values[k] = it.value ();
+      }
     }
+    return true;
+  }
 
-    lena_ = static_cast<int> (iafun_.size ());
-    nea_ = lena_;
+  bool NagSolverNlpSparse::recall (std::size_t functionId, const double* x,
+                                   double* f, double* g)
+  {
+    if (functionId >= memo_.size () || !memo_[functionId]) return false;
+    return memo_[functionId]->recall (
+      x, f, g ? g + patterns_[functionId].offset : 0);
+  }
 
-    if (lena_ == 0)
-    {
-      iafun_.resize (1);
-      javar_.resize (1);
-      a_.resize (1);
-      lena_ = 1;
-      nea_ = 0;
-    }
+  void NagSolverNlpSparse::record (std::size_t functionId, const double* x,
+                                   const double* f, const double* g)
+  {
+    if (functionId >= memo_.size () || !memo_[functionId]) return;
+    memo_[functionId]->record (x, f,
+                               g ? g + patterns_[functionId].offset : 0);
   }
 
-  void NagSolverNlpSparse::fill_igfun_jgvar_leng_neg ()
+  void NagSolverNlpSparse::setup_memo ()
   {
-    igfun_.clear ();
-    jgvar_.clear ();
+    memo_.clear ();
+    std::string directory = stringParameter ("nag.memo_directory");
+    if (directory.empty ()) return;
 
-    function_t::size_type offset = 0;
-    neg_ = 0;
+    const std::size_t capacity = static_cast<std::size_t> (
+      std::max (1, integerParameter ("nag.memo_capacity", 4096)));
+    const double quantum = doubleParameter ("nag.memo_quantum", 0.);
 
-    // evaluate objective jacobian.
-    const differentiableFunction_t* obj;
-    if (!problem ().function ().asType<differentiableFunction_t> ())
-      throw std::runtime_error ("objective function should be differentiable");
+    std::vector<const differentiableFunction_t*> functions;
+    nonlinearFunctions (functions);
 
-    obj = problem ().function ().castInto<differentiableFunction_t> ();
+    memo_.resize (functions.size ());
+    for (std::size_t f = 0; f < functions.size (); ++f)
+    {
+      const nag::MemoizedEvaluation* memo =
+        nag::memoizedEvaluation (*functions[f]);
+      if (!memo) continue;
+
+      // Jacobians are stored as their entries in G, which depend on
+      // the pattern of the function.
+      const JacobianPattern& pattern = patterns_[f];
+      const PatternStructure& structure = *pattern.structure;
+      std::string layout;
+      for (std::size_t r = 0; r < structure.rows.size (); ++r)
+        layout += (boost::format (" %1%") % structure.rows[r]).str ();
+      layout += "\n";
+      for (std::size_t k = 0; k < structure.columns.size (); ++k)
+        layout += (boost::format (" %1%") %
+                   (structure.columns[k] + pattern.columnShift))
+                    .str ();
+
+      std::string signature =
+        (boost::format ("%1%\nn %2%\nm %3%\nquantum %4$.17g\n"
+                        "pattern %5$016x\n") %
+         memo->memoKey () % functions[f]->inputSize () %
+         functions[f]->outputSize () % quantum % nag::hashSignature (layout))
+          .str ();
+
+      memo_[f].reset (new nag::EvaluationStore (
+        nag::evaluationStoreFile (directory, signature), signature,
+        static_cast<std::size_t> (functions[f]->inputSize ()),
+        static_cast<std::size_t> (functions[f]->outputSize ()),
+        structure.columns.size (), capacity, quantum));
+    }
+  }
 
-    vector_t x = lookForX ();
-    jacobian_t jac = obj->jacobian (x);
-    neg_ += jac.nonZeros ();
+  void NagSolverNlpSparse::setJacobianError (const function_t& f)
+  {
+    jacobianError_ =
+      (boost::format ("the jacobian of %1% has a nonzero entry outside of "
+                      "its sparsity pattern (see nag::JacobianStructure)") %
+       f.getName ())
+        .str ();
+  }
 
-    for (int k = 0; k < jac.outerSize (); ++k)
-      for (jacobian_t::InnerIterator it (jac, k); it; ++it)
+  namespace
+  {
+    /// \brief Bounds of y from lower <= a y <= upper.
+    void divideBounds (double lower, double upper, double a, double& low,
+                       double& up)
+    {
+      const double inf = Function::infinity ();
+      if (a > 0.)
       {
-        igfun_.push_back (it.row () + 1);
-        jgvar_.push_back (it.col () + 1);
+        low = infiniteBound (lower) ? -inf : lower / a;
+        up = infiniteBound (upper) ? inf : upper / a;
       }
-    offset += jac.rows ();
+      else
+      {
+        low = infiniteBound (upper) ? -inf : upper / a;
+        up = infiniteBound (lower) ? inf : lower / a;
+      }
+    }
 
-    for (unsigned constraintId = 0;
-         constraintId < problem ().constraints ().size (); ++constraintId)
+    /// \brief Free the names that are not kept and compact the others.
+    void compactNames (std::vector<const char*>& names,
+                       const std::vector<Integer>& kept)
     {
-      const boost::shared_ptr<const function_t>& cstr =
-        problem ().constraints ()[constraintId];
-
-      // if linear, pass.
-      if (cstr->asType<linearFunction_t> ()) continue;
+      std::vector<bool> used (names.size (), false);
+      std::vector<const char*> res;
+      res.reserve (kept.size ());
+      for (std::size_t i = 0; i < kept.size (); ++i)
+      {
+        used[static_cast<std::size_t> (kept[i])] = true;
+        res.push_back (names[static_cast<std::size_t> (kept[i])]);
+      }
+      for (std::size_t i = 0; i < names.size (); ++i)
+        if (!used[i]) free (const_cast<char*> (names[i]));
+      names.swap (res);
+    }
+  } // end of anonymous namespace
 
-      const nonlinearFunction_t* g = cstr->castInto<nonlinearFunction_t> ();
-      assert (!!g);
+  void NagSolverNlpSparse::presolve ()
+  {
+    const std::size_t n = static_cast<std::size_t> (n_);
+    const std::size_t nf = static_cast<std::size_t> (nf_);
+    const std::size_t nea = static_cast<std::size_t> (nea_);
+    const std::size_t neg = static_cast<std::size_t> (neg_);
+
+    fullXlow_ = xlow_;
+    fullXupp_ = xupp_;
+    fullFlow_ = flow_;
+    fullFupp_ = fupp_;
+
+    const BoundSource original = {-1, 1.};
+    variableLowerSources_.assign (n, original);
+    variableUpperSources_.assign (n, original);
+    rowLowerSources_.assign (nf, original);
+    rowUpperSources_.assign (nf, original);
+
+    // Fixed variables (NAG needs at least one variable).
+    std::vector<bool> fixed (n, false);
+    std::size_t fixedCount = 0;
+    for (std::size_t j = 0; j < n; ++j)
+      if (xlow_[j] == xupp_[j] && !infiniteBound (xlow_[j]))
+      {
+        fixed[j] = true;
+        ++fixedCount;
+      }
+    if (fixedCount == n)
+    {
+      fixed.assign (n, false);
+      fixedCount = 0;
+    }
 
-      vector_t x = lookForX (constraintId);
-      jacobian_t jac = g->jacobian (x);
-      neg_ += jac.nonZeros ();
+    // Linear rows without their fixed variables, whose contribution
+    // moves to the row bounds.
+    typedef std::vector<std::pair<Integer, double> > rowEntries_t;
+    std::vector<rowEntries_t> entries (nf);
+    vector_t lower (flow_);
+    vector_t upper (fupp_);
+    for (std::size_t k = 0; k < nea; ++k)
+    {
+      std::size_t r = static_cast<std::size_t> (iafun_[k] - 1);
+      std::size_t j = static_cast<std::size_t> (javar_[k] - 1);
+      if (fixed[j])
+      {
+        if (!infiniteBound (lower[r])) lower[r] -= a_[k] * xlow_[j];
+        if (!infiniteBound (upper[r])) upper[r] -= a_[k] * xlow_[j];
+      }
+      else if (a_[k] != 0.)
+        entries[r].push_back (std::make_pair (javar_[k] - 1, a_[k]));
+    }
 
-      for (int k = 0; k < jac.outerSize (); ++k)
-        for (jacobian_t::InnerIterator it (jac, k); it; ++it)
+    // Empty and singleton rows. Rows whose bounds would be
+    // inconsistent are left to NAG.
+    std::vector<bool> removed (nf, false);
+    std::size_t removedCount = 0;
+    for (std::size_t r = static_cast<std::size_t> (nfNonlinear_); r < nf; ++r)
+    {
+      if (entries[r].empty ())
+      {
+        if (lower[r] <= 0. && 0. <= upper[r])
         {
-          igfun_.push_back (offset + it.row () + 1);
-          jgvar_.push_back (it.col () + 1);
+          removed[r] = true;
+          ++removedCount;
         }
-      offset += jac.rows ();
-    }
+        continue;
+      }
+      if (entries[r].size () != 1) continue;
 
-    leng_ = static_cast<int> (igfun_.size ());
+      std::size_t j = static_cast<std::size_t> (entries[r][0].first);
+      double a = entries[r][0].second;
+      double low, up;
+      divideBounds (lower[r], upper[r], a, low, up);
+      if (std::max (low, xlow_[j]) > std::min (up, xupp_[j])) continue;
 
-    if (leng_ == 0)
-    {
-      igfun_.resize (1);
-      jgvar_.resize (1);
-      leng_ = 1;
-      neg_ = 0;
+      const BoundSource source = {static_cast<Integer> (r), a};
+      if (low > xlow_[j])
+      {
+        xlow_[j] = low;
+        variableLowerSources_[j] = source;
+      }
+      if (up < xupp_[j])
+      {
+        xupp_[j] = up;
+        variableUpperSources_[j] = source;
+      }
+      removed[r] = true;
+      ++removedCount;
     }
-  }
-
-  void NagSolverNlpSparse::fill_fnames ()
-  {
-    boost::format fmt ("%1%, %2%, Ouput variable %3%");
-
-    // first push the cost function name
-    fnames_.push_back (strdup (
-      (fmt % "cost" % problem ().function ().getName () % 0).str ().c_str ()));
 
-    // then nonlinear constraints
-    for (std::size_t constraintId = 0;
-         constraintId < problem ().constraints ().size (); ++constraintId)
+    // Duplicate rows, up to a factor: their bounds are merged into the
+    // first row.
+    typedef std::map<rowEntries_t, Integer> rowMap_t;
+    rowMap_t rowMap;
+    for (std::size_t r = static_cast<std::size_t> (nfNonlinear_); r < nf; ++r)
     {
-      const boost::shared_ptr<const function_t>& cstr =
-        problem ().constraints ()[constraintId];
+      if (removed[r] || entries[r].size () < 2) continue;
 
-      if (cstr->asType<linearFunction_t> ()) continue;
+      std::sort (entries[r].begin (), entries[r].end ());
+      rowEntries_t normalized (entries[r]);
+      for (std::size_t k = 0; k < normalized.size (); ++k)
+        normalized[k].second /= entries[r][0].second;
 
-      const nonlinearFunction_t* g = cstr->castInto<nonlinearFunction_t> ();
-      assert (!!g);
+      std::pair<rowMap_t::iterator, bool> inserted =
+        rowMap.insert (std::make_pair (normalized, static_cast<Integer> (r)));
+      if (inserted.second) continue;
 
-      for (Function::size_type i = 0; i < g->outputSize (); ++i)
-        fnames_.push_back (
-          strdup ((fmt % "nonlinear" % g->getName () % i).str ().c_str ()));
-    }
+      std::size_t kept = static_cast<std::size_t> (inserted.first->second);
+      double factor = entries[r][0].second / entries[kept][0].second;
+      double low, up;
+      divideBounds (lower[r], upper[r], factor, low, up);
+      if (std::max (low, lower[kept]) > std::min (up, upper[kept])) continue;
+
+      const BoundSource source = {static_cast<Integer> (r), factor};
+      if (low > lower[kept])
+      {
+        lower[kept] = low;
+        rowLowerSources_[kept] = source;
+      }
+      if (up < upper[kept])
+      {
+        upper[kept] = up;
+        rowUpperSources_[kept] = source;
+      }
+      removed[r] = true;
+      ++removedCount;
+    }
+
+    if (fixedCount == 0 && removedCount == 0) return;
+
+    // Full problem, used by usrfun and postsolve.
+    fullX_ = x_;
+    for (std::size_t j = 0; j < n; ++j)
+      if (fixed[j]) fullX_[j] = xlow_[j];
+    fullIafun_.assign (iafun_.begin (), iafun_.begin () + nea);
+    fullJavar_.assign (javar_.begin (), javar_.begin () + nea);
+    fullA_.assign (a_.begin (), a_.begin () + nea);
+    fullIgfun_.assign (igfun_.begin (), igfun_.begin () + neg);
+    fullJgvar_.assign (jgvar_.begin (), jgvar_.begin () + neg);
+    fullJacobian_.assign (std::max<std::size_t> (1, neg), 0.);
+
+    std::vector<Integer> column (n, -1);
+    variables_.clear ();
+    for (std::size_t j = 0; j < n; ++j)
+      if (!fixed[j])
+      {
+        column[j] = static_cast<Integer> (variables_.size ());
+        variables_.push_back (static_cast<Integer> (j));
+      }
+
+    std::vector<Integer> row (nf, -1);
+    rows_.clear ();
+    for (std::size_t r = 0; r < nf; ++r)
+      if (!removed[r])
+      {
+        row[r] = static_cast<Integer> (rows_.size ());
+        rows_.push_back (static_cast<Integer> (r));
+      }
+
+    // A of the presolved problem.
+    iafun_.clear ();
+    javar_.clear ();
+    a_.clear ();
+    for (std::size_t r = 0; r < nf; ++r)
+    {
+      if (removed[r]) continue;
+      for (std::size_t k = 0; k < entries[r].size (); ++k)
+      {
+        iafun_.push_back (row[r] + 1);
+        javar_.push_back (column[static_cast<std::size_t> (
+                            entries[r][k].first)] +
+                          1);
+        a_.push_back (entries[r][k].second);
+      }
+    }
+    nea_ = lena_ = static_cast<Integer> (a_.size ());
+    if (lena_ == 0)
+    {
+      iafun_.resize (1);
+      javar_.resize (1);
+      a_.resize (1);
+      lena_ = 1;
+    }
+
+    // G of the presolved problem: nonlinear rows are kept, with the
+    // same index.
+    std::vector<Integer> igfun;
+    std::vector<Integer> jgvar;
+    jacobianMap_.clear ();
+    for (std::size_t k = 0; k < neg; ++k)
+    {
+      std::size_t j = static_cast<std::size_t> (jgvar_[k] - 1);
+      if (fixed[j]) continue;
+      jacobianMap_.push_back (k);
+      igfun.push_back (igfun_[k]);
+      jgvar.push_back (column[j] + 1);
+    }
+    igfun_.swap (igfun);
+    jgvar_.swap (jgvar);
+    neg_ = leng_ = static_cast<Integer> (igfun_.size ());
+    if (leng_ == 0)
+    {
+      igfun_.resize (1);
+      jgvar_.resize (1);
+      leng_ = 1;
+    }
+
+    // Bounds, starting point and names.
+    vector_t xlow (variables_.size ());
+    vector_t xupp (variables_.size ());
+    vector_t x (variables_.size ());
+    for (std::size_t i = 0; i < variables_.size (); ++i)
+    {
+      xlow[i] = xlow_[variables_[i]];
+      xupp[i] = xupp_[variables_[i]];
+      x[i] = x_[variables_[i]];
+    }
+    xlow_.swap (xlow);
+    xupp_.swap (xupp);
+    x_.swap (x);
+
+    vector_t flow (rows_.size ());
+    vector_t fupp (rows_.size ());
+    for (std::size_t i = 0; i < rows_.size (); ++i)
+    {
+      flow[i] = lower[rows_[i]];
+      fupp[i] = upper[rows_[i]];
+    }
+    flow_.swap (flow);
+    fupp_.swap (fupp);
+
+    compactNames (xnames_, variables_);
+    compactNames (fnames_, rows_);
+
+    n_ = static_cast<Integer> (variables_.size ());
+    nf_ = static_cast<Integer> (rows_.size ());
+    presolved_ = true;
+  }
+
+  void NagSolverNlpSparse::postsolve ()
+  {
+    const vector_t::Index n = fullX_.size ();
+    const vector_t::Index nf =
+      static_cast<vector_t::Index> (rowLowerSources_.size ());
+
+    for (std::size_t i = 0; i < variables_.size (); ++i)
+      fullX_[variables_[i]] = x_[static_cast<vector_t::Index> (i)];
+
+    // Nonlinear rows come from NAG, linear rows are computed from the
+    // full A.
+    vector_t f = vector_t::Zero (nf);
+    vector_t fmul = vector_t::Zero (nf);
+    for (std::size_t k = 0; k < rows_.size (); ++k)
+    {
+      vector_t::Index k_ = static_cast<vector_t::Index> (k);
+      if (rows_[k] < nfNonlinear_) f[rows_[k]] = f_[k_];
+      fmul[rows_[k]] = fmul_[k_];
+    }
+    for (std::size_t k = 0; k < fullA_.size (); ++k)
+      f[fullIafun_[k] - 1] += fullA_[k] * fullX_[fullJavar_[k] - 1];
+
+    // The multiplier of a bound goes to the row that gave it (lower
+    // bounds have nonnegative multipliers).
+    for (std::size_t k = 0; k < rows_.size (); ++k)
+    {
+      std::size_t r = static_cast<std::size_t> (rows_[k]);
+      double multiplier = fmul[rows_[k]];
+      const BoundSource& source = multiplier >= 0. ? rowLowerSources_[r]
+                                                   : rowUpperSources_[r];
+      if (multiplier == 0. || source.row < 0) continue;
+      fmul[source.row] = multiplier / source.factor;
+      fmul[rows_[k]] = 0.;
+    }
+
+    vector_t xmul = vector_t::Zero (n);
+    for (std::size_t i = 0; i < variables_.size (); ++i)
+    {
+      std::size_t j = static_cast<std::size_t> (variables_[i]);
+      double multiplier = xmul_[static_cast<vector_t::Index> (i)];
+      const BoundSource& source = multiplier >= 0.
+                                    ? variableLowerSources_[j]
+                                    : variableUpperSources_[j];
+      if (multiplier != 0. && source.row >= 0)
+      {
+        fmul[source.row] = multiplier / source.factor;
+        multiplier = 0.;
+      }
+      xmul[variables_[i]] = multiplier;
+    }
+
+    // Fixed variables are not seen by NAG: their multipliers are
+    // g - J' fmul at the solution, the objective row giving g.
+    if (variables_.size () < static_cast<std::size_t> (n))
+    {
+      std::vector<const differentiableFunction_t*> functions;
+      nonlinearFunctions (functions);
+      for (std::size_t i = 0; i < functions.size (); ++i)
+        if (!scatterJacobian (i, functions[i]->jacobian (fullX_),
+                              &fullJacobian_[0]))
+        {
+          setJacobianError (*functions[i]);
+          throw std::runtime_error (jacobianError_);
+        }
+
+      vector_t weights = -fmul;
+      if (objrow_ > 0) weights[objrow_ - 1] = 1.;
+      vector_t reduced = vector_t::Zero (n);
+      for (std::size_t k = 0; k < fullA_.size (); ++k)
+        reduced[fullJavar_[k] - 1] += weights[fullIafun_[k] - 1] * fullA_[k];
+      for (std::size_t k = 0; k < fullIgfun_.size (); ++k)
+        reduced[fullJgvar_[k] - 1] +=
+          weights[fullIgfun_[k] - 1] * fullJacobian_[k];
+
+      std::vector<bool> kept (static_cast<std::size_t> (n), false);
+      for (std::size_t i = 0; i < variables_.size (); ++i)
+        kept[static_cast<std::size_t> (variables_[i])] = true;
+      for (vector_t::Index j = 0; j < n; ++j)
+        if (!kept[static_cast<std::size_t> (j)]) xmul[j] = reduced[j];
+    }
+
+    x_ = fullX_;
+    xmul_.swap (xmul);
+    f_.swap (f);
+    fmul_.swap (fmul);
+    n_ = static_cast<Integer> (n);
+    nf_ = static_cast<Integer> (nf);
+  }
+
+  bool NagSolverNlpSparse::linearConstraint (std::size_t constraintId) const
+  {
+    return (!affine_.empty () && affine_[constraintId]) ||
+           problem ().constraints ()[constraintId]->asType<linearFunction_t> ();
+  }
+
+  namespace
+  {
+    typedef GenericNumericLinearFunction<EigenMatrixSparse>
+      numericLinearFunction_t;
+
+    /// \brief Numeric form of a linear function.
+    /// \param f linear function.
+    /// \param storage storage of a converted linear function.
+    const numericLinearFunction_t*
+    numericLinearForm (const GenericFunction<EigenMatrixSparse>& f,
+                       boost::scoped_ptr<numericLinearFunction_t>& storage)
+    {
+      if (f.asType<numericLinearFunction_t> ())
+        return f.castInto<numericLinearFunction_t> ();
+
+      // Create a numeric linear function from a linear function
+      storage.reset (new numericLinearFunction_t (
+        *(f.castInto<GenericLinearFunction<EigenMatrixSparse> > ())));
+      return storage.get ();
+    }
+  } // end of anonymous namespace
+
+  const NagSolverNlpSparse::numericLinearFunction_t*
+  NagSolverNlpSparse::linearForm (
+    std::size_t constraintId,
+    boost::scoped_ptr<numericLinearFunction_t>& storage) const
+  {
+    if (affine_[constraintId]) return affine_[constraintId].get ();
+    return numericLinearForm (*problem ().constraints ()[constraintId],
+                              storage);
+  }
+
+  namespace
+  {
+    /// \brief Relative tolerance of the affine constraint detection.
+    static const double affineTolerance = 1e-10;
+
+    /// \brief Largest absolute value of a sparse matrix.
+    template <typename M>
+    double maxAbs (const M& m)
+    {
+      double res = 0.;
+      for (typename M::Index k = 0; k < m.outerSize (); ++k)
+        for (typename M::InnerIterator it (m, k); it; ++it)
+          res = std::max (res, std::abs (it.value ()));
+      return res;
+    }
+  } // end of anonymous namespace
+
+  void NagSolverNlpSparse::setup_objective ()
+  {
+    const function_t& cost = problem ().function ();
+    objective_ = 0;
+    objrow_ = 1;
+
+    if (!cost.asType<linearFunction_t> ())
+    {
+      if (!cost.asType<differentiableFunction_t> ())
+        throw std::runtime_error (
+          "objective function should be differentiable");
+      objective_ = cost.castInto<differentiableFunction_t> ();
+      return;
+    }
+
+    // Linear objectives are stored in A. Without coefficients, the
+    // problem is a feasibility problem.
+    boost::scoped_ptr<numericLinearFunction_t> storage;
+    if (maxAbs (numericLinearForm (cost, storage)->A ()) == 0.) objrow_ = 0;
+  }
+
+  void NagSolverNlpSparse::detect_affine ()
+  {
+    affine_.assign (problem ().constraints ().size (),
+                    boost::shared_ptr<const numericLinearFunction_t> ());
+    if (!integerParameter ("nag.detect_affine", 0)) return;
+
+    // Affinity cannot be checked at a single point.
+    const std::vector<vector_t>& points = samplePoints ();
+    if (points.size () < 2) return;
+
+    for (std::size_t constraintId = 0; constraintId < affine_.size ();
+         ++constraintId)
+    {
+      const boost::shared_ptr<const function_t>& cstr =
+        problem ().constraints ()[constraintId];
+      if (!activeConstraint (constraintId) ||
+          cstr->asType<linearFunction_t> ())
+        continue;
+
+      const nonlinearFunction_t* g = cstr->castInto<nonlinearFunction_t> ();
+      assert (!!g);
+
+      // Linearization at the first point: g (x) = A x + b.
+      jacobian_t a = g->jacobian (points[0]);
+      a.prune (0.);
+      vector_t b = (*g) (points[0]) - a * points[0];
+      double scale = 1. + maxAbs (a);
+
+      bool affine = true;
+      for (std::size_t k = 1; affine && k < points.size (); ++k)
+      {
+        jacobian_t jac = g->jacobian (points[k]);
+        vector_t value = (*g) (points[k]);
+        jacobian_t diff = jac - a;
+        affine = maxAbs (diff) <= affineTolerance * scale &&
+                 (value - a * points[k] - b).cwiseAbs ().maxCoeff () <=
+                   affineTolerance * (1. + value.cwiseAbs ().maxCoeff ());
+      }
+
+      if (affine)
+        affine_[constraintId] =
+          boost::make_shared<numericLinearFunction_t> (a, b);
+    }
+  }
+
+  void NagSolverNlpSparse::constraintStarts (std::vector<Integer>& start) const
+  {
+    const std::size_t constraints = problem ().constraints ().size ();
+
+    start.resize (constraints);
+    Integer nonlinearOffset = 1;
+    Integer linearOffset = nfNonlinear_;
+    for (std::size_t constraintId = 0; constraintId < constraints;
+         ++constraintId)
+    {
+      if (!activeConstraint (constraintId))
+      {
+        start[constraintId] = -1;
+        continue;
+      }
+
+      Integer size = static_cast<Integer> (
+        problem ().constraints ()[constraintId]->outputSize ());
+      Integer& offset =
+        linearConstraint (constraintId) ? linearOffset : nonlinearOffset;
+      start[constraintId] = offset;
+      offset += size;
+    }
+  }
+
+  void NagSolverNlpSparse::resultStarts (std::vector<Integer>& start) const
+  {
+    const std::size_t constraints = problem ().constraints ().size ();
+
+    start.resize (constraints);
+    Integer offset = 0;
+    for (int linear = 0; linear < 2; ++linear)
+      for (std::size_t constraintId = 0; constraintId < constraints;
+           ++constraintId)
+      {
+        const function_t& g = *problem ().constraints ()[constraintId];
+        if (static_cast<int> (g.asType<linearFunction_t> () != 0) != linear)
+          continue;
+        start[constraintId] = offset;
+        offset += static_cast<Integer> (g.outputSize ());
+      }
+  }
+
+  void NagSolverNlpSparse::restore_affine_rows ()
+  {
+    const std::size_t constraints = problem ().constraints ().size ();
+
+    bool detected = false;
+    for (std::size_t constraintId = 0; constraintId < constraints;
+         ++constraintId)
+      detected = detected || affine_[constraintId];
+    if (!detected) return;
+
+    // First row of each constraint in F.
+    std::vector<Integer> start;
+    constraintStarts (start);
+
+    f_ += affineConstants_;
+
+    // Rows of the constraints in the order they have without the
+    // detection: nonlinear constraints first, then linear ones.
+    std::vector<Integer> rows (1, 0);
+    for (int linear = 0; linear < 2; ++linear)
+      for (std::size_t constraintId = 0; constraintId < constraints;
+           ++constraintId)
+      {
+        const function_t& g = *problem ().constraints ()[constraintId];
+        if (!activeConstraint (constraintId) ||
+            static_cast<int> (g.asType<linearFunction_t> () != 0) != linear)
+          continue;
+        for (Integer i = 0; i < static_cast<Integer> (g.outputSize ()); ++i)
+          rows.push_back (start[constraintId] + i);
+      }
+    assert (rows.size () == static_cast<std::size_t> (nf_));
+
+    vector_t f (nf_);
+    vector_t fmul (nf_);
+    for (std::size_t k = 0; k < rows.size (); ++k)
+    {
+      f[static_cast<vector_t::Index> (k)] = f_[rows[k]];
+      fmul[static_cast<vector_t::Index> (k)] = fmul_[rows[k]];
+    }
+    f_.swap (f);
+    fmul_.swap (fmul);
+  }
+
+  void NagSolverNlpSparse::compute_nf ()
+  {
+    // Count constraints and compute their size. Sizes are summed
+    // before being converted, so that an overflow is detected.
+    function_t::size_type nf = problem ().function ().outputSize ();
+    function_t::size_type nfNonlinear = nf;
+
+    std::size_t constraintId = 0;
+    typedef problem_t::constraints_t::const_iterator iter_t;
+    for (iter_t it = problem ().constraints ().begin ();
+         it != problem ().constraints ().end (); ++it, ++constraintId)
+    {
+      if (!activeConstraint (constraintId)) continue;
+
+      if (linearConstraint (constraintId))
+        nf += (*it)->outputSize ();
+      else if ((*it)->asType<NagSolverNlpSparse::nonlinearFunction_t> ())
+      {
+        const nonlinearFunction_t* g = (*it)->castInto<nonlinearFunction_t> ();
+        assert (!!g);
+        nf += g->outputSize ();
+        nfNonlinear += g->outputSize ();
+      }
+      else
+        assert (false && "should never happen");
+    }
+
+    nf_ = nag::toInteger (nf, "the number of rows of F");
+    nfNonlinear_ = static_cast<Integer> (nfNonlinear);
+  }
+
+  void NagSolverNlpSparse::fill_xlow_xupp ()
+  {
+    assert (problem ().argumentBounds ().size () ==
+            static_cast<std::size_t> (n_));
+
+    xlow_.resize (n_);
+    xupp_.resize (n_);
+
+    for (Integer i = 0; i < n_; ++i)
+    {
+      std::size_t i_ = static_cast<std::size_t> (i);
+      xlow_[i] = problem ().argumentBounds ()[i_].first;
+      xupp_[i] = problem ().argumentBounds ()[i_].second;
+    }
+  }
+
+  void NagSolverNlpSparse::fill_flow_fupp ()
+  {
+    flow_.resize (nf_);
+    fupp_.resize (nf_);
+    flow_.setZero ();
+    fupp_.setZero ();
+
+    // - bounds for cost function: always none.
+    flow_[0] = -function_t::infinity ();
+    fupp_[0] = function_t::infinity ();
+
+    // - bounds for nonlinear constraints
+    Integer offset = 1; // start at one because of cost function.
+    for (std::size_t constraintId = 0;
+         constraintId < problem ().constraints ().size (); ++constraintId)
+    {
+      const boost::shared_ptr<const function_t>& cstr =
+        problem ().constraints ()[constraintId];
+
+      if (!activeConstraint (constraintId) || linearConstraint (constraintId))
+        continue;
+
+      const nonlinearFunction_t* g = cstr->castInto<nonlinearFunction_t> ();
+      assert (!!g);
+
+      for (Function::size_type i = 0; i < g->outputSize (); ++i)
+      {
+        std::size_t i_ = static_cast<std::size_t> (i);
+        flow_[offset] = problem ().boundsVector ()[constraintId][i_].first;
+        fupp_[offset] = problem ().boundsVector ()[constraintId][i_].second;
+        ++offset;
+      }
+    }
+
+    // - bounds for linear constraints
+    affineConstants_.setZero (nf_);
+    for (std::size_t constraintId = 0;
+         constraintId < problem ().constraints ().size (); ++constraintId)
+    {
+      if (!activeConstraint (constraintId) || !linearConstraint (constraintId))
+        continue;
+
+      boost::scoped_ptr<numericLinearFunction_t> g_;
+      const numericLinearFunction_t* g = linearForm (constraintId, g_);
+      assert (!!g);
+
+      for (function_t::size_type i = 0; i < g->outputSize (); ++i)
+      {
+        std::size_t i_ = static_cast<std::size_t> (i);
+        // warning: we shift bounds here.
+        flow_[offset] =
+          problem ().boundsVector ()[constraintId][i_].first - g->b ()[i];
+        fupp_[offset] =
+          problem ().boundsVector ()[constraintId][i_].second - g->b ()[i];
+        if (affine_[constraintId]) affineConstants_[offset] = g->b ()[i];
+        ++offset;
+      }
+    }
+
+    // Make sure we fill the vector entirely.
+    assert (offset == nf_);
+
+    // Make sure the bounds are consistent.
+    for (Integer id = 0; id < nf_; ++id)
+    {
+      if (std::abs (flow_[id]) < 1e-6) flow_[id] = 0.;
+      if (std::abs (fupp_[id]) < 1e-6) fupp_[id] = 0.;
+      if (std::abs (flow_[id] - fupp_[id]) < 1e-6) flow_[id] = fupp_[id];
+      assert (flow_[id] <= fupp_[id]);
+    }
+  }
+
+  NagSolverNlpSparse::function_t::vector_t NagSolverNlpSparse::lookForX ()
+  {
+    function_t::vector_t x (n_);
+
+    if (warmStart_)
+      x = warmStart_->x;
+    else if (!problem ().startingPoint ())
+      x.setZero ();
+    else
+      x = *(problem ().startingPoint ());
+    return x;
+  }
+
+  const std::vector<NagSolverNlpSparse::vector_t>&
+  NagSolverNlpSparse::samplePoints ()
+  {
+    if (!samplePoints_.empty ()) return samplePoints_;
+
+    int samples = std::max (1, integerParameter ("nag.structure_samples", 3));
+
+    // The first point is the starting point, the others are
+    // deterministic perturbations of it (within the argument bounds),
+    // so that entries vanishing at one of them are still found.
+    // Perturbations leaving the bounds are reversed, so that variables
+    // starting at a bound still move.
+    vector_t x0 = lookForX ();
+    samplePoints_.push_back (x0);
+
+    boost::random::mt19937 rng (0);
+    boost::random::uniform_real_distribution<> uniform (-1., 1.);
+
+    for (int k = 1; k < samples; ++k)
+    {
+      vector_t x (x0);
+      for (function_t::size_type i = 0; i < x.size (); ++i)
+      {
+        const function_t::interval_t& bounds =
+          problem ().argumentBounds ()[static_cast<std::size_t> (i)];
+        double step = .1 * std::max (1., std::abs (x0[i])) * uniform (rng);
+        if (x0[i] + step < bounds.first || x0[i] + step > bounds.second)
+          step = -step;
+        x[i] = std::min (std::max (x0[i] + step, bounds.first), bounds.second);
+      }
+      samplePoints_.push_back (x);
+    }
+    return samplePoints_;
+  }
+
+  namespace
+  {
+    /// \brief Add the stored entries of a Jacobian to a structure.
+    template <typename M, typename S>
+    void addStructure (const M& jac, S& structure)
+    {
+      if (static_cast<std::size_t> (jac.rows ()) != structure.size ())
+        throw std::runtime_error ("invalid jacobian structure size");
+
+      for (typename M::Index k = 0; k < jac.outerSize (); ++k)
+        for (typename M::InnerIterator it (jac, k); it; ++it)
+          structure[static_cast<std::size_t> (it.row ())].push_back (
+            it.col ());
+    }
+  } // end of anonymous namespace
+
+  void NagSolverNlpSparse::jacobianStructure (const differentiableFunction_t& f,
+                                              structure_t& structure)
+  {
+    structure.assign (static_cast<std::size_t> (f.outputSize ()),
+                      structure_t::value_type ());
+
+    if (const nag::JacobianStructure* hint = nag::jacobianStructure (f))
+      addStructure (hint->jacobianStructure (), structure);
+    else
+    {
+      const std::vector<vector_t>& points = samplePoints ();
+      for (std::size_t k = 0; k < points.size (); ++k)
+        addStructure (f.jacobian (points[k]), structure);
+    }
+
+    for (std::size_t r = 0; r < structure.size (); ++r)
+    {
+      std::sort (structure[r].begin (), structure[r].end ());
+      structure[r].erase (
+        std::unique (structure[r].begin (), structure[r].end ()),
+        structure[r].end ());
+    }
+  }
+
+  namespace
+  {
+    /// \brief Key of the group of instances of a repeated function.
+    std::string instanceKey (const GenericFunction<EigenMatrixSparse>& f)
+    {
+      return (boost::format ("%1% %2% %3%") % typeid (f).name () %
+              f.inputSize () % f.outputSize ())
+        .str ();
+    }
+  } // end of anonymous namespace
+
+  void NagSolverNlpSparse::nonlinearFunctions (
+    std::vector<const differentiableFunction_t*>& functions) const
+  {
+    functions.clear ();
+
+    if (objective_) functions.push_back (objective_);
+
+    for (std::size_t constraintId = 0;
+         constraintId < problem ().constraints ().size (); ++constraintId)
+    {
+      if (!activeConstraint (constraintId) || linearConstraint (constraintId))
+        continue;
+
+      const nonlinearFunction_t* g = problem ()
+                                       .constraints ()[constraintId]
+                                       ->castInto<nonlinearFunction_t> ();
+      assert (!!g);
+      functions.push_back (g);
+    }
+  }
+
+  void NagSolverNlpSparse::appendJacobianPattern (
+    const differentiableFunction_t& f, const structure_t& structure,
+    function_t::size_type row, jacobian_t::Index columnShift)
+  {
+    for (std::size_t r = 0; r < structure.size (); ++r)
+      for (std::size_t k = 0; k < structure[r].size (); ++k)
+      {
+        jacobian_t::Index column = structure[r][k] + columnShift;
+        if (column < 0 || column >= n_)
+          throw std::runtime_error (
+            (boost::format ("the shifted jacobian pattern of %1% has a "
+                            "column out of bounds (%2%)") %
+             f.getName () % column)
+              .str ());
+
+        igfun_.push_back (static_cast<Integer> (row + r + 1));
+        jgvar_.push_back (static_cast<Integer> (column + 1));
+      }
+  }
+
+  bool NagSolverNlpSparse::match_pattern (const PatternStructure& structure,
+                                          jacobian_t::Index columnShift,
+                                          Integer row, std::size_t k) const
+  {
+    const std::size_t neg = static_cast<std::size_t> (neg_);
+    const std::size_t size = structure.columns.size ();
+    const Integer rows = static_cast<Integer> (structure.rows.size () - 1);
+
+    if (k + size > neg) return false;
+
+    for (Integer r = 0; r < rows; ++r)
+      for (std::size_t e = structure.rows[static_cast<std::size_t> (r)];
+           e < structure.rows[static_cast<std::size_t> (r) + 1]; ++e)
+        if (igfun_[k + e] != row + r + 1 ||
+            jgvar_[k + e] - 1 != structure.columns[e] + columnShift)
+          return false;
+
+    // The following entries must belong to the next functions.
+    return k + size == neg || igfun_[k + size] > row + rows;
+  }
+
+  void NagSolverNlpSparse::setup_fused ()
+  {
+    std::vector<const differentiableFunction_t*> functions;
+    nonlinearFunctions (functions);
+
+    fused_.resize (functions.size ());
+    for (std::size_t f = 0; f < functions.size (); ++f)
+      fused_[f] = nag::fusedEvaluation (*functions[f]);
+  }
+
+  bool NagSolverNlpSparse::fill_patterns ()
+  {
+    patterns_.clear ();
+
+    std::vector<const differentiableFunction_t*> functions;
+    nonlinearFunctions (functions);
+
+    // First pattern and column offset of each repeated function.
+    typedef std::map<std::string, std::pair<std::size_t, jacobian_t::Index> >
+      instances_t;
+    instances_t instances;
+
+    // G entries are sorted by row, then by column in each row. They
+    // start after the cost row if the objective is not in G.
+    std::size_t k = 0;
+    const std::size_t neg = static_cast<std::size_t> (neg_);
+    Integer row = objective_ ? 0 : 1;
+    for (std::size_t f = 0; f < functions.size (); ++f)
+    {
+      const function_t::size_type rows = functions[f]->outputSize ();
+
+      JacobianPattern pattern;
+      pattern.offset = k;
+      pattern.columnShift = 0;
+
+      // Instances of a repeated function share the structure of the
+      // first one, if their G entries match it.
+      const nag::PatternInstance* instance =
+        nag::patternInstance (*functions[f]);
+      std::string key;
+      instances_t::const_iterator first = instances.end ();
+      if (instance)
+      {
+        key = instanceKey (*functions[f]);
+        first = instances.find (key);
+      }
+
+      if (first != instances.end ())
+      {
+        boost::shared_ptr<const PatternStructure> reference =
+          patterns_[first->second.first].structure;
+        jacobian_t::Index shift =
+          instance->columnOffset () - first->second.second;
+
+        if (match_pattern (*reference, shift, row, k))
+        {
+          pattern.columnShift = shift;
+          pattern.structure = reference;
+          patterns_.push_back (pattern);
+          k += reference->columns.size ();
+          row += static_cast<Integer> (rows);
+          continue;
+        }
+      }
+
+      boost::shared_ptr<PatternStructure> structure (new PatternStructure ());
+      structure->rows.reserve (static_cast<std::size_t> (rows) + 1);
+      structure->rows.push_back (0);
+
+      for (function_t::size_type r = 0; r < rows; ++r, ++row)
+      {
+        for (; k < neg && igfun_[k] == row + 1; ++k)
+        {
+          jacobian_t::Index column = jgvar_[k] - 1;
+          if (column < 0 || column >= n_ ||
+              (structure->columns.size () > structure->rows.back () &&
+               column <= structure->columns.back ()))
+            return false;
+          structure->columns.push_back (column);
+        }
+        structure->rows.push_back (structure->columns.size ());
+      }
+
+      pattern.structure = structure;
+      if (instance && first == instances.end ())
+        instances[key] =
+          std::make_pair (patterns_.size (), instance->columnOffset ());
+      patterns_.push_back (pattern);
+    }
+    return k == neg;
+  }
+
+  std::string NagSolverNlpSparse::signature () const
+  {
+    std::string res =
+      (boost::format ("n %1%\ncost %2% %3% %4%\n") % n_ %
+       (objective_ ? "nonlinear" : objrow_ ? "linear" : "constant") %
+       problem ().function ().getName () % problem ().function ().outputSize ())
+        .str ();
+
+    for (std::size_t constraintId = 0;
+         constraintId < problem ().constraints ().size (); ++constraintId)
+    {
+      const function_t& g = *problem ().constraints ()[constraintId];
+      res += (boost::format ("%1% %2% %3%\n") %
+              (!activeConstraint (constraintId)
+                 ? "inactive"
+                 : g.asType<linearFunction_t> ()
+                 ? "linear"
+                 : affine_[constraintId] ? "affine" : "nonlinear") %
+              g.getName () % g.outputSize ())
+               .str ();
+    }
+    return res;
+  }
+
+  bool NagSolverNlpSparse::load_structure (const std::string& filename,
+                                           const std::string& signature)
+  {
+    nag::SparseStructure structure;
+    if (!nag::loadPatternCache (filename, signature, structure)) return false;
+
+    // A is filled from the problem: a different sparsity of the linear
+    // functions means that the cached G may not be the one of this
+    // problem either.
+    const std::size_t nea = static_cast<std::size_t> (nea_);
+    if (structure.iafun.size () != nea ||
+        !std::equal (structure.iafun.begin (), structure.iafun.end (),
+                     iafun_.begin ()) ||
+        !std::equal (structure.javar.begin (), structure.javar.end (),
+                     javar_.begin ()))
+      return false;
+
+    igfun_.swap (structure.igfun);
+    jgvar_.swap (structure.jgvar);
+    neg_ = leng_ = static_cast<Integer> (igfun_.size ());
+
+    // Same padding as fill_igfun_jgvar_leng_neg.
+    if (leng_ == 0)
+    {
+      igfun_.resize (1);
+      jgvar_.resize (1);
+      leng_ = 1;
+    }
+
+    return fill_patterns ();
+  }
+
+  void NagSolverNlpSparse::save_structure (const std::string& filename,
+                                           const std::string& signature) const
+  {
+    const std::size_t nea = static_cast<std::size_t> (nea_);
+    const std::size_t neg = static_cast<std::size_t> (neg_);
+
+    nag::SparseStructure structure;
+    structure.iafun.assign (iafun_.begin (), iafun_.begin () + nea);
+    structure.javar.assign (javar_.begin (), javar_.begin () + nea);
+    structure.igfun.assign (igfun_.begin (), igfun_.begin () + neg);
+    structure.jgvar.assign (jgvar_.begin (), jgvar_.begin () + neg);
+    nag::savePatternCache (filename, signature, structure);
+  }
+
+  std::string NagSolverNlpSparse::basisSignature () const
+  {
+    // Presolve changes the variables and rows seen by NAG, scaling
+    // does not (basis files hold unscaled values).
+    return (boost::format ("%1%presolved %2%\nn %3%\nnf %4%\n") %
+            signature () % presolved_ % n_ % nf_)
+      .str ();
+  }
+
+  bool NagSolverNlpSparse::load_basis (const std::string& filename)
+  {
+    nag::Basis basis;
+    if (!nag::loadBasis (filename, basisSignature (), basis) ||
+        basis.x.size () != static_cast<std::size_t> (n_) ||
+        basis.f.size () != static_cast<std::size_t> (nf_))
+      return false;
+
+    x_ = Eigen::Map<const vector_t> (&basis.x[0], n_);
+    xmul_ = Eigen::Map<const vector_t> (&basis.xmul[0], n_);
+    f_ = Eigen::Map<const vector_t> (&basis.f[0], nf_);
+    fmul_ = Eigen::Map<const vector_t> (&basis.fmul[0], nf_);
+    xstate_.swap (basis.xstate);
+    fstate_.swap (basis.fstate);
+    ns_ = basis.ns;
+
+    if (scaled_) scale_start ();
+    return true;
+  }
+
+  void NagSolverNlpSparse::scale_start ()
+  {
+    x_.array () /= columnScales_.array ();
+    xmul_.array () *= columnScales_.array ();
+    f_.array () *= rowScales_.array ();
+    fmul_.array () /= rowScales_.array ();
+  }
+
+  void NagSolverNlpSparse::setWarmStart (const vector_t& x,
+                                         const vector_t& xmul,
+                                         const vector_t& lambda)
+  {
+    function_t::size_type m = 0;
+    for (std::size_t constraintId = 0;
+         constraintId < problem ().constraints ().size (); ++constraintId)
+      m += problem ().constraints ()[constraintId]->outputSize ();
+
+    if (x.size () != problem ().function ().inputSize () ||
+        xmul.size () != x.size () || lambda.size () != m)
+      throw std::runtime_error ("the warm start does not match the problem");
+
+    warmStart_.reset (new WarmStart ());
+    warmStart_->x = x;
+    warmStart_->xmul = xmul;
+    warmStart_->lambda = lambda;
+  }
+
+  namespace
+  {
+    /// \brief NAG state of a variable or a row starting with a
+    /// multiplier: nonbasic at the bound it holds, basic otherwise.
+    Integer warmState (double multiplier)
+    {
+      if (multiplier > 0.) return 0;
+      if (multiplier < 0.) return 1;
+      return 3;
+    }
+  } // end of anonymous namespace
+
+  void NagSolverNlpSparse::apply_warm_start ()
+  {
+    const WarmStart& warm = *warmStart_;
+    const std::size_t constraints = problem ().constraints ().size ();
+
+    std::vector<Integer> starts;
+    std::vector<Integer> results;
+    constraintStarts (starts);
+    resultStarts (results);
+
+    // Multipliers of the rows of F of the full problem. The cost row
+    // has none.
+    Integer nf = nfNonlinear_;
+    for (std::size_t constraintId = 0; constraintId < constraints;
+         ++constraintId)
+      if (activeConstraint (constraintId) && linearConstraint (constraintId))
+        nf += static_cast<Integer> (
+          problem ().constraints ()[constraintId]->outputSize ());
+
+    vector_t fmul = vector_t::Zero (nf);
+    for (std::size_t constraintId = 0; constraintId < constraints;
+         ++constraintId)
+    {
+      if (!activeConstraint (constraintId)) continue;
+      Integer m = static_cast<Integer> (
+        problem ().constraints ()[constraintId]->outputSize ());
+      fmul.segment (starts[constraintId], m) =
+        warm.lambda.segment (results[constraintId], m);
+    }
+
+    if (presolved_)
+    {
+      // The multiplier of a row removed by presolve goes to the bound
+      // it gave (the reverse of postsolve).
+      for (Integer i = 0; i < n_; ++i)
+      {
+        std::size_t j =
+          static_cast<std::size_t> (variables_[static_cast<std::size_t> (i)]);
+        x_[i] = warm.x[j];
+        xmul_[i] = warm.xmul[j];
+
+        const BoundSource sources[] = {variableLowerSources_[j],
+                                       variableUpperSources_[j]};
+        for (std::size_t k = 0; k < 2; ++k)
+          if (sources[k].row >= 0 && fmul[sources[k].row] != 0.)
+            xmul_[i] = fmul[sources[k].row] * sources[k].factor;
+      }
+      for (Integer i = 0; i < nf_; ++i)
+      {
+        std::size_t r =
+          static_cast<std::size_t> (rows_[static_cast<std::size_t> (i)]);
+        fmul_[i] = fmul[static_cast<vector_t::Index> (r)];
+
+        const BoundSource sources[] = {rowLowerSources_[r],
+                                       rowUpperSources_[r]};
+        for (std::size_t k = 0; k < 2; ++k)
+          if (sources[k].row >= 0 && fmul[sources[k].row] != 0.)
+            fmul_[i] = fmul[sources[k].row] * sources[k].factor;
+      }
+    }
+    else
+    {
+      x_ = warm.x;
+      xmul_ = warm.xmul;
+      fmul_ = fmul;
+    }
+
+    // F is computed again by NAG.
+    f_.setZero ();
+    if (scaled_) scale_start ();
+
+    for (Integer i = 0; i < n_; ++i)
+      xstate_[static_cast<std::size_t> (i)] = warmState (xmul_[i]);
+    for (Integer i = 0; i < nf_; ++i)
+      fstate_[static_cast<std::size_t> (i)] = warmState (fmul_[i]);
+    ns_ = 0;
+  }
+
+  void NagSolverNlpSparse::save_basis (const std::string& filename) const
+  {
+    nag::Basis basis;
+    basis.x.assign (x_.data (), x_.data () + n_);
+    basis.xmul.assign (xmul_.data (), xmul_.data () + n_);
+    basis.xstate = xstate_;
+    basis.f.assign (f_.data (), f_.data () + nf_);
+    basis.fmul.assign (fmul_.data (), fmul_.data () + nf_);
+    basis.fstate = fstate_;
+    basis.ns = ns_;
+    nag::saveBasis (filename, basisSignature (), basis);
+  }
+
+  void NagSolverNlpSparse::fill_iafun_javar_lena_nea ()
+  {
+    iafun_.clear ();
+    javar_.clear ();
+    a_.clear ();
+
+    function_t::size_type offset = 0;
+
+    // compute the initial offset
+    offset += problem ().function ().outputSize ();
+    for (std::size_t constraintId = 0;
+         constraintId < problem ().constraints ().size (); ++constraintId)
+    {
+      // if linear or inactive, pass.
+      if (!activeConstraint (constraintId) || linearConstraint (constraintId))
+        continue;
+
+      const nonlinearFunction_t* g = problem ()
+                                       .constraints ()[constraintId]
+                                       ->castInto<nonlinearFunction_t> ();
+      assert (!!g);
+      offset += g->outputSize ();
+    }
+
+    nea_ = 0;
+
+    // linear objective in the cost row
+    if (!objective_ && objrow_ != 0)
+    {
+      boost::scoped_ptr<numericLinearFunction_t> g_;
+      const numericLinearFunction_t* g =
+        numericLinearForm (problem ().function (), g_);
+
+      for (function_t::matrix_t::Index k = 0; k < g->A ().outerSize (); ++k)
+        for (function_t::matrix_t::InnerIterator it (g->A (), k); it; ++it)
+        {
+          iafun_.push_back (1);
+          javar_.push_back (static_cast<Integer> (it.col () + 1));
+          a_.push_back (it.value ());
+        }
+    }
+
+    for (std::size_t constraintId = 0;
+         constraintId < problem ().constraints ().size (); ++constraintId)
+    {
+      // if nonlinear or inactive, pass.
+      if (!activeConstraint (constraintId) || !linearConstraint (constraintId))
+        continue;
+
+      boost::scoped_ptr<numericLinearFunction_t> g_;
+      const numericLinearFunction_t* g = linearForm (constraintId, g_);
+
+      // copy the non-null elements of the jacobian (rows and columns
+      // fit in an Integer since nf and n do)
+      for (function_t::matrix_t::Index k = 0; k < g->A ().outerSize (); ++k)
+        for (function_t::matrix_t::InnerIterator it (g->A (), k); it; ++it)
+        {
+          iafun_.push_back (static_cast<Integer> (offset + it.row () + 1));
+          javar_.push_back (static_cast<Integer> (it.col () + 1));
+          a_.push_back (it.value ());
+        }
+      offset += g->A ().rows ();
+    }
+
+    lena_ = nag::toInteger (iafun_.size (), "the number of nonzeros of A");
+    nea_ = lena_;
+
+    if (lena_ == 0)
+    {
+      iafun_.resize (1);
+      javar_.resize (1);
+      a_.resize (1);
+      lena_ = 1;
+      nea_ = 0;
+    }
+  }
+
+  void NagSolverNlpSparse::fill_igfun_jgvar_leng_neg ()
+  {
+    igfun_.clear ();
+    jgvar_.clear ();
+    samplePoints_.clear ();
+
+    // Cost first, then the nonlinear constraints.
+    std::vector<const differentiableFunction_t*> functions;
+    nonlinearFunctions (functions);
+
+    // Structure and column offset of the first instance of each
+    // repeated function.
+    typedef std::map<std::string,
+                     std::pair<structure_t, jacobian_t::Index> > instances_t;
+    instances_t instances;
+
+    function_t::size_type offset = objective_ ? 0 : 1;
+    structure_t structure;
+
+    for (std::size_t f = 0; f < functions.size (); ++f)
+    {
+      const differentiableFunction_t& g = *functions[f];
+      const nag::PatternInstance* instance = nag::patternInstance (g);
+
+      if (!instance)
+      {
+        jacobianStructure (g, structure);
+        appendJacobianPattern (g, structure, offset, 0);
+      }
+      else
+      {
+        std::string key = instanceKey (g);
+        instances_t::iterator it = instances.find (key);
+        if (it == instances.end ())
+        {
+          it = instances
+                 .insert (std::make_pair (
+                   key, std::make_pair (structure_t (),
+                                        instance->columnOffset ())))
+                 .first;
+          jacobianStructure (g, it->second.first);
+        }
+        appendJacobianPattern (g, it->second.first, offset,
+                               instance->columnOffset () - it->second.second);
+      }
+      offset += g.outputSize ();
+    }
+
+    leng_ = nag::toInteger (igfun_.size (), "the number of nonzeros of G");
+    neg_ = leng_;
+
+    if (leng_ == 0)
+    {
+      igfun_.resize (1);
+      jgvar_.resize (1);
+      leng_ = 1;
+      neg_ = 0;
+    }
+
+    bool patterns = fill_patterns ();
+    assert (patterns);
+    (void)patterns;
+  }
+
+  void NagSolverNlpSparse::fill_fnames ()
+  {
+    boost::format fmt ("%1%, %2%, Ouput variable %3%");
+
+    // first push the cost function name
+    fnames_.push_back (strdup (
+      (fmt % "cost" % problem ().function ().getName () % 0).str ().c_str ()));
+
+    // then nonlinear constraints
+    for (std::size_t constraintId = 0;
+         constraintId < problem ().constraints ().size (); ++constraintId)
+    {
+      const boost::shared_ptr<const function_t>& cstr =
+        problem ().constraints ()[constraintId];
+
+      if (!activeConstraint (constraintId) || linearConstraint (constraintId))
+        continue;
+
+      const nonlinearFunction_t* g = cstr->castInto<nonlinearFunction_t> ();
+      assert (!!g);
+
+      for (Function::size_type i = 0; i < g->outputSize (); ++i)
+        fnames_.push_back (
+          strdup ((fmt % "nonlinear" % g->getName () % i).str ().c_str ()));
+    }
 
     // and to finish the linear ones.
     for (std::size_t constraintId = 0;
@@ -580,23 +2230,503 @@ namespace roboptim
       const boost::shared_ptr<const function_t>& cstr =
         problem ().constraints ()[constraintId];
 
-      if (!cstr->asType<linearFunction_t> ()) continue;
+      if (!activeConstraint (constraintId) || !linearConstraint (constraintId))
+        continue;
+
+      const char* type = affine_[constraintId] ? "affine" : "linear";
+      for (Function::size_type i = 0; i < cstr->outputSize (); ++i)
+        fnames_.push_back (
+          strdup ((fmt % type % cstr->getName () % i).str ().c_str ()));
+    }
+
+    assert (static_cast<std::size_t> (nf_) == fnames_.size ());
+  }
+
+  const char* cxxtoCString (std::string s) { return s.c_str (); }
+
+  namespace
+  {
+    /// \brief NAG file opened for the duration of a solve.
+    class ScopedNagFile
+    {
+    public:
+      /// \param filename file name (no file if empty).
+      /// \param mode 0 for reading, 1 for writing.
+      ScopedNagFile (const std::string& filename, Integer mode)
+        : open_ (false), fileId_ ()
+      {
+        if (filename.empty ()) return;
+
+        NagError fail;
+        std::memset (&fail, 0, sizeof (NagError));
+        INIT_FAIL (fail);
+        nag_open_file (filename.c_str (), mode, &fileId_, &fail);
+        if (fail.code != NE_NOERROR) throw std::runtime_error (fail.message);
+        open_ = true;
+      }
+
+      ~ScopedNagFile ()
+      {
+        if (!open_) return;
+
+        NagError fail;
+        std::memset (&fail, 0, sizeof (NagError));
+        INIT_FAIL (fail);
+        nag_close_file (fileId_, &fail);
+      }
+
+      /// \brief NAG file identifier, 0 if there is no file.
+      Integer id () const
+      {
+        return open_ ? static_cast<Integer> (fileId_) : 0;
+      }
+
+    private:
+      bool open_;
+      Nag_FileID fileId_;
+    };
+  } // end of anonymous namespace
+
+  namespace
+  {
+    /// \brief Independent block of a decomposed problem.
+    struct Block
+    {
+      typedef NagSolverNlpSparse::function_t function_t;
+
+      /// \brief Variables of the block.
+      std::vector<function_t::size_type> columns;
+
+      /// \brief Rows of each constraint in the block.
+      std::vector<std::vector<function_t::size_type> > rows;
+
+      /// \brief Cost of the block, referenced by its problem.
+      boost::shared_ptr<const function_t> cost;
+
+      boost::scoped_ptr<NagSolverNlpSparse::problem_t> problem;
+      boost::scoped_ptr<NagSolverNlpSparse> solver;
+
+      /// \brief Why the solver threw, if it did.
+      std::string exception;
+    };
+
+    /// \brief Solve a block, in a decreasing size order.
+    struct SolveBlock
+    {
+      void operator() (std::size_t k) const
+      {
+        Block& block = *blocks[order[k]];
+        try
+        {
+          block.solver->minimum ();
+        }
+        catch (const std::exception& e)
+        {
+          block.exception = e.what ();
+        }
+      }
+
+      const std::vector<boost::shared_ptr<Block> >& blocks;
+
+      /// \brief Solve order of the blocks.
+      const std::vector<std::size_t>& order;
+    };
+
+    /// \brief Whether the first block has more variables.
+    struct LargerBlock
+    {
+      explicit LargerBlock (const std::vector<boost::shared_ptr<Block> >& b)
+        : blocks (b)
+      {
+      }
+
+      bool operator() (std::size_t i, std::size_t j) const
+      {
+        return blocks[i]->columns.size () > blocks[j]->columns.size ();
+      }
+
+      const std::vector<boost::shared_ptr<Block> >& blocks;
+    };
+  } // end of anonymous namespace
+
+  bool NagSolverNlpSparse::solve_blocks (double start)
+  {
+    // Iteration callbacks expect the full problem.
+    if (!integerParameter ("nag.decompose", 0) || callback_) return false;
+
+    nag::Decomposition decomposition;
+    nag::decompose (n_, nf_, iafun_.data (), javar_.data (), nea_,
+                    igfun_.data (), jgvar_.data (), neg_,
+                    objective_ ? 0 : objrow_, decomposition);
+    if (decomposition.blocks < 2) return false;
+
+    typedef function_t::size_type size_type;
+    const std::size_t constraints = problem ().constraints ().size ();
+    const vector_t x = lookForX ();
+
+    std::vector<Integer> starts;
+    constraintStarts (starts);
+
+    std::vector<boost::shared_ptr<Block> > blocks (decomposition.blocks);
+    for (std::size_t b = 0; b < blocks.size (); ++b)
+    {
+      blocks[b] = boost::make_shared<Block> ();
+      blocks[b]->rows.resize (constraints);
+    }
+    for (Integer i = 0; i < n_; ++i)
+      blocks[decomposition.variableBlock[static_cast<std::size_t> (i)]]
+        ->columns.push_back (i);
+    for (std::size_t constraintId = 0; constraintId < constraints;
+         ++constraintId)
+      for (size_type i = 0;
+           i < problem ().constraints ()[constraintId]->outputSize (); ++i)
+        blocks[decomposition.rowBlock[static_cast<std::size_t> (
+                 starts[constraintId] + i)]]
+          ->rows[constraintId]
+          .push_back (i);
+
+    // A nonlinear cost links its variables, so that it belongs to a
+    // single block. Linear costs are split between the blocks.
+    boost::scoped_ptr<numericLinearFunction_t> costStorage;
+    const numericLinearFunction_t* linearCost =
+      objective_ ? 0 : numericLinearForm (problem ().function (), costStorage);
+
+    for (std::size_t b = 0; b < blocks.size (); ++b)
+    {
+      Block& block = *blocks[b];
+      const size_type n = static_cast<size_type> (block.columns.size ());
+
+      std::vector<size_type> columnIndex (static_cast<std::size_t> (n_), -1);
+      for (std::size_t i = 0; i < block.columns.size (); ++i)
+        columnIndex[static_cast<std::size_t> (block.columns[i])] =
+          static_cast<size_type> (i);
+
+      if (objective_ && decomposition.rowBlock[0] == b)
+        block.cost = boost::make_shared<nag::BlockFunction> (
+          *objective_, std::vector<size_type> (1, 0), block.columns, x);
+      else if (objective_)
+        block.cost = boost::make_shared<numericLinearFunction_t> (
+          jacobian_t (1, n), vector_t::Zero (1));
+      else
+        block.cost = boost::make_shared<numericLinearFunction_t> (
+          nag::subMatrix (linearCost->A (), std::vector<size_type> (1, 0),
+                          columnIndex, n),
+          vector_t::Zero (1));
+
+      block.problem.reset (new problem_t (*block.cost));
+      vector_t startingPoint (n);
+      for (std::size_t i = 0; i < block.columns.size (); ++i)
+      {
+        block.problem->argumentBounds ()[i] =
+          problem ().argumentBounds ()[static_cast<std::size_t> (
+            block.columns[i])];
+        startingPoint[static_cast<size_type> (i)] = x[block.columns[i]];
+      }
+      block.problem->startingPoint () = startingPoint;
+
+      for (std::size_t constraintId = 0; constraintId < constraints;
+           ++constraintId)
+      {
+        const std::vector<size_type>& rows = block.rows[constraintId];
+        if (rows.empty ()) continue;
+
+        const boost::shared_ptr<const function_t>& cstr =
+          problem ().constraints ()[constraintId];
+        const function_t::intervals_t& cstrBounds =
+          problem ().boundsVector ()[constraintId];
+        function_t::intervals_t bounds;
+        for (std::size_t i = 0; i < rows.size (); ++i)
+          bounds.push_back (cstrBounds[static_cast<std::size_t> (rows[i])]);
+        problem_t::scaling_t scales (rows.size (), 1.);
+
+        if (cstr->asType<linearFunction_t> ())
+        {
+          boost::scoped_ptr<numericLinearFunction_t> storage;
+          const numericLinearFunction_t* g =
+            numericLinearForm (*cstr, storage);
+          vector_t b (static_cast<size_type> (rows.size ()));
+          for (std::size_t i = 0; i < rows.size (); ++i)
+            b[static_cast<size_type> (i)] = g->b ()[rows[i]];
+          block.problem->addConstraint (
+            boost::make_shared<numericLinearFunction_t> (
+              nag::subMatrix (g->A (), rows, columnIndex, n), b),
+            bounds, scales);
+        }
+        else
+          block.problem->addConstraint (
+            boost::make_shared<nag::BlockFunction> (
+              *cstr->castInto<nonlinearFunction_t> (), rows, block.columns,
+              x),
+            bounds, scales);
+      }
+
+      // Cached patterns are not shared by the blocks (see shareSettings),
+      // since blocks made of the same functions may use different rows.
+      block.solver.reset (new NagSolverNlpSparse (*block.problem));
+      block.solver->shareSettings (*this);
+      block.solver->parameters ()["nag.decompose"].value = 0;
+    }
+
+    // Largest blocks first, so that the threads end at the same time.
+    std::vector<std::size_t> order (blocks.size ());
+    for (std::size_t b = 0; b < order.size (); ++b) order[b] = b;
+    std::stable_sort (order.begin (), order.end (), LargerBlock (blocks));
+
+    double solveStart = nag::now ();
+    statistics_.setupTime = solveStart - start;
+
+    SolveBlock task = {blocks, order};
+    nag::parallelFor (task, blocks.size (),
+                      integerParameter ("nag.decompose_threads", 0));
+
+    statistics_.solveTime = nag::now () - solveStart;
+
+    // Merge the block results: constraints are in the Result order,
+    // nonlinear constraints first.
+    std::vector<Integer> results;
+    resultStarts (results);
+    xmul_.setZero (n_);
+
+    Result res (problem ().function ().inputSize (),
+                problem ().function ().outputSize ());
+    res.x = x;
+    res.value.setZero ();
+    res.constraints.setZero (nf_ - 1);
+    res.lambda.setZero (nf_ - 1);
+
+    std::string error;
+    statistics_.majorIterations = 0;
+    for (std::size_t b = 0; b < blocks.size (); ++b)
+    {
+      Block& block = *blocks[b];
+      const nag::Statistics& stats = block.solver->statistics ();
+      statistics_.evaluations += stats.evaluations;
+      statistics_.derivativeEvaluations += stats.derivativeEvaluations;
+      statistics_.callbackTime += stats.callbackTime;
+      statistics_.nonZeros += stats.nonZeros;
+      if (stats.majorIterations < 0 || statistics_.majorIterations < 0)
+        statistics_.majorIterations = -1;
+      else
+        statistics_.majorIterations += stats.majorIterations;
+
+      // A block that threw keeps its starting point: the other blocks
+      // are still merged, in the last state of the error.
+      const Result* blockResult = 0;
+      const result_t& result = block.solver->result_;
+      if (!block.exception.empty ())
+      {
+        if (error.empty ())
+          error =
+            (boost::format ("block %1%: %2%") % b % block.exception).str ();
+      }
+      else if (result.which () == SOLVER_VALUE)
+        blockResult = &boost::get<Result> (result);
+      else if (result.which () == SOLVER_ERROR)
+      {
+        const SolverError& e = boost::get<SolverError> (result);
+        if (error.empty ())
+          error = (boost::format ("block %1%: %2%") % b % e.what ()).str ();
+        if (e.lastState ()) blockResult = &*e.lastState ();
+      }
+      if (!blockResult) continue;
+
+      for (std::size_t i = 0; i < block.columns.size (); ++i)
+      {
+        res.x[block.columns[i]] = blockResult->x[static_cast<size_type> (i)];
+        xmul_[block.columns[i]] =
+          block.solver->variableMultipliers ()[static_cast<size_type> (i)];
+      }
+
+      // Block constraints are in the order of the problem constraints,
+      // with the same types.
+      Integer blockOffset = 0;
+      for (int linear = 0; linear < 2; ++linear)
+        for (std::size_t constraintId = 0; constraintId < constraints;
+             ++constraintId)
+        {
+          const function_t& g = *problem ().constraints ()[constraintId];
+          const std::vector<size_type>& rows = block.rows[constraintId];
+          if (rows.empty () ||
+              static_cast<int> (g.asType<linearFunction_t> () != 0) != linear)
+            continue;
+          for (std::size_t i = 0; i < rows.size (); ++i, ++blockOffset)
+          {
+            Integer row = results[constraintId] + rows[i];
+            res.constraints[row] = blockResult->constraints[blockOffset];
+            res.lambda[row] = blockResult->lambda[blockOffset];
+          }
+        }
+    }
+
+    x_ = res.x;
+    res.value[0] = problem ().function () (res.x)[0];
+
+    if (error.empty ())
+      this->result_ = res;
+    else
+    {
+      SolverError e (error);
+      e.lastState () = res;
+      this->result_ = e;
+    }
+
+    statistics_.wallTime = nag::now () - start;
+    if (reportStatistics_)
+      nag::appendStatistics ("nag-nlp-sparse",
+                             problem ().function ().getName (), n_, nf_,
+                             error.empty (), statistics_);
+    return true;
+  }
+
+  struct NagSolverNlpSparse::Structure
+  {
+    /// \brief Signature of the problem (see signature).
+    std::string signature;
+
+    std::vector<Integer> igfun;
+    std::vector<Integer> jgvar;
+    Integer leng;
+    Integer neg;
+    std::vector<JacobianPattern> patterns;
+  };
+
+  struct NagSolverNlpSparse::BatchTask
+  {
+    void operator() (std::size_t i) const
+    {
+      try
+      {
+        NagSolverNlpSparse solver (*problems[i]);
+        solver.shareSettings (prototype);
+        solver.parameters ()["nag.decompose"].value = 0;
+        solver.shareStructure (structure);
+        results[i] = solver.minimum ();
+        statistics[i] = solver.statistics ();
+      }
+      catch (const std::exception& e)
+      {
+        results[i] = SolverError (e.what ());
+      }
+    }
+
+    const NagSolverNlpSparse& prototype;
+    const structurePtr_t& structure;
+    const std::vector<const problem_t*>& problems;
+    std::vector<result_t>& results;
+    std::vector<nag::Statistics>& statistics;
+  };
+
+  std::vector<NagSolverNlpSparse::result_t>
+  NagSolverNlpSparse::solveBatch (const std::vector<const problem_t*>& problems,
+                                  std::vector<nag::Statistics>& statistics)
+    const
+  {
+    // Sparsity patterns shared by the instances, found by a scratch
+    // solver so that the state of this one (lazy constraints, last
+    // structure) is left as it is.
+    NagSolverNlpSparse scratch (problem ());
+    scratch.parameters () = parameters ();
+    scratch.setup_structure ();
+
+    std::vector<result_t> results (problems.size ());
+    statistics.assign (problems.size (), nag::Statistics ());
+
+    BatchTask task = {*this, scratch.structure_, problems, results,
+                      statistics};
+    nag::parallelFor (task, problems.size (),
+                      integerParameter ("nag.batch_threads", 0));
+    return results;
+  }
+
+  void NagSolverNlpSparse::setLazyConstraints (const std::vector<bool>& lazy)
+  {
+    if (!lazy.empty () && lazy.size () != problem ().constraints ().size ())
+      throw std::runtime_error (
+        "lazy constraints should be given for every constraint");
+    lazy_ = lazy;
+  }
+
+  void NagSolverNlpSparse::fill_names ()
+  {
+    // Names of a previous solve are released first.
+    free_names ();
+    fill_fnames ();
+    for (Function::size_type i = 0; i < problem_.function ().inputSize (); ++i)
+      xnames_.push_back (strdup (
+        ((boost::format ("RobOptim variable %1%") % i).str ().c_str ())));
+  }
+
+  void NagSolverNlpSparse::setup_structure ()
+  {
+    // Sizes of the full problem.
+    n_ = nag::toInteger (problem ().function ().inputSize (),
+                         "the number of variables");
+    samplePoints_.clear ();
+    setup_objective ();
+    detect_affine ();
+    compute_nf ();
+    setup_fused ();
+    presolved_ = false;
+    scaled_ = false;
+
+    // Shared patterns are taken as they are. A holds the data of the
+    // linear functions, it is filled again.
+    if (sharedStructure_ && signature () == sharedStructure_->signature)
+    {
+      fill_iafun_javar_lena_nea ();
+      igfun_ = sharedStructure_->igfun;
+      jgvar_ = sharedStructure_->jgvar;
+      leng_ = sharedStructure_->leng;
+      neg_ = sharedStructure_->neg;
+      patterns_ = sharedStructure_->patterns;
+      structure_ = sharedStructure_;
+      return;
+    }
 
-      const linearFunction_t* g = cstr->castInto<linearFunction_t> ();
-      assert (!!g);
+    // fill sparse A data and structure, then G structure, unless it is
+    // found in the pattern cache.
+    std::string cacheDirectory = stringParameter ("nag.structure_cache");
+    std::string cacheSignature;
+    std::string cacheFile;
+    if (!cacheDirectory.empty ())
+    {
+      cacheSignature = signature ();
+      cacheFile = nag::patternCacheFile (cacheDirectory, cacheSignature);
+    }
 
-      for (Function::size_type i = 0; i < g->outputSize (); ++i)
-        fnames_.push_back (
-          strdup ((fmt % "linear" % g->getName () % i).str ().c_str ()));
+    fill_iafun_javar_lena_nea ();
+    if (cacheFile.empty () || !load_structure (cacheFile, cacheSignature))
+    {
+      fill_igfun_jgvar_leng_neg ();
+      if (!cacheFile.empty ()) save_structure (cacheFile, cacheSignature);
     }
 
-    assert (nf_ == static_cast<int> (fnames_.size ()));
+    // Kept before presolve and lazy constraints change G.
+    boost::shared_ptr<Structure> structure (new Structure ());
+    structure->signature = cacheSignature.empty () ? signature ()
+                                                   : cacheSignature;
+    structure->igfun = igfun_;
+    structure->jgvar = jgvar_;
+    structure->leng = leng_;
+    structure->neg = neg_;
+    structure->patterns = patterns_;
+    structure_ = structure;
   }
 
-  const char* cxxtoCString (std::string s) { return s.c_str (); }
-  void NagSolverNlpSparse::solve ()
+  void NagSolverNlpSparse::setup_bounds (const vector_t& x)
   {
-    compute_nf ();
+    // Fill bounds.
+    fill_xlow_xupp ();
+    fill_flow_fupp ();
+
+    // Fill fnames.
+    fill_names ();
+
+    // Fill starting point.
+    x_ = x;
+
+    // Presolve and scale the problem, if requested.
+    if (integerParameter ("nag.presolve", 0)) presolve ();
 
     if (nf_ == 1 || n_ == 1)
     {
@@ -609,33 +2739,300 @@ namespace roboptim
       nxname_ = n_;
     }
 
-    // fill sparse A and G date and/or structure
-    fill_iafun_javar_lena_nea ();
-    fill_igfun_jgvar_leng_neg ();
-
-    // Fill bounds.
-    fill_xlow_xupp ();
-    fill_flow_fupp ();
-
-    // Fill fnames.
-    fill_fnames ();
+    if (integerParameter ("nag.auto_scaling", 0))
+    {
+      compute_scaling ();
+      apply_scaling ();
+    }
 
-    // Fill xstate.
-    x_.resize (n_);
+    // Fill xstate, xmul.
     xstate_.resize (static_cast<std::size_t> (n_));
     xmul_.resize (static_cast<Eigen::MatrixXd::Index> (n_));
 
-    // Fill starting point.
-    if (problem ().startingPoint ())
-      x_ = *problem ().startingPoint ();
-    else
-      x_.setZero ();
-
     // Fill f, fstate, fmul.
     f_.resize (nf_);
     fstate_.resize (static_cast<std::size_t> (nf_));
     fmul_.resize (nf_);
+  }
+
+  namespace
+  {
+    /// \brief Append the bytes of a value to a problem key.
+    template <typename T>
+    void appendKey (std::string& key, const T& value)
+    {
+      key.append (reinterpret_cast<const char*> (&value), sizeof (T));
+    }
+
+    void appendKey (std::string& key, const std::string& value)
+    {
+      appendKey (key, value.size ());
+      key += value;
+    }
+
+    void appendKey (std::string& key, const Function::vector_t& value)
+    {
+      appendKey (key, value.size ());
+      for (Function::vector_t::Index i = 0; i < value.size (); ++i)
+        appendKey (key, value[i]);
+    }
+
+    /// \brief Append a parameter value to a problem key.
+    /// \return false for values of other types, which cannot be
+    /// compared.
+    struct ParameterKey : public boost::static_visitor<bool>
+    {
+      explicit ParameterKey (std::string& k) : key (k)
+      {
+      }
+
+      bool operator() (const Function::value_type& value) const
+      {
+        key += 'd';
+        appendKey (key, value);
+        return true;
+      }
+
+      bool operator() (const int& value) const
+      {
+        key += 'i';
+        appendKey (key, value);
+        return true;
+      }
+
+      bool operator() (const std::string& value) const
+      {
+        key += 's';
+        appendKey (key, value);
+        return true;
+      }
+
+      bool operator() (const char* value) const
+      {
+        key += 's';
+        appendKey (key, std::string (value));
+        return true;
+      }
+
+      bool operator() (const bool& value) const
+      {
+        key += 'b';
+        appendKey (key, value);
+        return true;
+      }
+
+      bool operator() (const Function::vector_t& value) const
+      {
+        key += 'v';
+        appendKey (key, value);
+        return true;
+      }
+
+      template <typename T>
+      bool operator() (const T&) const
+      {
+        return false;
+      }
+
+      std::string& key;
+    };
+
+    /// \brief Append a function to a problem key: the data of linear
+    /// functions, the identifier of the others (see
+    /// nag::MemoizedEvaluation).
+    /// \return false if the function has no identifier.
+    bool functionKey (const GenericFunction<EigenMatrixSparse>& f,
+                      std::string& key, std::vector<std::string>& tokens)
+    {
+      appendKey (key, f.inputSize ());
+      appendKey (key, f.outputSize ());
+
+      if (f.asType<GenericLinearFunction<EigenMatrixSparse> > ())
+      {
+        boost::scoped_ptr<numericLinearFunction_t> storage;
+        const numericLinearFunction_t* g = numericLinearForm (f, storage);
+        key += 'l';
+        appendKey (key, g->A ().nonZeros ());
+        for (numericLinearFunction_t::matrix_t::Index k = 0;
+             k < g->A ().outerSize (); ++k)
+          for (numericLinearFunction_t::matrix_t::InnerIterator it (g->A (),
+                                                                    k);
+               it; ++it)
+          {
+            appendKey (key, it.row ());
+            appendKey (key, it.col ());
+            appendKey (key, it.value ());
+          }
+        appendKey (key, Function::vector_t (g->b ()));
+        return true;
+      }
+
+      const nag::MemoizedEvaluation* memo = nag::memoizedEvaluation (f);
+      if (!memo) return false;
+      tokens.push_back (memo->memoKey ());
+      key += 'f';
+      appendKey (key, tokens.back ());
+      return true;
+    }
+
+    /// \brief Parameters reading a basis file, which the result
+    /// depends on, or writing one, which only a solve does.
+    const char* const basisFileParameters[] = {
+      "nag.basis_load", "nag.old_basis_file", "nag.basis_save",
+      "nag.new_basis_file", "nag.backup_basis_file"};
+  } // end of anonymous namespace
+
+  bool NagSolverNlpSparse::result_key (std::string& key,
+                                       std::vector<std::string>& tokens) const
+  {
+    key.clear ();
+    tokens.clear ();
+
+    for (std::size_t i = 0; i < sizeof (basisFileParameters) /
+                                  sizeof (basisFileParameters[0]);
+         ++i)
+      if (!stringParameter (basisFileParameters[i]).empty ()) return false;
+
+    // Functions and bounds.
+    if (!functionKey (problem ().function (), key, tokens)) return false;
+    for (std::size_t i = 0; i < problem ().argumentBounds ().size (); ++i)
+    {
+      appendKey (key, problem ().argumentBounds ()[i].first);
+      appendKey (key, problem ().argumentBounds ()[i].second);
+    }
+
+    for (std::size_t constraintId = 0;
+         constraintId < problem ().constraints ().size (); ++constraintId)
+    {
+      if (!functionKey (*problem ().constraints ()[constraintId], key, tokens))
+        return false;
+
+      const function_t::intervals_t& bounds =
+        problem ().boundsVector ()[constraintId];
+      for (std::size_t i = 0; i < bounds.size (); ++i)
+      {
+        appendKey (key, bounds[i].first);
+        appendKey (key, bounds[i].second);
+      }
+      appendKey (key, !lazy_.empty () && lazy_[constraintId]);
+    }
+
+    // Starting point.
+    appendKey (key, !!problem ().startingPoint ());
+    if (problem ().startingPoint ())
+      appendKey (key, Function::vector_t (*problem ().startingPoint ()));
+    appendKey (key, !!warmStart_);
+    if (warmStart_)
+    {
+      appendKey (key, warmStart_->x);
+      appendKey (key, warmStart_->xmul);
+      appendKey (key, warmStart_->lambda);
+    }
+
+    // Options.
+    typedef const std::pair<const std::string, Parameter> const_iterator_t;
+    BOOST_FOREACH (const_iterator_t& it, parameters ())
+    {
+      appendKey (key, it.first);
+      if (!boost::apply_visitor (ParameterKey (key), it.second.value))
+        return false;
+    }
+    return true;
+  }
+
+  void NagSolverNlpSparse::setResultCache (
+    const boost::shared_ptr<nag::ResultCache>& cache)
+  {
+    resultCache_ = cache;
+  }
+
+  void NagSolverNlpSparse::solve ()
+  {
+    statistics_.reset ();
+    double start = nag::now ();
+
+    // A problem solved before gets its previous result.
+    std::string cacheKey;
+    std::vector<std::string> cacheTokens;
+    if (resultCache_ && result_key (cacheKey, cacheTokens))
+    {
+      Result cached (problem ().function ().inputSize (),
+                     problem ().function ().outputSize ());
+      if (resultCache_->find (cacheKey, cached, xmul_))
+      {
+        this->result_ = cached;
+        x_ = cached.x;
+        warmStart_.reset ();
+        statistics_.wallTime = nag::now () - start;
+        return;
+      }
+    }
+    else
+      cacheKey.clear ();
+
+    solve_problem (start);
+
+    if (!cacheKey.empty () && this->result_.which () == SOLVER_VALUE)
+      resultCache_->insert (cacheKey, cacheTokens,
+                            boost::get<Result> (this->result_), xmul_);
+  }
+
+  void NagSolverNlpSparse::solve_problem (double start)
+  {
+    // Kept for a second run (see below).
+    boost::scoped_ptr<WarmStart> warmStart (
+      warmStart_ ? new WarmStart (*warmStart_) : 0);
+
+    bool success;
+    if (!setup_and_run (start, success)) return;
+
+    // Shared patterns come from a problem with the same functions, whose
+    // Jacobians may still have other nonzero entries: this problem is
+    // then solved again with its own patterns.
+    if (!success && !jacobianError_.empty () && sharedStructure_ &&
+        structure_ == sharedStructure_)
+    {
+      structurePtr_t shared;
+      shared.swap (sharedStructure_);
+      warmStart_.swap (warmStart);
+      bool solved = setup_and_run (start, success);
+      sharedStructure_.swap (shared);
+      if (!solved) return;
+    }
+
+    statistics_.wallTime = nag::now () - start;
+    if (reportStatistics_)
+      nag::appendStatistics ("nag-nlp-sparse",
+                             problem ().function ().getName (), n_, nf_,
+                             success, statistics_);
+  }
+
+  bool NagSolverNlpSparse::setup_and_run (double start, bool& success)
+  {
+    if (std::find (lazy_.begin (), lazy_.end (), true) != lazy_.end ())
+    {
+      success = solve_lazy (start);
+      return true;
+    }
+
+    active_.clear ();
+    setup_structure ();
+
+    // Independent blocks are solved separately, if requested.
+    if (solve_blocks (start))
+    {
+      warmStart_.reset ();
+      return false;
+    }
+
+    setup_bounds (lookForX ());
+
+    success = run (start, Nag_Cold);
+    return true;
+  }
 
+  bool NagSolverNlpSparse::run (double setupStart, Nag_Start startMode)
+  {
     // Error code initialization.
     NagError fail;
     std::memset (&fail, 0, sizeof (NagError));
@@ -645,29 +3042,54 @@ namespace roboptim
     // To print NAG errors to stdout
     // fail.print = Nag_TRUE;
 
-    Nag_E04State state;
-    std::memset (&state, 0, sizeof (Nag_E04State));
-
-    nag_opt_sparse_nlp_init (&state, &fail);
-    updateParameters (&state, &fail);
+    // NAG state is initialized once and kept between solves, so that
+    // only modified options have to be pushed again.
+    if (!stateInitialized_)
+    {
+      nag_opt_sparse_nlp_init (&state_, &fail);
+      stateInitialized_ = true;
+      resetAppliedParameters ();
+    }
+    updateParameters (&fail);
+
+    // NAG basis files are given to NAG as file identifiers, valid for
+    // this solve only.
+    ScopedNagFile oldBasis (stringParameter ("nag.old_basis_file"), 0);
+    ScopedNagFile newBasis (stringParameter ("nag.new_basis_file"), 1);
+    ScopedNagFile backupBasis (stringParameter ("nag.backup_basis_file"), 1);
+    nag_opt_sparse_nlp_option_set_integer ("Old Basis File", oldBasis.id (),
+                                           &state_, &fail);
+    nag_opt_sparse_nlp_option_set_integer ("New Basis File", newBasis.id (),
+                                           &state_, &fail);
+    nag_opt_sparse_nlp_option_set_integer ("Backup Basis File",
+                                           backupBasis.id (), &state_, &fail);
+
+    // Warm start from a saved basis, if it matches the problem.
+    std::string basisFile = stringParameter ("nag.basis_load");
+    if (startMode == Nag_Cold && !basisFile.empty () && load_basis (basisFile))
+      startMode = Nag_Warm;
+    else if (startMode == Nag_Cold && warmStart_)
+    {
+      apply_warm_start ();
+      startMode = Nag_Warm;
+    }
+    warmStart_.reset ();
 
     // Nag communication object.
     Nag_Comm comm;
     std::memset (&comm, 0, sizeof (Nag_Comm));
     comm.p = this;
 
-    // Solve.
-    for (Function::size_type i = 0; i < problem_.function ().inputSize (); ++i)
-      xnames_.push_back (strdup (
-        ((boost::format ("RobOptim variable %1%") % i).str ().c_str ())));
+    jacobianError_.clear ();
 
+    // Solve.
     // Double check that sizes are valid.
     ROBOPTIM_ASSERT (nf_ > 0);
     ROBOPTIM_ASSERT (n_ > 0);
     ROBOPTIM_ASSERT (nxname_ == 1 || nxname_ == n_);
     ROBOPTIM_ASSERT (nfname_ == 1 || nfname_ == nf_);
     ROBOPTIM_ASSERT (objadd_ == 0.);
-    ROBOPTIM_ASSERT (1 <= objrow_ && objrow_ <= nf_);
+    ROBOPTIM_ASSERT (0 <= objrow_ && objrow_ <= nf_);
     ROBOPTIM_ASSERT (iafun_.size () == static_cast<std::size_t> (lena_));
     ROBOPTIM_ASSERT (javar_.size () == static_cast<std::size_t> (lena_));
     ROBOPTIM_ASSERT (a_.size () == static_cast<std::size_t> (lena_));
@@ -695,58 +3117,358 @@ namespace roboptim
     ROBOPTIM_ASSERT (fmul_.size () ==
                      static_cast<Eigen::MatrixXd::Index> (nf_));
 
+    // Start a new trace, if requested. It holds the variables and rows
+    // of the full problem.
+    if (presolved_)
+      openTrace (static_cast<std::size_t> (fullX_.size ()),
+                 static_cast<std::size_t> (fullFlow_.size () - 1));
+    else
+      openTrace (static_cast<std::size_t> (n_),
+                 static_cast<std::size_t> (nf_ - 1));
+
+    // Open the evaluation stores, if requested.
+    setup_memo ();
+
+    statistics_.nonZeros = neg_ + nea_;
+
+    double solveStart = nag::now ();
+    statistics_.setupTime += solveStart - setupStart;
+
     nag_opt_sparse_nlp_solve (
-      Nag_Cold, nf_, n_, nxname_, nfname_, objadd_, objrow_, "RobOptim problem",
-      detail::usrfun, iafun_.data (), javar_.data (), a_.data (), lena_, nea_,
-      igfun_.data (), jgvar_.data (), leng_, neg_, xlow_.data (), xupp_.data (),
-      xnames_.data (), flow_.data (), fupp_.data (), fnames_.data (),
-      x_.data (), xstate_.data (), xmul_.data (), f_.data (), fstate_.data (),
-      fmul_.data (), &ns_, &ninf_, &sinf_, &state, &comm, &fail);
+      startMode, nf_, n_, nxname_, nfname_, objadd_, objrow_,
+      "RobOptim problem", detail::usrfun, iafun_.data (), javar_.data (),
+      a_.data (), lena_, nea_, igfun_.data (), jgvar_.data (), leng_, neg_,
+      xlow_.data (), xupp_.data (), xnames_.data (), flow_.data (),
+      fupp_.data (), fnames_.data (), x_.data (), xstate_.data (),
+      xmul_.data (), f_.data (), fstate_.data (), fmul_.data (), &ns_, &ninf_,
+      &sinf_, &state_, &comm, &fail);
+
+    statistics_.solveTime += nag::now () - solveStart;
+
+    // Record the solution and its multipliers.
+    if (trace ()) traceEvaluation (x_.data (), f_.data (), fmul_.data () + 1);
+
+    if (scaled_) unscale_solution ();
+
+    basisFile = stringParameter ("nag.basis_save");
+    if (!basisFile.empty ()) save_basis (basisFile);
+
+    if (presolved_) postsolve ();
+    restore_affine_rows ();
 
     Result res (problem ().function ().inputSize (),
                 problem ().function ().outputSize ());
 
     res.x = x_;
     res.value.setZero ();
-    res.value[0] = f_[0];
+    // Linear and constant objectives are evaluated once, at the
+    // solution.
+    res.value[0] = objective_ ? f_[0] : problem ().function () (x_)[0];
     res.constraints = f_.segment (1, nf_ - 1);
     res.lambda = fmul_.segment (1, nf_ - 1);
 
     if (fail.code == NE_NOERROR)
-    {
       this->result_ = res;
-      return;
+    else
+    {
+      SolverError error (jacobianError_.empty () ? std::string (fail.message)
+                                                 : jacobianError_);
+      error.lastState () = res;
+      this->result_ = error;
     }
 
-    SolverError error (fail.message);
-    error.lastState () = res;
-    this->result_ = error;
+    return fail.code == NE_NOERROR;
   }
-} // end of namespace roboptim.
 
-extern "C" {
-typedef roboptim::NagSolverNlpSparse NagSolverNlpSparse;
-typedef roboptim::Solver< ::roboptim::EigenMatrixSparse> solver_t;
+  bool NagSolverNlpSparse::solve_lazy (double start)
+  {
+    const std::size_t constraints = problem ().constraints ().size ();
+    const int rounds = integerParameter ("nag.lazy_rounds", 20);
+    const double tolerance = doubleParameter ("nag.lazy_tolerance", 1e-6);
 
-ROBOPTIM_DLLEXPORT unsigned getSizeOfProblem ();
-ROBOPTIM_DLLEXPORT const char* getTypeIdOfConstraintsList ();
-ROBOPTIM_DLLEXPORT solver_t* create (const NagSolverNlpSparse::problem_t& pb);
-ROBOPTIM_DLLEXPORT void destroy (solver_t* p);
+    active_.resize (constraints);
+    for (std::size_t constraintId = 0; constraintId < constraints;
+         ++constraintId)
+      active_[constraintId] = !lazy_[constraintId];
 
-ROBOPTIM_DLLEXPORT unsigned getSizeOfProblem ()
-{
-  return sizeof (NagSolverNlpSparse::problem_t);
-}
+    setup_structure ();
+    setup_bounds (lookForX ());
+    bool success = run (start, Nag_Cold);
 
-ROBOPTIM_DLLEXPORT const char* getTypeIdOfConstraintsList ()
-{
-  return typeid (NagSolverNlpSparse::problem_t::constraintsList_t).name ();
-}
+    std::vector<std::size_t> violated;
+    for (int round = 1;; ++round)
+    {
+      Result* res = 0;
+      if (this->result_.which () == SOLVER_VALUE)
+        res = &boost::get<Result> (this->result_);
+      else
+      {
+        SolverError& error = boost::get<SolverError> (this->result_);
+        if (error.lastState ()) res = &*error.lastState ();
+      }
+      if (!res) return false;
 
-ROBOPTIM_DLLEXPORT solver_t* create (const NagSolverNlpSparse::problem_t& pb)
-{
-  return new roboptim::NagSolverNlpSparse (pb);
-}
+      violated.clear ();
+      complete_result (*res, tolerance, violated);
+      if (!success || violated.empty ()) return success;
+
+      if (round >= rounds)
+      {
+        SolverError error (
+          (boost::format ("%1% lazy constraints are still violated after "
+                          "%2% solves") %
+           violated.size () % round)
+            .str ());
+        error.lastState () = *res;
+        this->result_ = error;
+        return false;
+      }
+
+      double roundStart = nag::now ();
+
+      // The rows of F given to NAG are only kept if they are not
+      // modified after the solve, otherwise the problem is built again
+      // and solved from the current point.
+      bool affine = false;
+      for (std::size_t constraintId = 0; constraintId < constraints;
+           ++constraintId)
+        affine = affine || affine_[constraintId];
+
+      if (presolved_ || scaled_ || affine)
+      {
+        vector_t x = x_;
+        for (std::size_t i = 0; i < violated.size (); ++i)
+          active_[violated[i]] = true;
+        setup_structure ();
+        setup_bounds (x);
+        success = run (roundStart, Nag_Cold);
+      }
+      else
+      {
+        add_constraints (violated);
+        success = run (roundStart, Nag_Warm);
+      }
+    }
+  }
+
+  void NagSolverNlpSparse::complete_result (
+    Result& res, double tolerance, std::vector<std::size_t>& violated) const
+  {
+    const std::size_t constraints = problem ().constraints ().size ();
+
+    function_t::size_type size = 0;
+    for (std::size_t constraintId = 0; constraintId < constraints;
+         ++constraintId)
+      size += problem ().constraints ()[constraintId]->outputSize ();
+
+    // Constraints are in the Result order, nonlinear constraints first.
+    vector_t values (size);
+    vector_t lambda (size);
+    function_t::size_type offset = 0;
+    function_t::size_type activeOffset = 0;
+    for (int linear = 0; linear < 2; ++linear)
+      for (std::size_t constraintId = 0; constraintId < constraints;
+           ++constraintId)
+      {
+        const function_t& g = *problem ().constraints ()[constraintId];
+        if (static_cast<int> (g.asType<linearFunction_t> () != 0) != linear)
+          continue;
+
+        const function_t::size_type m = g.outputSize ();
+        if (activeConstraint (constraintId))
+        {
+          values.segment (offset, m) =
+            res.constraints.segment (activeOffset, m);
+          lambda.segment (offset, m) = res.lambda.segment (activeOffset, m);
+          activeOffset += m;
+        }
+        else
+        {
+          vector_t value = g (res.x);
+
+          const function_t::intervals_t& bounds =
+            problem ().boundsVector ()[constraintId];
+          for (function_t::size_type i = 0; i < m; ++i)
+          {
+            const std::size_t i_ = static_cast<std::size_t> (i);
+            if (value[i] < bounds[i_].first - tolerance ||
+                value[i] > bounds[i_].second + tolerance)
+            {
+              violated.push_back (constraintId);
+              break;
+            }
+          }
+
+          // Linear rows are given without their constant, as computed
+          // by NAG.
+          if (linear)
+          {
+            boost::scoped_ptr<numericLinearFunction_t> storage;
+            value -= linearForm (constraintId, storage)->b ();
+          }
+          values.segment (offset, m) = value;
+          lambda.segment (offset, m).setZero ();
+        }
+        offset += m;
+      }
+
+    std::sort (violated.begin (), violated.end ());
+    res.constraints.swap (values);
+    res.lambda.swap (lambda);
+  }
+
+  void NagSolverNlpSparse::add_constraints (
+    const std::vector<std::size_t>& added)
+  {
+    const Integer nf = nf_;
+    std::vector<Integer> starts;
+    constraintStarts (starts);
+
+    // G entries of each nonlinear function, in G order.
+    std::vector<std::size_t> offsets;
+    for (std::size_t f = 0; f < patterns_.size (); ++f)
+      offsets.push_back (patterns_[f].offset);
+    offsets.push_back (static_cast<std::size_t> (neg_));
+
+    for (std::size_t i = 0; i < added.size (); ++i) active_[added[i]] = true;
+    compute_nf ();
+    setup_fused ();
+
+    std::vector<Integer> newStarts;
+    constraintStarts (newStarts);
+
+    // New row of each row of F.
+    std::vector<Integer> rows (static_cast<std::size_t> (nf), 0);
+    const std::size_t constraints = problem ().constraints ().size ();
+    for (std::size_t constraintId = 0; constraintId < constraints;
+         ++constraintId)
+    {
+      if (starts[constraintId] < 0) continue;
+      Integer m = static_cast<Integer> (
+        problem ().constraints ()[constraintId]->outputSize ());
+      for (Integer i = 0; i < m; ++i)
+        rows[static_cast<std::size_t> (starts[constraintId] + i)] =
+          newStarts[constraintId] + i;
+    }
+
+    // A: rows are moved, then the added linear constraints are
+    // appended (NAG does not require its entries to be sorted).
+    if (nea_ == 0)
+    {
+      iafun_.clear ();
+      javar_.clear ();
+      a_.clear ();
+    }
+    for (std::size_t k = 0; k < iafun_.size (); ++k)
+      iafun_[k] = rows[static_cast<std::size_t> (iafun_[k] - 1)] + 1;
+
+    // G: entries are sorted by row, so that those of the added
+    // nonlinear constraints are inserted among the others.
+    std::vector<Integer> igfun;
+    std::vector<Integer> jgvar;
+    igfun_.swap (igfun);
+    jgvar_.swap (jgvar);
+
+    std::size_t f = 0;
+    if (objective_)
+    {
+      for (std::size_t k = offsets[0]; k < offsets[1]; ++k)
+      {
+        igfun_.push_back (igfun[k]);
+        jgvar_.push_back (jgvar[k]);
+      }
+      ++f;
+    }
+
+    structure_t structure;
+    for (std::size_t constraintId = 0; constraintId < constraints;
+         ++constraintId)
+    {
+      if (!activeConstraint (constraintId)) continue;
+
+      bool isNew = std::binary_search (added.begin (), added.end (),
+                                       constraintId);
+      if (!linearConstraint (constraintId) && !isNew)
+      {
+        for (std::size_t k = offsets[f]; k < offsets[f + 1]; ++k)
+        {
+          igfun_.push_back (rows[static_cast<std::size_t> (igfun[k] - 1)] + 1);
+          jgvar_.push_back (jgvar[k]);
+        }
+        ++f;
+      }
+      else if (!linearConstraint (constraintId))
+      {
+        const nonlinearFunction_t* g = problem ()
+                                         .constraints ()[constraintId]
+                                         ->castInto<nonlinearFunction_t> ();
+        assert (!!g);
+        jacobianStructure (*g, structure);
+        appendJacobianPattern (*g, structure, newStarts[constraintId], 0);
+      }
+      else if (isNew)
+      {
+        boost::scoped_ptr<numericLinearFunction_t> g_;
+        const numericLinearFunction_t* g = linearForm (constraintId, g_);
+        for (function_t::matrix_t::Index k = 0; k < g->A ().outerSize (); ++k)
+          for (function_t::matrix_t::InnerIterator it (g->A (), k); it; ++it)
+          {
+            iafun_.push_back (
+              static_cast<Integer> (newStarts[constraintId] + it.row () + 1));
+            javar_.push_back (static_cast<Integer> (it.col () + 1));
+            a_.push_back (it.value ());
+          }
+      }
+    }
+
+    lena_ = nag::toInteger (iafun_.size (), "the number of nonzeros of A");
+    nea_ = lena_;
+    if (lena_ == 0)
+    {
+      iafun_.resize (1);
+      javar_.resize (1);
+      a_.resize (1);
+      lena_ = 1;
+      nea_ = 0;
+    }
+
+    leng_ = nag::toInteger (igfun_.size (), "the number of nonzeros of G");
+    neg_ = leng_;
+    if (leng_ == 0)
+    {
+      igfun_.resize (1);
+      jgvar_.resize (1);
+      leng_ = 1;
+      neg_ = 0;
+    }
+
+    bool patterns = fill_patterns ();
+    assert (patterns);
+    (void)patterns;
+
+    fill_flow_fupp ();
+    fill_names ();
+    if (n_ > 1)
+    {
+      nfname_ = nf_;
+      nxname_ = n_;
+    }
 
-ROBOPTIM_DLLEXPORT void destroy (solver_t* p) { delete p; }
-}
+    // The rows of the added constraints start in the basis, the others
+    // keep their state and multipliers. NAG computes F again.
+    vector_t values = vector_t::Zero (nf_);
+    vector_t multipliers = vector_t::Zero (nf_);
+    std::vector<Integer> states (static_cast<std::size_t> (nf_), 3);
+    for (Integer i = 0; i < nf; ++i)
+    {
+      const Integer row = rows[static_cast<std::size_t> (i)];
+      values[row] = f_[i];
+      multipliers[row] = fmul_[i];
+      states[static_cast<std::size_t> (row)] =
+        fstate_[static_cast<std::size_t> (i)];
+    }
+    f_.swap (values);
+    fmul_.swap (multipliers);
+    fstate_.swap (states);
+  }
+} // end of namespace roboptim.
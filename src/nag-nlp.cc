@@ -15,16 +15,21 @@
 // You should have received a copy of the GNU Lesser General Public License
 // along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
 #include <roboptim/core/numeric-linear-function.hh>
 #include <roboptim/core/differentiable-function.hh>
 
+#include <boost/format.hpp>
+
 #include <nag.h>
 #include <nage04.h>
 
+#include <roboptim/core/plugin/nag/nag-function-hints.hh>
 #include <roboptim/core/plugin/nag/nag-nlp.hh>
+#include <roboptim/core/plugin/nag/nag-parallel.hh>
 
 #define DEFINE_PARAMETER(KEY, DESCRIPTION, VALUE)	\
   do {							\
@@ -54,6 +59,15 @@ namespace roboptim
       NagSolverNlp* solver = static_cast<NagSolverNlp*> (comm->p);
       assert (!!solver);
 
+      nag::ScopedTimer timer (solver->statistics ().callbackTime);
+
+      // Request termination if the solve has been cancelled.
+      if (solver->cancellationToken ()->isCancelled ())
+	{
+	  *mode = -1;
+	  return;
+	}
+
       // Maps C-arrays to Eigen structures.
       Eigen::Map<const DifferentiableFunction::argument_t> x_ (x, n);
       Eigen::Map<DifferentiableFunction::result_t> ccon_ (ccon, ncnln);
@@ -61,33 +75,72 @@ namespace roboptim
 	double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> > jac_
 	(cjac, ncnln, tdcj);
 
+      if (*mode == 0 || *mode == 2)
+	++solver->statistics ().evaluations;
+      if (*mode == 1 || *mode == 2)
+	++solver->statistics ().derivativeEvaluations;
+
       // Iterate on constraints.
       Function::size_type idx = 0;
+      std::size_t functionId = 1;
       typedef NagSolverNlp::problem_t::constraints_t::const_iterator iter_t;
       for (iter_t it = solver->problem ().constraints ().begin ();
 	   it != solver->problem ().constraints ().end (); ++it)
 	{
+	  // Linear constraints are handled by NAG through A.
+	  if ((*it)->asType<LinearFunction> ())
+	    continue;
+
 	  DifferentiableFunction const* g;
           if ((*it)->asType<DifferentiableFunction>())
             g = (*it)->castInto<DifferentiableFunction>();
           else throw std::runtime_error ("invalid constraint provided");
 	  assert (!!g);
 
-	  // evaluate constraint.
-	  if (*mode == 0 || *mode == 2)
+	  // Memoized evaluations are reused when they are stored (rows
+	  // of cjac are contiguous since tdcj is n).
+	  double* values = (*mode == 0 || *mode == 2) ? ccon + idx : 0;
+	  double* jacobian = (*mode == 1 || *mode == 2) ? cjac + idx * tdcj : 0;
+	  if (solver->recall (functionId, x, values, jacobian))
 	    {
-	      ccon_.segment (idx, g->outputSize ()) = (*g) (x_);
+	      idx += g->outputSize ();
+	      ++functionId;
+	      continue;
 	    }
 
-	  // evaluate jacobian.
-	  if (*mode == 1 || *mode == 2)
+	  // evaluate constraint and jacobian together if possible.
+	  const nag::FusedEvaluation<EigenMatrixDense>* fused =
+	    (*mode == 2) ? nag::fusedEvaluation (*g) : 0;
+	  if (fused)
+	    {
+	      DifferentiableFunction::jacobian_t jac (g->outputSize (),
+						       g->inputSize ());
+	      fused->valueAndJacobian (ccon_.segment (idx, g->outputSize ()),
+				       jac, x_);
+	      jac_.block (idx, 0, g->outputSize (), g->inputSize ()) = jac;
+	    }
+	  else
 	    {
-	      jac_.block (idx, 0, g->outputSize (), g->inputSize ()) =
-		g->jacobian (x_);
+	      // evaluate constraint.
+	      if (*mode == 0 || *mode == 2)
+		{
+		  ccon_.segment (idx, g->outputSize ()) = (*g) (x_);
+		}
+
+	      // evaluate jacobian.
+	      if (*mode == 1 || *mode == 2)
+		{
+		  jac_.block (idx, 0, g->outputSize (), g->inputSize ()) =
+		    g->jacobian (x_);
+		}
 	    }
 
+	  solver->record (functionId++, x, values, jacobian);
 	  idx += g->outputSize ();
 	}
+
+      if (solver->trace () && (*mode == 0 || *mode == 2))
+	solver->traceConstraints (ccon);
     }
 
     // Objective callback
@@ -104,6 +157,15 @@ namespace roboptim
       NagSolverNlp* solver = static_cast<NagSolverNlp*> (comm->p);
       assert (!!solver);
 
+      nag::ScopedTimer timer (solver->statistics ().callbackTime);
+
+      // Request termination if the solve has been cancelled.
+      if (solver->cancellationToken ()->isCancelled ())
+	{
+	  *mode = -1;
+	  return;
+	}
+
       // Maps C-arrays to Eigen structures.
       Eigen::Map<const Function::argument_t> x_ (x, n);
       Eigen::Map<Function::result_t> objf_ (objf, 1);
@@ -116,11 +178,37 @@ namespace roboptim
 
       assert (!!mode);
       assert (*mode >= 0 && *mode <= 2 && "should never happen");
-      if (*mode == 0 || *mode == 2) // evaluate objective
-	objf_ = (*f) (x_);
+      if (*mode == 0 || *mode == 2)
+	++solver->statistics ().evaluations;
+      if (*mode == 1 || *mode == 2)
+	++solver->statistics ().derivativeEvaluations;
+
+      // Memoized evaluations are reused when they are stored.
+      double* value = (*mode == 0 || *mode == 2) ? objf : 0;
+      double* gradient = (*mode == 1 || *mode == 2) ? grad : 0;
+      if (!solver->recall (0, x, value, gradient))
+	{
+	  const nag::FusedEvaluation<EigenMatrixDense>* fused =
+	    (*mode == 2) ? nag::fusedEvaluation (*f) : 0;
+	  if (fused) // evaluate objective and gradient together
+	    {
+	      // The gradient is the only row of the jacobian.
+	      Eigen::Map<DifferentiableFunction::jacobian_t> jac_ (grad, 1, n);
+	      fused->valueAndJacobian (objf_, jac_, x_);
+	    }
+	  else
+	    {
+	      if (*mode == 0 || *mode == 2) // evaluate objective
+		objf_ = (*f) (x_);
 
-      if (*mode == 1 || *mode == 2) // evaluate objective gradient
-	grad_ = f->gradient (x_, 0);
+	      if (*mode == 1 || *mode == 2) // evaluate objective gradient
+		grad_ = f->gradient (x_, 0);
+	    }
+	  solver->record (0, x, value, gradient);
+	}
+
+      if (solver->trace () && (*mode == 0 || *mode == 2))
+	solver->traceEvaluation (x, objf_[0], 0);
 
       if (!solver->callback ())
 	return;
@@ -150,18 +238,138 @@ namespace roboptim
       h_ (),
       x_ (pb.function ().inputSize ()),
       callback_ (),
-      solverState_ (pb)
+      solverState_ (pb),
+      traceC_ (),
+      memo_ ()
   {
     objf_[0] = 0.;
+
+    DEFINE_PARAMETER ("nag.batch_threads",
+		      "number of threads solving the instances of a batch "
+		      "(0: one per core)",
+		      0);
+    DEFINE_PARAMETER ("nag.memo_directory",
+		      "directory of the stored evaluations of the functions "
+		      "implementing nag::MemoizedEvaluation (empty: none)",
+		      std::string (""));
+    DEFINE_PARAMETER ("nag.memo_capacity",
+		      "number of evaluations stored per function", 4096);
+    DEFINE_PARAMETER ("nag.memo_quantum",
+		      "step of the rounded points of the stored evaluations "
+		      "(0: exact points)",
+		      0.);
+  }
+
+  bool
+  NagSolverNlp::recall (std::size_t functionId, const double* x,
+			double* f, double* jacobian)
+  {
+    if (functionId >= memo_.size () || !memo_[functionId])
+      return false;
+    return memo_[functionId]->recall (x, f, jacobian);
+  }
+
+  void
+  NagSolverNlp::record (std::size_t functionId, const double* x,
+			const double* f, const double* jacobian)
+  {
+    if (functionId >= memo_.size () || !memo_[functionId])
+      return;
+    memo_[functionId]->record (x, f, jacobian);
+  }
+
+  void
+  NagSolverNlp::setup_memo ()
+  {
+    memo_.clear ();
+    std::string directory = stringParameter ("nag.memo_directory");
+    if (directory.empty ())
+      return;
+
+    const std::size_t capacity = static_cast<std::size_t>
+      (std::max (1, integerParameter ("nag.memo_capacity", 4096)));
+    const double quantum = doubleParameter ("nag.memo_quantum", 0.);
+
+    // Cost first, then the nonlinear constraints.
+    std::vector<const DifferentiableFunction*> functions;
+    functions.push_back
+      (problem ().function ().castInto<DifferentiableFunction> ());
+    typedef problem_t::constraints_t::const_iterator iter_t;
+    for (iter_t it = problem ().constraints ().begin ();
+	 it != problem ().constraints ().end (); ++it)
+      if (!(*it)->asType<LinearFunction> ())
+	functions.push_back ((*it)->castInto<DifferentiableFunction> ());
+
+    memo_.resize (functions.size ());
+    for (std::size_t f = 0; f < functions.size (); ++f)
+      {
+	const nag::MemoizedEvaluation* memo =
+	  nag::memoizedEvaluation (*functions[f]);
+	if (!memo)
+	  continue;
+
+	// Jacobians are stored as dense row-major matrices.
+	const std::size_t m =
+	  static_cast<std::size_t> (functions[f]->outputSize ());
+	std::string signature =
+	  (boost::format ("%1%\nn %2%\nm %3%\nquantum %4$.17g\ndense\n")
+	   % memo->memoKey () % n_ % m % quantum).str ();
+
+	memo_[f].reset (new nag::EvaluationStore
+			(nag::evaluationStoreFile (directory, signature),
+			 signature, static_cast<std::size_t> (n_), m,
+			 m * static_cast<std::size_t> (n_), capacity,
+			 quantum));
+      }
   }
 
   NagSolverNlp::~NagSolverNlp ()
   {}
 
+  void
+  NagSolverNlp::traceConstraints (const double* ccon)
+  {
+    traceC_ = Eigen::Map<const Function::vector_t> (ccon, ncnln_);
+  }
+
+  void
+  NagSolverNlp::traceEvaluation (const double* x, double objf,
+				 const double* multipliers)
+  {
+    assert (!!trace ());
+
+    Eigen::Map<const Function::vector_t> x_ (x, n_);
+
+    // Values constrained by bl and bu: x, A x, then nonlinear constraints.
+    Function::vector_t values (n_ + nclin_ + ncnln_);
+    values.head (n_) = x_;
+    if (nclin_ > 0)
+      values.segment (n_, nclin_) = a_.topRows (nclin_) * x_;
+    if (ncnln_ > 0)
+      {
+	if (traceC_.size () == ncnln_)
+	  values.tail (ncnln_) = traceC_;
+	else
+	  values.tail (ncnln_).setZero ();
+      }
+
+    double violation = 0.;
+    for (Function::size_type i = 0; i < values.size (); ++i)
+      violation += std::max (0., bl_[i] - values[i])
+	+ std::max (0., values[i] - bu_[i]);
+
+    trace ()->record (objf, violation, x, multipliers);
+  }
+
   void
   NagSolverNlp::solve ()
   {
+    statistics_.reset ();
+    double start = nag::now ();
+
     // Count constraints and compute their size.
+    nclin_ = 0;
+    ncnln_ = 0;
     typedef problem_t::constraints_t::const_iterator iter_t;
     for (iter_t it = problem ().constraints ().begin ();
 	 it != problem ().constraints ().end (); ++it)
@@ -197,15 +405,13 @@ namespace roboptim
     // Fill A matrix.
     Function::size_type idx = 0;
     for (iter_t it = problem ().constraints ().begin ();
-	 it != problem ().constraints ().begin (); ++it)
+	 it != problem ().constraints ().end (); ++it)
       {
-	if (!(*it)->asType<NumericLinearFunction> ())
+	if (!(*it)->asType<LinearFunction> ())
 	  continue;
-        NumericLinearFunction* const g =
-            (*it)->castInto<NumericLinearFunction> ();
-        assert (!!g);
-	a_.block (idx, 0, g->outputSize (), g->inputSize ()) = g->A();
-	idx += g->outputSize ();
+	NumericLinearFunction g (*(*it)->castInto<LinearFunction> ());
+	a_.block (idx, 0, g.outputSize (), g.inputSize ()) = g.A ();
+	idx += g.outputSize ();
       }
 
     // Fill bu and bl.
@@ -223,24 +429,22 @@ namespace roboptim
 	 constraintId < problem ().constraints ().size ();
 	 ++constraintId)
       {
-	if (!problem ().constraints ()[constraintId]->asType<NumericLinearFunction> ())
+	if (!problem ().constraints ()[constraintId]->asType<LinearFunction> ())
 	  continue;
-        NumericLinearFunction* const g =
-            problem ()
-                .constraints ()[constraintId]
-                ->castInto<NumericLinearFunction> ();
-        assert (!!g);
+	NumericLinearFunction g
+	  (*problem ().constraints ()[constraintId]->castInto<LinearFunction> ());
 
-	for (unsigned i = 0; i < g->outputSize (); ++i)
+	for (unsigned i = 0; i < g.outputSize (); ++i)
 	  {
-	    const NumericLinearFunction::vector_t& b = g->b ();
-	    // warning: we shift bounds here.
+	    const NumericLinearFunction::vector_t& b = g.b ();
+	    // warning: we shift bounds here (A x + b in [l, u] becomes
+	    // A x in [l - b, u - b]).
 	    bl_[idx + i] =
-	      problem ().boundsVector ()[constraintId][i].first + b[i];
+	      problem ().boundsVector ()[constraintId][i].first - b[i];
 	    bu_[idx + i] =
-	      problem ().boundsVector ()[constraintId][i].second + b[i];
+	      problem ().boundsVector ()[constraintId][i].second - b[i];
 	  }
-	idx += g->outputSize ();
+	idx += g.outputSize ();
       }
 
     // - nonlinear constraints
@@ -250,7 +454,7 @@ namespace roboptim
       {
         if (problem ()
                 .constraints ()[constraintId]
-                ->asType<NumericLinearFunction> () ||
+                ->asType<LinearFunction> () ||
             !problem ()
                  .constraints ()[constraintId]
                  ->asType<DifferentiableFunction> ())
@@ -299,9 +503,23 @@ namespace roboptim
     ::Integer* istate = new Integer[n_ + nclin_ + ncnln_];
 
     std::size_t istateSize =
-      static_cast<std::size_t> ((n_ + nclin_ + ncnln_)) * sizeof (double);
+      static_cast<std::size_t> ((n_ + nclin_ + ncnln_)) * sizeof (Integer);
     std::memset (istate, 0, istateSize);
 
+    // Start a new trace, if requested.
+    traceC_.resize (0);
+    openTrace (static_cast<std::size_t> (n_),
+	       static_cast<std::size_t> (n_ + nclin_ + ncnln_));
+
+    // Open the evaluation stores, if requested.
+    setup_memo ();
+
+    // Dense Jacobians: cost gradient, A and nonlinear constraints.
+    statistics_.nonZeros = n_ * (1 + nclin_ + ncnln_);
+
+    double solveStart = nag::now ();
+    statistics_.setupTime = solveStart - start;
+
     // Solve.
     nag_opt_nlp_solve
       (n_, nclin_, ncnln_, tda_, tdcj_, tdh_, &a_ (0, 0), &bl_[0], &bu_[0],
@@ -314,6 +532,17 @@ namespace roboptim
     delete[] istate;
     istate = 0;
 
+    statistics_.solveTime = nag::now () - solveStart;
+    statistics_.majorIterations = majits;
+
+    // Record the solution and its multipliers.
+    if (trace ())
+      {
+	if (ncnln_ > 0)
+	  traceConstraints (&ccon_[0]);
+	traceEvaluation (&x_[0], objf_[0], &clamda_[0]);
+      }
+
     if (fail.code == NE_NOERROR)
       {
 	Result res (problem ().function ().inputSize (),
@@ -326,42 +555,50 @@ namespace roboptim
 	    res.lambda = clamda_;
 	  }
 	result_ = res;
-	return;
       }
-
-    this->result_ = SolverError (fail.message);
+    else
+      this->result_ = SolverError (fail.message);
+
+    statistics_.wallTime = nag::now () - start;
+    if (reportStatistics_)
+      nag::appendStatistics ("nag-nlp", problem ().function ().getName (),
+			     n_, nclin_ + ncnln_, fail.code == NE_NOERROR,
+			     statistics_);
   }
-} // end of namespace roboptim.
-
-extern "C"
-{
-  typedef roboptim::NagSolverNlp NagSolverNlp;
-  typedef roboptim::Solver<roboptim::EigenMatrixDense> solver_t;
 
-  ROBOPTIM_DLLEXPORT unsigned getSizeOfProblem ();
-  ROBOPTIM_DLLEXPORT const char* getTypeIdOfConstraintsList ();
-  ROBOPTIM_DLLEXPORT solver_t* create
-  (const NagSolverNlp::problem_t& pb);
-  ROBOPTIM_DLLEXPORT void destroy (solver_t* p);
-
-  ROBOPTIM_DLLEXPORT unsigned getSizeOfProblem ()
+  struct NagSolverNlp::BatchTask
   {
-    return sizeof (NagSolverNlp::problem_t);
-  }
+    void operator() (std::size_t i) const
+    {
+      try
+	{
+	  NagSolverNlp solver (*problems[i]);
+	  solver.shareSettings (prototype);
+	  results[i] = solver.minimum ();
+	  statistics[i] = solver.statistics ();
+	}
+      catch (const std::exception& e)
+	{
+	  results[i] = SolverError (e.what ());
+	}
+    }
 
-  ROBOPTIM_DLLEXPORT const char* getTypeIdOfConstraintsList ()
-  {
-    return typeid (NagSolverNlp::problem_t::constraintsList_t).name ();
-  }
+    const NagSolverNlp& prototype;
+    const std::vector<const problem_t*>& problems;
+    std::vector<result_t>& results;
+    std::vector<nag::Statistics>& statistics;
+  };
 
-  ROBOPTIM_DLLEXPORT solver_t* create
-  (const NagSolverNlp::problem_t& pb)
+  std::vector<NagSolverNlp::result_t>
+  NagSolverNlp::solveBatch (const std::vector<const problem_t*>& problems,
+			    std::vector<nag::Statistics>& statistics) const
   {
-    return new roboptim::NagSolverNlp (pb);
-  }
+    std::vector<result_t> results (problems.size ());
+    statistics.assign (problems.size (), nag::Statistics ());
 
-  ROBOPTIM_DLLEXPORT void destroy (solver_t* p)
-  {
-    delete p;
+    BatchTask task = {*this, problems, results, statistics};
+    nag::parallelFor (task, problems.size (),
+		      integerParameter ("nag.batch_threads", 0));
+    return results;
   }
-}
+} // end of namespace roboptim.
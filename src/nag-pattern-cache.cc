@@ -0,0 +1,204 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <boost/format.hpp>
+
+#include <roboptim/core/plugin/nag/nag-pattern-cache.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace
+    {
+      static const boost::uint32_t patternCacheVersion = 2;
+
+      void throwSystemError (const std::string& what)
+      {
+        throw std::runtime_error (
+          (boost::format ("%s: %s") % what % std::strerror (errno)).str ());
+      }
+
+      /// \brief Round a size up to a multiple of 8 bytes.
+      std::size_t align (std::size_t size)
+      {
+        return (size + 7) & ~static_cast<std::size_t> (7);
+      }
+
+      /// \brief Size of a cache file, in bytes.
+      std::size_t fileSize (std::size_t signatureSize, std::size_t nea,
+                            std::size_t neg)
+      {
+        return sizeof (PatternCacheHeader) + align (signatureSize) +
+               2 * (nea + neg) * sizeof (Integer);
+      }
+
+      template <typename T>
+      const char* read (const char* data, std::vector<T>& v, std::size_t size)
+      {
+        const T* begin = reinterpret_cast<const T*> (data);
+        v.assign (begin, begin + size);
+        return data + size * sizeof (T);
+      }
+
+      template <typename T>
+      void write (std::FILE* file, const std::vector<T>& v, std::size_t size)
+      {
+        if (size > 0 && std::fwrite (&v[0], sizeof (T), size, file) != size)
+          throwSystemError ("failed to write pattern cache");
+      }
+    } // end of anonymous namespace
+
+    boost::uint64_t hashSignature (const std::string& signature)
+    {
+      boost::uint64_t hash = 14695981039346656037ULL;
+      for (std::size_t i = 0; i < signature.size (); ++i)
+      {
+        hash ^= static_cast<unsigned char> (signature[i]);
+        hash *= 1099511628211ULL;
+      }
+      return hash;
+    }
+
+    std::string patternCacheFile (const std::string& directory,
+                                  const std::string& signature)
+    {
+      return (boost::format ("%s/%016x.pattern") % directory %
+              hashSignature (signature))
+        .str ();
+    }
+
+    bool loadPatternCache (const std::string& filename,
+                           const std::string& signature,
+                           SparseStructure& structure)
+    {
+      int fd = ::open (filename.c_str (), O_RDONLY);
+      if (fd < 0) return false;
+
+      struct stat st;
+      if (::fstat (fd, &st) != 0 ||
+          static_cast<std::size_t> (st.st_size) < sizeof (PatternCacheHeader))
+      {
+        ::close (fd);
+        return false;
+      }
+
+      std::size_t size = static_cast<std::size_t> (st.st_size);
+      void* map = ::mmap (0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close (fd);
+      if (map == MAP_FAILED) return false;
+
+      const char* data = static_cast<const char*> (map);
+      const PatternCacheHeader* header =
+        reinterpret_cast<const PatternCacheHeader*> (data);
+
+      bool valid =
+        std::memcmp (header->magic, "RONAGPAT", sizeof (header->magic)) == 0 &&
+        header->version == patternCacheVersion &&
+        header->headerSize == sizeof (PatternCacheHeader) &&
+        header->integerSize == sizeof (Integer) &&
+        header->signatureHash == hashSignature (signature) &&
+        header->signatureSize == signature.size () &&
+        size == fileSize (signature.size (),
+                          static_cast<std::size_t> (header->nea),
+                          static_cast<std::size_t> (header->neg)) &&
+        signature.compare (0, signature.size (), data + sizeof (*header),
+                           signature.size ()) == 0;
+
+      if (valid)
+      {
+        std::size_t nea = static_cast<std::size_t> (header->nea);
+        std::size_t neg = static_cast<std::size_t> (header->neg);
+
+        data += sizeof (PatternCacheHeader) + align (signature.size ());
+        data = read (data, structure.iafun, nea);
+        data = read (data, structure.javar, nea);
+        data = read (data, structure.igfun, neg);
+        read (data, structure.jgvar, neg);
+      }
+
+      ::munmap (map, size);
+      return valid;
+    }
+
+    void savePatternCache (const std::string& filename,
+                           const std::string& signature,
+                           const SparseStructure& structure)
+    {
+      const std::size_t nea = structure.iafun.size ();
+      const std::size_t neg = structure.igfun.size ();
+
+      PatternCacheHeader header;
+      std::memset (&header, 0, sizeof (PatternCacheHeader));
+      std::memcpy (header.magic, "RONAGPAT", sizeof (header.magic));
+      header.version = patternCacheVersion;
+      header.headerSize = sizeof (PatternCacheHeader);
+      header.integerSize = sizeof (Integer);
+      header.signatureHash = hashSignature (signature);
+      header.signatureSize = signature.size ();
+      header.nea = nea;
+      header.neg = neg;
+
+      std::string temporary =
+        (boost::format ("%s.%d.tmp") % filename % ::getpid ()).str ();
+      std::FILE* file = std::fopen (temporary.c_str (), "wb");
+      if (!file) throwSystemError ("failed to open " + temporary);
+
+      try
+      {
+        std::vector<char> signatureData (align (signature.size ()), 0);
+        std::copy (signature.begin (), signature.end (),
+                   signatureData.begin ());
+
+        if (std::fwrite (&header, sizeof (header), 1, file) != 1)
+          throwSystemError ("failed to write pattern cache");
+        write (file, signatureData, signatureData.size ());
+        write (file, structure.iafun, nea);
+        write (file, structure.javar, nea);
+        write (file, structure.igfun, neg);
+        write (file, structure.jgvar, neg);
+
+        if (std::fclose (file) != 0)
+        {
+          file = 0;
+          throwSystemError ("failed to write pattern cache");
+        }
+        file = 0;
+
+        if (std::rename (temporary.c_str (), filename.c_str ()) != 0)
+          throwSystemError ("failed to rename " + temporary);
+      }
+      catch (...)
+      {
+        if (file) std::fclose (file);
+        std::remove (temporary.c_str ());
+        throw;
+      }
+    }
+  } // end of namespace nag.
+} // end of namespace roboptim.
@@ -0,0 +1,106 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+
+#include <boost/thread/locks.hpp>
+
+#include <roboptim/core/plugin/nag/nag-pattern-cache.hh>
+#include <roboptim/core/plugin/nag/nag-result-cache.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    ResultCache::ResultCache (std::size_t capacity)
+      : capacity_ (std::max (capacity, static_cast<std::size_t> (1))),
+        entries_ (),
+        index_ (),
+        mutex_ ()
+    {
+    }
+
+    bool ResultCache::find (const std::string& key, Result& result,
+                            Function::vector_t& xmul)
+    {
+      boost::uint64_t hash = hashSignature (key);
+
+      boost::lock_guard<boost::mutex> lock (mutex_);
+      index_t::iterator it = index_.find (hash);
+      if (it == index_.end () || it->second->key != key) return false;
+
+      entries_.splice (entries_.begin (), entries_, it->second);
+      result = it->second->result;
+      xmul = it->second->xmul;
+      return true;
+    }
+
+    void ResultCache::insert (const std::string& key,
+                              const std::vector<std::string>& tokens,
+                              const Result& result,
+                              const Function::vector_t& xmul)
+    {
+      Entry entry = {hashSignature (key), key, tokens, result, xmul};
+
+      boost::lock_guard<boost::mutex> lock (mutex_);
+
+      // A previous result with the same hash is replaced.
+      index_t::iterator it = index_.find (entry.hash);
+      if (it != index_.end ())
+      {
+        entries_.erase (it->second);
+        index_.erase (it);
+      }
+
+      if (entries_.size () >= capacity_)
+      {
+        index_.erase (entries_.back ().hash);
+        entries_.pop_back ();
+      }
+
+      entries_.push_front (entry);
+      index_[entry.hash] = entries_.begin ();
+    }
+
+    void ResultCache::invalidate (const std::string& token)
+    {
+      boost::lock_guard<boost::mutex> lock (mutex_);
+      for (entries_t::iterator it = entries_.begin (); it != entries_.end ();)
+        if (std::find (it->tokens.begin (), it->tokens.end (), token) !=
+            it->tokens.end ())
+        {
+          index_.erase (it->hash);
+          it = entries_.erase (it);
+        }
+        else
+          ++it;
+    }
+
+    void ResultCache::clear ()
+    {
+      boost::lock_guard<boost::mutex> lock (mutex_);
+      entries_.clear ();
+      index_.clear ();
+    }
+
+    std::size_t ResultCache::size () const
+    {
+      boost::lock_guard<boost::mutex> lock (mutex_);
+      return entries_.size ();
+    }
+  } // end of namespace nag.
+} // end of namespace roboptim.
@@ -47,6 +47,13 @@ namespace roboptim
         assert (!!solver);
         assert (n == solver->problem ().function ().inputSize ());
 
+        // Request termination if the solve has been cancelled.
+        if (solver->cancellationToken ()->isCancelled ())
+        {
+          comm->flag = -1;
+          return;
+        }
+
         Eigen::Map<const Function::vector_t> x_ (
           xc, solver->problem ().function ().inputSize ());
         Eigen::Map<Function::vector_t> fc_ (
@@ -66,7 +73,8 @@ namespace roboptim
         x_ (problem ().function ().inputSize ()),
         f_ (problem ().function ().outputSize ()),
         callback_ (),
-        solverState_ (pb)
+        solverState_ (pb),
+        cancellationToken_ (new NagCancellationToken ())
     {
       x_.setZero ();
       f_.setZero ();
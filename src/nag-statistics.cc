@@ -0,0 +1,97 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdlib>
+#include <fstream>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <boost/format.hpp>
+
+#include <roboptim/core/plugin/nag/nag-statistics.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace
+    {
+      /// \brief Quote a CSV field.
+      std::string quote (const std::string& s)
+      {
+        std::string res = "\"";
+        for (std::size_t i = 0; i < s.size (); ++i)
+        {
+          if (s[i] == '"')
+            res += "\"\"";
+          else if (s[i] == '\n')
+            res += ' ';
+          else
+            res += s[i];
+        }
+        return res + "\"";
+      }
+    } // end of anonymous namespace
+
+    double now ()
+    {
+      timespec ts;
+      clock_gettime (CLOCK_MONOTONIC, &ts);
+      return static_cast<double> (ts.tv_sec) +
+             1e-9 * static_cast<double> (ts.tv_nsec);
+    }
+
+    ScopedTimer::ScopedTimer (double& counter)
+      : counter_ (counter),
+        start_ (now ())
+    {
+    }
+
+    ScopedTimer::~ScopedTimer ()
+    {
+      counter_ += now () - start_;
+    }
+
+    void appendStatistics (const std::string& solver,
+                           const std::string& problem, long n, long nf,
+                           bool success, const Statistics& stats)
+    {
+      const char* filename = std::getenv ("ROBOPTIM_NAG_STATS_FILE");
+      if (!filename || !*filename) return;
+
+      std::ofstream file (filename, std::ios::app);
+      if (!file) return;
+
+      // Peak resident set size, in KiB on Linux.
+      rusage usage;
+      long peakMemory = -1;
+      if (getrusage (RUSAGE_SELF, &usage) == 0) peakMemory = usage.ru_maxrss;
+
+      // Name of the benchmark program, given by run-bench.cmake.
+      const char* program = std::getenv ("ROBOPTIM_NAG_STATS_PROGRAM");
+
+      file << (boost::format (
+                 "%s,%s,%s,%d,%d,%d,%d,%.9f,%.9f,%.9f,%.9f,%d,%d,%d,%d\n") %
+               quote (program ? program : "") % quote (solver) %
+               quote (problem) % n % nf % stats.nonZeros % (success ? 1 : 0) %
+               stats.setupTime % stats.solveTime % stats.wallTime %
+               stats.callbackTime % stats.evaluations %
+               stats.derivativeEvaluations % stats.majorIterations %
+               peakMemory);
+    }
+  } // end of namespace nag.
+} // end of namespace roboptim.
@@ -0,0 +1,147 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <boost/atomic.hpp>
+#include <boost/format.hpp>
+
+#include <roboptim/core/plugin/nag/nag-trace.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace
+    {
+      /// \brief Number of scalar fields preceding x in a record.
+      static const std::size_t recordFields = 5;
+
+      void throwSystemError (const std::string& what)
+      {
+        throw std::runtime_error (
+          (boost::format ("%s: %s") % what % std::strerror (errno)).str ());
+      }
+    } // end of anonymous namespace
+
+    Trace::Trace (const std::string& filename, std::size_t capacity,
+                  std::size_t n, std::size_t m)
+      : filename_ (filename),
+        fd_ (-1),
+        data_ (0),
+        size_ (0),
+        header_ (0),
+        previous_ (n, 0.),
+        iteration_ (0)
+    {
+      if (capacity == 0)
+        throw std::runtime_error ("trace capacity should be positive");
+
+      std::size_t recordSize = (recordFields + n + m) * sizeof (double);
+      size_ = sizeof (TraceHeader) + capacity * recordSize;
+
+      fd_ = ::open (filename.c_str (), O_RDWR | O_CREAT | O_TRUNC, 0644);
+      if (fd_ < 0) throwSystemError ("failed to open " + filename);
+
+      if (::ftruncate (fd_, static_cast<off_t> (size_)) != 0)
+      {
+        ::close (fd_);
+        throwSystemError ("failed to resize " + filename);
+      }
+
+      void* data =
+        ::mmap (0, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+      if (data == MAP_FAILED)
+      {
+        ::close (fd_);
+        throwSystemError ("failed to map " + filename);
+      }
+      data_ = static_cast<char*> (data);
+
+      header_ = reinterpret_cast<TraceHeader*> (data_);
+      std::memcpy (header_->magic, "RONAGTRC", sizeof (header_->magic));
+      header_->version = 1;
+      header_->headerSize = sizeof (TraceHeader);
+      header_->recordSize = recordSize;
+      header_->capacity = capacity;
+      header_->n = n;
+      header_->m = m;
+      header_->count = 0;
+    }
+
+    Trace::~Trace ()
+    {
+      ::munmap (data_, size_);
+      ::close (fd_);
+    }
+
+    void Trace::record (double objective, double violation, const double* x,
+                        const double* multipliers)
+    {
+      const std::size_t n = static_cast<std::size_t> (header_->n);
+      const std::size_t m = static_cast<std::size_t> (header_->m);
+
+      double step = 0.;
+      for (std::size_t i = 0; i < n; ++i)
+      {
+        double dx = x[i] - previous_[i];
+        step += dx * dx;
+        previous_[i] = x[i];
+      }
+      step = std::sqrt (step);
+
+      char* slot = data_ + sizeof (TraceHeader) +
+                   static_cast<std::size_t> (iteration_ % header_->capacity) *
+                     static_cast<std::size_t> (header_->recordSize);
+      volatile boost::uint64_t* sequence =
+        reinterpret_cast<volatile boost::uint64_t*> (slot);
+      boost::uint64_t* fields = reinterpret_cast<boost::uint64_t*> (slot);
+      double* values = reinterpret_cast<double*> (slot);
+
+      // Mark the record as being written.
+      *sequence = 2 * iteration_ + 1;
+      boost::atomic_thread_fence (boost::memory_order_release);
+
+      fields[1] = iteration_;
+      values[2] = objective;
+      values[3] = violation;
+      values[4] = step;
+      std::memcpy (values + recordFields, x, n * sizeof (double));
+      if (multipliers)
+        std::memcpy (values + recordFields + n, multipliers,
+                     m * sizeof (double));
+      else
+        std::fill (values + recordFields + n, values + recordFields + n + m,
+                   std::numeric_limits<double>::quiet_NaN ());
+
+      // Publish the record.
+      boost::atomic_thread_fence (boost::memory_order_release);
+      *sequence = 2 * (iteration_ + 1);
+      ++iteration_;
+      header_->count = iteration_;
+    }
+  } // end of namespace nag.
+} // end of namespace roboptim.
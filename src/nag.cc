@@ -45,6 +45,13 @@ namespace roboptim
       NagSolver* solver = static_cast<NagSolver*> (comm->p);
       assert (!!solver);
 
+      // Request termination if the solve has been cancelled.
+      if (solver->cancellationToken ()->isCancelled ())
+	{
+	  comm->flag = -1;
+	  return;
+	}
+
       Eigen::Map<const Function::vector_t> x_
 	(&xc, 1);
       Eigen::Map<Function::vector_t> fc_
@@ -0,0 +1,102 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+// Microbenchmark of the one-variable callback with derivatives
+// (detail::nagSolverCallbackDifferentiable).
+//
+// The plug-in source is included so that its internal callback can
+// be called directly, without NAG.
+
+#include "../../src/nag-differentiable.cc"
+
+#include "microbench.hh"
+#include "trivial-functions.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::bench;
+
+namespace
+{
+  /// \brief Call the callback, as NAG does.
+  struct Callback
+  {
+    explicit Callback (NagSolverDifferentiable& solver)
+      : fc_ (0.),
+        gc_ (0.)
+    {
+      std::memset (&comm_, 0, sizeof (Nag_Comm));
+      comm_.p = &solver;
+    }
+
+    void operator() ()
+    {
+      detail::nagSolverCallbackDifferentiable (.5, &fc_, &gc_, &comm_);
+    }
+
+    double fc_;
+    double gc_;
+    Nag_Comm comm_;
+  };
+
+  /// \brief Evaluate the user function only.
+  struct UserFunction
+  {
+    explicit UserFunction (const DifferentiableFunction& f)
+      : f_ (f),
+        x_ (Function::vector_t::Constant (1, .5)),
+        result_ (1),
+        grad_ (1)
+    {
+    }
+
+    void operator() ()
+    {
+      f_ (result_, x_);
+      f_.gradient (grad_, x_, 0);
+    }
+
+    const DifferentiableFunction& f_;
+    Function::vector_t x_;
+    Function::vector_t result_;
+    DifferentiableFunction::gradient_t grad_;
+  };
+
+  void noop (const NagSolverDifferentiable::problem_t&,
+             NagSolverDifferentiable::solverState_t&)
+  {
+  }
+} // end of anonymous namespace
+
+int main ()
+{
+  printHeader ();
+
+  TrivialDenseFunction cost (1, 1);
+  NagSolverDifferentiable::problem_t pb (cost);
+  pb.argumentBounds ()[0] = Function::makeInterval (0., 1.);
+  NagSolverDifferentiable solver (pb);
+
+  Callback f (solver);
+  UserFunction user (cost);
+  print ("nagSolverCallbackDifferentiable", 1, 1, 1, measure (f, calls (1)),
+         measure (user, calls (1)));
+
+  solver.setIterationCallback (&noop);
+  print ("nagSolverCallbackDifferentiable (callback)", 1, 1, 1,
+         measure (f, calls (1)), measure (user, calls (1)));
+
+  return 0;
+}
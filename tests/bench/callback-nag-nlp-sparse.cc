@@ -0,0 +1,176 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Microbenchmark of the sparse NLP callback (detail::usrfun).
+//
+// The plug-in source is included so that its internal callback can
+// be called directly, without NAG.
+
+#include "../../src/nag-nlp-sparse.cc"
+
+#include <boost/make_shared.hpp>
+
+#include "microbench.hh"
+#include "trivial-functions.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::bench;
+
+namespace
+{
+  typedef NagSolverNlpSparse::jacobian_t jacobian_t;
+
+  /// \brief Call usrfun, as NAG does.
+  struct Usrfun
+  {
+    Usrfun (NagSolverNlpSparse& solver, Integer n, Integer nf, Integer leng,
+            Integer needf, Integer needg)
+      : n_ (n),
+        nf_ (nf),
+        leng_ (leng),
+        needf_ (needf),
+        needg_ (needg),
+        x_ (static_cast<std::size_t> (n), .5),
+        f_ (static_cast<std::size_t> (nf)),
+        g_ (static_cast<std::size_t> (leng))
+    {
+      std::memset (&comm_, 0, sizeof (Nag_Comm));
+      comm_.p = &solver;
+    }
+
+    void operator() ()
+    {
+      Integer status = 0;
+      detail::usrfun (&status, n_, &x_[0], needf_, nf_, &f_[0], needg_, leng_,
+                      &g_[0], &comm_);
+    }
+
+    Integer n_;
+    Integer nf_;
+    Integer leng_;
+    Integer needf_;
+    Integer needg_;
+    std::vector<double> x_;
+    std::vector<double> f_;
+    std::vector<double> g_;
+    Nag_Comm comm_;
+  };
+
+  /// \brief Evaluate the user functions only, in preallocated
+  /// buffers.
+  struct UserFunctions
+  {
+    UserFunctions (const TrivialSparseFunction& cost,
+                   const TrivialSparseFunction& constraint, bool values,
+                   bool jacobians)
+      : cost_ (cost),
+        constraint_ (constraint),
+        values_ (values),
+        jacobians_ (jacobians),
+        x_ (Function::vector_t::Constant (cost.inputSize (), .5)),
+        costValue_ (1),
+        constraintValue_ (constraint.outputSize ()),
+        costJacobian_ (cost.jacobian (x_)),
+        constraintJacobian_ (constraint.jacobian (x_))
+    {
+    }
+
+    void operator() ()
+    {
+      if (values_)
+      {
+        cost_ (costValue_, x_);
+        constraint_ (constraintValue_, x_);
+      }
+      if (jacobians_)
+      {
+        cost_.jacobian (costJacobian_, x_);
+        constraint_.jacobian (constraintJacobian_, x_);
+      }
+    }
+
+    const TrivialSparseFunction& cost_;
+    const TrivialSparseFunction& constraint_;
+    bool values_;
+    bool jacobians_;
+    Function::vector_t x_;
+    Function::vector_t costValue_;
+    Function::vector_t constraintValue_;
+    jacobian_t costJacobian_;
+    jacobian_t constraintJacobian_;
+  };
+
+  void noop (const NagSolverNlpSparse::problem_t&,
+             NagSolverNlpSparse::solverState_t&)
+  {
+  }
+
+  void run (Function::size_type n, Function::size_type m,
+            Function::size_type k)
+  {
+    TrivialSparseFunction cost (n, 1, n);
+    boost::shared_ptr<TrivialSparseFunction> constraint =
+      boost::make_shared<TrivialSparseFunction> (n, m, k);
+
+    NagSolverNlpSparse::problem_t pb (cost);
+    pb.addConstraint (constraint,
+                      NagSolverNlpSparse::problem_t::intervals_t (
+                        static_cast<std::size_t> (m),
+                        Function::makeInfiniteInterval ()));
+    NagSolverNlpSparse solver (pb);
+
+    // usrfun relies on the sparsity patterns computed when setting up
+    // a solve.
+    solver.minimum ();
+
+    Integer nf = static_cast<Integer> (1 + m);
+    Integer nnz = static_cast<Integer> (cost.nonZeros () +
+                                        constraint->nonZeros ());
+    long size = static_cast<long> (n + nnz);
+
+    Usrfun f (solver, static_cast<Integer> (n), nf, nnz, 1, 0);
+    Usrfun g (solver, static_cast<Integer> (n), nf, nnz, 0, 1);
+    Usrfun fg (solver, static_cast<Integer> (n), nf, nnz, 1, 1);
+    UserFunctions userF (cost, *constraint, true, false);
+    UserFunctions userG (cost, *constraint, false, true);
+    UserFunctions userFg (cost, *constraint, true, true);
+
+    print ("usrfun (values)", n, nf, nnz, measure (f, calls (size)),
+           measure (userF, calls (size)));
+    print ("usrfun (jacobians)", n, nf, nnz, measure (g, calls (size)),
+           measure (userG, calls (size)));
+    print ("usrfun (values and jacobians)", n, nf, nnz,
+           measure (fg, calls (size)), measure (userFg, calls (size)));
+
+    solver.setIterationCallback (&noop);
+    print ("usrfun (values, callback)", n, nf, nnz, measure (f, calls (size)),
+           measure (userF, calls (size)));
+  }
+} // end of anonymous namespace
+
+int main ()
+{
+  printHeader ();
+
+  const Function::size_type sizes[] = {10, 100, 1000, 10000};
+  const Function::size_type nonZerosPerRow[] = {2, 10};
+  for (std::size_t i = 0; i < sizeof (sizes) / sizeof (sizes[0]); ++i)
+    for (std::size_t j = 0; j < 2; ++j)
+      run (sizes[i], sizes[i] / 2, nonZerosPerRow[j]);
+
+  return 0;
+}
@@ -0,0 +1,195 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Microbenchmark of the dense NLP callbacks (detail::confun and
+// detail::objfun).
+//
+// The plug-in source is included so that its internal callbacks can
+// be called directly, without NAG.
+
+#include "../../src/nag-nlp.cc"
+
+#include <boost/make_shared.hpp>
+
+#include "microbench.hh"
+#include "trivial-functions.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::bench;
+
+namespace
+{
+  /// \brief Call confun, as NAG does.
+  struct Confun
+  {
+    Confun (NagSolverNlp& solver, Integer n, Integer ncnln, Integer mode)
+      : n_ (n),
+        ncnln_ (ncnln),
+        mode_ (mode),
+        needc_ (static_cast<std::size_t> (ncnln), 1),
+        x_ (static_cast<std::size_t> (n), .5),
+        ccon_ (static_cast<std::size_t> (ncnln)),
+        cjac_ (static_cast<std::size_t> (ncnln * n))
+    {
+      std::memset (&comm_, 0, sizeof (Nag_Comm));
+      comm_.p = &solver;
+    }
+
+    void operator() ()
+    {
+      Integer mode = mode_;
+      detail::confun (&mode, ncnln_, n_, n_, &needc_[0], &x_[0], &ccon_[0],
+                      &cjac_[0], 0, &comm_);
+    }
+
+    Integer n_;
+    Integer ncnln_;
+    Integer mode_;
+    std::vector<Integer> needc_;
+    std::vector<double> x_;
+    std::vector<double> ccon_;
+    std::vector<double> cjac_;
+    Nag_Comm comm_;
+  };
+
+  /// \brief Call objfun, as NAG does.
+  struct Objfun
+  {
+    Objfun (NagSolverNlp& solver, Integer n, Integer mode)
+      : n_ (n),
+        mode_ (mode),
+        x_ (static_cast<std::size_t> (n), .5),
+        objf_ (0.),
+        grad_ (static_cast<std::size_t> (n))
+    {
+      std::memset (&comm_, 0, sizeof (Nag_Comm));
+      comm_.p = &solver;
+    }
+
+    void operator() ()
+    {
+      Integer mode = mode_;
+      detail::objfun (&mode, n_, &x_[0], &objf_, &grad_[0], 0, &comm_);
+    }
+
+    Integer n_;
+    Integer mode_;
+    std::vector<double> x_;
+    double objf_;
+    std::vector<double> grad_;
+    Nag_Comm comm_;
+  };
+
+  /// \brief Evaluate a user function only, in preallocated buffers.
+  struct UserFunction
+  {
+    enum Output
+    {
+      VALUE,
+      GRADIENT,
+      JACOBIAN
+    };
+
+    UserFunction (const DifferentiableFunction& f, Output output)
+      : f_ (f),
+        output_ (output),
+        x_ (Function::vector_t::Constant (f.inputSize (), .5)),
+        result_ (f.outputSize ()),
+        grad_ (f.inputSize ()),
+        jac_ (f.outputSize (), f.inputSize ())
+    {
+    }
+
+    void operator() ()
+    {
+      switch (output_)
+      {
+      case VALUE:
+        f_ (result_, x_);
+        break;
+      case GRADIENT:
+        f_.gradient (grad_, x_, 0);
+        break;
+      case JACOBIAN:
+        f_.jacobian (jac_, x_);
+        break;
+      }
+    }
+
+    const DifferentiableFunction& f_;
+    Output output_;
+    Function::vector_t x_;
+    Function::vector_t result_;
+    DifferentiableFunction::gradient_t grad_;
+    DifferentiableFunction::jacobian_t jac_;
+  };
+
+  void noop (const NagSolverNlp::problem_t&, NagSolverNlp::solverState_t&)
+  {
+  }
+
+  void run (Function::size_type n, Function::size_type m)
+  {
+    TrivialDenseFunction cost (n, 1);
+    boost::shared_ptr<TrivialDenseFunction> constraint =
+      boost::make_shared<TrivialDenseFunction> (n, m);
+
+    NagSolverNlp::problem_t pb (cost);
+    pb.addConstraint (constraint,
+                      NagSolverNlp::problem_t::intervals_t (
+                        static_cast<std::size_t> (m),
+                        Function::makeInfiniteInterval ()));
+    NagSolverNlp solver (pb);
+
+    Integer n_ = static_cast<Integer> (n);
+    Integer m_ = static_cast<Integer> (m);
+    long nnz = static_cast<long> (n * m);
+
+    Confun c (solver, n_, m_, 0);
+    Confun cj (solver, n_, m_, 1);
+    Objfun f (solver, n_, 0);
+    Objfun fg (solver, n_, 1);
+    UserFunction userC (*constraint, UserFunction::VALUE);
+    UserFunction userCj (*constraint, UserFunction::JACOBIAN);
+    UserFunction userF (cost, UserFunction::VALUE);
+    UserFunction userFg (cost, UserFunction::GRADIENT);
+
+    print ("confun (values)", n, m, nnz, measure (c, calls (m)),
+           measure (userC, calls (m)));
+    print ("confun (jacobian)", n, m, nnz, measure (cj, calls (nnz)),
+           measure (userCj, calls (nnz)));
+    print ("objfun (value)", n, 1, n, measure (f, calls (n)),
+           measure (userF, calls (n)));
+    print ("objfun (gradient)", n, 1, n, measure (fg, calls (n)),
+           measure (userFg, calls (n)));
+
+    solver.setIterationCallback (&noop);
+    print ("objfun (value, callback)", n, 1, n, measure (f, calls (n)),
+           measure (userF, calls (n)));
+  }
+} // end of anonymous namespace
+
+int main ()
+{
+  printHeader ();
+
+  const Function::size_type sizes[] = {10, 100, 1000};
+  for (std::size_t i = 0; i < sizeof (sizes) / sizeof (sizes[0]); ++i)
+    run (sizes[i], sizes[i] / 2);
+
+  return 0;
+}
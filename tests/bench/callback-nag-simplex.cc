@@ -0,0 +1,105 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+// Microbenchmark of the simplex callback (nag::detail::solverCallback).
+//
+// The plug-in source is included so that its internal callback can
+// be called directly, without NAG.
+
+#include "../../src/nag-simplex.cc"
+
+#include "microbench.hh"
+#include "trivial-functions.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::bench;
+
+namespace
+{
+  /// \brief Call the callback, as NAG does.
+  struct Callback
+  {
+    Callback (nag::Simplex& solver, Integer n)
+      : n_ (n),
+        x_ (static_cast<std::size_t> (n), .5),
+        fc_ (0.)
+    {
+      std::memset (&comm_, 0, sizeof (Nag_Comm));
+      comm_.p = &solver;
+    }
+
+    void operator() ()
+    {
+      nag::detail::solverCallback (n_, &x_[0], &fc_, &comm_);
+    }
+
+    Integer n_;
+    std::vector<double> x_;
+    double fc_;
+    Nag_Comm comm_;
+  };
+
+  /// \brief Evaluate the user function only.
+  struct UserFunction
+  {
+    explicit UserFunction (const Function& f)
+      : f_ (f),
+        x_ (Function::vector_t::Constant (f.inputSize (), .5)),
+        result_ (1)
+    {
+    }
+
+    void operator() ()
+    {
+      f_ (result_, x_);
+    }
+
+    const Function& f_;
+    Function::vector_t x_;
+    Function::vector_t result_;
+  };
+
+  void noop (const nag::Simplex::problem_t&, nag::Simplex::solverState_t&)
+  {
+  }
+
+  void run (Function::size_type n)
+  {
+    TrivialDenseFunction cost (n, 1);
+    nag::Simplex::problem_t pb (cost);
+    nag::Simplex solver (pb);
+
+    Callback f (solver, static_cast<Integer> (n));
+    UserFunction user (cost);
+    print ("solverCallback", n, 1, n, measure (f, calls (n)),
+           measure (user, calls (n)));
+
+    solver.setIterationCallback (&noop);
+    print ("solverCallback (callback)", n, 1, n, measure (f, calls (n)),
+           measure (user, calls (n)));
+  }
+} // end of anonymous namespace
+
+int main ()
+{
+  printHeader ();
+
+  const Function::size_type sizes[] = {2, 10, 100, 1000};
+  for (std::size_t i = 0; i < sizeof (sizes) / sizeof (sizes[0]); ++i)
+    run (sizes[i]);
+
+  return 0;
+}
@@ -0,0 +1,88 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+// Microbenchmark of the one-variable callback without derivatives
+// (detail::nagSolverCallback).
+//
+// The plug-in source is included so that its internal callback can
+// be called directly, without NAG.
+
+#include "../../src/nag.cc"
+
+#include "microbench.hh"
+#include "trivial-functions.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::bench;
+
+namespace
+{
+  /// \brief Call the callback, as NAG does.
+  struct Callback
+  {
+    explicit Callback (NagSolver& solver)
+      : fc_ (0.)
+    {
+      std::memset (&comm_, 0, sizeof (Nag_Comm));
+      comm_.p = &solver;
+    }
+
+    void operator() ()
+    {
+      detail::nagSolverCallback (.5, &fc_, &comm_);
+    }
+
+    double fc_;
+    Nag_Comm comm_;
+  };
+
+  /// \brief Evaluate the user function only.
+  struct UserFunction
+  {
+    explicit UserFunction (const Function& f)
+      : f_ (f),
+        x_ (Function::vector_t::Constant (1, .5)),
+        result_ (1)
+    {
+    }
+
+    void operator() ()
+    {
+      f_ (result_, x_);
+    }
+
+    const Function& f_;
+    Function::vector_t x_;
+    Function::vector_t result_;
+  };
+} // end of anonymous namespace
+
+int main ()
+{
+  printHeader ();
+
+  TrivialDenseFunction cost (1, 1);
+  NagSolver::problem_t pb (cost);
+  pb.argumentBounds ()[0] = Function::makeInterval (0., 1.);
+  NagSolver solver (pb);
+
+  Callback f (solver);
+  UserFunction user (cost);
+  print ("nagSolverCallback", 1, 1, 1, measure (f, calls (1)),
+         measure (user, calls (1)));
+
+  return 0;
+}
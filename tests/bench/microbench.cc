@@ -0,0 +1,79 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Heap allocation counters of the microbenchmarks.
+//
+// malloc, calloc and realloc are interposed (glibc only) so that
+// allocations done by operator new, Eigen and Boost are all counted.
+
+#include <cstddef>
+
+#include "microbench.hh"
+
+extern "C" {
+void* __libc_malloc (std::size_t size);
+void* __libc_calloc (std::size_t count, std::size_t size);
+void* __libc_realloc (void* ptr, std::size_t size);
+}
+
+namespace
+{
+  std::size_t allocations = 0;
+  std::size_t bytes = 0;
+} // end of anonymous namespace
+
+extern "C" {
+void* malloc (std::size_t size)
+{
+  ++allocations;
+  bytes += size;
+  return __libc_malloc (size);
+}
+
+void* calloc (std::size_t count, std::size_t size)
+{
+  ++allocations;
+  bytes += count * size;
+  return __libc_calloc (count, size);
+}
+
+void* realloc (void* ptr, std::size_t size)
+{
+  ++allocations;
+  bytes += size;
+  return __libc_realloc (ptr, size);
+}
+}
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace bench
+    {
+      std::size_t allocationCount ()
+      {
+        return allocations;
+      }
+
+      std::size_t allocatedBytes ()
+      {
+        return bytes;
+      }
+    } // end of namespace bench.
+  } // end of namespace nag.
+} // end of namespace roboptim.
@@ -0,0 +1,118 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_PLUGIN_NAG_TESTS_BENCH_MICROBENCH_HH
+# define ROBOPTIM_CORE_PLUGIN_NAG_TESTS_BENCH_MICROBENCH_HH
+
+# include <algorithm>
+# include <cstdio>
+# include <string>
+
+# include <time.h>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace bench
+    {
+      /// \brief Number of heap allocations so far (see microbench.cc).
+      std::size_t allocationCount ();
+
+      /// \brief Number of bytes allocated on the heap so far.
+      std::size_t allocatedBytes ();
+
+      /// \brief Cost of one call.
+      struct Measure
+      {
+        Measure ()
+          : ns (0.),
+            bytes (0.),
+            allocations (0.)
+        {
+        }
+
+        /// \brief Nanoseconds per call.
+        double ns;
+        /// \brief Bytes allocated per call.
+        double bytes;
+        /// \brief Heap allocations per call.
+        double allocations;
+      };
+
+      inline double now ()
+      {
+        timespec ts;
+        clock_gettime (CLOCK_MONOTONIC, &ts);
+        return static_cast<double> (ts.tv_sec) +
+               1e-9 * static_cast<double> (ts.tv_nsec);
+      }
+
+      /// \brief Number of calls giving about `work` elementary
+      /// operations, for a call touching `size` values.
+      inline long calls (long size, long work = 20000000)
+      {
+        return std::max (10L, work / std::max (1L, size));
+      }
+
+      /// \brief Measure the average cost of f ().
+      template <typename F>
+      Measure measure (F& f, long calls)
+      {
+        // Warm up: the first call may allocate buffers that are then
+        // reused.
+        f ();
+
+        Measure res;
+        std::size_t allocations = allocationCount ();
+        std::size_t bytes = allocatedBytes ();
+        double start = now ();
+        for (long i = 0; i < calls; ++i) f ();
+        double time = now () - start;
+
+        res.ns = 1e9 * time / static_cast<double> (calls);
+        res.bytes = static_cast<double> (allocatedBytes () - bytes) /
+                    static_cast<double> (calls);
+        res.allocations =
+          static_cast<double> (allocationCount () - allocations) /
+          static_cast<double> (calls);
+        return res;
+      }
+
+      inline void printHeader ()
+      {
+        std::printf ("%-32s %8s %8s %10s %12s %12s %12s %12s %10s\n",
+                     "callback", "n", "nf", "nnz", "ns/call", "user ns",
+                     "wrapper ns", "bytes/call", "user bytes");
+      }
+
+      /// \brief Print the cost of a callback, and the share of the
+      /// user functions it calls.
+      inline void print (const std::string& callback, long n, long nf,
+                         long nnz, const Measure& total, const Measure& user)
+      {
+        std::printf ("%-32s %8ld %8ld %10ld %12.1f %12.1f %12.1f %12.1f "
+                     "%10.1f\n",
+                     callback.c_str (), n, nf, nnz, total.ns, user.ns,
+                     total.ns - user.ns, total.bytes, user.bytes);
+        std::fflush (stdout);
+      }
+    } // end of namespace bench.
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_PLUGIN_NAG_TESTS_BENCH_MICROBENCH_HH
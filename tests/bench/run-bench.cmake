@@ -0,0 +1,113 @@
+# Copyright 2016, Benjamin Chrétien, CNRS-AIST JRL.
+#
+# This file is part of roboptim-core.
+# roboptim-core is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# roboptim-core is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Lesser Public License for more details.
+# You should have received a copy of the GNU Lesser General Public License
+# along with roboptim-core.  If not, see <http://www.gnu.org/licenses/>.
+
+# Run the benchmark problems several times and gather the statistics
+# reported by the NAG plug-ins (see nag-statistics.hh) in
+# OUTPUT_DIR/results.csv and OUTPUT_DIR/results.json.
+#
+# Expected variables:
+#  CTEST_COMMAND  ctest executable,
+#  BUILD_DIR      build directory holding the tests,
+#  REPEAT         number of runs,
+#  REGEX          regular expression selecting the benchmark tests,
+#  OUTPUT_DIR     directory receiving the results.
+
+SET(RAW "${OUTPUT_DIR}/raw.csv")
+SET(CSV "${OUTPUT_DIR}/results.csv")
+SET(JSON "${OUTPUT_DIR}/results.json")
+
+FILE(MAKE_DIRECTORY "${OUTPUT_DIR}")
+FILE(WRITE "${CSV}" "run,program,solver,problem,n,nf,nonzeros,success,setup_time,solve_time,wall_time,callback_time,evaluations,derivative_evaluations,major_iterations,peak_memory\n")
+SET(ENV{ROBOPTIM_NAG_STATS_FILE} "${RAW}")
+
+# Tests are run one at a time, so that the plug-ins can report the
+# name of the test in the program column.
+EXECUTE_PROCESS(
+  COMMAND "${CTEST_COMMAND}" -N -R "${REGEX}"
+  WORKING_DIRECTORY "${BUILD_DIR}"
+  OUTPUT_VARIABLE LISTING)
+STRING(REGEX MATCHALL "Test +#[0-9]+: [^\n]+" TESTS "${LISTING}")
+STRING(REGEX REPLACE "Test +#[0-9]+: " "" TESTS "${TESTS}")
+
+FOREACH(RUN RANGE 1 ${REPEAT})
+  MESSAGE(STATUS "Benchmark run ${RUN}/${REPEAT}")
+  FILE(REMOVE "${RAW}")
+
+  # Failing problems are part of the benchmark: ignore the result.
+  FOREACH(TEST ${TESTS})
+    STRING(REGEX REPLACE "([][+.*?()^$|\\])" "\\\\\\1" PATTERN "${TEST}")
+    SET(ENV{ROBOPTIM_NAG_STATS_PROGRAM} "${TEST}")
+    EXECUTE_PROCESS(
+      COMMAND "${CTEST_COMMAND}" -R "^${PATTERN}$" -Q
+      WORKING_DIRECTORY "${BUILD_DIR}")
+  ENDFOREACH()
+
+  IF(EXISTS "${RAW}")
+    FILE(STRINGS "${RAW}" LINES)
+    FOREACH(LINE ${LINES})
+      FILE(APPEND "${CSV}" "${RUN},${LINE}\n")
+    ENDFOREACH()
+  ENDIF()
+ENDFOREACH()
+FILE(REMOVE "${RAW}")
+
+# Convert a quoted CSV field to a JSON string.
+MACRO(CSV_TO_JSON_STRING VAR QUOTED)
+  STRING(REGEX REPLACE "^\"(.*)\"$" "\\1" ${VAR} "${QUOTED}")
+  STRING(REPLACE "\\" "\\\\" ${VAR} "${${VAR}}")
+  STRING(REPLACE "\"\"" "\\\"" ${VAR} "${${VAR}}")
+  SET(${VAR} "\"${${VAR}}\"")
+ENDMACRO()
+
+SET(FIELD "(\"([^\"]|\"\")*\")")
+FILE(STRINGS "${CSV}" LINES)
+LIST(REMOVE_AT LINES 0)
+FILE(WRITE "${JSON}" "[\n")
+SET(SEPARATOR "")
+FOREACH(LINE ${LINES})
+  IF("${LINE}" MATCHES "^([0-9]+),${FIELD},${FIELD},${FIELD},(.*)$")
+    # Save the matches before they are overwritten.
+    SET(RUN "${CMAKE_MATCH_1}")
+    SET(PROGRAM "${CMAKE_MATCH_2}")
+    SET(SOLVER "${CMAKE_MATCH_4}")
+    SET(PROBLEM "${CMAKE_MATCH_6}")
+    STRING(REPLACE "," ";" VALUES "${CMAKE_MATCH_8}")
+    CSV_TO_JSON_STRING(PROGRAM "${PROGRAM}")
+    CSV_TO_JSON_STRING(SOLVER "${SOLVER}")
+    CSV_TO_JSON_STRING(PROBLEM "${PROBLEM}")
+    LIST(GET VALUES 0 N)
+    LIST(GET VALUES 1 NF)
+    LIST(GET VALUES 2 NONZEROS)
+    LIST(GET VALUES 3 SUCCESS)
+    LIST(GET VALUES 4 SETUP_TIME)
+    LIST(GET VALUES 5 SOLVE_TIME)
+    LIST(GET VALUES 6 WALL_TIME)
+    LIST(GET VALUES 7 CALLBACK_TIME)
+    LIST(GET VALUES 8 EVALUATIONS)
+    LIST(GET VALUES 9 DERIVATIVE_EVALUATIONS)
+    LIST(GET VALUES 10 MAJOR_ITERATIONS)
+    LIST(GET VALUES 11 PEAK_MEMORY)
+    IF(SUCCESS)
+      SET(SUCCESS true)
+    ELSE()
+      SET(SUCCESS false)
+    ENDIF()
+    FILE(APPEND "${JSON}" "${SEPARATOR}  {\"run\": ${RUN}, \"program\": ${PROGRAM}, \"solver\": ${SOLVER}, \"problem\": ${PROBLEM}, \"n\": ${N}, \"nf\": ${NF}, \"nonzeros\": ${NONZEROS}, \"success\": ${SUCCESS}, \"setup_time\": ${SETUP_TIME}, \"solve_time\": ${SOLVE_TIME}, \"wall_time\": ${WALL_TIME}, \"callback_time\": ${CALLBACK_TIME}, \"evaluations\": ${EVALUATIONS}, \"derivative_evaluations\": ${DERIVATIVE_EVALUATIONS}, \"major_iterations\": ${MAJOR_ITERATIONS}, \"peak_memory\": ${PEAK_MEMORY}}")
+    SET(SEPARATOR ",\n")
+  ENDIF()
+ENDFOREACH()
+FILE(APPEND "${JSON}" "\n]\n")
+
+MESSAGE(STATUS "Benchmark results: ${CSV}, ${JSON}")
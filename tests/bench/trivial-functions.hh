@@ -0,0 +1,114 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_PLUGIN_NAG_TESTS_BENCH_TRIVIAL_FUNCTIONS_HH
+# define ROBOPTIM_CORE_PLUGIN_NAG_TESTS_BENCH_TRIVIAL_FUNCTIONS_HH
+
+# include <vector>
+
+# include <roboptim/core/differentiable-function.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace bench
+    {
+      /// \brief Dense function doing as little work as possible:
+      /// \f$f_i (x) = x_{i \bmod n}\f$.
+      class TrivialDenseFunction : public DifferentiableFunction
+      {
+      public:
+        TrivialDenseFunction (size_type n, size_type m)
+          : DifferentiableFunction (n, m, "trivial dense function")
+        {
+        }
+
+      protected:
+        void impl_compute (result_ref result, const_argument_ref x) const
+        {
+          for (size_type i = 0; i < outputSize (); ++i)
+            result[i] = x[i % inputSize ()];
+        }
+
+        void impl_gradient (gradient_ref grad, const_argument_ref,
+                            size_type i) const
+        {
+          grad.setZero ();
+          grad[i % inputSize ()] = 1.;
+        }
+
+        void impl_jacobian (jacobian_ref jac, const_argument_ref) const
+        {
+          jac.setZero ();
+          for (size_type i = 0; i < outputSize (); ++i)
+            jac (i, i % inputSize ()) = 1.;
+        }
+      };
+
+      /// \brief Sparse function doing as little work as possible: row
+      /// i depends on k consecutive variables, its value is the first
+      /// of them and its Jacobian is constant.
+      class TrivialSparseFunction : public DifferentiableSparseFunction
+      {
+      public:
+        TrivialSparseFunction (size_type n, size_type m, size_type k)
+          : DifferentiableSparseFunction (n, m, "trivial sparse function"),
+            jacobian_ (m, n)
+        {
+          typedef Eigen::Triplet<double> triplet_t;
+          std::vector<triplet_t> triplets;
+          for (size_type i = 0; i < m; ++i)
+            for (size_type j = 0; j < std::min (k, n); ++j)
+              triplets.push_back (triplet_t (static_cast<int> (i),
+                                             static_cast<int> ((i + j) % n),
+                                             1.));
+          jacobian_.setFromTriplets (triplets.begin (), triplets.end ());
+        }
+
+        /// \brief Number of nonzeros of the Jacobian.
+        size_type nonZeros () const
+        {
+          return jacobian_.nonZeros ();
+        }
+
+      protected:
+        void impl_compute (result_ref result, const_argument_ref x) const
+        {
+          for (size_type i = 0; i < outputSize (); ++i)
+            result[i] = x[i % inputSize ()];
+        }
+
+        void impl_gradient (gradient_ref grad, const_argument_ref,
+                            size_type i) const
+        {
+          grad = jacobian_.row (i);
+        }
+
+        void impl_jacobian (jacobian_ref jac, const_argument_ref) const
+        {
+          jac = jacobian_;
+        }
+
+      private:
+        jacobian_t jacobian_;
+      };
+    } // end of namespace bench.
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_PLUGIN_NAG_TESTS_BENCH_TRIVIAL_FUNCTIONS_HH
@@ -0,0 +1,174 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Unit tests of the decomposition of sparse problems in independent
+// blocks (see nag::decompose).
+
+#define BOOST_TEST_MODULE decomposition
+
+#include <cstddef>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+#include <roboptim/core/plugin/nag/nag-decomposition.hh>
+
+using namespace roboptim;
+
+namespace
+{
+  /// \brief Sparse matrix given as (row, column) pairs, 1-based as in
+  /// NAG.
+  struct Elements
+  {
+    Elements& operator() (Integer row, Integer column)
+    {
+      rows.push_back (row);
+      columns.push_back (column);
+      return *this;
+    }
+
+    const Integer* rowData () const
+    {
+      return rows.empty () ? 0 : &rows[0];
+    }
+
+    const Integer* columnData () const
+    {
+      return columns.empty () ? 0 : &columns[0];
+    }
+
+    Integer size () const
+    {
+      return static_cast<Integer> (rows.size ());
+    }
+
+    std::vector<Integer> rows;
+    std::vector<Integer> columns;
+  };
+
+  void decompose (Integer n, Integer nf, const Elements& a, const Elements& g,
+                  Integer objrow, nag::Decomposition& decomposition)
+  {
+    nag::decompose (n, nf, a.rowData (), a.columnData (), a.size (),
+                    g.rowData (), g.columnData (), g.size (), objrow,
+                    decomposition);
+  }
+
+  void checkBlocks (const std::vector<std::size_t>& blocks,
+                    const std::size_t* expected, std::size_t size)
+  {
+    BOOST_CHECK_EQUAL_COLLECTIONS (blocks.begin (), blocks.end (), expected,
+                                   expected + size);
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (decomposition)
+
+// Rows link their variables transitively, and blocks are numbered by
+// their first variable.
+BOOST_AUTO_TEST_CASE (connected_components)
+{
+  Elements a, g;
+  g (1, 2) (1, 4);
+  g (2, 1) (2, 3);
+  a (3, 3) (3, 5);
+
+  nag::Decomposition decomposition;
+  decompose (5, 3, a, g, 0, decomposition);
+
+  BOOST_CHECK_EQUAL (decomposition.blocks, 2u);
+  const std::size_t variables[] = {0, 1, 0, 1, 0};
+  checkBlocks (decomposition.variableBlock, variables, 5);
+  const std::size_t rows[] = {1, 0, 0};
+  checkBlocks (decomposition.rowBlock, rows, 3);
+}
+
+// The objective row of A does not link its variables: those that only
+// appear there are gathered in a single block, and the objective row
+// belongs to the first block.
+BOOST_AUTO_TEST_CASE (linear_objective)
+{
+  Elements a, g;
+  a (1, 1) (1, 2) (1, 3) (1, 4) (1, 5);
+  g (2, 1) (2, 2);
+  g (3, 4);
+  a (4, 2);
+
+  nag::Decomposition decomposition;
+  decompose (5, 4, a, g, 1, decomposition);
+
+  BOOST_CHECK_EQUAL (decomposition.blocks, 3u);
+  const std::size_t variables[] = {0, 0, 1, 2, 1};
+  checkBlocks (decomposition.variableBlock, variables, 5);
+  const std::size_t rows[] = {0, 0, 2, 0};
+  checkBlocks (decomposition.rowBlock, rows, 4);
+}
+
+// Without an objective row, the first row of A links its variables as
+// any other row.
+BOOST_AUTO_TEST_CASE (nonlinear_objective)
+{
+  Elements a, g;
+  a (1, 1) (1, 3);
+  g (2, 2);
+  g (3, 3);
+
+  nag::Decomposition decomposition;
+  decompose (3, 3, a, g, 0, decomposition);
+
+  BOOST_CHECK_EQUAL (decomposition.blocks, 2u);
+  const std::size_t variables[] = {0, 1, 0};
+  checkBlocks (decomposition.variableBlock, variables, 3);
+  const std::size_t rows[] = {0, 1, 0};
+  checkBlocks (decomposition.rowBlock, rows, 3);
+}
+
+// Rows without entries belong to the first block, and unused variables
+// are gathered in a single block, numbered by the first of them.
+BOOST_AUTO_TEST_CASE (empty_rows_and_unused_variables)
+{
+  Elements a, g;
+  g (2, 3);
+  g (4, 5);
+
+  nag::Decomposition decomposition;
+  decompose (6, 5, a, g, 0, decomposition);
+
+  BOOST_CHECK_EQUAL (decomposition.blocks, 3u);
+  const std::size_t variables[] = {0, 0, 1, 0, 2, 0};
+  checkBlocks (decomposition.variableBlock, variables, 6);
+  const std::size_t rows[] = {0, 1, 0, 2, 0};
+  checkBlocks (decomposition.rowBlock, rows, 5);
+}
+
+// A problem without rows is a single block.
+BOOST_AUTO_TEST_CASE (no_rows)
+{
+  Elements a, g;
+
+  nag::Decomposition decomposition;
+  decompose (3, 1, a, g, 1, decomposition);
+
+  BOOST_CHECK_EQUAL (decomposition.blocks, 1u);
+  const std::size_t variables[] = {0, 0, 0};
+  checkBlocks (decomposition.variableBlock, variables, 3);
+  const std::size_t rows[] = {0};
+  checkBlocks (decomposition.rowBlock, rows, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
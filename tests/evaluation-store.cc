@@ -0,0 +1,196 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Unit tests of the on-disk store of memoized evaluations (see
+// nag::EvaluationStore).
+
+#define BOOST_TEST_MODULE evaluation_store
+
+#include <cstdio>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+#include <roboptim/core/plugin/nag/nag-evaluation-store.hh>
+
+using namespace roboptim;
+
+namespace
+{
+  /// \brief Store file of a test, removed before and after it.
+  struct StoreFile
+  {
+    explicit StoreFile (const std::string& name)
+      : filename (name + ".evaluations")
+    {
+      std::remove (filename.c_str ());
+    }
+
+    ~StoreFile ()
+    {
+      std::remove (filename.c_str ());
+    }
+
+    std::string filename;
+  };
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (evaluation_store)
+
+BOOST_AUTO_TEST_CASE (round_trip)
+{
+  StoreFile file ("round-trip");
+  nag::EvaluationStore store (file.filename, "f", 2, 1, 2, 64, 0.);
+
+  const double x[] = {1., -2.};
+  const double value[] = {3.};
+  const double jacobian[] = {4., 5.};
+  double v[1] = {0.};
+  double j[2] = {0., 0.};
+
+  BOOST_CHECK (!store.recall (x, v, j));
+  store.record (x, value, jacobian);
+  BOOST_REQUIRE (store.recall (x, v, j));
+  BOOST_CHECK_EQUAL (v[0], 3.);
+  BOOST_CHECK_EQUAL (j[0], 4.);
+  BOOST_CHECK_EQUAL (j[1], 5.);
+
+  // Keys are exact, -0 and 0 being the same point.
+  const double y[] = {1. + 1e-12, -2.};
+  BOOST_CHECK (!store.recall (y, v, 0));
+
+  const double zero[] = {0., 0.};
+  const double negativeZero[] = {-0., 0.};
+  store.record (zero, value, 0);
+  BOOST_CHECK (store.recall (negativeZero, v, 0));
+}
+
+BOOST_AUTO_TEST_CASE (rounded_keys)
+{
+  StoreFile file ("rounded-keys");
+  nag::EvaluationStore store (file.filename, "f", 1, 1, 0, 64, 1e-3);
+
+  const double x[] = {.5};
+  const double near[] = {.5 + 4e-4};
+  const double far[] = {.5 + 6e-4};
+  const double value[] = {7.};
+  double v[1] = {0.};
+
+  store.record (x, value, 0);
+  BOOST_CHECK (store.recall (near, v, 0));
+  BOOST_CHECK_EQUAL (v[0], 7.);
+  BOOST_CHECK (!store.recall (far, v, 0));
+}
+
+// A store of 8 records is a single set: the least recently used record
+// is replaced when it is full.
+BOOST_AUTO_TEST_CASE (eviction)
+{
+  StoreFile file ("eviction");
+  nag::EvaluationStore store (file.filename, "f", 1, 1, 0,
+                              nag::evaluationStoreWays, 0.);
+
+  double v[1];
+  for (std::size_t i = 0; i < nag::evaluationStoreWays; ++i)
+  {
+    const double x[] = {static_cast<double> (i)};
+    store.record (x, x, 0);
+  }
+
+  // Use the first point, so that the second one is the oldest.
+  const double first[] = {0.};
+  BOOST_CHECK (store.recall (first, v, 0));
+
+  const double last[] = {static_cast<double> (nag::evaluationStoreWays)};
+  store.record (last, last, 0);
+
+  const double second[] = {1.};
+  BOOST_CHECK (!store.recall (second, v, 0));
+  BOOST_CHECK (store.recall (first, v, 0));
+  BOOST_CHECK_EQUAL (v[0], 0.);
+  BOOST_CHECK (store.recall (last, v, 0));
+  BOOST_CHECK_EQUAL (v[0], last[0]);
+  for (std::size_t i = 2; i < nag::evaluationStoreWays; ++i)
+  {
+    const double x[] = {static_cast<double> (i)};
+    BOOST_CHECK (store.recall (x, v, 0));
+    BOOST_CHECK_EQUAL (v[0], x[0]);
+  }
+}
+
+// A value recorded alone is completed by a later Jacobian, and only
+// recalled once all the requested parts are stored.
+BOOST_AUTO_TEST_CASE (completion)
+{
+  StoreFile file ("completion");
+  nag::EvaluationStore store (file.filename, "f", 1, 1, 2, 64, 0.);
+
+  const double x[] = {2.};
+  const double value[] = {3.};
+  const double jacobian[] = {4., 5.};
+  double v[1] = {0.};
+  double j[2] = {0., 0.};
+
+  store.record (x, value, 0);
+  BOOST_CHECK (!store.recall (x, v, j));
+  BOOST_CHECK (!store.recall (x, 0, j));
+  BOOST_CHECK_EQUAL (v[0], 0.);
+  BOOST_CHECK (store.recall (x, v, 0));
+  BOOST_CHECK_EQUAL (v[0], 3.);
+
+  v[0] = 0.;
+  store.record (x, 0, jacobian);
+  BOOST_REQUIRE (store.recall (x, v, j));
+  BOOST_CHECK_EQUAL (v[0], 3.);
+  BOOST_CHECK_EQUAL (j[0], 4.);
+  BOOST_CHECK_EQUAL (j[1], 5.);
+}
+
+// Evaluations are kept by the file, unless it is reopened with another
+// signature or other sizes.
+BOOST_AUTO_TEST_CASE (reopen)
+{
+  StoreFile file ("reopen");
+  const double x[] = {1.};
+  const double value[] = {2.};
+  double v[1];
+
+  {
+    nag::EvaluationStore store (file.filename, "f", 1, 1, 0, 64, 0.);
+    store.record (x, value, 0);
+  }
+  {
+    nag::EvaluationStore store (file.filename, "f", 1, 1, 0, 8, 0.);
+    BOOST_CHECK (store.recall (x, v, 0));
+    BOOST_CHECK_EQUAL (v[0], 2.);
+  }
+  {
+    nag::EvaluationStore store (file.filename, "g", 1, 1, 0, 64, 0.);
+    BOOST_CHECK (!store.recall (x, v, 0));
+    store.record (x, value, 0);
+  }
+  {
+    nag::EvaluationStore store (file.filename, "g", 1, 2, 0, 64, 0.);
+    BOOST_CHECK (!store.recall (x, v, 0));
+  }
+  {
+    nag::EvaluationStore store (file.filename, "f", 1, 1, 0, 64, 0.);
+    BOOST_CHECK (!store.recall (x, v, 0));
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,83 @@
+/* Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+ *
+ * This file is part of the roboptim.
+ *
+ * roboptim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * roboptim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* NAG stub: types and error handling.
+ *
+ * Only the subset of the NAG C Library used by the RobOptim plug-ins
+ * is declared here, with the same names and signatures.
+ */
+
+#ifndef ROBOPTIM_NAG_STUB_NAG_H
+# define ROBOPTIM_NAG_STUB_NAG_H
+
+/* 64-bit Integer for the ILP64 variant of NAG. */
+# ifdef NAG_STUB_ILP64
+typedef long Integer;
+# else
+typedef int Integer;
+# endif
+typedef void* Pointer;
+typedef int Nag_FileID;
+
+typedef enum
+{
+  Nag_FALSE = 0,
+  Nag_TRUE = 1
+} Nag_Boolean;
+
+/* Size of the error message buffer. */
+# define NAG_ERROR_BUF_LEN 512
+
+/* Error codes. */
+# define NE_NOERROR 0
+# define NE_USER_STOP 1
+# define NE_BAD_PARAM 2
+# define NE_INT 3
+# define NE_INT_2 4
+# define NE_ALLOC_FAIL 5
+# define NE_NOT_INIT 6
+# define NE_INVALID_OPTION 7
+# define NE_NOT_OPEN_FILE 8
+# define NE_INTERNAL_ERROR 9
+# define NE_LIN_NOT_FEASIBLE 10
+
+typedef struct
+{
+  int code;
+  int iflag;
+  Nag_Boolean print;
+  char message[NAG_ERROR_BUF_LEN];
+  void (*handler) (const char*, int, const char*);
+  Integer errnum;
+} NagError;
+
+# define INIT_FAIL(e)                           \
+  ((e).code = NE_NOERROR, (e).print = Nag_FALSE, (e).handler = 0)
+
+typedef struct
+{
+  double* user;
+  Integer* iuser;
+  Pointer p;
+  Integer flag;
+  Nag_Boolean first;
+  Integer nf;
+  Integer ng;
+} Nag_Comm;
+
+#endif /* !ROBOPTIM_NAG_STUB_NAG_H */
@@ -0,0 +1,121 @@
+/* Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+ *
+ * This file is part of the roboptim.
+ *
+ * roboptim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * roboptim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* NAG stub: chapter E04 (minimizing or maximizing a function). */
+
+#ifndef ROBOPTIM_NAG_STUB_NAGE04_H
+# define ROBOPTIM_NAG_STUB_NAGE04_H
+
+# include <nag.h>
+
+typedef enum
+{
+  Nag_Cold,
+  Nag_Warm,
+  Nag_Hot
+} Nag_Start;
+
+/* Optional parameters and solver state. */
+typedef struct
+{
+  Integer initialized;
+  Integer majorIterationsLimit;
+  Integer printFile;
+  Integer verifyLevel;
+} Nag_E04State;
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/* e04vgc, e04vjc-e04vlc: sparse NLP initialization and options. */
+void nag_opt_sparse_nlp_init (Nag_E04State* state, NagError* fail);
+void nag_opt_sparse_nlp_option_set_string (const char* optstr,
+                                           Nag_E04State* state,
+                                           NagError* fail);
+void nag_opt_sparse_nlp_option_set_integer (const char* optstr, Integer ivalue,
+                                            Nag_E04State* state,
+                                            NagError* fail);
+void nag_opt_sparse_nlp_option_set_double (const char* optstr, double rvalue,
+                                           Nag_E04State* state,
+                                           NagError* fail);
+
+/* e04vhc: sparse NLP solver. */
+void nag_opt_sparse_nlp_solve (
+  Nag_Start start, Integer nf, Integer n, Integer nxname, Integer nfname,
+  double objadd, Integer objrow, const char* prob,
+  void (*usrfun) (Integer* status, Integer n, const double x[], Integer needf,
+                  Integer nf, double f[], Integer needg, Integer leng,
+                  double g[], Nag_Comm* comm),
+  Integer iafun[], Integer javar[], double a[], Integer lena, Integer nea,
+  Integer igfun[], Integer jgvar[], Integer leng, Integer neg,
+  const double xlow[], const double xupp[], const char* xnames[],
+  const double flow[], const double fupp[], const char* fnames[], double x[],
+  Integer xstate[], double xmul[], double f[], Integer fstate[], double fmul[],
+  Integer* ns, Integer* ninf, double* sinf, Nag_E04State* state,
+  Nag_Comm* comm, NagError* fail);
+
+/* e04wcc, e04wfc-e04whc: dense NLP initialization and options. */
+void nag_opt_nlp_init (Nag_E04State* state, NagError* fail);
+void nag_opt_nlp_option_set_string (const char* optstr, Nag_E04State* state,
+                                    NagError* fail);
+void nag_opt_nlp_option_set_integer (const char* optstr, Integer ivalue,
+                                     Nag_E04State* state, NagError* fail);
+void nag_opt_nlp_option_set_double (const char* optstr, double rvalue,
+                                    Nag_E04State* state, NagError* fail);
+
+/* e04wdc: dense NLP solver. */
+void nag_opt_nlp_solve (
+  Integer n, Integer nclin, Integer ncnln, Integer tda, Integer tdcj,
+  Integer tdh, const double a[], const double bl[], const double bu[],
+  void (*confun) (Integer* mode, Integer ncnln, Integer n, Integer tdcj,
+                  const Integer needc[], const double x[], double ccon[],
+                  double cjac[], Integer nstate, Nag_Comm* comm),
+  void (*objfun) (Integer* mode, Integer n, const double x[], double* objf,
+                  double grad[], Integer nstate, Nag_Comm* comm),
+  Integer* majits, Integer istate[], double ccon[], double cjac[],
+  double clamda[], double* objf, double grad[], double h[], double x[],
+  Nag_E04State* state, Nag_Comm* comm, NagError* fail);
+
+/* e04cbc: Nelder-Mead simplex. */
+void nag_opt_simplex_easy (
+  Integer n, double x[], double* f, double tolf, double tolx,
+  void (*funct) (Integer n, const double* xc, double* fc, Nag_Comm* comm),
+  void (*monit) (double fmin, double fmax, const double sim[], Integer n,
+                 Integer ncall, double serror, double vratio, Nag_Comm* comm),
+  Integer maxcal, Nag_Comm* comm, NagError* fail);
+
+/* e04abc: one-variable minimization, function values only. */
+void nag_opt_one_var_no_deriv (void (*funct) (double xc, double* fc,
+                                              Nag_Comm* comm),
+                               double e1, double e2, double* a, double* b,
+                               Integer max_fun, double* x, double* f,
+                               Nag_Comm* comm, NagError* fail);
+
+/* e04bbc: one-variable minimization, first derivative available. */
+void nag_opt_one_var_deriv (void (*funct) (double xc, double* fc, double* gc,
+                                           Nag_Comm* comm),
+                            double e1, double e2, double* a, double* b,
+                            Integer max_fun, double* x, double* f, double* g,
+                            Nag_Comm* comm, NagError* fail);
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif /* !ROBOPTIM_NAG_STUB_NAGE04_H */
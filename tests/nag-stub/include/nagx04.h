@@ -0,0 +1,40 @@
+/* Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+ *
+ * This file is part of the roboptim.
+ *
+ * roboptim is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * roboptim is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* NAG stub: chapter X04 (input/output utilities). */
+
+#ifndef ROBOPTIM_NAG_STUB_NAGX04_H
+# define ROBOPTIM_NAG_STUB_NAGX04_H
+
+# include <nag.h>
+
+# ifdef __cplusplus
+extern "C" {
+# endif
+
+/* Open a file: mode 0 for reading, 1 for writing, 2 for appending. */
+void nag_open_file (const char* filename, Integer mode, Nag_FileID* fileid,
+                    NagError* fail);
+
+void nag_close_file (Nag_FileID fileid, NagError* fail);
+
+# ifdef __cplusplus
+}
+# endif
+
+#endif /* !ROBOPTIM_NAG_STUB_NAGX04_H */
@@ -0,0 +1,892 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Stand-in for the subset of the NAG C Library used by the plug-ins.
+//
+// The solvers do not optimize anything: they validate their
+// arguments, then drive the user callbacks with a deterministic,
+// scripted sequence of points. This is enough to test and benchmark
+// the plug-ins (problem assembly, callbacks, options, logging)
+// without a NAG licence.
+//
+// The number of scripted iterations of the NLP solvers is the
+// "Major Iterations Limit" option, capped by the
+// ROBOPTIM_NAG_STUB_ITERATIONS environment variable (default: 10).
+//
+// At the last point, the NLP solvers return the multipliers of the
+// constraints active there, fitted to the objective gradient, so that
+// the plug-ins mapping of multipliers can be tested. The dense solver
+// also checks that the point satisfies the linear constraints. As in
+// NAG, the sparse solver returns the states matching the multipliers,
+// and a warm start moves the nonbasic variables to their bounds.
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <nag.h>
+#include <nage04.h>
+#include <nagx04.h>
+
+namespace
+{
+  /// \brief Maximum number of files opened by nag_open_file.
+  static const int maxFiles = 64;
+
+  /// \brief Files opened by nag_open_file, indexed by file id.
+  FILE* files[maxFiles] = {0};
+
+  /// \brief Default major iterations limit.
+  static const Integer defaultIterations = 10;
+
+  /// \brief Maximum number of active constraints for which multipliers
+  /// are computed.
+  static const std::size_t maxActive = 100;
+
+  /// \brief Relative tolerance of the active set and of the linear
+  /// constraints.
+  static const double tolerance = 1e-8;
+
+  /// \brief Sparse gradient of a constraint: (variable, value) pairs.
+  typedef std::vector<std::pair<Integer, double> > sparseRow_t;
+
+  /// \brief Report an error the way NAG does.
+  ///
+  /// The error is stored in fail. The handler is called if there is
+  /// one. Otherwise the message is printed if requested. A null fail
+  /// is a hard failure.
+  void report (NagError* fail, int code, const char* name, const char* fmt,
+               ...)
+  {
+    char message[NAG_ERROR_BUF_LEN];
+    va_list args;
+    va_start (args, fmt);
+    std::vsnprintf (message, sizeof (message), fmt, args);
+    va_end (args);
+
+    if (!fail)
+    {
+      std::fprintf (stderr, "%s: %s\n", name, message);
+      std::exit (EXIT_FAILURE);
+    }
+
+    fail->code = code;
+    std::strcpy (fail->message, message);
+    if (fail->handler)
+      fail->handler (fail->message, code, name);
+    else if (fail->print)
+      std::fprintf (stderr, "%s: %s\n", name, fail->message);
+  }
+
+  void resetFail (NagError* fail)
+  {
+    if (!fail) return;
+    fail->code = NE_NOERROR;
+    fail->message[0] = '\0';
+  }
+
+  /// \brief Print a line to a NAG file, if it is open.
+  void printLine (Integer fileid, const char* fmt, ...)
+  {
+    if (fileid <= 0 || fileid >= maxFiles || !files[fileid]) return;
+
+    va_list args;
+    va_start (args, fmt);
+    std::vfprintf (files[fileid], fmt, args);
+    va_end (args);
+    std::fputc ('\n', files[fileid]);
+    std::fflush (files[fileid]);
+  }
+
+  /// \brief Number of scripted iterations.
+  Integer iterations (const Nag_E04State* state)
+  {
+    Integer limit = defaultIterations;
+    const char* env = std::getenv ("ROBOPTIM_NAG_STUB_ITERATIONS");
+    if (env && *env) limit = static_cast<Integer> (std::atoi (env));
+    if (state && state->majorIterationsLimit > 0)
+      limit = std::min (limit, state->majorIterationsLimit);
+    return std::max (limit, static_cast<Integer> (1));
+  }
+
+  /// \brief k-th scripted point: x0 moved along a fixed direction,
+  /// projected on the bounds (if any).
+  void scriptedPoint (Integer k, Integer n, const double* x0,
+                      const double* lower, const double* upper, double* x)
+  {
+    const double step = 1e-3 * static_cast<double> (k);
+    for (Integer i = 0; i < n; ++i)
+    {
+      x[i] = x0[i] + step * static_cast<double> (i % 3 - 1);
+      if (lower) x[i] = std::max (x[i], lower[i]);
+      if (upper) x[i] = std::min (x[i], upper[i]);
+    }
+  }
+
+  /// \brief Sum of the bound violations.
+  double violation (Integer n, const double* v, const double* lower,
+                    const double* upper, Integer* count)
+  {
+    double sum = 0.;
+    for (Integer i = 0; i < n; ++i)
+    {
+      double d = std::max (0., lower[i] - v[i]) + std::max (0., v[i] - upper[i]);
+      if (d > 0.) ++*count;
+      sum += d;
+    }
+    return sum;
+  }
+
+  /// \brief Whether a value is at a finite bound.
+  bool atBound (double value, double bound)
+  {
+    return std::abs (bound) < 1e20 &&
+           std::abs (value - bound) <= tolerance * (1. + std::abs (bound));
+  }
+
+  double dot (const std::vector<double>& u, const std::vector<double>& v)
+  {
+    double sum = 0.;
+    for (std::size_t i = 0; i < u.size (); ++i) sum += u[i] * v[i];
+    return sum;
+  }
+
+  /// \brief Multipliers of the constraints active at a point.
+  ///
+  /// Constraints are the n variables, then the rows. The objective
+  /// gradient is fitted, in the least-squares sense, by the gradients
+  /// of the active constraints: gradient = sum_i mul_i grad_i, so that
+  /// lower bounds of a minimum have nonnegative multipliers, as in
+  /// NAG. Dependent gradients, inactive constraints and problems with
+  /// more than maxActive active constraints get zero multipliers.
+  ///
+  /// \param n number of variables.
+  /// \param gradient objective gradient.
+  /// \param rows gradients of the rows.
+  /// \param values values of the constraints.
+  /// \param lower lower bounds of the constraints.
+  /// \param upper upper bounds of the constraints.
+  /// \param multipliers multipliers of the constraints.
+  void activeMultipliers (Integer n, const std::vector<double>& gradient,
+                          const std::vector<sparseRow_t>& rows,
+                          const double* values, const double* lower,
+                          const double* upper, double* multipliers)
+  {
+    const std::size_t size = static_cast<std::size_t> (n);
+    const std::size_t constraints = size + rows.size ();
+    std::fill (multipliers, multipliers + constraints, 0.);
+
+    std::vector<std::size_t> active;
+    for (std::size_t c = 0; c < constraints; ++c)
+      if (atBound (values[c], lower[c]) || atBound (values[c], upper[c]))
+        active.push_back (c);
+    if (active.empty () || active.size () > maxActive) return;
+
+    // Modified Gram-Schmidt QR of the active gradients.
+    const std::size_t k = active.size ();
+    std::vector<std::vector<double> > q (k);
+    std::vector<double> r (k * k, 0.);
+    std::vector<bool> independent (k, false);
+    for (std::size_t p = 0; p < k; ++p)
+    {
+      std::vector<double>& v = q[p];
+      v.assign (size, 0.);
+      if (active[p] < size)
+        v[active[p]] = 1.;
+      else
+      {
+        const sparseRow_t& row = rows[active[p] - size];
+        for (std::size_t e = 0; e < row.size (); ++e)
+          v[static_cast<std::size_t> (row[e].first)] += row[e].second;
+      }
+
+      double norm = std::sqrt (dot (v, v));
+      for (std::size_t l = 0; l < p; ++l)
+      {
+        if (!independent[l]) continue;
+        r[l * k + p] = dot (q[l], v);
+        for (std::size_t i = 0; i < size; ++i) v[i] -= r[l * k + p] * q[l][i];
+      }
+
+      double residual = std::sqrt (dot (v, v));
+      if (residual <= 1e-10 * norm) continue;
+      independent[p] = true;
+      r[p * k + p] = residual;
+      for (std::size_t i = 0; i < size; ++i) v[i] /= residual;
+    }
+
+    // R y = Q^T gradient.
+    std::vector<double> y (k, 0.);
+    for (std::size_t p = k; p-- > 0;)
+    {
+      if (!independent[p]) continue;
+      double sum = dot (q[p], gradient);
+      for (std::size_t l = p + 1; l < k; ++l) sum -= r[p * k + l] * y[l];
+      y[p] = sum / r[p * k + p];
+      multipliers[active[p]] = y[p];
+    }
+  }
+
+  /// \brief NAG state of a variable or a row: nonbasic at the bound
+  /// whose multiplier it has, basic otherwise.
+  Integer basisState (double multiplier)
+  {
+    if (multiplier > 0.) return 0;
+    if (multiplier < 0.) return 1;
+    return 3;
+  }
+
+  /// \brief Case-insensitive comparison of an option name.
+  bool sameOption (const std::string& a, const char* b)
+  {
+    if (a.size () != std::strlen (b)) return false;
+    for (std::size_t i = 0; i < a.size (); ++i)
+      if (std::tolower (a[i]) != std::tolower (b[i])) return false;
+    return true;
+  }
+
+  std::string trim (const std::string& s)
+  {
+    std::size_t first = s.find_first_not_of (" \t");
+    if (first == std::string::npos) return "";
+    std::size_t last = s.find_last_not_of (" \t");
+    return s.substr (first, last - first + 1);
+  }
+
+  void setOption (const char* name, const char* optstr, Integer ivalue,
+                  bool hasValue, Nag_E04State* state, NagError* fail)
+  {
+    resetFail (fail);
+    if (!state || !state->initialized)
+    {
+      report (fail, NE_NOT_INIT, name,
+              "Initialization function has not been called.");
+      return;
+    }
+    if (!optstr)
+    {
+      report (fail, NE_INVALID_OPTION, name, "Option string is null.");
+      return;
+    }
+
+    // "Key = value" or "Key value" strings.
+    std::string key = optstr;
+    std::string value;
+    std::size_t separator = key.find ('=');
+    if (separator != std::string::npos)
+    {
+      value = trim (key.substr (separator + 1));
+      key = key.substr (0, separator);
+    }
+    key = trim (key);
+
+    if (!hasValue && !value.empty ())
+    {
+      ivalue = static_cast<Integer> (std::atoi (value.c_str ()));
+      hasValue = true;
+    }
+
+    // Options affecting the stub are stored, the others are accepted
+    // and ignored.
+    if (!hasValue) return;
+    if (sameOption (key, "Major Iterations Limit") ||
+        sameOption (key, "Iterations Limit"))
+      state->majorIterationsLimit = ivalue;
+    else if (sameOption (key, "Print File"))
+      state->printFile = ivalue;
+    else if (sameOption (key, "Verify Level"))
+      state->verifyLevel = ivalue;
+  }
+
+  void initState (const char* name, Nag_E04State* state, NagError* fail)
+  {
+    resetFail (fail);
+    if (!state)
+    {
+      report (fail, NE_BAD_PARAM, name, "State is null.");
+      return;
+    }
+    state->initialized = 1;
+    state->majorIterationsLimit = 0;
+    state->printFile = 0;
+    state->verifyLevel = 0;
+  }
+} // end of anonymous namespace
+
+extern "C" {
+
+void nag_open_file (const char* filename, Integer mode, Nag_FileID* fileid,
+                    NagError* fail)
+{
+  static const char* name = "nag_open_file";
+  resetFail (fail);
+
+  const char* modes[] = {"r", "w", "a"};
+  if (mode < 0 || mode > 2)
+  {
+    report (fail, NE_INT, name, "On entry, mode = %d.", static_cast<int> (mode));
+    return;
+  }
+
+  int id = 1;
+  while (id < maxFiles && files[id]) ++id;
+  if (id == maxFiles)
+  {
+    report (fail, NE_NOT_OPEN_FILE, name, "Too many open files.");
+    return;
+  }
+
+  files[id] = std::fopen (filename, modes[mode]);
+  if (!files[id])
+  {
+    report (fail, NE_NOT_OPEN_FILE, name, "Cannot open file %s.", filename);
+    return;
+  }
+  *fileid = id;
+}
+
+void nag_close_file (Nag_FileID fileid, NagError* fail)
+{
+  static const char* name = "nag_close_file";
+  resetFail (fail);
+
+  if (fileid <= 0 || fileid >= maxFiles || !files[fileid])
+  {
+    report (fail, NE_NOT_OPEN_FILE, name, "File %d is not open.", fileid);
+    return;
+  }
+  std::fclose (files[fileid]);
+  files[fileid] = 0;
+}
+
+void nag_opt_sparse_nlp_init (Nag_E04State* state, NagError* fail)
+{
+  initState ("nag_opt_sparse_nlp_init", state, fail);
+}
+
+void nag_opt_sparse_nlp_option_set_string (const char* optstr,
+                                           Nag_E04State* state,
+                                           NagError* fail)
+{
+  setOption ("nag_opt_sparse_nlp_option_set_string", optstr, 0, false, state,
+             fail);
+}
+
+void nag_opt_sparse_nlp_option_set_integer (const char* optstr, Integer ivalue,
+                                            Nag_E04State* state,
+                                            NagError* fail)
+{
+  setOption ("nag_opt_sparse_nlp_option_set_integer", optstr, ivalue, true,
+             state, fail);
+}
+
+void nag_opt_sparse_nlp_option_set_double (const char* optstr, double,
+                                           Nag_E04State* state,
+                                           NagError* fail)
+{
+  setOption ("nag_opt_sparse_nlp_option_set_double", optstr, 0, false, state,
+             fail);
+}
+
+void nag_opt_sparse_nlp_solve (
+  Nag_Start start, Integer nf, Integer n, Integer nxname, Integer nfname, double,
+  Integer objrow, const char* prob,
+  void (*usrfun) (Integer* status, Integer n, const double x[], Integer needf,
+                  Integer nf, double f[], Integer needg, Integer leng,
+                  double g[], Nag_Comm* comm),
+  Integer iafun[], Integer javar[], double a[], Integer lena, Integer nea,
+  Integer igfun[], Integer jgvar[], Integer leng, Integer neg,
+  const double xlow[], const double xupp[], const char*[],
+  const double flow[], const double fupp[], const char*[], double x[],
+  Integer xstate[], double xmul[], double f[], Integer fstate[], double fmul[],
+  Integer* ns, Integer* ninf, double* sinf, Nag_E04State* state,
+  Nag_Comm* comm, NagError* fail)
+{
+  static const char* name = "nag_opt_sparse_nlp_solve";
+  resetFail (fail);
+
+  // Argument checks.
+  if (!state || !state->initialized)
+  {
+    report (fail, NE_NOT_INIT, name,
+            "Initialization function has not been called.");
+    return;
+  }
+  if (nf < 1 || n < 1)
+  {
+    report (fail, NE_INT, name, "On entry, nf = %d and n = %d.",
+            static_cast<int> (nf), static_cast<int> (n));
+    return;
+  }
+  if (nxname != 1 && nxname != n)
+  {
+    report (fail, NE_INT_2, name, "On entry, nxname = %d and n = %d.",
+            static_cast<int> (nxname), static_cast<int> (n));
+    return;
+  }
+  if (nfname != 1 && nfname != nf)
+  {
+    report (fail, NE_INT_2, name, "On entry, nfname = %d and nf = %d.",
+            static_cast<int> (nfname), static_cast<int> (nf));
+    return;
+  }
+  if (objrow < 0 || objrow > nf)
+  {
+    report (fail, NE_INT_2, name, "On entry, objrow = %d and nf = %d.",
+            static_cast<int> (objrow), static_cast<int> (nf));
+    return;
+  }
+  if (lena < 1 || nea < 0 || nea > lena || leng < 1 || neg < 0 || neg > leng)
+  {
+    report (fail, NE_INT, name,
+            "On entry, lena = %d, nea = %d, leng = %d and neg = %d.",
+            static_cast<int> (lena), static_cast<int> (nea),
+            static_cast<int> (leng), static_cast<int> (neg));
+    return;
+  }
+  for (Integer k = 0; k < nea; ++k)
+    if (iafun[k] < 1 || iafun[k] > nf || javar[k] < 1 || javar[k] > n)
+    {
+      report (fail, NE_INT, name,
+              "On entry, iafun[%d] = %d and javar[%d] = %d are out of range.",
+              static_cast<int> (k), static_cast<int> (iafun[k]),
+              static_cast<int> (k), static_cast<int> (javar[k]));
+      return;
+    }
+  for (Integer k = 0; k < neg; ++k)
+    if (igfun[k] < 1 || igfun[k] > nf || jgvar[k] < 1 || jgvar[k] > n)
+    {
+      report (fail, NE_INT, name,
+              "On entry, igfun[%d] = %d and jgvar[%d] = %d are out of range.",
+              static_cast<int> (k), static_cast<int> (igfun[k]),
+              static_cast<int> (k), static_cast<int> (jgvar[k]));
+      return;
+    }
+  for (Integer i = 0; i < n; ++i)
+    if (xlow[i] > xupp[i])
+    {
+      report (fail, NE_BAD_PARAM, name, "On entry, xlow[%d] > xupp[%d].",
+              static_cast<int> (i), static_cast<int> (i));
+      return;
+    }
+  for (Integer i = 0; i < nf; ++i)
+    if (flow[i] > fupp[i])
+    {
+      report (fail, NE_BAD_PARAM, name, "On entry, flow[%d] > fupp[%d].",
+              static_cast<int> (i), static_cast<int> (i));
+      return;
+    }
+
+  printLine (state->printFile, "NAG stub: sparse NLP %s, n = %d, nf = %d",
+             prob ? prob : "", static_cast<int> (n), static_cast<int> (nf));
+
+  // Nonbasic variables of a warm start are at their bounds.
+  if (start == Nag_Warm)
+    for (Integer i = 0; i < n; ++i)
+    {
+      if (xstate[i] == 0) x[i] = xlow[i];
+      if (xstate[i] == 1) x[i] = xupp[i];
+    }
+
+  std::vector<double> x0 (x, x + n);
+  std::vector<double> g (static_cast<std::size_t> (leng), 0.);
+  Integer iterationsLimit = iterations (state);
+  Integer status = 1;
+
+  for (Integer k = 0; k < iterationsLimit; ++k)
+  {
+    scriptedPoint (k, n, &x0[0], xlow, xupp, x);
+
+    // usrfun only sets the nonlinear part of F.
+    std::fill (f, f + nf, 0.);
+    usrfun (&status, n, x, 1, nf, f, 1, leng, &g[0], comm);
+    if (status <= -2)
+    {
+      report (fail, NE_USER_STOP, name,
+              "User requested termination, status = %d.",
+              static_cast<int> (status));
+      break;
+    }
+    status = 0;
+
+    for (Integer l = 0; l < nea; ++l)
+      f[iafun[l] - 1] += a[l] * x[javar[l] - 1];
+
+    printLine (state->printFile, "%6d %24.16e", static_cast<int> (k + 1),
+               objrow > 0 ? f[objrow - 1] : 0.);
+  }
+
+  // Final call.
+  status = 2;
+  usrfun (&status, n, x, 0, nf, f, 0, leng, &g[0], comm);
+
+  // Constraints at the last point: variables, then rows of F. The
+  // objective row gives the gradient, and is never active.
+  std::vector<double> gradient (static_cast<std::size_t> (n), 0.);
+  std::vector<sparseRow_t> rows (static_cast<std::size_t> (nf));
+  for (Integer l = 0; l < nea + neg; ++l)
+  {
+    const Integer row = l < nea ? iafun[l] : igfun[l - nea];
+    const Integer column = l < nea ? javar[l] - 1 : jgvar[l - nea] - 1;
+    const double value =
+      l < nea ? a[l] : g[static_cast<std::size_t> (l - nea)];
+    if (row == objrow)
+      gradient[static_cast<std::size_t> (column)] += value;
+    else
+      rows[static_cast<std::size_t> (row - 1)].push_back (
+        std::make_pair (column, value));
+  }
+  std::vector<double> values (x, x + n);
+  std::vector<double> lower (xlow, xlow + n);
+  std::vector<double> upper (xupp, xupp + n);
+  values.insert (values.end (), f, f + nf);
+  lower.insert (lower.end (), flow, flow + nf);
+  upper.insert (upper.end (), fupp, fupp + nf);
+  if (objrow > 0)
+  {
+    lower[static_cast<std::size_t> (n + objrow - 1)] = -1e20;
+    upper[static_cast<std::size_t> (n + objrow - 1)] = 1e20;
+  }
+  std::vector<double> multipliers (values.size ());
+  activeMultipliers (n, gradient, rows, &values[0], &lower[0], &upper[0],
+                     &multipliers[0]);
+
+  std::copy (multipliers.begin (), multipliers.begin () + n, xmul);
+  std::copy (multipliers.begin () + n, multipliers.end (), fmul);
+  for (Integer i = 0; i < n; ++i) xstate[i] = basisState (xmul[i]);
+  for (Integer i = 0; i < nf; ++i) fstate[i] = basisState (fmul[i]);
+  *ns = 0;
+  *ninf = 0;
+  *sinf = violation (n, x, xlow, xupp, ninf);
+  for (Integer i = 0; i < nf; ++i)
+    if (i != objrow - 1)
+      *sinf += violation (1, f + i, flow + i, fupp + i, ninf);
+}
+
+void nag_opt_nlp_init (Nag_E04State* state, NagError* fail)
+{
+  initState ("nag_opt_nlp_init", state, fail);
+}
+
+void nag_opt_nlp_option_set_string (const char* optstr, Nag_E04State* state,
+                                    NagError* fail)
+{
+  setOption ("nag_opt_nlp_option_set_string", optstr, 0, false, state, fail);
+}
+
+void nag_opt_nlp_option_set_integer (const char* optstr, Integer ivalue,
+                                     Nag_E04State* state, NagError* fail)
+{
+  setOption ("nag_opt_nlp_option_set_integer", optstr, ivalue, true, state,
+             fail);
+}
+
+void nag_opt_nlp_option_set_double (const char* optstr, double,
+                                    Nag_E04State* state, NagError* fail)
+{
+  setOption ("nag_opt_nlp_option_set_double", optstr, 0, false, state, fail);
+}
+
+void nag_opt_nlp_solve (
+  Integer n, Integer nclin, Integer ncnln, Integer tda, Integer tdcj,
+  Integer tdh, const double a[], const double bl[], const double bu[],
+  void (*confun) (Integer* mode, Integer ncnln, Integer n, Integer tdcj,
+                  const Integer needc[], const double x[], double ccon[],
+                  double cjac[], Integer nstate, Nag_Comm* comm),
+  void (*objfun) (Integer* mode, Integer n, const double x[], double* objf,
+                  double grad[], Integer nstate, Nag_Comm* comm),
+  Integer* majits, Integer istate[], double ccon[], double cjac[],
+  double clamda[], double* objf, double grad[], double h[], double x[],
+  Nag_E04State* state, Nag_Comm* comm, NagError* fail)
+{
+  static const char* name = "nag_opt_nlp_solve";
+  resetFail (fail);
+
+  // Argument checks.
+  if (!state || !state->initialized)
+  {
+    report (fail, NE_NOT_INIT, name,
+            "Initialization function has not been called.");
+    return;
+  }
+  if (n < 1 || nclin < 0 || ncnln < 0)
+  {
+    report (fail, NE_INT, name, "On entry, n = %d, nclin = %d and ncnln = %d.",
+            static_cast<int> (n), static_cast<int> (nclin),
+            static_cast<int> (ncnln));
+    return;
+  }
+  if ((nclin > 0 && tda < n) || (ncnln > 0 && tdcj < n) || tdh < n)
+  {
+    report (fail, NE_INT_2, name,
+            "On entry, tda = %d, tdcj = %d, tdh = %d and n = %d.",
+            static_cast<int> (tda), static_cast<int> (tdcj),
+            static_cast<int> (tdh), static_cast<int> (n));
+    return;
+  }
+  const Integer nctotal = n + nclin + ncnln;
+  for (Integer i = 0; i < nctotal; ++i)
+    if (bl[i] > bu[i])
+    {
+      report (fail, NE_BAD_PARAM, name, "On entry, bl[%d] > bu[%d].",
+              static_cast<int> (i), static_cast<int> (i));
+      return;
+    }
+
+  printLine (state->printFile,
+             "NAG stub: dense NLP, n = %d, nclin = %d, ncnln = %d",
+             static_cast<int> (n), static_cast<int> (nclin),
+             static_cast<int> (ncnln));
+
+  std::vector<double> x0 (x, x + n);
+  std::vector<Integer> needc (static_cast<std::size_t> (ncnln) + 1, 1);
+
+  // The scripted points start from a point satisfying the linear
+  // constraints, as a real solver would.
+  scriptedPoint (0, n, &x0[0], bl, bu, x);
+  for (Integer i = 0; i < nclin; ++i)
+  {
+    double value = 0.;
+    for (Integer j = 0; j < n; ++j) value += a[i * tda + j] * x[j];
+    const Integer c = n + i;
+    if (value < bl[c] - tolerance * (1. + std::abs (bl[c])) ||
+        value > bu[c] + tolerance * (1. + std::abs (bu[c])))
+    {
+      report (fail, NE_LIN_NOT_FEASIBLE, name,
+              "No feasible point was found for the linear constraints.");
+      return;
+    }
+  }
+
+  Integer iterationsLimit = iterations (state);
+  *majits = 0;
+
+  for (Integer k = 0; k < iterationsLimit; ++k)
+  {
+    scriptedPoint (k, n, &x0[0], bl, bu, x);
+    Integer nstate = k == 0 ? 1 : 0;
+    Integer mode = 2;
+
+    if (ncnln > 0)
+    {
+      confun (&mode, ncnln, n, tdcj, &needc[0], x, ccon, cjac, nstate, comm);
+      if (mode < 0)
+      {
+        report (fail, NE_USER_STOP, name,
+                "User requested termination, mode = %d.",
+                static_cast<int> (mode));
+        return;
+      }
+    }
+
+    objfun (&mode, n, x, objf, grad, nstate, comm);
+    if (mode < 0)
+    {
+      report (fail, NE_USER_STOP, name,
+              "User requested termination, mode = %d.",
+              static_cast<int> (mode));
+      return;
+    }
+
+    ++*majits;
+    printLine (state->printFile, "%6d %24.16e", static_cast<int> (*majits),
+               *objf);
+  }
+
+  // Constraints at the last point: bounds, linear then nonlinear rows.
+  std::vector<double> values (x, x + n);
+  std::vector<sparseRow_t> rows (static_cast<std::size_t> (nclin + ncnln));
+  for (Integer i = 0; i < nclin + ncnln; ++i)
+  {
+    const double* row = i < nclin ? a + i * tda : cjac + (i - nclin) * tdcj;
+    double value = 0.;
+    for (Integer j = 0; j < n; ++j)
+      if (row[j] != 0.)
+      {
+        rows[static_cast<std::size_t> (i)].push_back (
+          std::make_pair (j, row[j]));
+        value += row[j] * x[j];
+      }
+    values.push_back (i < nclin ? value : ccon[i - nclin]);
+  }
+
+  // Outputs that a real solver would compute.
+  std::vector<double> gradient (grad, grad + n);
+  std::fill (istate, istate + nctotal, 0);
+  activeMultipliers (n, gradient, rows, &values[0], bl, bu, clamda);
+  for (Integer i = 0; i < n; ++i)
+    for (Integer j = 0; j < n; ++j)
+      h[i * tdh + j] = i == j ? 1. : 0.;
+}
+
+void nag_opt_simplex_easy (
+  Integer n, double x[], double* f, double tolf, double tolx,
+  void (*funct) (Integer n, const double* xc, double* fc, Nag_Comm* comm),
+  void (*monit) (double fmin, double fmax, const double sim[], Integer n,
+                 Integer ncall, double serror, double vratio, Nag_Comm* comm),
+  Integer maxcal, Nag_Comm* comm, NagError* fail)
+{
+  static const char* name = "nag_opt_simplex_easy";
+  resetFail (fail);
+
+  if (n < 1 || maxcal < 1)
+  {
+    report (fail, NE_INT, name, "On entry, n = %d and maxcal = %d.",
+            static_cast<int> (n), static_cast<int> (maxcal));
+    return;
+  }
+
+  // Scripted compass search: probe each coordinate direction, halve
+  // the step after a sweep without improvement.
+  std::vector<double> trial (x, x + n);
+  std::vector<double> sim (static_cast<std::size_t> ((n + 1) * n));
+  double step = 0.1;
+  double ftrial;
+  Integer ncall = 1;
+
+  funct (n, x, f, comm);
+  while (ncall < maxcal && step > std::max (tolx, 0.) && comm->flag >= 0)
+  {
+    bool improved = false;
+    double fmax = *f;
+    for (Integer i = 0; i < n && ncall < maxcal; ++i)
+      for (int sign = -1; sign <= 1 && ncall < maxcal; sign += 2)
+      {
+        std::copy (x, x + n, trial.begin ());
+        trial[i] += sign * step;
+        funct (n, &trial[0], &ftrial, comm);
+        ++ncall;
+        if (comm->flag < 0) break;
+        fmax = std::max (fmax, ftrial);
+        if (ftrial < *f - std::max (tolf, 0.))
+        {
+          std::copy (trial.begin (), trial.end (), x);
+          *f = ftrial;
+          improved = true;
+        }
+      }
+    if (!improved) step /= 2.;
+
+    if (monit)
+    {
+      for (Integer v = 0; v <= n; ++v)
+        for (Integer i = 0; i < n; ++i)
+          sim[v * n + i] = x[i] + (v == i + 1 ? step : 0.);
+      monit (*f, fmax, &sim[0], n, ncall, 0., 1., comm);
+    }
+  }
+
+  if (comm->flag < 0)
+    report (fail, NE_USER_STOP, name,
+            "User requested termination, comm->flag = %d.",
+            static_cast<int> (comm->flag));
+}
+
+void nag_opt_one_var_no_deriv (void (*funct) (double xc, double* fc,
+                                              Nag_Comm* comm),
+                               double, double, double* a, double* b,
+                               Integer max_fun, double* x, double* f,
+                               Nag_Comm* comm, NagError* fail)
+{
+  static const char* name = "nag_opt_one_var_no_deriv";
+  resetFail (fail);
+
+  if (max_fun < 3 || *a >= *b)
+  {
+    report (fail, NE_BAD_PARAM, name,
+            "On entry, max_fun = %d, a = %g and b = %g.",
+            static_cast<int> (max_fun), *a, *b);
+    return;
+  }
+
+  // Scripted uniform scan of [a, b].
+  const double h = (*b - *a) / static_cast<double> (max_fun);
+  double fc;
+  *f = HUGE_VAL;
+  for (Integer k = 0; k < max_fun; ++k)
+  {
+    double xc = *a + (static_cast<double> (k) + .5) * h;
+    funct (xc, &fc, comm);
+    if (comm->flag < 0)
+    {
+      report (fail, NE_USER_STOP, name,
+              "User requested termination, comm->flag = %d.",
+              static_cast<int> (comm->flag));
+      return;
+    }
+    if (fc < *f)
+    {
+      *f = fc;
+      *x = xc;
+    }
+  }
+  *a = *x - h / 2.;
+  *b = *x + h / 2.;
+}
+
+void nag_opt_one_var_deriv (void (*funct) (double xc, double* fc, double* gc,
+                                           Nag_Comm* comm),
+                            double, double, double* a, double* b,
+                            Integer max_fun, double* x, double* f, double* g,
+                            Nag_Comm* comm, NagError* fail)
+{
+  static const char* name = "nag_opt_one_var_deriv";
+  resetFail (fail);
+
+  if (max_fun < 3 || *a >= *b)
+  {
+    report (fail, NE_BAD_PARAM, name,
+            "On entry, max_fun = %d, a = %g and b = %g.",
+            static_cast<int> (max_fun), *a, *b);
+    return;
+  }
+
+  // Scripted uniform scan of [a, b].
+  const double h = (*b - *a) / static_cast<double> (max_fun);
+  double fc;
+  double gc;
+  *f = HUGE_VAL;
+  for (Integer k = 0; k < max_fun; ++k)
+  {
+    double xc = *a + (static_cast<double> (k) + .5) * h;
+    funct (xc, &fc, &gc, comm);
+    if (comm->flag < 0)
+    {
+      report (fail, NE_USER_STOP, name,
+              "User requested termination, comm->flag = %d.",
+              static_cast<int> (comm->flag));
+      return;
+    }
+    if (fc < *f)
+    {
+      *f = fc;
+      *g = gc;
+      *x = xc;
+    }
+  }
+  *a = *x - h / 2.;
+  *b = *x + h / 2.;
+}
+
+} // extern "C"
@@ -0,0 +1,161 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Linear constraints of the dense NLP solver: A x + b in [l, u] is
+// given to NAG as A x in [l - b, u - b], for numeric and generic
+// linear functions.
+//
+// The problems are built so that their starting point is the solution,
+// with known multipliers: this holds for NAG and for the NAG stub,
+// which stays at the starting point when run for one iteration.
+
+#define BOOST_TEST_MODULE nlp_linear_constraints
+
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/linear-function.hh>
+#include <roboptim/core/numeric-linear-function.hh>
+
+#include <roboptim/core/plugin/nag/nag-nlp.hh>
+
+using namespace roboptim;
+
+namespace
+{
+  /// \brief c^T x + 1/2 ||x - x0||^2, whose gradient at x0 is c.
+  struct Cost : public DifferentiableFunction
+  {
+    Cost (const vector_t& c, const vector_t& x0)
+      : DifferentiableFunction (c.size (), 1, "c^T x + 1/2 ||x - x0||^2"),
+        c_ (c),
+        x0_ (x0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = c_.dot (x) + .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient = c_ + (x - x0_);
+    }
+
+    vector_t c_;
+    vector_t x0_;
+  };
+
+  /// \brief x0 + 2 x1 - x2 + 3, as a generic linear function.
+  struct Combination : public LinearFunction
+  {
+    Combination () : LinearFunction (3, 1, "x0 + 2 x1 - x2 + 3")
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = x[0] + 2. * x[1] - x[2] + 3.;
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref,
+                        size_type) const
+    {
+      gradient << 1., 2., -1.;
+    }
+  };
+
+  typedef NagSolverNlp::problem_t problem_t;
+
+  /// \brief Solve the test problem.
+  ///
+  /// At the starting point x0, the first row of A x + b, with
+  /// b = (1, -2), is at its upper bound (multiplier -1/2), the second
+  /// row is inactive and the generic linear function is at its lower
+  /// bound (multiplier 1/4).
+  ///
+  /// \param upper upper bound of the first row, 7/4 at x0.
+  NagSolverNlp::result_t solve (double upper)
+  {
+    Function::vector_t x0 (3);
+    x0 << .5, .25, 1.;
+
+    // c = -1/2 (1, 1, 0) + 1/4 (1, 2, -1).
+    Function::vector_t c (3);
+    c << -.25, 0., -.25;
+
+    Cost cost (c, x0);
+    problem_t problem (cost);
+    problem.startingPoint () = x0;
+    for (std::size_t i = 0; i < 3; ++i)
+      problem.argumentBounds ()[i] = Function::makeInterval (-10., 10.);
+
+    Function::matrix_t a (2, 3);
+    a << 1., 1., 0., 0., 1., 1.;
+    Function::vector_t b (2);
+    b << 1., -2.;
+    Function::intervals_t bounds;
+    bounds.push_back (Function::makeInterval (0., upper));
+    bounds.push_back (Function::makeInterval (-1., 0.));
+    problem.addConstraint (boost::make_shared<NumericLinearFunction> (a, b),
+                           bounds);
+
+    problem.addConstraint (
+      boost::make_shared<Combination> (),
+      Function::intervals_t (1, Function::makeInterval (3., 5.)));
+
+    NagSolverNlp solver (problem);
+    return solver.minimum ();
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_linear_constraints)
+
+BOOST_AUTO_TEST_CASE (shifted_bounds)
+{
+  NagSolverNlp::result_t result = solve (1.75);
+  BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlp::SOLVER_VALUE);
+  const Result& res = boost::get<Result> (result);
+
+  BOOST_CHECK_SMALL (res.x[0] - .5, 1e-6);
+  BOOST_CHECK_SMALL (res.x[1] - .25, 1e-6);
+  BOOST_CHECK_SMALL (res.x[2] - 1., 1e-6);
+
+  // Multipliers of the bounds, then of the linear rows.
+  BOOST_REQUIRE_EQUAL (res.lambda.size (), 6);
+  for (Function::size_type i = 0; i < 3; ++i)
+    BOOST_CHECK_SMALL (res.lambda[i], 1e-6);
+  BOOST_CHECK_SMALL (res.lambda[3] + .5, 1e-6);
+  BOOST_CHECK_SMALL (res.lambda[4], 1e-6);
+  BOOST_CHECK_SMALL (res.lambda[5] - .25, 1e-6);
+}
+
+// The starting point violates the first row: NAG has to move, and
+// the stub fails.
+BOOST_AUTO_TEST_CASE (infeasible_start)
+{
+  NagSolverNlp::result_t result = solve (1.5);
+  if (result.which () != NagSolverNlp::SOLVER_VALUE) return;
+
+  const Result& res = boost::get<Result> (result);
+  BOOST_CHECK_LE (res.x[0] + res.x[1] + 1., 1.5 + 1e-6);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,216 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Detection of affine constraints by the sparse NLP solver
+// ("nag.detect_affine"): a nonlinear constraint found to be affine is
+// moved to A, with its constant moved to its bounds, and the result is
+// the same as without the detection.
+//
+// The problem starts at its solution, where the NAG stub stays when
+// run for one iteration.
+
+#define BOOST_TEST_MODULE nlp_sparse_affine
+
+#include <cmath>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief c' x + 1/2 ||x - x0||^2.
+  struct Cost : public differentiableFunction_t
+  {
+    Cost (const vector_t& c, const vector_t& x0)
+      : differentiableFunction_t (x0.size (), 1,
+                                  "c' x + 1/2 ||x - x0||^2"),
+        c_ (c),
+        x0_ (x0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = c_.dot (x) + .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = c_[i] + x[i] - x0_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = c_[i] + x[i] - x0_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t c_;
+    vector_t x0_;
+  };
+
+  /// \brief 2 x0 + x1 + 3, given as a nonlinear function, counting its
+  /// evaluations.
+  struct Affine : public differentiableFunction_t
+  {
+    Affine ()
+      : differentiableFunction_t (2, 1, "2 x0 + x1 + 3"),
+        evaluations (0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      ++evaluations;
+      result[0] = 2. * x[0] + x[1] + 3.;
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (0) = 2.;
+      gradient.insert (1) = 1.;
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, 0) = 2.;
+      jacobian.insert (0, 1) = 1.;
+      jacobian.makeCompressed ();
+    }
+
+    mutable int evaluations;
+  };
+
+  /// \brief x0 x1, which stays in G.
+  struct Product : public differentiableFunction_t
+  {
+    Product () : differentiableFunction_t (2, 1, "x0 x1")
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = x[0] * x[1];
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (0) = x[1];
+      gradient.insert (1) = x[0];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, 0) = x[1];
+      jacobian.insert (0, 1) = x[0];
+      jacobian.makeCompressed ();
+    }
+  };
+
+  /// \brief Number of points where the Jacobians are sampled.
+  const int samples = 3;
+
+  /// \brief Solve the test problem, whose solution x0 = (1, 2) is on
+  /// the upper bound 7 of the affine constraint.
+  /// \param detect value of nag.detect_affine.
+  /// \param res result.
+  /// \return number of evaluations of the affine constraint.
+  int solve (int detect, Result& res)
+  {
+    vector_t c (2);
+    c << -2., -1.;
+    vector_t x0 (2);
+    x0 << 1., 2.;
+
+    Cost cost (c, x0);
+    sparseProblem_t problem (cost);
+    problem.startingPoint () = x0;
+    for (std::size_t i = 0; i < 2; ++i)
+      problem.argumentBounds ()[i] = Function::makeInterval (-10., 10.);
+
+    boost::shared_ptr<Affine> affine = boost::make_shared<Affine> ();
+    problem.addConstraint (
+      affine,
+      sparseProblem_t::intervals_t (1, Function::makeInterval (-10., 7.)));
+    problem.addConstraint (
+      boost::make_shared<Product> (),
+      sparseProblem_t::intervals_t (1, Function::makeInterval (-100., 100.)));
+
+    NagSolverNlpSparse solver (problem);
+    solver.setParameter ("nag.detect_affine", detect);
+    solver.setParameter ("nag.structure_samples", samples);
+
+    const NagSolverNlpSparse::result_t& result = solver.minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+    res = boost::get<Result> (result);
+    BOOST_CHECK_SMALL ((res.x - x0).lpNorm<Eigen::Infinity> (), 1e-12);
+    return affine->evaluations;
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_sparse_affine)
+
+BOOST_AUTO_TEST_CASE (detected)
+{
+  Result expected (2, 1);
+  Result res (2, 1);
+  BOOST_CHECK_GT (solve (0, expected), 0);
+
+  // Evaluated at the structure samples only, not by NAG.
+  BOOST_CHECK_EQUAL (solve (1, res), samples);
+
+  // Rows in the order of the problem, with the constant of the affine
+  // row added back.
+  BOOST_REQUIRE_EQUAL (res.constraints.size (), 2);
+  BOOST_CHECK_SMALL (res.constraints[0] - 7., 1e-12);
+  BOOST_CHECK_SMALL (res.constraints[1] - 2., 1e-12);
+  BOOST_CHECK_SMALL (
+    (res.constraints - expected.constraints).lpNorm<Eigen::Infinity> (),
+    1e-12);
+
+  // The shifted bound of the affine row is active.
+  BOOST_CHECK_GT (std::abs (expected.lambda[0]), .5);
+  BOOST_CHECK_SMALL ((res.lambda - expected.lambda).lpNorm<Eigen::Infinity> (),
+                     1e-10);
+  BOOST_CHECK_SMALL (res.value[0] - expected.value[0], 1e-12);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,212 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Automatic scaling of the sparse NLP solver ("nag.auto_scaling"): the
+// solution and the multipliers of a scaled problem are given in the
+// units of the problem, and are those of the unscaled problem.
+//
+// The problem is built so that its starting point is the solution,
+// with known multipliers: this holds for NAG and for the NAG stub,
+// which stays at the starting point when run for one iteration.
+
+#define BOOST_TEST_MODULE nlp_sparse_auto_scaling
+
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief c^T x + 1/2 ||x - x0||^2, whose gradient at x0 is c.
+  struct Cost : public differentiableFunction_t
+  {
+    Cost (const vector_t& c, const vector_t& x0)
+      : differentiableFunction_t (c.size (), 1, "c^T x + 1/2 ||x - x0||^2"),
+        c_ (c),
+        x0_ (x0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = c_.dot (x) + .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = c_[i] + x[i] - x0_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = c_[i] + x[i] - x0_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t c_;
+    vector_t x0_;
+  };
+
+  /// \brief 10^-3 x1 x2.
+  struct Product : public differentiableFunction_t
+  {
+    Product () : differentiableFunction_t (3, 1, "1e-3 x1 x2")
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = 1e-3 * x[1] * x[2];
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (1) = 1e-3 * x[2];
+      gradient.insert (2) = 1e-3 * x[1];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, 1) = 1e-3 * x[2];
+      jacobian.insert (0, 2) = 1e-3 * x[1];
+      jacobian.makeCompressed ();
+    }
+  };
+
+  /// \brief Solution of the test problem.
+  struct Solution
+  {
+    Result result;
+    vector_t variableMultipliers;
+  };
+
+  /// \brief Solve the test problem, whose variables and Jacobian
+  /// entries range over several orders of magnitude.
+  ///
+  /// At the starting point x0 = (10^-3, 2, 10^3):
+  /// - 10^-3 x1 x2 >= 2 is active (multiplier 1/4),
+  /// - 10^3 x0 + x1 <= 3 is active (multiplier -1/2),
+  /// - x2 <= 10^3 is active (multiplier -1).
+  Solution solve (bool scaling)
+  {
+    vector_t x0 (3);
+    x0 << 1e-3, 2., 1e3;
+
+    // c = 1/4 (0, 1, 2 10^-3) - 1/2 (10^3, 1, 0) - (0, 0, 1).
+    vector_t c (3);
+    c << -500., -.25, -.9995;
+
+    Cost cost (c, x0);
+    sparseProblem_t problem (cost);
+    problem.startingPoint () = x0;
+    problem.argumentBounds ()[0] = Function::makeInterval (-10., 10.);
+    problem.argumentBounds ()[1] = Function::makeInterval (-100., 100.);
+    problem.argumentBounds ()[2] = Function::makeInterval (0., 1e3);
+
+    // Nonlinear rows come first in the results: the constraints are
+    // added in that order.
+    problem.addConstraint (
+      boost::make_shared<Product> (),
+      sparseProblem_t::intervals_t (
+        1, Function::makeInterval (2., Function::infinity ())));
+
+    std::vector<triplet_t> triplets;
+    triplets.push_back (triplet_t (0, 0, 1e3));
+    triplets.push_back (triplet_t (0, 1, 1.));
+    matrix_t a (1, 3);
+    a.setFromTriplets (triplets.begin (), triplets.end ());
+    problem.addConstraint (
+      boost::make_shared<numericLinearFunction_t> (a, vector_t::Zero (1)),
+      sparseProblem_t::intervals_t (
+        1, Function::makeInterval (-Function::infinity (), 3.)));
+
+    NagSolverNlpSparse solver (problem);
+    solver.setParameter ("nag.auto_scaling", scaling ? 1 : 0);
+
+    const NagSolverNlpSparse::result_t& result = solver.minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+
+    Solution solution = {boost::get<Result> (result),
+                         solver.variableMultipliers ()};
+    return solution;
+  }
+
+  void checkClose (const vector_t& actual, const vector_t& expected)
+  {
+    BOOST_REQUIRE_EQUAL (actual.size (), expected.size ());
+    for (vector_t::Index i = 0; i < actual.size (); ++i)
+      BOOST_CHECK_SMALL (actual[i] - expected[i],
+                         1e-6 * (1. + std::abs (expected[i])));
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_sparse_auto_scaling)
+
+BOOST_AUTO_TEST_CASE (unscaled_problem)
+{
+  Solution unscaled = solve (false);
+
+  vector_t x (3);
+  x << 1e-3, 2., 1e3;
+  checkClose (unscaled.result.x, x);
+
+  vector_t constraints (2);
+  constraints << 2., 3.;
+  checkClose (unscaled.result.constraints, constraints);
+
+  vector_t lambda (2);
+  lambda << .25, -.5;
+  checkClose (unscaled.result.lambda, lambda);
+
+  vector_t xmul (3);
+  xmul << 0., 0., -1.;
+  checkClose (unscaled.variableMultipliers, xmul);
+}
+
+BOOST_AUTO_TEST_CASE (scaled_problem)
+{
+  Solution unscaled = solve (false);
+  Solution scaled = solve (true);
+
+  checkClose (scaled.result.x, unscaled.result.x);
+  checkClose (scaled.result.value, unscaled.result.value);
+  checkClose (scaled.result.constraints, unscaled.result.constraints);
+  checkClose (scaled.result.lambda, unscaled.result.lambda);
+  checkClose (scaled.variableMultipliers, unscaled.variableMultipliers);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,181 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Basis files of the sparse NLP solver ("nag.basis_save" and
+// "nag.basis_load"): a solve warm started from the basis saved by a
+// previous solve starts from its point, whatever its own starting
+// point, unless the basis belongs to another problem.
+//
+// The NAG stub stays at its starting point when run for one
+// iteration: the point of the result tells where the solve started.
+
+#define BOOST_TEST_MODULE nlp_sparse_basis
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief Basis file of a test, removed before and after it.
+  struct BasisFile
+  {
+    explicit BasisFile (const std::string& name)
+      : filename (name + ".basis")
+    {
+      std::remove (filename.c_str ());
+    }
+
+    ~BasisFile ()
+    {
+      std::remove (filename.c_str ());
+    }
+
+    std::string filename;
+  };
+
+  /// \brief c' x + 1/2 ||x - x0||^2.
+  struct Cost : public differentiableFunction_t
+  {
+    Cost (const vector_t& c, const vector_t& x0)
+      : differentiableFunction_t (x0.size (), 1,
+                                  "c' x + 1/2 ||x - x0||^2"),
+        c_ (c),
+        x0_ (x0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = c_.dot (x) + .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = c_[i] + x[i] - x0_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = c_[i] + x[i] - x0_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t c_;
+    vector_t x0_;
+  };
+
+  /// \brief Solve the problem whose solution (1, 2) is on the upper
+  /// bound of x1, with one linear row x0 + x1.
+  /// \param start starting point.
+  /// \param rows number of copies of the linear row: problems with
+  /// other numbers of rows do not share their basis.
+  Result solve (const vector_t& start, int rows, const std::string& save,
+                const std::string& load)
+  {
+    vector_t c (2);
+    c << 0., -3.;
+    vector_t x0 (2);
+    x0 << 1., 2.;
+
+    Cost cost (c, x0);
+    sparseProblem_t problem (cost);
+    problem.startingPoint () = start;
+    problem.argumentBounds ()[0] = Function::makeInterval (-10., 10.);
+    problem.argumentBounds ()[1] = Function::makeInterval (-10., 2.);
+
+    matrix_t a (1, 2);
+    a.insert (0, 0) = 1.;
+    a.insert (0, 1) = 1.;
+    for (int i = 0; i < rows; ++i)
+      problem.addConstraint (
+        boost::make_shared<numericLinearFunction_t> (a, vector_t::Zero (1)),
+        sparseProblem_t::intervals_t (1, Function::makeInterval (-20., 20.)));
+
+    NagSolverNlpSparse solver (problem);
+    solver.setParameter ("nag.basis_save", save);
+    solver.setParameter ("nag.basis_load", load);
+
+    const NagSolverNlpSparse::result_t& result = solver.minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+    return boost::get<Result> (result);
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_sparse_basis)
+
+BOOST_AUTO_TEST_CASE (round_trip)
+{
+  BasisFile file ("round-trip");
+  vector_t solution (2);
+  solution << 1., 2.;
+  vector_t start (2);
+  start << 3., -1.;
+
+  Result expected = solve (solution, 1, file.filename, "");
+  BOOST_CHECK (std::ifstream (file.filename.c_str ()).good ());
+
+  // Cold start, for reference.
+  Result cold = solve (start, 1, "", "");
+  BOOST_CHECK_SMALL ((cold.x - start).lpNorm<Eigen::Infinity> (), 1e-12);
+
+  Result res = solve (start, 1, "", file.filename);
+  BOOST_CHECK_SMALL ((res.x - solution).lpNorm<Eigen::Infinity> (), 1e-12);
+  BOOST_CHECK_SMALL (res.value[0] - expected.value[0], 1e-12);
+  BOOST_CHECK_SMALL (
+    (res.constraints - expected.constraints).lpNorm<Eigen::Infinity> (),
+    1e-12);
+  BOOST_CHECK_SMALL (
+    (res.lambda - expected.lambda).lpNorm<Eigen::Infinity> (), 1e-12);
+}
+
+// A basis of another problem, or a missing one, gives a cold start.
+BOOST_AUTO_TEST_CASE (mismatch)
+{
+  BasisFile file ("mismatch");
+  vector_t solution (2);
+  solution << 1., 2.;
+  vector_t start (2);
+  start << 3., -1.;
+
+  Result res = solve (start, 1, "", file.filename);
+  BOOST_CHECK_SMALL ((res.x - start).lpNorm<Eigen::Infinity> (), 1e-12);
+
+  solve (solution, 1, file.filename, "");
+  res = solve (start, 2, "", file.filename);
+  BOOST_CHECK_SMALL ((res.x - start).lpNorm<Eigen::Infinity> (), 1e-12);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,248 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Fused evaluations of the sparse NLP solver (see
+// nag::FusedEvaluation): functions computing their value and Jacobian
+// together give the same G, hence the same result, as when they are
+// evaluated separately.
+//
+// The problem starts at its solution, where the NAG stub stays when
+// run for one iteration. The multipliers the stub gives depend on the
+// G of its last point.
+
+#define BOOST_TEST_MODULE nlp_sparse_fused
+
+#include <cmath>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-function-hints.hh>
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief c' x + 1/2 ||x - x0||^2.
+  struct Cost : public differentiableFunction_t
+  {
+    Cost (const vector_t& c, const vector_t& x0)
+      : differentiableFunction_t (x0.size (), 1,
+                                  "c' x + 1/2 ||x - x0||^2"),
+        c_ (c),
+        x0_ (x0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = c_.dot (x) + .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = c_[i] + x[i] - x0_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = c_[i] + x[i] - x0_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t c_;
+    vector_t x0_;
+  };
+
+  /// \brief 1/2 x0^2, evaluated separately, before the fused
+  /// constraint in G.
+  struct Square : public differentiableFunction_t
+  {
+    Square () : differentiableFunction_t (2, 1, "1/2 x0^2")
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = .5 * x[0] * x[0];
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (0) = x[0];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, 0) = x[0];
+      jacobian.makeCompressed ();
+    }
+  };
+
+  /// \brief x0 x1.
+  struct Product : public differentiableFunction_t
+  {
+    Product () : differentiableFunction_t (2, 1, "x0 x1")
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = x[0] * x[1];
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (0) = x[1];
+      gradient.insert (1) = x[0];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, 0) = x[1];
+      jacobian.insert (0, 1) = x[0];
+      jacobian.makeCompressed ();
+    }
+  };
+
+  /// \brief Function F offering a fused evaluation, counting them.
+  template <typename F>
+  struct Fused : public F, public nag::FusedEvaluation<sparse_t>
+  {
+    Fused () : F (), evaluations (0)
+    {
+    }
+
+    Fused (const vector_t& c, const vector_t& x0)
+      : F (c, x0),
+        evaluations (0)
+    {
+    }
+
+    void valueAndJacobian (typename F::result_ref result,
+                           typename F::jacobian_ref jacobian,
+                           typename F::const_argument_ref x) const
+    {
+      ++evaluations;
+      this->impl_compute (result, x);
+      this->impl_jacobian (jacobian, x);
+    }
+
+    mutable int evaluations;
+  };
+
+  /// \brief Solve the test problem, whose solution x0 = (1, 2) is on
+  /// the upper bound of x0 x1.
+  /// \param fused whether the cost and x0 x1 offer a fused evaluation.
+  /// \param res result.
+  /// \param xmul multipliers of the argument bounds.
+  void solve (bool fused, Result& res, vector_t& xmul)
+  {
+    vector_t c (2);
+    c << -2., -1.;
+    vector_t x0 (2);
+    x0 << 1., 2.;
+
+    boost::shared_ptr<Fused<Cost> > fusedCost;
+    boost::shared_ptr<Fused<Product> > fusedProduct;
+    boost::shared_ptr<Cost> cost;
+    boost::shared_ptr<Product> product;
+    if (fused)
+    {
+      cost = fusedCost = boost::make_shared<Fused<Cost> > (c, x0);
+      product = fusedProduct = boost::make_shared<Fused<Product> > ();
+    }
+    else
+    {
+      cost = boost::make_shared<Cost> (c, x0);
+      product = boost::make_shared<Product> ();
+    }
+
+    sparseProblem_t problem (*cost);
+    problem.startingPoint () = x0;
+    for (std::size_t i = 0; i < 2; ++i)
+      problem.argumentBounds ()[i] = Function::makeInterval (-10., 10.);
+    problem.addConstraint (
+      boost::make_shared<Square> (),
+      sparseProblem_t::intervals_t (1, Function::makeInterval (-10., 10.)));
+    problem.addConstraint (
+      product,
+      sparseProblem_t::intervals_t (1, Function::makeInterval (-10., 2.)));
+
+    NagSolverNlpSparse solver (problem);
+    const NagSolverNlpSparse::result_t& result = solver.minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+    res = boost::get<Result> (result);
+    xmul = solver.variableMultipliers ();
+    BOOST_CHECK_SMALL ((res.x - x0).lpNorm<Eigen::Infinity> (), 1e-12);
+
+    if (fused)
+    {
+      BOOST_CHECK_GT (fusedCost->evaluations, 0);
+      BOOST_CHECK_GT (fusedProduct->evaluations, 0);
+    }
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_sparse_fused)
+
+BOOST_AUTO_TEST_CASE (same_result)
+{
+  Result expected (2, 1);
+  Result res (2, 1);
+  vector_t expectedXmul;
+  vector_t xmul;
+  solve (false, expected, expectedXmul);
+  solve (true, res, xmul);
+
+  BOOST_REQUIRE_EQUAL (res.constraints.size (), 2);
+  BOOST_CHECK_SMALL (res.constraints[0] - .5, 1e-12);
+  BOOST_CHECK_SMALL (res.constraints[1] - 2., 1e-12);
+  BOOST_CHECK_SMALL (res.value[0] - expected.value[0], 1e-12);
+
+  // The bound of x0 x1 is active: its multiplier depends on its row
+  // of G and on the cost gradient.
+  BOOST_CHECK_GT (std::abs (expected.lambda[1]), .5);
+  BOOST_CHECK_SMALL (
+    (res.lambda - expected.lambda).lpNorm<Eigen::Infinity> (), 1e-12);
+  BOOST_REQUIRE_EQUAL (xmul.size (), 2);
+  BOOST_CHECK_SMALL ((xmul - expectedXmul).lpNorm<Eigen::Infinity> (),
+                     1e-12);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,238 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Lazy constraints of the sparse NLP solver (see
+// NagSolverNlpSparse::setLazyConstraints): a lazy solve gives the
+// solution and the multipliers of the full problem, whether violated
+// constraints are spliced into the problem of the previous solve or
+// the problem is built again (when it is scaled).
+//
+// The starting point violates a linear and a nonlinear lazy constraint,
+// which are added after the first solve. The NAG stub, run for one
+// iteration, stays at the starting point, and NAG converges to the
+// solution of the convex problem: in both cases, lazy and full solves
+// give the same results.
+
+#define BOOST_TEST_MODULE nlp_sparse_lazy
+
+#include <algorithm>
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief c^T x + 1/2 ||x - x0||^2, whose gradient at x0 is c.
+  struct Cost : public differentiableFunction_t
+  {
+    Cost (const vector_t& c, const vector_t& x0)
+      : differentiableFunction_t (c.size (), 1, "c^T x + 1/2 ||x - x0||^2"),
+        c_ (c),
+        x0_ (x0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = c_.dot (x) + .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = c_[i] + x[i] - x0_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = c_[i] + x[i] - x0_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t c_;
+    vector_t x0_;
+  };
+
+  /// \brief xi^2 + xj^2.
+  struct SquaredNorm : public differentiableFunction_t
+  {
+    SquaredNorm (size_type i, size_type j)
+      : differentiableFunction_t (4, 1, "xi^2 + xj^2"),
+        i_ (i),
+        j_ (j)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = x[i_] * x[i_] + x[j_] * x[j_];
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (std::min (i_, j_)) = 2. * x[std::min (i_, j_)];
+      gradient.insert (std::max (i_, j_)) = 2. * x[std::max (i_, j_)];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, std::min (i_, j_)) = 2. * x[std::min (i_, j_)];
+      jacobian.insert (0, std::max (i_, j_)) = 2. * x[std::max (i_, j_)];
+      jacobian.makeCompressed ();
+    }
+
+    size_type i_;
+    size_type j_;
+  };
+
+  /// \brief Linear function of one row.
+  boost::shared_ptr<numericLinearFunction_t> row (double a0, double a1,
+                                                  double a2, double a3)
+  {
+    const double coefficients[] = {a0, a1, a2, a3};
+    std::vector<triplet_t> triplets;
+    for (int j = 0; j < 4; ++j)
+      if (coefficients[j] != 0.)
+        triplets.push_back (triplet_t (0, j, coefficients[j]));
+    matrix_t a (1, 4);
+    a.setFromTriplets (triplets.begin (), triplets.end ());
+    return boost::make_shared<numericLinearFunction_t> (a,
+                                                        vector_t::Zero (1));
+  }
+
+  sparseProblem_t::intervals_t interval (double lower, double upper)
+  {
+    return sparseProblem_t::intervals_t (
+      1, Function::makeInterval (lower, upper));
+  }
+
+  /// \brief Solution of the test problem.
+  struct Solution
+  {
+    Result result;
+    vector_t variableMultipliers;
+  };
+
+  /// \brief Solve the test problem.
+  ///
+  /// At the starting point x0 = (1, 1, 1, 1), x0 <= 1, x1^2 + x2^2 <= 2
+  /// and x0 + x3 >= 2 are active, and the lazy constraints
+  /// x1^2 + x3^2 <= 3/2 and x1 + x2 + x3 <= 5/2 are violated. The last
+  /// lazy constraint, x2 - x3 in [-1, 1], is satisfied and stays out of
+  /// the problem.
+  ///
+  /// \param lazy whether the constraints but x1^2 + x2^2 <= 2 and
+  /// x0 + x3 >= 2 are lazy.
+  /// \param scaling whether the problem is scaled, in which case a
+  /// lazy solve builds the problem again.
+  Solution solve (bool lazy, bool scaling)
+  {
+    vector_t x0 = vector_t::Ones (4);
+    vector_t c (4);
+    c << -1., -.5, .3, .2;
+
+    Cost cost (c, x0);
+    sparseProblem_t problem (cost);
+    problem.startingPoint () = x0;
+    for (std::size_t i = 0; i < 4; ++i)
+      problem.argumentBounds ()[i] = Function::makeInterval (-5., 5.);
+    problem.argumentBounds ()[0] = Function::makeInterval (-5., 1.);
+
+    // The rows of the constraints given to NAG first are moved when the
+    // lazy constraints are added.
+    problem.addConstraint (boost::make_shared<SquaredNorm> (1, 3),
+                           interval (-Function::infinity (), 1.5));
+    problem.addConstraint (boost::make_shared<SquaredNorm> (1, 2),
+                           interval (-Function::infinity (), 2.));
+    problem.addConstraint (row (1., 0., 0., 1.),
+                           interval (2., Function::infinity ()));
+    problem.addConstraint (row (0., 1., 1., 1.),
+                           interval (-Function::infinity (), 2.5));
+    problem.addConstraint (row (0., 0., 1., -1.), interval (-1., 1.));
+
+    NagSolverNlpSparse solver (problem);
+    solver.setParameter ("nag.auto_scaling", scaling ? 1 : 0);
+    if (lazy)
+    {
+      std::vector<bool> lazyConstraints (5, true);
+      lazyConstraints[1] = lazyConstraints[2] = false;
+      solver.setLazyConstraints (lazyConstraints);
+    }
+
+    const NagSolverNlpSparse::result_t& result = solver.minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+
+    Solution solution = {boost::get<Result> (result),
+                         solver.variableMultipliers ()};
+    return solution;
+  }
+
+  void checkClose (const vector_t& actual, const vector_t& expected)
+  {
+    BOOST_REQUIRE_EQUAL (actual.size (), expected.size ());
+    for (vector_t::Index i = 0; i < actual.size (); ++i)
+      BOOST_CHECK_SMALL (actual[i] - expected[i], 1e-6);
+  }
+
+  void checkLazySolve (bool scaling)
+  {
+    Solution full = solve (false, scaling);
+    Solution lazy = solve (true, scaling);
+
+    checkClose (lazy.result.x, full.result.x);
+    checkClose (lazy.result.value, full.result.value);
+    checkClose (lazy.result.constraints, full.result.constraints);
+    checkClose (lazy.result.lambda, full.result.lambda);
+    checkClose (lazy.variableMultipliers, full.variableMultipliers);
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_sparse_lazy)
+
+// The violated constraints are spliced into A and G, and NAG is
+// warm-started.
+BOOST_AUTO_TEST_CASE (warm_splice)
+{
+  checkLazySolve (false);
+}
+
+// The scaled problem is built again with the violated constraints.
+BOOST_AUTO_TEST_CASE (rebuild)
+{
+  checkLazySolve (true);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,188 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Linear and constant objectives of the sparse NLP solver: they are
+// stored in A, or give a feasibility problem (objrow 0), instead of
+// being evaluated by usrfun. The results are the same as with the same
+// objective given as a nonlinear function.
+//
+// The problems start at their solution, where the NAG stub stays when
+// run for one iteration.
+
+#define BOOST_TEST_MODULE nlp_sparse_linear_objective
+
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief c' x + d, given as a nonlinear function.
+  struct Affine : public differentiableFunction_t
+  {
+    Affine (const vector_t& c, double d)
+      : differentiableFunction_t (c.size (), 1, "c' x + d"),
+        c_ (c),
+        d_ (d)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = c_.dot (x) + d_;
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = c_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = c_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t c_;
+    double d_;
+  };
+
+  /// \brief x0 x1, so that the problem has a G.
+  struct Product : public differentiableFunction_t
+  {
+    Product () : differentiableFunction_t (2, 1, "x0 x1")
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = x[0] * x[1];
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (0) = x[1];
+      gradient.insert (1) = x[0];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, 0) = x[1];
+      jacobian.insert (0, 1) = x[0];
+      jacobian.makeCompressed ();
+    }
+  };
+
+  /// \brief Solve the problem of cost c' x + d on [1, 10] x [2, 10],
+  /// whose solution for c >= 0 is the starting point (1, 2).
+  /// \param linear whether the cost is a linear function.
+  void solve (const vector_t& c, double d, bool linear, Result& res,
+              vector_t& xmul)
+  {
+    vector_t x0 (2);
+    x0 << 1., 2.;
+
+    boost::shared_ptr<differentiableFunction_t> cost;
+    if (linear)
+    {
+      std::vector<triplet_t> triplets;
+      for (size_type j = 0; j < c.size (); ++j)
+        if (c[j] != 0.) triplets.push_back (triplet_t (0, j, c[j]));
+      matrix_t a (1, c.size ());
+      a.setFromTriplets (triplets.begin (), triplets.end ());
+      cost = boost::make_shared<numericLinearFunction_t> (
+        a, vector_t::Constant (1, d));
+    }
+    else
+      cost = boost::make_shared<Affine> (c, d);
+
+    sparseProblem_t problem (*cost);
+    problem.startingPoint () = x0;
+    problem.argumentBounds ()[0] = Function::makeInterval (1., 10.);
+    problem.argumentBounds ()[1] = Function::makeInterval (2., 10.);
+    problem.addConstraint (
+      boost::make_shared<Product> (),
+      sparseProblem_t::intervals_t (1, Function::makeInterval (-100., 100.)));
+
+    NagSolverNlpSparse solver (problem);
+    const NagSolverNlpSparse::result_t& result = solver.minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+    res = boost::get<Result> (result);
+    xmul = solver.variableMultipliers ();
+    BOOST_CHECK_SMALL ((res.x - x0).lpNorm<Eigen::Infinity> (), 1e-12);
+    BOOST_REQUIRE_EQUAL (res.constraints.size (), 1);
+    BOOST_CHECK_SMALL (res.constraints[0] - 2., 1e-12);
+  }
+
+  /// \brief Compare the linear cost with the nonlinear one.
+  void check (const vector_t& c, double d)
+  {
+    Result expected (2, 1);
+    Result res (2, 1);
+    vector_t expectedXmul;
+    vector_t xmul;
+    solve (c, d, false, expected, expectedXmul);
+    solve (c, d, true, res, xmul);
+
+    BOOST_CHECK_SMALL (expected.value[0] - (c[0] + 2. * c[1] + d), 1e-12);
+    BOOST_CHECK_SMALL (res.value[0] - expected.value[0], 1e-12);
+    BOOST_CHECK_SMALL (
+      (res.lambda - expected.lambda).lpNorm<Eigen::Infinity> (), 1e-12);
+    BOOST_REQUIRE_EQUAL (xmul.size (), 2);
+    BOOST_CHECK_SMALL ((xmul - expectedXmul).lpNorm<Eigen::Infinity> (),
+                       1e-12);
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_sparse_linear_objective)
+
+// The cost is a row of A, and its constant is added to the value.
+BOOST_AUTO_TEST_CASE (linear)
+{
+  vector_t c (2);
+  c << 1., 3.;
+  check (c, 5.);
+}
+
+// Without coefficients, NAG solves a feasibility problem (objrow 0).
+BOOST_AUTO_TEST_CASE (feasibility)
+{
+  check (vector_t::Zero (2), 4.);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,226 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Presolve of the sparse NLP solver ("nag.presolve"): the solution and
+// the multipliers of a presolved problem are those of the full problem.
+//
+// The problem is built so that its starting point is the solution,
+// with known multipliers: this holds for NAG and for the NAG stub,
+// which stays at the starting point when run for one iteration.
+
+#define BOOST_TEST_MODULE nlp_sparse_presolve
+
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief c^T x + 1/2 ||x - x0||^2, whose gradient at x0 is c.
+  struct Cost : public differentiableFunction_t
+  {
+    Cost (const vector_t& c, const vector_t& x0)
+      : differentiableFunction_t (c.size (), 1, "c^T x + 1/2 ||x - x0||^2"),
+        c_ (c),
+        x0_ (x0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = c_.dot (x) + .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = c_[i] + x[i] - x0_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = c_[i] + x[i] - x0_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t c_;
+    vector_t x0_;
+  };
+
+  /// \brief x2 x3.
+  struct Product : public differentiableFunction_t
+  {
+    Product () : differentiableFunction_t (5, 1, "x2 x3")
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = x[2] * x[3];
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (2) = x[3];
+      gradient.insert (3) = x[2];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, 2) = x[3];
+      jacobian.insert (0, 3) = x[2];
+      jacobian.makeCompressed ();
+    }
+  };
+
+  /// \brief Solution of the test problem.
+  struct Solution
+  {
+    Result result;
+    vector_t variableMultipliers;
+  };
+
+  /// \brief Solve the test problem.
+  ///
+  /// At the starting point x0 = (1, 2, 1, 3, 1/2), where x3 is fixed:
+  /// - x2 x3 <= 3 is active (multiplier -1),
+  /// - the singleton row 2 x0 <= 2 is active (multiplier -1),
+  /// - of the duplicate rows x1 + x2 <= 10 and -2 x1 - 2 x2 >= -6, only
+  ///   the second one is active (multiplier 1/2),
+  /// - x3 + x4 >= 7/2 is active (multiplier 2), and becomes a singleton
+  ///   row once x3 is removed,
+  /// - the multiplier of x3 is 1/4.
+  Solution solve (bool presolve)
+  {
+    vector_t x0 (5);
+    x0 << 1., 2., 1., 3., .5;
+
+    // c = -(0, 0, 3, 1, 0) - 2 (1, 0, 0, 0, 0) - 1/2 (0, 2, 2, 0, 0)
+    //     + 2 (0, 0, 0, 1, 1) + 1/4 (0, 0, 0, 1, 0).
+    vector_t c (5);
+    c << -2., -1., -4., 1.25, 2.;
+
+    Cost cost (c, x0);
+    sparseProblem_t problem (cost);
+    problem.startingPoint () = x0;
+    for (std::size_t i = 0; i < 5; ++i)
+      problem.argumentBounds ()[i] = Function::makeInterval (-10., 10.);
+    problem.argumentBounds ()[3] = Function::makeInterval (3., 3.);
+
+    // Nonlinear rows come first in the results: the constraints are
+    // added in that order.
+    problem.addConstraint (
+      boost::make_shared<Product> (),
+      sparseProblem_t::intervals_t (
+        1, Function::makeInterval (-Function::infinity (), 3.)));
+
+    std::vector<triplet_t> triplets;
+    triplets.push_back (triplet_t (0, 0, 2.));
+    triplets.push_back (triplet_t (1, 1, 1.));
+    triplets.push_back (triplet_t (1, 2, 1.));
+    triplets.push_back (triplet_t (2, 1, -2.));
+    triplets.push_back (triplet_t (2, 2, -2.));
+    triplets.push_back (triplet_t (3, 3, 1.));
+    triplets.push_back (triplet_t (3, 4, 1.));
+    matrix_t a (4, 5);
+    a.setFromTriplets (triplets.begin (), triplets.end ());
+
+    sparseProblem_t::intervals_t bounds;
+    bounds.push_back (Function::makeInterval (-Function::infinity (), 2.));
+    bounds.push_back (Function::makeInterval (0., 10.));
+    bounds.push_back (Function::makeInterval (-6., 0.));
+    bounds.push_back (Function::makeInterval (3.5, 5.));
+    problem.addConstraint (
+      boost::make_shared<numericLinearFunction_t> (a, vector_t::Zero (4)),
+      bounds);
+
+    NagSolverNlpSparse solver (problem);
+    solver.setParameter ("nag.presolve", presolve ? 1 : 0);
+
+    const NagSolverNlpSparse::result_t& result = solver.minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+
+    Solution solution = {boost::get<Result> (result),
+                         solver.variableMultipliers ()};
+    return solution;
+  }
+
+  void checkClose (const vector_t& actual, const vector_t& expected)
+  {
+    BOOST_REQUIRE_EQUAL (actual.size (), expected.size ());
+    for (vector_t::Index i = 0; i < actual.size (); ++i)
+      BOOST_CHECK_SMALL (actual[i] - expected[i], 1e-6);
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_sparse_presolve)
+
+BOOST_AUTO_TEST_CASE (full_problem)
+{
+  Solution full = solve (false);
+
+  vector_t x (5);
+  x << 1., 2., 1., 3., .5;
+  checkClose (full.result.x, x);
+
+  vector_t constraints (5);
+  constraints << 3., 2., 3., -6., 3.5;
+  checkClose (full.result.constraints, constraints);
+
+  vector_t lambda (5);
+  lambda << -1., -1., 0., .5, 2.;
+  checkClose (full.result.lambda, lambda);
+
+  vector_t xmul (5);
+  xmul << 0., 0., 0., .25, 0.;
+  checkClose (full.variableMultipliers, xmul);
+}
+
+// Multipliers of the bounds given by removed rows go back to these
+// rows, and fixed variables get their multipliers back.
+BOOST_AUTO_TEST_CASE (presolved_problem)
+{
+  Solution full = solve (false);
+  Solution presolved = solve (true);
+
+  checkClose (presolved.result.x, full.result.x);
+  BOOST_CHECK_SMALL (presolved.result.value[0] - full.result.value[0], 1e-6);
+  checkClose (presolved.result.constraints, full.result.constraints);
+  checkClose (presolved.result.lambda, full.result.lambda);
+  checkClose (presolved.variableMultipliers, full.variableMultipliers);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,234 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Result cache of the sparse NLP solver (see nag::ResultCache): a
+// problem solved again by a solver sharing the cache gets the stored
+// result, unless its data, its parameters or the functions it uses
+// changed.
+//
+// The problem starts at its solution, where the NAG stub stays when
+// run for one iteration.
+
+#define BOOST_TEST_MODULE nlp_sparse_result_cache
+
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+#include <roboptim/core/plugin/nag/nag-result-cache.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief c' x + 1/2 ||x - x0||^2, identified for the result cache.
+  struct Cost : public differentiableFunction_t,
+                public nag::MemoizedEvaluation
+  {
+    Cost (const vector_t& c, const vector_t& x0)
+      : differentiableFunction_t (x0.size (), 1,
+                                  "c' x + 1/2 ||x - x0||^2"),
+        c_ (c),
+        x0_ (x0)
+    {
+    }
+
+    std::string memoKey () const
+    {
+      return "cost";
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = c_.dot (x) + .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = c_[i] + x[i] - x0_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = c_[i] + x[i] - x0_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t c_;
+    vector_t x0_;
+  };
+
+  /// \brief Problem whose solution x0 = (1, 2) is on the upper bound
+  /// of x1, with a nonzero multiplier.
+  struct TestProblem
+  {
+    TestProblem ()
+      : c (2),
+        x0 (2),
+        cost (),
+        problem ()
+    {
+      c << 0., -3.;
+      x0 << 1., 2.;
+      cost = boost::make_shared<Cost> (c, x0);
+      problem = boost::make_shared<sparseProblem_t> (*cost);
+      problem->startingPoint () = x0;
+      problem->argumentBounds ()[0] = Function::makeInterval (-10., 10.);
+      problem->argumentBounds ()[1] = Function::makeInterval (-10., 2.);
+    }
+
+    vector_t c;
+    vector_t x0;
+    boost::shared_ptr<Cost> cost;
+    boost::shared_ptr<sparseProblem_t> problem;
+  };
+
+  /// \brief Solve a problem with a new solver using the cache.
+  /// \return number of evaluations of the functions (0: cache hit).
+  int solve (const sparseProblem_t& problem,
+             const boost::shared_ptr<nag::ResultCache>& cache,
+             Result& res, vector_t& xmul,
+             const std::string& basisFile = std::string ())
+  {
+    NagSolverNlpSparse solver (problem);
+    solver.setResultCache (cache);
+    solver.setParameter ("nag.basis_save", basisFile);
+
+    const NagSolverNlpSparse::result_t& result = solver.minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+    res = boost::get<Result> (result);
+    xmul = solver.variableMultipliers ();
+    return solver.statistics ().evaluations;
+  }
+
+  /// \brief Result of a solve without cache.
+  void reference (const sparseProblem_t& problem, Result& res,
+                  vector_t& xmul)
+  {
+    BOOST_CHECK_GT (solve (problem, boost::shared_ptr<nag::ResultCache> (),
+                           res, xmul),
+                    0);
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_sparse_result_cache)
+
+BOOST_AUTO_TEST_CASE (hit)
+{
+  TestProblem test;
+  boost::shared_ptr<nag::ResultCache> cache =
+    boost::make_shared<nag::ResultCache> (8);
+  Result expected (2, 1);
+  vector_t expectedXmul;
+  reference (*test.problem, expected, expectedXmul);
+  BOOST_REQUIRE_EQUAL (expectedXmul.size (), 2);
+  BOOST_CHECK_GT (std::abs (expectedXmul[1]), 1.);
+
+  Result res (2, 1);
+  vector_t xmul;
+  BOOST_CHECK_GT (solve (*test.problem, cache, res, xmul), 0);
+  BOOST_CHECK_EQUAL (cache->size (), 1);
+
+  // Same problem, new solver: nothing is evaluated.
+  BOOST_CHECK_EQUAL (solve (*test.problem, cache, res, xmul), 0);
+  BOOST_CHECK_EQUAL (cache->size (), 1);
+  BOOST_CHECK_SMALL ((res.x - expected.x).lpNorm<Eigen::Infinity> (), 1e-12);
+  BOOST_CHECK_SMALL (res.value[0] - expected.value[0], 1e-12);
+  BOOST_REQUIRE_EQUAL (xmul.size (), 2);
+  BOOST_CHECK_SMALL ((xmul - expectedXmul).lpNorm<Eigen::Infinity> (),
+                     1e-12);
+}
+
+BOOST_AUTO_TEST_CASE (miss)
+{
+  TestProblem test;
+  boost::shared_ptr<nag::ResultCache> cache =
+    boost::make_shared<nag::ResultCache> (8);
+  Result res (2, 1);
+  vector_t xmul;
+  BOOST_CHECK_GT (solve (*test.problem, cache, res, xmul), 0);
+
+  // Other bound.
+  test.problem->argumentBounds ()[0] = Function::makeInterval (-5., 10.);
+  BOOST_CHECK_GT (solve (*test.problem, cache, res, xmul), 0);
+  BOOST_CHECK_EQUAL (cache->size (), 2);
+
+  // Other parameter.
+  {
+    NagSolverNlpSparse solver (*test.problem);
+    solver.setResultCache (cache);
+    solver.setParameter ("nag.lazy_rounds", 5);
+    BOOST_CHECK_EQUAL (solver.minimum ().which (),
+                       NagSolverNlpSparse::SOLVER_VALUE);
+    BOOST_CHECK_GT (solver.statistics ().evaluations, 0);
+  }
+  BOOST_CHECK_EQUAL (cache->size (), 3);
+}
+
+// Solves writing a basis file are always run, and not stored.
+BOOST_AUTO_TEST_CASE (basis_file)
+{
+  TestProblem test;
+  boost::shared_ptr<nag::ResultCache> cache =
+    boost::make_shared<nag::ResultCache> (8);
+  const std::string basisFile = "result-cache.basis";
+  Result res (2, 1);
+  vector_t xmul;
+
+  BOOST_CHECK_GT (solve (*test.problem, cache, res, xmul), 0);
+  BOOST_CHECK_GT (solve (*test.problem, cache, res, xmul, basisFile), 0);
+  BOOST_CHECK_GT (solve (*test.problem, cache, res, xmul, basisFile), 0);
+  BOOST_CHECK_EQUAL (cache->size (), 1);
+  std::remove (basisFile.c_str ());
+}
+
+BOOST_AUTO_TEST_CASE (invalidate)
+{
+  TestProblem test;
+  boost::shared_ptr<nag::ResultCache> cache =
+    boost::make_shared<nag::ResultCache> (8);
+  Result res (2, 1);
+  vector_t xmul;
+
+  BOOST_CHECK_GT (solve (*test.problem, cache, res, xmul), 0);
+  cache->invalidate ("other");
+  BOOST_CHECK_EQUAL (cache->size (), 1);
+  BOOST_CHECK_EQUAL (solve (*test.problem, cache, res, xmul), 0);
+
+  cache->invalidate (test.cost->memoKey ());
+  BOOST_CHECK_EQUAL (cache->size (), 0);
+  BOOST_CHECK_GT (solve (*test.problem, cache, res, xmul), 0);
+  BOOST_CHECK_EQUAL (cache->size (), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,211 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Pattern cache of the sparse NLP solver ("nag.structure_cache"): a
+// problem whose linear data changes, but not its signature, is solved
+// with its own data.
+//
+// Each solve uses a new solver, which reads the cache file written by
+// the previous one as a new process would. The problems start at their
+// solution, where the NAG stub stays when run for one iteration.
+
+#define BOOST_TEST_MODULE nlp_sparse_structure_cache
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief Cache directory of a test, emptied before and after it.
+  struct CacheDirectory
+  {
+    explicit CacheDirectory (const std::string& name)
+      : directory (name + ".cache")
+    {
+      ::mkdir (directory.c_str (), 0755);
+      clear ();
+    }
+
+    ~CacheDirectory ()
+    {
+      clear ();
+      std::remove (directory.c_str ());
+    }
+
+    /// \brief Remove the cache files.
+    void clear () const
+    {
+      DIR* dir = ::opendir (directory.c_str ());
+      if (!dir) return;
+
+      std::vector<std::string> files;
+      while (dirent* entry = ::readdir (dir))
+      {
+        std::string file = entry->d_name;
+        if (file != "." && file != "..") files.push_back (file);
+      }
+      ::closedir (dir);
+
+      for (std::size_t i = 0; i < files.size (); ++i)
+        std::remove ((directory + "/" + files[i]).c_str ());
+    }
+
+    std::string directory;
+  };
+
+  /// \brief 1/2 ||x - x0||^2.
+  struct Distance : public differentiableFunction_t
+  {
+    explicit Distance (const vector_t& x0)
+      : differentiableFunction_t (x0.size (), 1, "1/2 ||x - x0||^2"),
+        x0_ (x0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = x[i] - x0_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = x[i] - x0_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t x0_;
+  };
+
+  /// \brief x0 x1, so that the problem has a G pattern to cache.
+  struct Product : public differentiableFunction_t
+  {
+    Product () : differentiableFunction_t (2, 1, "x0 x1")
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = x[0] * x[1];
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (0) = x[1];
+      gradient.insert (1) = x[0];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, 0) = x[1];
+      jacobian.insert (0, 1) = x[0];
+      jacobian.makeCompressed ();
+    }
+  };
+
+  /// \brief Solve the test problem, whose linear row a x has a single
+  /// coefficient, and return the value of that row.
+  ///
+  /// The signature of the problem does not depend on the coefficient
+  /// nor on its column.
+  double solve (const std::string& directory, double coefficient,
+                int column)
+  {
+    vector_t x0 (2);
+    x0 << .5, 2.;
+
+    Distance cost (x0);
+    sparseProblem_t problem (cost);
+    problem.startingPoint () = x0;
+    for (std::size_t i = 0; i < 2; ++i)
+      problem.argumentBounds ()[i] = Function::makeInterval (-10., 10.);
+
+    problem.addConstraint (
+      boost::make_shared<Product> (),
+      sparseProblem_t::intervals_t (1, Function::makeInterval (-100., 100.)));
+
+    std::vector<triplet_t> triplets;
+    triplets.push_back (triplet_t (0, column, coefficient));
+    matrix_t a (1, 2);
+    a.setFromTriplets (triplets.begin (), triplets.end ());
+    problem.addConstraint (
+      boost::make_shared<numericLinearFunction_t> (a, vector_t::Zero (1)),
+      sparseProblem_t::intervals_t (1, Function::makeInterval (-100., 100.)));
+
+    NagSolverNlpSparse solver (problem);
+    solver.setParameter ("nag.structure_cache", directory);
+
+    const NagSolverNlpSparse::result_t& result = solver.minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+    const Result& res = boost::get<Result> (result);
+    BOOST_REQUIRE_EQUAL (res.constraints.size (), 2);
+
+    // Nonlinear rows come first.
+    BOOST_CHECK_SMALL (res.constraints[0] - 1., 1e-12);
+    return res.constraints[1];
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_sparse_structure_cache)
+
+BOOST_AUTO_TEST_CASE (changed_coefficient)
+{
+  CacheDirectory cache ("changed-coefficient");
+
+  BOOST_CHECK_SMALL (solve (cache.directory, 2., 0) - 1., 1e-12);
+  BOOST_CHECK_SMALL (solve (cache.directory, 7., 0) - 3.5, 1e-12);
+}
+
+BOOST_AUTO_TEST_CASE (changed_sparsity)
+{
+  CacheDirectory cache ("changed-sparsity");
+
+  BOOST_CHECK_SMALL (solve (cache.directory, 2., 0) - 1., 1e-12);
+  BOOST_CHECK_SMALL (solve (cache.directory, 2., 1) - 4., 1e-12);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,208 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Warm start of the sparse NLP solver (see
+// NagSolverNlpSparse::setWarmStart): the point and the multipliers are
+// given to NAG through presolve and scaling.
+//
+// Variables whose multiplier is nonzero start nonbasic, at their bound:
+// this holds for NAG and for the NAG stub, which then stays at the
+// starting point when run for one iteration.
+
+#define BOOST_TEST_MODULE nlp_sparse_warm_start
+
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief c^T x + 1/2 ||x - x0||^2, whose gradient at x0 is c.
+  struct Cost : public differentiableFunction_t
+  {
+    Cost (const vector_t& c, const vector_t& x0)
+      : differentiableFunction_t (c.size (), 1, "c^T x + 1/2 ||x - x0||^2"),
+        c_ (c),
+        x0_ (x0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = c_.dot (x) + .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = c_[i] + x[i] - x0_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = c_[i] + x[i] - x0_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t c_;
+    vector_t x0_;
+  };
+
+  /// \brief 10^4 (x2^2 + x3^2), whose large Jacobian entries give
+  /// scale factors to x2 and x3.
+  struct Norm : public differentiableFunction_t
+  {
+    Norm () : differentiableFunction_t (4, 1, "1e4 (x2^2 + x3^2)")
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = 1e4 * (x[2] * x[2] + x[3] * x[3]);
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (2) = 2e4 * x[2];
+      gradient.insert (3) = 2e4 * x[3];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, 2) = 2e4 * x[2];
+      jacobian.insert (0, 3) = 2e4 * x[3];
+      jacobian.makeCompressed ();
+    }
+  };
+
+  /// \brief Solve the test problem from a warm start.
+  ///
+  /// The solution is (1, 2, 0, 7/10), where:
+  /// - x1 is fixed (multiplier -1/4),
+  /// - the singleton row 10^3 x0 <= 10^3 is active (multiplier
+  ///   -10^-3), and becomes the upper bound of x0 with presolve,
+  /// - x2 >= 0 is active (multiplier 1/2),
+  /// - 10^4 (x2^2 + x3^2) <= 10^6 is inactive.
+  ///
+  /// The warm start has these multipliers, at a point where only x3
+  /// has its value at the solution.
+  Result solve (bool presolve, bool scaling)
+  {
+    vector_t solution (4);
+    solution << 1., 2., 0., .7;
+
+    // c = -10^-3 (10^3, 0, 0, 0) - 1/4 (0, 1, 0, 0) + 1/2 (0, 0, 1, 0).
+    vector_t c (4);
+    c << -1., -.25, .5, 0.;
+
+    Cost cost (c, solution);
+    sparseProblem_t problem (cost);
+    problem.startingPoint () = vector_t::Zero (4);
+    for (std::size_t i = 0; i < 4; ++i)
+      problem.argumentBounds ()[i] = Function::makeInterval (-10., 10.);
+    problem.argumentBounds ()[1] = Function::makeInterval (2., 2.);
+    problem.argumentBounds ()[2] = Function::makeInterval (0., 10.);
+
+    // Nonlinear rows come first in the multipliers: the constraints
+    // are added in that order.
+    problem.addConstraint (
+      boost::make_shared<Norm> (),
+      sparseProblem_t::intervals_t (
+        1, Function::makeInterval (-Function::infinity (), 1e6)));
+
+    std::vector<triplet_t> triplets;
+    triplets.push_back (triplet_t (0, 0, 1e3));
+    matrix_t a (1, 4);
+    a.setFromTriplets (triplets.begin (), triplets.end ());
+    problem.addConstraint (
+      boost::make_shared<numericLinearFunction_t> (a, vector_t::Zero (1)),
+      sparseProblem_t::intervals_t (
+        1, Function::makeInterval (-Function::infinity (), 1e3)));
+
+    NagSolverNlpSparse solver (problem);
+    solver.setParameter ("nag.presolve", presolve ? 1 : 0);
+    solver.setParameter ("nag.auto_scaling", scaling ? 1 : 0);
+
+    vector_t x (4);
+    x << .9, 2.5, .1, .7;
+    vector_t xmul (4);
+    xmul << 0., -.25, .5, 0.;
+    vector_t lambda (2);
+    lambda << 0., -1e-3;
+    solver.setWarmStart (x, xmul, lambda);
+
+    const NagSolverNlpSparse::result_t& result = solver.minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+    return boost::get<Result> (result);
+  }
+
+  /// \brief Check the solution, but for x0 which is only at its
+  /// solution when the singleton row is a bound (for the NAG stub).
+  void checkSolution (const Result& result, bool presolve)
+  {
+    BOOST_REQUIRE_EQUAL (result.x.size (), 4);
+    if (presolve) BOOST_CHECK_SMALL (result.x[0] - 1., 1e-6);
+    BOOST_CHECK_SMALL (result.x[1] - 2., 1e-6);
+    BOOST_CHECK_SMALL (result.x[2], 1e-6);
+    BOOST_CHECK_SMALL (result.x[3] - .7, 1e-6);
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (nlp_sparse_warm_start)
+
+BOOST_AUTO_TEST_CASE (full_problem)
+{
+  checkSolution (solve (false, false), false);
+}
+
+// The multiplier of the singleton row is the one of the upper bound of
+// x0, and x2 is the second variable.
+BOOST_AUTO_TEST_CASE (presolved_problem)
+{
+  checkSolution (solve (true, false), true);
+}
+
+BOOST_AUTO_TEST_CASE (scaled_problem)
+{
+  checkSolution (solve (false, true), false);
+}
+
+BOOST_AUTO_TEST_CASE (presolved_and_scaled_problem)
+{
+  checkSolution (solve (true, true), true);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,218 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Batch solves of the NLP solvers, through a solver loaded by the
+// solver factory: each result is the one of a solve of its instance
+// alone, and results come in the order of the instances.
+
+#define BOOST_TEST_MODULE solve_batch
+
+#include <vector>
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/solver-factory.hh>
+
+#include <roboptim/core/plugin/nag/nag-nlp.hh>
+#include <roboptim/core/plugin/nag/nag-nlp-sparse.hh>
+
+using namespace roboptim;
+
+namespace
+{
+  typedef Function::vector_t vector_t;
+
+  /// \brief 1/2 ||x - t||^2.
+  struct Distance : public DifferentiableFunction
+  {
+    explicit Distance (const vector_t& t)
+      : DifferentiableFunction (t.size (), 1, "1/2 ||x - t||^2"),
+        t_ (t)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = .5 * (x - t_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient = x - t_;
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.row (0) = (x - t_).transpose ();
+    }
+
+    vector_t t_;
+  };
+
+  /// \brief 1/2 ||x - t||^2, with a sparse Jacobian.
+  struct SparseDistance : public DifferentiableSparseFunction
+  {
+    explicit SparseDistance (const vector_t& t)
+      : DifferentiableSparseFunction (t.size (), 1, "1/2 ||x - t||^2"),
+        t_ (t)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = .5 * (x - t_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = x[i] - t_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = x[i] - t_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t t_;
+  };
+
+  /// \brief Instances of a problem family: distance to a target under
+  /// the bounds [-2, 2] and x0 + x1 + x2 + 1 >= 0.
+  template <typename T, typename F>
+  struct Instances
+  {
+    typedef GenericNumericLinearFunction<T> linear_t;
+    typedef typename linear_t::matrix_t matrix_t;
+    typedef Problem<T> problem_t;
+
+    Instances (const matrix_t& a, std::size_t size)
+    {
+      vector_t b (1);
+      b << 1.;
+      boost::shared_ptr<linear_t> linear =
+        boost::make_shared<linear_t> (a, b);
+
+      for (std::size_t i = 0; i < size; ++i)
+      {
+        const double s = static_cast<double> (i);
+        vector_t t (3);
+        t << s, -s, 3.;
+        vector_t x0 (3);
+        x0 << .5 * s, 0., 1.;
+
+        functions.push_back (boost::make_shared<F> (t));
+        problems.push_back (boost::make_shared<problem_t> (*functions[i]));
+        problem_t& problem = *problems[i];
+        problem.startingPoint () = x0;
+        for (std::size_t j = 0; j < 3; ++j)
+          problem.argumentBounds ()[j] = Function::makeInterval (-2., 2.);
+        problem.addConstraint (
+          linear, typename problem_t::intervals_t (
+                    1, Function::makeInterval (0., Function::infinity ())));
+        pointers.push_back (problems[i].get ());
+      }
+    }
+
+    std::vector<boost::shared_ptr<F> > functions;
+    std::vector<boost::shared_ptr<problem_t> > problems;
+    std::vector<const problem_t*> pointers;
+  };
+
+  /// \brief Check the results of a batch against solves of each
+  /// instance.
+  template <typename S>
+  void checkBatch (
+    const std::vector<boost::shared_ptr<typename S::problem_t> >& problems,
+    const std::vector<typename S::result_t>& results,
+    const std::vector<nag::Statistics>& statistics)
+  {
+    BOOST_REQUIRE_EQUAL (results.size (), problems.size ());
+    BOOST_REQUIRE_EQUAL (statistics.size (), problems.size ());
+
+    for (std::size_t i = 0; i < problems.size (); ++i)
+    {
+      S solver (*problems[i]);
+      const typename S::result_t& expected = solver.minimum ();
+
+      BOOST_REQUIRE_EQUAL (results[i].which (), S::SOLVER_VALUE);
+      BOOST_REQUIRE_EQUAL (expected.which (), S::SOLVER_VALUE);
+      const Result& result = boost::get<Result> (results[i]);
+      const Result& reference = boost::get<Result> (expected);
+      BOOST_CHECK_SMALL ((result.x - reference.x).lpNorm<Eigen::Infinity> (),
+                         1e-8);
+      BOOST_CHECK_SMALL (result.value[0] - reference.value[0], 1e-8);
+      BOOST_CHECK_GT (statistics[i].evaluations, 0);
+    }
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (solve_batch)
+
+BOOST_AUTO_TEST_CASE (nlp)
+{
+  typedef Solver<EigenMatrixDense> solver_t;
+
+  Function::matrix_t a (1, 3);
+  a << 1., 1., 1.;
+  Instances<EigenMatrixDense, Distance> instances (a, 4);
+
+  SolverFactory<solver_t> factory ("nag-nlp", *instances.problems[0]);
+  NagSolverNlp* solver = dynamic_cast<NagSolverNlp*> (&factory ());
+  BOOST_REQUIRE (solver);
+
+  std::vector<nag::Statistics> statistics;
+  std::vector<NagSolverNlp::result_t> results =
+    solver->solveBatch (instances.pointers, statistics);
+  checkBatch<NagSolverNlp> (instances.problems, results, statistics);
+}
+
+BOOST_AUTO_TEST_CASE (nlp_sparse)
+{
+  typedef Solver<EigenMatrixSparse> solver_t;
+  typedef Instances<EigenMatrixSparse, SparseDistance> instances_t;
+
+  instances_t::matrix_t a (1, 3);
+  for (int j = 0; j < 3; ++j) a.insert (0, j) = 1.;
+  instances_t instances (a, 4);
+
+  SolverFactory<solver_t> factory ("nag-nlp-sparse", *instances.problems[0]);
+  const NagSolverNlpSparse* solver =
+    dynamic_cast<const NagSolverNlpSparse*> (&factory ());
+  BOOST_REQUIRE (solver);
+
+  std::vector<nag::Statistics> statistics;
+  std::vector<NagSolverNlpSparse::result_t> results =
+    solver->solveBatch (instances.pointers, statistics);
+  checkBatch<NagSolverNlpSparse> (instances.problems, results, statistics);
+
+  // The patterns are found by another solver.
+  BOOST_CHECK (!solver->structure ());
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,204 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Pool of sparse solvers (see nag::SolverPool): the patterns found for
+// a problem are shared with the next problems made of the same
+// functions, which are still solved with their own sparsity.
+//
+// The problems start at their solution, where the NAG stub stays when
+// run for one iteration.
+
+#define BOOST_TEST_MODULE solver_pool
+
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/plugin/nag/nag-solver-pool.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+namespace
+{
+  /// \brief 1/2 ||x - x0||^2.
+  struct Distance : public differentiableFunction_t
+  {
+    explicit Distance (const vector_t& x0)
+      : differentiableFunction_t (x0.size (), 1, "1/2 ||x - x0||^2"),
+        x0_ (x0)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = .5 * (x - x0_).squaredNorm ();
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      for (size_type i = 0; i < inputSize (); ++i)
+        gradient.insert (i) = x[i] - x0_[i];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.reserve (inputSize ());
+      for (size_type i = 0; i < inputSize (); ++i)
+        jacobian.insert (0, i) = x[i] - x0_[i];
+      jacobian.makeCompressed ();
+    }
+
+    vector_t x0_;
+  };
+
+  /// \brief 1/2 x_i^2, whose name does not depend on i: problems using
+  /// different variables have the same pool key.
+  struct Square : public differentiableFunction_t
+  {
+    Square (size_type n, size_type i)
+      : differentiableFunction_t (n, 1, "1/2 x_i^2"),
+        i_ (i)
+    {
+    }
+
+    void impl_compute (result_ref result, const_argument_ref x) const
+    {
+      result[0] = .5 * x[i_] * x[i_];
+    }
+
+    void impl_gradient (gradient_ref gradient, const_argument_ref x,
+                        size_type) const
+    {
+      gradient.setZero ();
+      gradient.insert (i_) = x[i_];
+    }
+
+    void impl_jacobian (jacobian_ref jacobian, const_argument_ref x) const
+    {
+      jacobian.resize (1, inputSize ());
+      jacobian.setZero ();
+      jacobian.insert (0, i_) = x[i_];
+      jacobian.makeCompressed ();
+    }
+
+    size_type i_;
+  };
+
+  /// \brief Problem whose constraint is 1/2 x_i^2, starting at its
+  /// solution x0 = (1, 2).
+  struct TestProblem
+  {
+    explicit TestProblem (size_type i)
+      : x0 (2),
+        cost (),
+        problem ()
+    {
+      x0 << 1., 2.;
+      cost = boost::make_shared<Distance> (x0);
+      problem = boost::make_shared<sparseProblem_t> (*cost);
+      problem->startingPoint () = x0;
+      problem->addConstraint (
+        boost::make_shared<Square> (2, i),
+        sparseProblem_t::intervals_t (1,
+                                      Function::makeInterval (-10., 10.)));
+    }
+
+    vector_t x0;
+    boost::shared_ptr<Distance> cost;
+    boost::shared_ptr<sparseProblem_t> problem;
+  };
+
+  /// \brief Solve a problem with a solver of the pool, and return the
+  /// value of its constraint.
+  double solve (nag::SolverPool& pool, const TestProblem& test,
+                nag::SolverPool::solver_t::structurePtr_t& structure)
+  {
+    boost::shared_ptr<nag::SolverPool::solver_t> solver =
+      pool.checkout (*test.problem);
+
+    const NagSolverNlpSparse::result_t& result = solver->minimum ();
+    BOOST_REQUIRE_EQUAL (result.which (), NagSolverNlpSparse::SOLVER_VALUE);
+    const Result& res = boost::get<Result> (result);
+    BOOST_CHECK_SMALL ((res.x - test.x0).lpNorm<Eigen::Infinity> (), 1e-12);
+    BOOST_REQUIRE_EQUAL (res.constraints.size (), 1);
+
+    structure = solver->structure ();
+    pool.release (*solver);
+    return res.constraints[0];
+  }
+
+  nag::SolverPool::parameters_t parameters ()
+  {
+    TestProblem test (0);
+    NagSolverNlpSparse solver (*test.problem);
+    return solver.parameters ();
+  }
+} // end of anonymous namespace
+
+BOOST_AUTO_TEST_SUITE (solver_pool)
+
+BOOST_AUTO_TEST_CASE (shared_patterns)
+{
+  nag::SolverPool pool (parameters ());
+  TestProblem first (1);
+  TestProblem second (1);
+  nag::SolverPool::solver_t::structurePtr_t structure;
+  nag::SolverPool::solver_t::structurePtr_t shared;
+
+  BOOST_CHECK_EQUAL (pool.size (), 0);
+  BOOST_CHECK_SMALL (solve (pool, first, structure) - 2., 1e-12);
+  BOOST_REQUIRE (structure);
+  BOOST_CHECK_EQUAL (pool.size (), 1);
+
+  BOOST_CHECK_SMALL (solve (pool, second, shared) - 2., 1e-12);
+  BOOST_CHECK (shared == structure);
+  BOOST_CHECK_EQUAL (pool.size (), 1);
+
+  pool.clear ();
+  BOOST_CHECK_EQUAL (pool.size (), 0);
+}
+
+// Same key, other sparsity: the shared patterns lack the Jacobian
+// entry of the second problem, which is solved with its own patterns.
+BOOST_AUTO_TEST_CASE (other_sparsity)
+{
+  nag::SolverPool pool (parameters ());
+  TestProblem first (0);
+  TestProblem second (1);
+  nag::SolverPool::solver_t::structurePtr_t structure;
+  nag::SolverPool::solver_t::structurePtr_t own;
+
+  BOOST_CHECK_SMALL (solve (pool, first, structure) - .5, 1e-12);
+  BOOST_CHECK_SMALL (solve (pool, second, own) - 2., 1e-12);
+  BOOST_REQUIRE (own);
+  BOOST_CHECK (own != structure);
+
+  // The patterns of the second problem replace those of the first.
+  BOOST_CHECK_EQUAL (pool.size (), 1);
+  BOOST_CHECK_SMALL (solve (pool, second, structure) - 2., 1e-12);
+  BOOST_CHECK (structure == own);
+}
+
+BOOST_AUTO_TEST_SUITE_END ()
@@ -0,0 +1,405 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ROBOPTIM_CORE_PLUGIN_NAG_TESTS_SPARSE_PROBLEM_HH
+# define ROBOPTIM_CORE_PLUGIN_NAG_TESTS_SPARSE_PROBLEM_HH
+
+# include <cassert>
+# include <cmath>
+# include <string>
+# include <vector>
+
+# include <boost/format.hpp>
+# include <boost/make_shared.hpp>
+# include <boost/shared_ptr.hpp>
+# include <boost/random/mersenne_twister.hpp>
+# include <boost/random/uniform_int_distribution.hpp>
+# include <boost/random/uniform_real_distribution.hpp>
+
+# include <roboptim/core/differentiable-function.hh>
+# include <roboptim/core/numeric-linear-function.hh>
+# include <roboptim/core/solver.hh>
+
+# include <roboptim/core/plugin/nag/nag-function-hints.hh>
+
+namespace roboptim
+{
+  namespace nag
+  {
+    namespace test
+    {
+      typedef EigenMatrixSparse sparse_t;
+      typedef GenericDifferentiableFunction<sparse_t> differentiableFunction_t;
+      typedef GenericNumericLinearFunction<sparse_t> numericLinearFunction_t;
+      typedef Problem<sparse_t> sparseProblem_t;
+
+      typedef differentiableFunction_t::size_type size_type;
+      typedef differentiableFunction_t::vector_t vector_t;
+      typedef differentiableFunction_t::matrix_t matrix_t;
+      typedef Eigen::Triplet<double> triplet_t;
+
+      /// \brief Parameters of a synthetic sparse problem.
+      ///
+      /// The n variables are seen as a trajectory of n / stateSize
+      /// states of size stateSize.
+      struct SparseProblemParameters
+      {
+        explicit SparseProblemParameters (size_type n_)
+          : n (n_),
+            stateSize (10),
+            blockSize (10),
+            linearRows (n_ / 10),
+            linearRowNonZeros (5),
+            seed (42)
+        {
+        }
+
+        /// \brief Number of variables.
+        size_type n;
+        /// \brief Size of a state of the banded dynamics.
+        size_type stateSize;
+        /// \brief Size of the blocks of the block-diagonal constraint.
+        size_type blockSize;
+        /// \brief Number of random sparse linear rows.
+        size_type linearRows;
+        /// \brief Number of nonzeros per linear row.
+        size_type linearRowNonZeros;
+        /// \brief Random generator seed.
+        unsigned seed;
+      };
+
+      /// \brief Distance to the known solution:
+      /// \f$f(x) = \frac{1}{2} \sum_i (x_i - x^*_i)^2\f$.
+      class DistanceCost : public differentiableFunction_t
+      {
+      public:
+        DistanceCost (const vector_t& solution, const std::string& name)
+          : differentiableFunction_t (solution.size (), 1, name),
+            solution_ (solution)
+        {
+        }
+
+      protected:
+        void impl_compute (result_ref result, const_argument_ref x) const
+        {
+          result[0] = .5 * (x - solution_).squaredNorm ();
+        }
+
+        void impl_gradient (gradient_ref grad, const_argument_ref x,
+                            size_type) const
+        {
+          grad.setZero ();
+          for (size_type i = 0; i < inputSize (); ++i)
+            grad.insert (i) = x[i] - solution_[i];
+        }
+
+        void impl_jacobian (jacobian_ref jac, const_argument_ref x) const
+        {
+          jac.resize (1, inputSize ());
+          jac.setZero ();
+          jac.reserve (inputSize ());
+          for (size_type i = 0; i < inputSize (); ++i)
+            jac.insert (0, i) = x[i] - solution_[i];
+          jac.makeCompressed ();
+        }
+
+      private:
+        vector_t solution_;
+      };
+
+      /// \brief Banded discrete dynamics:
+      /// \f$x_{k+1,i} - x_{k,i} - h \sin (x_{k,i+1 \bmod d}) = 0\f$.
+      ///
+      /// Each row has three nonzeros: the Jacobian is banded with a
+      /// bandwidth of stateSize + 1. Its structure is declared.
+      class BandedDynamics : public differentiableFunction_t,
+                             public JacobianStructure
+      {
+      public:
+        BandedDynamics (size_type n, size_type stateSize, double h)
+          : differentiableFunction_t (n, n - stateSize, "banded dynamics"),
+            stateSize_ (stateSize),
+            h_ (h)
+        {
+        }
+
+        /// \brief Integrate the dynamics from the first state of x.
+        void integrate (vector_t& x) const
+        {
+          for (size_type r = 0; r < outputSize (); ++r)
+            x[r + stateSize_] = x[r] + h_ * std::sin (x[next (r)]);
+        }
+
+        structure_t jacobianStructure () const
+        {
+          std::vector<triplet_t> triplets;
+          triplets.reserve (static_cast<std::size_t> (3 * outputSize ()));
+          for (size_type r = 0; r < outputSize (); ++r)
+          {
+            int r_ = static_cast<int> (r);
+            triplets.push_back (triplet_t (r_, r_, 1.));
+            triplets.push_back (
+              triplet_t (r_, static_cast<int> (next (r)), 1.));
+            triplets.push_back (
+              triplet_t (r_, static_cast<int> (r + stateSize_), 1.));
+          }
+          structure_t structure (outputSize (), inputSize ());
+          structure.setFromTriplets (triplets.begin (), triplets.end ());
+          return structure;
+        }
+
+      protected:
+        void impl_compute (result_ref result, const_argument_ref x) const
+        {
+          for (size_type r = 0; r < outputSize (); ++r)
+            result[r] = x[r + stateSize_] - x[r] - h_ * std::sin (x[next (r)]);
+        }
+
+        void impl_gradient (gradient_ref grad, const_argument_ref x,
+                            size_type r) const
+        {
+          grad.setZero ();
+          grad.coeffRef (r) += -1.;
+          grad.coeffRef (next (r)) += -h_ * std::cos (x[next (r)]);
+          grad.coeffRef (r + stateSize_) += 1.;
+        }
+
+        void impl_jacobian (jacobian_ref jac, const_argument_ref x) const
+        {
+          std::vector<triplet_t> triplets;
+          triplets.reserve (static_cast<std::size_t> (3 * outputSize ()));
+          for (size_type r = 0; r < outputSize (); ++r)
+          {
+            triplets.push_back (triplet_t (static_cast<int> (r),
+                                           static_cast<int> (r), -1.));
+            triplets.push_back (
+              triplet_t (static_cast<int> (r), static_cast<int> (next (r)),
+                         -h_ * std::cos (x[next (r)])));
+            triplets.push_back (triplet_t (
+              static_cast<int> (r), static_cast<int> (r + stateSize_), 1.));
+          }
+          jac.resize (outputSize (), inputSize ());
+          jac.setFromTriplets (triplets.begin (), triplets.end ());
+        }
+
+      private:
+        /// \brief Index of the coupled variable of row r.
+        size_type next (size_type r) const
+        {
+          return r - r % stateSize_ + (r + 1) % stateSize_;
+        }
+
+        size_type stateSize_;
+        double h_;
+      };
+
+      /// \brief Squared norm of each block of variables:
+      /// \f$c_j (x) = \sum_{i \in B_j} x_i^2\f$.
+      ///
+      /// Its structure is declared.
+      class BlockNorms : public differentiableFunction_t,
+                         public JacobianStructure
+      {
+      public:
+        BlockNorms (size_type n, size_type blockSize)
+          : differentiableFunction_t (n, (n + blockSize - 1) / blockSize,
+                                      "block norms"),
+            blockSize_ (blockSize)
+        {
+        }
+
+        structure_t jacobianStructure () const
+        {
+          structure_t structure (outputSize (), inputSize ());
+          structure.reserve (inputSize ());
+          for (size_type i = 0; i < inputSize (); ++i)
+            structure.insert (i / blockSize_, i) = 1.;
+          structure.makeCompressed ();
+          return structure;
+        }
+
+      protected:
+        void impl_compute (result_ref result, const_argument_ref x) const
+        {
+          result.setZero ();
+          for (size_type i = 0; i < inputSize (); ++i)
+            result[i / blockSize_] += x[i] * x[i];
+        }
+
+        void impl_gradient (gradient_ref grad, const_argument_ref x,
+                            size_type j) const
+        {
+          grad.setZero ();
+          for (size_type i = j * blockSize_;
+               i < std::min (inputSize (), (j + 1) * blockSize_); ++i)
+            grad.insert (i) = 2. * x[i];
+        }
+
+        void impl_jacobian (jacobian_ref jac, const_argument_ref x) const
+        {
+          jac.resize (outputSize (), inputSize ());
+          jac.setZero ();
+          jac.reserve (inputSize ());
+          for (size_type i = 0; i < inputSize (); ++i)
+            jac.insert (i / blockSize_, i) = 2. * x[i];
+          jac.makeCompressed ();
+        }
+
+      private:
+        size_type blockSize_;
+      };
+
+      /// \brief Synthetic sparse problem with a known solution.
+      ///
+      /// The cost is the distance to a point x* satisfying the banded
+      /// dynamics, while the block-diagonal and random linear
+      /// constraints are inactive at x*: x* is thus the unique
+      /// solution of the problem.
+      class SparseProblem
+      {
+      public:
+        explicit SparseProblem (const SparseProblemParameters& params)
+          : params_ (params),
+            solution_ (params.n)
+        {
+          typedef differentiableFunction_t::interval_t interval_t;
+          typedef differentiableFunction_t::intervals_t intervals_t;
+
+          const size_type n = params.n;
+          assert (n % params.stateSize == 0);
+          assert (n > params.stateSize);
+
+          boost::random::mt19937 rng (params.seed);
+          boost::random::uniform_real_distribution<> uniform (-1., 1.);
+
+          // Known solution: random initial state, integrated dynamics.
+          dynamics_ = boost::make_shared<BandedDynamics> (
+            n, params.stateSize, 1. / static_cast<double> (n));
+          solution_.setZero ();
+          for (size_type i = 0; i < params.stateSize; ++i)
+            solution_[i] = uniform (rng);
+          dynamics_->integrate (solution_);
+
+          cost_ = boost::make_shared<DistanceCost> (solution_, name ());
+          problem_ = boost::make_shared<sparseProblem_t> (*cost_);
+
+          // Variable bounds, inactive at the solution.
+          for (size_type i = 0; i < n; ++i)
+            problem_->argumentBounds ()[static_cast<std::size_t> (i)] =
+              differentiableFunction_t::makeInterval (-10., 10.);
+
+          // Banded dynamics.
+          problem_->addConstraint (
+            dynamics_, intervals_t (static_cast<std::size_t> (
+                                      dynamics_->outputSize ()),
+                                    interval_t (0., 0.)));
+
+          // Block-diagonal constraints.
+          boost::shared_ptr<BlockNorms> blocks =
+            boost::make_shared<BlockNorms> (n, params.blockSize);
+          vector_t norms = (*blocks) (solution_);
+          intervals_t blockBounds;
+          for (size_type j = 0; j < blocks->outputSize (); ++j)
+            blockBounds.push_back (differentiableFunction_t::makeInterval (
+              0., norms[j] + 1.));
+          problem_->addConstraint (blocks, blockBounds);
+
+          // Random sparse linear rows.
+          if (params.linearRows > 0)
+          {
+            boost::random::uniform_int_distribution<size_type> column (0,
+                                                                       n - 1);
+            std::vector<triplet_t> triplets;
+            for (size_type r = 0; r < params.linearRows; ++r)
+              for (size_type k = 0; k < params.linearRowNonZeros; ++k)
+                triplets.push_back (triplet_t (static_cast<int> (r),
+                                               static_cast<int> (column (rng)),
+                                               uniform (rng)));
+            matrix_t a (params.linearRows, n);
+            a.setFromTriplets (triplets.begin (), triplets.end ());
+            vector_t b = vector_t::Zero (params.linearRows);
+
+            boost::shared_ptr<numericLinearFunction_t> linear =
+              boost::make_shared<numericLinearFunction_t> (a, b);
+            vector_t ax = a * solution_;
+            intervals_t linearBounds;
+            for (size_type r = 0; r < params.linearRows; ++r)
+              linearBounds.push_back (differentiableFunction_t::makeInterval (
+                ax[r] - 1., ax[r] + 1.));
+            problem_->addConstraint (linear, linearBounds);
+          }
+
+          // Starting point: perturbed solution.
+          vector_t start (n);
+          for (size_type i = 0; i < n; ++i)
+            start[i] = solution_[i] + .1 * uniform (rng);
+          problem_->startingPoint () = start;
+        }
+
+        /// \brief Generated problem.
+        sparseProblem_t& problem ()
+        {
+          return *problem_;
+        }
+
+        /// \brief Known solution.
+        const vector_t& solution () const
+        {
+          return solution_;
+        }
+
+        /// \brief Generation parameters.
+        const SparseProblemParameters& parameters () const
+        {
+          return params_;
+        }
+
+        /// \brief Number of structural nonzeros of the constraint
+        /// Jacobian (cost included).
+        size_type nonZeros () const
+        {
+          size_type nnz = 0;
+          typedef sparseProblem_t::constraints_t::const_iterator iter_t;
+          for (iter_t it = problem_->constraints ().begin ();
+               it != problem_->constraints ().end (); ++it)
+          {
+            const differentiableFunction_t* g =
+              (*it)->castInto<differentiableFunction_t> ();
+            nnz += g->jacobian (solution_).nonZeros ();
+          }
+          return nnz + cost_->jacobian (solution_).nonZeros ();
+        }
+
+        /// \brief Problem name.
+        std::string name () const
+        {
+          return (boost::format ("synthetic sparse problem (n = %1%)") %
+                  params_.n).str ();
+        }
+
+      private:
+        SparseProblemParameters params_;
+        vector_t solution_;
+        boost::shared_ptr<BandedDynamics> dynamics_;
+        boost::shared_ptr<DistanceCost> cost_;
+        boost::shared_ptr<sparseProblem_t> problem_;
+      };
+    } // end of namespace test.
+  } // end of namespace nag.
+} // end of namespace roboptim
+
+#endif //! ROBOPTIM_CORE_PLUGIN_NAG_TESTS_SPARSE_PROBLEM_HH
@@ -0,0 +1,132 @@
+// Copyright (C) 2016 by Benjamin Chrétien, CNRS-AIST JRL.
+//
+// This file is part of the roboptim.
+//
+// roboptim is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// roboptim is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public License
+// along with roboptim.  If not, see <http://www.gnu.org/licenses/>.
+
+// Scaling benchmark of the sparse NLP plug-in on a synthetic problem.
+//
+// Usage: sparse-scaling [n]
+//
+// The problem size, the number of nonzeros, the problem build time,
+// the cost of one raw evaluation (values and Jacobians, outside of
+// NAG) and the peak memory are printed on stdout. Solver-side
+// statistics (setup time, callback time, evaluation counts) are
+// appended to ROBOPTIM_NAG_STATS_FILE by the plug-in itself.
+
+#include <cstdlib>
+#include <iostream>
+
+#include <time.h>
+#include <sys/resource.h>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/variant/get.hpp>
+
+#include <roboptim/core/solver-factory.hh>
+
+#include "sparse-problem.hh"
+
+using namespace roboptim;
+using namespace roboptim::nag::test;
+
+typedef Solver<EigenMatrixSparse> solver_t;
+
+static double now ()
+{
+  timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return static_cast<double> (ts.tv_sec) +
+         1e-9 * static_cast<double> (ts.tv_nsec);
+}
+
+static long peakMemory ()
+{
+  rusage usage;
+  if (getrusage (RUSAGE_SELF, &usage) != 0) return -1;
+  return usage.ru_maxrss;
+}
+
+/// \brief Average time of one evaluation of all the values and
+/// Jacobians, as done by the plug-in callback.
+static double evaluationTime (SparseProblem& generator, int repeat)
+{
+  const sparseProblem_t& pb = generator.problem ();
+  const differentiableFunction_t& cost =
+    *pb.function ().castInto<differentiableFunction_t> ();
+  const vector_t& x = *pb.startingPoint ();
+
+  double start = now ();
+  for (int k = 0; k < repeat; ++k)
+  {
+    cost (x);
+    cost.jacobian (x);
+    typedef sparseProblem_t::constraints_t::const_iterator iter_t;
+    for (iter_t it = pb.constraints ().begin ();
+         it != pb.constraints ().end (); ++it)
+    {
+      const differentiableFunction_t* g =
+        (*it)->castInto<differentiableFunction_t> ();
+      (*g) (x);
+      g->jacobian (x);
+    }
+  }
+  return (now () - start) / repeat;
+}
+
+int main (int argc, char** argv)
+{
+  size_type n = 1000;
+  if (argc > 1) n = boost::lexical_cast<size_type> (argv[1]);
+
+  double start = now ();
+  SparseProblem generator ((SparseProblemParameters (n)));
+  double buildTime = now () - start;
+
+  size_type nnz = generator.nonZeros ();
+  double evalTime = evaluationTime (generator, 10);
+
+  SolverFactory<solver_t> factory ("nag-nlp-sparse", generator.problem ());
+  solver_t& solver = factory ();
+
+  start = now ();
+  solver_t::result_t res = solver.minimum ();
+  double solveTime = now () - start;
+
+  std::cout << "n: " << n << std::endl
+            << "nonzeros: " << nnz << std::endl
+            << "build time: " << buildTime << " s" << std::endl
+            << "evaluation time: " << evalTime << " s" << std::endl
+            << "solve time: " << solveTime << " s" << std::endl
+            << "peak memory: " << peakMemory () << " KiB" << std::endl;
+
+  if (res.which () != solver_t::SOLVER_VALUE)
+  {
+    std::cout << "A solution should have been found. Failing..." << std::endl
+              << boost::get<SolverError> (res).what () << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // The solution is known: check it.
+  const Result& result = boost::get<Result> (res);
+  double error = (result.x - generator.solution ()).lpNorm<Eigen::Infinity> ();
+  std::cout << "solution error: " << error << std::endl;
+
+#ifdef ROBOPTIM_CORE_PLUGIN_NAG_STUB
+  // The NAG stub does not optimize: only the overhead is measured.
+  return EXIT_SUCCESS;
+#else
+  return error < 1e-4 ? EXIT_SUCCESS : EXIT_FAILURE;
+#endif // ROBOPTIM_CORE_PLUGIN_NAG_STUB
+}